@@ -0,0 +1,33 @@
+#!/bin/sh
+# Run one my_redis_benchmark workload against the server on each I/O engine
+# and print the results side by side as CSV, with an engine column.
+# Extra arguments go to the benchmark, e.g.
+#   bench/io_engines.sh -c 50 -P 16 -n 1000000 -t set,get
+# Run from the repository root after `make` and `make -f redis-cli/Makefile`
+set -e
+
+PORT=${PORT:-6390}
+SERVER=./my_redis_server
+BENCHMARK=./bin/my_redis_benchmark
+WORKDIR=$(mktemp -d)
+trap 'kill $PID 2>/dev/null || true; rm -rf "$WORKDIR"' EXIT
+
+header=1
+for engine in epoll io_uring; do
+    # A fresh server per engine, from an empty directory so no dump is loaded
+    (cd "$WORKDIR" && rm -f dump.my_rdb && exec "$OLDPWD/$SERVER" "$PORT" --io-engine "$engine" > server.log 2>&1) &
+    PID=$!
+    sleep 0.5
+    "$BENCHMARK" -p "$PORT" "$@" --csv | while IFS= read -r line; do
+        case "$line" in
+            '"test"'*) [ "$header" = 1 ] && echo "\"engine\",$line" ;;
+            *) echo "\"$engine\",$line" ;;
+        esac
+    done
+    header=0
+    kill -INT $PID
+    wait $PID 2>/dev/null || true
+    if grep -q "falling back" "$WORKDIR/server.log"; then
+        echo "# io_uring unavailable, the second run used epoll" >&2
+    fi
+done
@@ -0,0 +1,465 @@
+// Microbenchmarks for the hot paths that do not need a socket: the RESP
+// parser (with each CRLF scanner, checked first to agree with the scalar
+// one on fuzzed input), RedisDatabase operations at several dataset sizes
+// (GET with and without the LFU counters),
+// large integer set intersections in both encodings,
+// the HyperLogLog kernels (checked against their scalar versions) and the
+// dump / load and replication snapshot paths. Every case runs warmup
+// rounds, then a fixed number of measured iterations; ns/op is reported as
+// median, mean, stddev, min and max over the iterations. Inputs come from a
+// fixed seed, so runs on different commits measure the same work.
+//
+//   ./bench_micro [--iterations N] [--warmup N] [--filter substring] [--csv]
+#include "config.h"
+#include "hyperloglog.h"
+#include "redis_command_handler.h"
+#include "redis_database.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile size_t sink;
+
+struct BenchCase {
+    std::string name;
+    // Runs before every iteration, not measured
+    std::function<void()> setup;
+    // One measured iteration, returns the number of operations it did
+    std::function<size_t()> run;
+};
+
+struct Stats {
+    double median, mean, stddev, min, max;
+};
+
+static Stats summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    Stats s{};
+    size_t n = samples.size();
+    s.median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    s.min = samples.front();
+    s.max = samples.back();
+    for (double v : samples) s.mean += v;
+    s.mean /= n;
+    for (double v : samples) s.stddev += (v - s.mean) * (v - s.mean);
+    s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0;
+    return s;
+}
+
+static Stats measure(const BenchCase& bench, int warmup, int iterations) {
+    for (int i = 0; i < warmup; i++) {
+        if (bench.setup) bench.setup();
+        sink = bench.run();
+    }
+
+    std::vector<double> nsPerOp;
+    for (int i = 0; i < iterations; i++) {
+        if (bench.setup) bench.setup();
+        auto start = std::chrono::steady_clock::now();
+        size_t ops = bench.run();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        nsPerOp.push_back(elapsed.count() / std::max<size_t>(ops, 1));
+    }
+    return summarize(nsPerOp);
+}
+
+static std::string encode(const std::vector<std::string>& args) {
+    std::string out = "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto& arg : args) {
+        out += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+    }
+    return out;
+}
+
+// Parse every command in input, as processInput does with a query buffer
+static size_t parseAll(const std::string& input) {
+    size_t pos = 0, commands = 0;
+    std::vector<std::string> tokens;
+    while (parseRespCommand(input, pos, tokens) == ParseStatus::Ok) {
+        commands++;
+    }
+    sink = tokens.size();
+    return commands;
+}
+
+// Same with the zero copy overload, tokens stay views into input
+static size_t parseAllViews(const std::string& input) {
+    size_t pos = 0, commands = 0;
+    std::vector<std::string_view> tokens;
+    while (parseRespCommand(std::string_view(input), pos, tokens) == ParseStatus::Ok) {
+        commands++;
+    }
+    sink = tokens.size();
+    return commands;
+}
+
+// Every command of input until the first non Ok status, as text
+static std::string parseTrace(const std::string& input) {
+    std::string trace;
+    size_t pos = 0;
+    std::vector<std::string_view> tokens;
+    while (true) {
+        ParseStatus status = parseRespCommand(std::string_view(input), pos, tokens);
+        trace += std::to_string(static_cast<int>(status)) + "@" + std::to_string(pos) + ":";
+        if (status != ParseStatus::Ok) return trace;
+        for (const auto& token : tokens) trace += std::to_string(token.size()) + "=" + std::string(token) + ",";
+    }
+}
+
+// The vector scanners must split any input exactly like the scalar one.
+// Random pipelines with CR / LF heavy arguments, truncated and with bytes
+// overwritten, are parsed with every scanner and the traces compared
+static bool scannersAgree(int rounds) {
+    static const char alphabet[] = "\r\n\r\n*$-0123456789abc ";
+    std::mt19937_64 rng(42);
+    const RespScanner scanners[] = {RespScanner::Scalar, RespScanner::SSE2, RespScanner::AVX2};
+
+    for (int round = 0; round < rounds; round++) {
+        std::string input;
+        int commands = 1 + rng() % 8;
+        for (int c = 0; c < commands; c++) {
+            std::vector<std::string> args(1 + rng() % 5);
+            for (auto& arg : args) {
+                size_t len = rng() % 80;
+                for (size_t i = 0; i < len; i++) arg += alphabet[rng() % (sizeof(alphabet) - 1)];
+            }
+            input += (rng() % 8) ? encode(args) : args[0] + "\r\n";
+        }
+        for (int flips = rng() % 4; flips > 0 && !input.empty(); flips--) {
+            input[rng() % input.size()] = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        if (rng() % 2) input.resize(rng() % (input.size() + 1));
+
+        std::string expected;
+        for (RespScanner scanner : scanners) {
+            setRespScanner(scanner);
+            std::string trace = parseTrace(input);
+            if (scanner == RespScanner::Scalar) {
+                expected = trace;
+            } else if (trace != expected) {
+                std::fprintf(stderr, "%s parser differs from scalar on round %d\n",
+                             respScannerName(activeRespScanner()), round);
+                setRespScanner(RespScanner::Auto);
+                return false;
+            }
+        }
+    }
+    setRespScanner(RespScanner::Auto);
+    return true;
+}
+
+static void addParserCases(std::vector<BenchCase>& cases) {
+    struct Input {
+        std::string name;
+        std::string data;
+    };
+    std::vector<Input> inputs;
+
+    std::string smallPipeline, inlinePipeline, manyArgs;
+    for (int i = 0; i < 1000; i++) {
+        smallPipeline += encode({"SET", "key:" + std::to_string(i), "value"});
+        inlinePipeline += "SET key:" + std::to_string(i) + " value\r\n";
+    }
+    std::vector<std::string> args = {"HMSET", "hash"};
+    for (int i = 0; i < 100; i++) {
+        args.push_back("field:" + std::to_string(i));
+        args.push_back("value:" + std::to_string(i));
+    }
+    for (int i = 0; i < 100; i++) manyArgs += encode(args);
+    std::string largeValues;
+    for (int i = 0; i < 16; i++) largeValues += encode({"SET", "key:" + std::to_string(i), std::string(64 * 1024, 'x')});
+
+    inputs.push_back({"parse/multibulk-small x1000", smallPipeline});
+    inputs.push_back({"parse/inline-small x1000", inlinePipeline});
+    inputs.push_back({"parse/multibulk-202-args x100", manyArgs});
+    inputs.push_back({"parse/multibulk-64KB-value x16", largeValues});
+
+    const RespScanner scanners[] = {RespScanner::Scalar, RespScanner::SSE2, RespScanner::AVX2};
+    for (const auto& input : inputs) {
+        std::string data = input.data;
+        for (RespScanner scanner : scanners) {
+            std::string name = input.name + " [" + respScannerName(scanner) + "]";
+            cases.push_back({name, [scanner]() { setRespScanner(scanner); }, [data]() { return parseAll(data); }});
+        }
+        cases.push_back({input.name + " [views]", []() { setRespScanner(RespScanner::Auto); },
+                         [data]() { return parseAllViews(data); }});
+    }
+}
+
+static void fillStrings(RedisDatabase& db, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        db.set("key:" + std::to_string(i), "value:" + std::to_string(i));
+    }
+}
+
+static void addDatabaseCases(std::vector<BenchCase>& cases) {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    const size_t sizes[] = {1000, 100000};
+    const size_t OPS = 100000;
+
+    for (size_t size : sizes) {
+        std::string suffix = " n=" + std::to_string(size);
+        // Keys are drawn from the dataset with a fixed seed
+        auto keys = std::make_shared<std::vector<std::string>>();
+        std::mt19937_64 rng(1234);
+        for (size_t i = 0; i < OPS; i++) keys->push_back("key:" + std::to_string(rng() % size));
+
+        // lfuTracking 0 leaves out the access counter lookup every command
+        // pays, to show its cost
+        auto strings = [&db, size](long long lfuTracking) {
+            return [&db, size, lfuTracking]() {
+                serverConfig().lfuTracking.store(lfuTracking);
+                db.flushAll();
+                fillStrings(db, size);
+            };
+        };
+        auto freshStrings = strings(1);
+        auto get = [&db, keys]() {
+            std::string value;
+            size_t hits = 0;
+            for (const auto& key : *keys) hits += db.get(key, value);
+            sink = hits;
+            return keys->size();
+        };
+
+        cases.push_back({"db/set" + suffix, freshStrings, [&db, keys]() {
+            for (const auto& key : *keys) db.set(key, "new-value");
+            return keys->size();
+        }});
+        cases.push_back({"db/get" + suffix, freshStrings, get});
+        cases.push_back({"db/get lfu off" + suffix, strings(0), get});
+        cases.push_back({"db/keys" + suffix, freshStrings, [&db, size]() {
+            sink = db.keys().size();
+            return size;
+        }});
+
+        // Lists: size elements spread over 100 lists
+        cases.push_back({"db/lpush" + suffix, [&db]() { db.flushAll(); }, [&db, size]() {
+            for (size_t i = 0; i < size; i++) db.lpush("list:" + std::to_string(i % 100), "element");
+            return size;
+        }});
+        cases.push_back({"db/lpop" + suffix, [&db, size]() {
+            db.flushAll();
+            for (size_t i = 0; i < size; i++) db.rpush("list:" + std::to_string(i % 100), "element");
+        }, [&db, size]() {
+            std::string value;
+            for (size_t i = 0; i < size; i++) db.lpop("list:" + std::to_string(i % 100), value);
+            return size;
+        }});
+
+        // Hashes: size fields over 100 hashes
+        cases.push_back({"db/hset" + suffix, [&db]() { db.flushAll(); }, [&db, size]() {
+            for (size_t i = 0; i < size; i++) db.hset("hash:" + std::to_string(i % 100), "field:" + std::to_string(i), "value");
+            return size;
+        }});
+        cases.push_back({"db/hgetall" + suffix + " (per field)", [&db, size]() {
+            db.flushAll();
+            for (size_t i = 0; i < size; i++) db.hset("hash:" + std::to_string(i % 100), "field:" + std::to_string(i), "value");
+        }, [&db, size]() {
+            size_t fields = 0;
+            for (int h = 0; h < 100; h++) fields += db.hgetall("hash:" + std::to_string(h)).size();
+            return fields;
+        }});
+    }
+}
+
+static void addSetCases(std::vector<BenchCase>& cases) {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    const size_t MEMBERS = 100000;
+
+    // Two sets of 100k integers sharing half their members, in a random
+    // order so SADD cannot take the append path. intsetEntries picks the
+    // encoding they end up in
+    auto members = [MEMBERS](size_t first) {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < MEMBERS; i++) result.push_back(std::to_string(first + i * 3));
+        std::shuffle(result.begin(), result.end(), std::mt19937_64(99));
+        return result;
+    };
+    auto a = std::make_shared<std::vector<std::string>>(members(0));
+    auto b = std::make_shared<std::vector<std::string>>(members(MEMBERS * 3 / 2));
+    auto fill = [&db, a, b](long long intsetEntries) {
+        return [&db, a, b, intsetEntries]() {
+            serverConfig().setMaxIntsetEntries.store(intsetEntries);
+            db.flushAll();
+            db.sadd("set:a", *a);
+            db.sadd("set:b", *b);
+        };
+    };
+    const std::vector<std::string> keys = {"set:a", "set:b"};
+
+    cases.push_back({"set/sadd intset 100k (per member)", [&db]() {
+        serverConfig().setMaxIntsetEntries.store(1 << 20);
+        db.flushAll();
+    }, [&db, a]() {
+        sink = db.sadd("set:a", *a);
+        return a->size();
+    }});
+    cases.push_back({"set/sinter intset 100k (per member)", fill(1 << 20), [&db, keys, MEMBERS]() {
+        sink = db.sinter(keys).size();
+        return MEMBERS * 2;
+    }});
+    cases.push_back({"set/sinter hashtable 100k (per member)", fill(512), [&db, keys, MEMBERS]() {
+        sink = db.sinter(keys).size();
+        return MEMBERS * 2;
+    }});
+}
+
+// The HyperLogLog kernels must give the scalar results on random registers,
+// dense bodies included
+static bool hllKernelsAgree(int rounds) {
+    std::mt19937_64 rng(7);
+    std::vector<uint8_t> registers(HyperLogLog::REGISTERS), scalar, vector;
+    for (int round = 0; round < rounds; round++) {
+        for (auto& r : registers) r = static_cast<uint8_t>(rng() % (HyperLogLog::Q + 2));
+        std::string dense = HyperLogLog::fromRegisters(registers.data(), 0);
+        auto body = reinterpret_cast<const uint8_t*>(dense.data() + HyperLogLog::HEADER_BYTES);
+        scalar.assign(HyperLogLog::REGISTERS, 0);
+        vector.assign(HyperLogLog::REGISTERS, 0);
+        HyperLogLog::mergeDenseScalar(scalar.data(), body);
+        HyperLogLog::mergeDense(vector.data(), body);
+
+        size_t zeros[2], saturated[2];
+        double sums[2] = {HyperLogLog::registerSumScalar(registers.data(), zeros[0], saturated[0]),
+                          HyperLogLog::registerSum(registers.data(), zeros[1], saturated[1])};
+        if (scalar != registers || vector != registers || zeros[0] != zeros[1] || saturated[0] != saturated[1] ||
+            std::fabs(sums[0] - sums[1]) > 1e-9 * sums[0]) {
+            std::fprintf(stderr, "%s HyperLogLog kernels differ from scalar on round %d\n", HyperLogLog::kernelName(), round);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void addHyperLogLogCases(std::vector<BenchCase>& cases) {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    const size_t COUNTERS = 16;
+    const size_t ELEMENTS = 100000;
+
+    // 16 dense counters of 100k elements each
+    auto fill = [&db, COUNTERS, ELEMENTS]() {
+        db.flushAll();
+        for (size_t c = 0; c < COUNTERS; c++) {
+            std::vector<std::string> elements;
+            for (size_t i = 0; i < ELEMENTS; i++) elements.push_back("visitor:" + std::to_string(c * ELEMENTS / 2 + i));
+            db.pfadd("hll:" + std::to_string(c), elements);
+        }
+    };
+    auto keys = std::make_shared<std::vector<std::string>>();
+    for (size_t c = 0; c < COUNTERS; c++) keys->push_back("hll:" + std::to_string(c));
+
+    cases.push_back({"hll/pfadd sparse", [&db]() { db.flushAll(); }, [&db]() {
+        for (size_t i = 0; i < 1000; i++) db.pfadd("hll:sparse", {"visitor:" + std::to_string(i)});
+        return size_t(1000);
+    }});
+    cases.push_back({"hll/pfadd dense", fill, [&db]() {
+        for (size_t i = 0; i < 100000; i++) db.pfadd("hll:0", {"new:" + std::to_string(i)});
+        return size_t(100000);
+    }});
+    cases.push_back({"hll/pfcount 16 keys (per key)", fill, [&db, keys]() {
+        uint64_t count = 0;
+        for (int i = 0; i < 100; i++) db.pfcount(*keys, count);
+        sink = count;
+        return keys->size() * 100;
+    }});
+}
+
+static void addPersistenceCases(std::vector<BenchCase>& cases) {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    const size_t size = 100000;
+    std::string path = "/tmp/my_redis_bench_" + std::to_string(getpid()) + ".my_rdb";
+
+    auto fill = [&db, size]() {
+        db.flushAll();
+        fillStrings(db, size);
+        for (size_t i = 0; i < size / 10; i++) db.rpush("list:" + std::to_string(i % 100), "element:" + std::to_string(i));
+        for (size_t i = 0; i < size / 10; i++) db.hset("hash:" + std::to_string(i % 100), "field:" + std::to_string(i), "value");
+    };
+    size_t keys = size + 200;
+
+    cases.push_back({"persist/dump n=100000", fill, [&db, path, keys]() {
+        db.dump(path);
+        return keys;
+    }});
+    cases.push_back({"persist/load n=100000", [&db, fill, path]() {
+        fill();
+        db.dump(path);
+    }, [&db, path, keys]() {
+        db.load(path);
+        return keys;
+    }});
+
+    auto snapshot = std::make_shared<std::string>();
+    cases.push_back({"persist/snapshot n=100000", fill, [&db, snapshot, keys]() {
+        *snapshot = db.snapshot();
+        return keys;
+    }});
+    cases.push_back({"persist/load-snapshot n=100000", [&db, fill, snapshot]() {
+        fill();
+        *snapshot = db.snapshot();
+    }, [&db, snapshot, keys]() {
+        db.loadSnapshot(*snapshot);
+        return keys;
+    }});
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 10, warmup = 2;
+    std::string filter;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc) warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--csv") csv = true;
+        else {
+            std::fprintf(stderr, "usage: %s [--iterations N] [--warmup N] [--filter substring] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!scannersAgree(20000)) return 1;
+    if (!hllKernelsAgree(200)) return 1;
+
+    std::vector<BenchCase> cases;
+    addParserCases(cases);
+    addDatabaseCases(cases);
+    addSetCases(cases);
+    addHyperLogLogCases(cases);
+    addPersistenceCases(cases);
+
+    if (csv) {
+        std::printf("name,iterations,median_ns_op,mean_ns_op,stddev_ns_op,min_ns_op,max_ns_op\n");
+    } else {
+        std::printf("%d warmup + %d measured iterations per case, ns/op\n", warmup, iterations);
+        std::printf("%-38s %10s %10s %9s %10s %10s\n", "case", "median", "mean", "stddev%", "min", "max");
+    }
+
+    for (const auto& bench : cases) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) continue;
+        Stats s = measure(bench, warmup, iterations);
+        if (csv) {
+            std::printf("\"%s\",%d,%.2f,%.2f,%.2f,%.2f,%.2f\n", bench.name.c_str(), iterations, s.median, s.mean,
+                        s.stddev, s.min, s.max);
+        } else {
+            std::printf("%-38s %10.1f %10.1f %8.1f%% %10.1f %10.1f\n", bench.name.c_str(), s.median, s.mean,
+                        s.mean > 0 ? 100 * s.stddev / s.mean : 0, s.min, s.max);
+        }
+        std::fflush(stdout);
+    }
+
+    RedisDatabase::getInstance().flushAll();
+    std::remove(("/tmp/my_redis_bench_" + std::to_string(getpid()) + ".my_rdb").c_str());
+    return 0;
+}
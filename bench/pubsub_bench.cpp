@@ -0,0 +1,88 @@
+// Publish throughput against subscriber count, measured in process: the
+// subscribers are RedisConnection objects without sockets, so the numbers
+// isolate PubSub fan-out (frame build, pattern match, enqueue) from the
+// network. Each publish is followed by draining the queues, as the event
+// loop would after writing them out.
+#include "pubsub.h"
+#include "redis_connection.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void drainOutput() {
+    auto& pending = pendingWriteConnections();
+    for (RedisConnection* conn : pending) {
+        conn->inPendingWrites = false;
+        conn->consumeOutput(conn->outputBytes);
+    }
+    pending.clear();
+}
+
+static double publishRate(PubSub& pubsub, const std::string& channel, const std::string& message, int publishes) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < publishes; i++) {
+        pubsub.publish(channel, message);
+        drainOutput();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return publishes / elapsed.count();
+}
+
+// The approach PubSub replaces: build and copy the frame for every subscriber
+static double copyPerSubscriberRate(std::vector<std::unique_ptr<RedisConnection>>& conns,
+                                    const std::string& channel, const std::string& message, int publishes) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < publishes; i++) {
+        for (auto& conn : conns) {
+            conn->addReply("*3\r\n$7\r\nmessage\r\n$" + std::to_string(channel.size()) + "\r\n" + channel + "\r\n$" +
+                           std::to_string(message.size()) + "\r\n" + message + "\r\n");
+        }
+        drainOutput();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return publishes / elapsed.count();
+}
+
+int main() {
+    const std::string message(256, 'x');
+    const int subscriberCounts[] = {1, 10, 100, 1000, 10000};
+
+    std::printf("channel fan-out, %zu byte message\n", message.size());
+    std::printf("%12s %16s %18s %18s\n", "subscribers", "publish/s", "deliveries/s", "copy-each publish/s");
+    for (int subscribers : subscriberCounts) {
+        PubSub pubsub;
+        std::vector<std::unique_ptr<RedisConnection>> conns;
+        for (int i = 0; i < subscribers; i++) {
+            conns.push_back(std::make_unique<RedisConnection>());
+            conns.back()->id = i + 1;
+            pubsub.subscribe(*conns.back(), {"news"});
+        }
+        drainOutput();
+
+        int publishes = std::max(200, 2000000 / subscribers);
+        publishRate(pubsub, "news", message, publishes / 10);
+        double rate = publishRate(pubsub, "news", message, publishes);
+        double copyRate = copyPerSubscriberRate(conns, "news", message, publishes);
+        std::printf("%12d %16.0f %18.0f %18.0f\n", subscribers, rate, rate * subscribers, copyRate);
+    }
+
+    std::printf("\npattern matching, one subscriber per pattern, one pattern matches\n");
+    std::printf("%12s %16s\n", "patterns", "publish/s");
+    for (int patterns : subscriberCounts) {
+        PubSub pubsub;
+        std::vector<std::unique_ptr<RedisConnection>> conns;
+        for (int i = 0; i < patterns; i++) {
+            conns.push_back(std::make_unique<RedisConnection>());
+            pubsub.psubscribe(*conns.back(), {"user." + std::to_string(i) + ".*"});
+        }
+        drainOutput();
+
+        int publishes = 200000;
+        double rate = publishRate(pubsub, "user.42.profile", message, publishes);
+        std::printf("%12d %16.0f\n", patterns, rate);
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef BLOCKING_H
+#define BLOCKING_H
+
+#include <chrono>
+#include <deque>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "redis_connection.h"
+
+// Clients parked by blocking list pops. Every key has a FIFO queue of
+// waiters, deadlines are kept ordered so the event loop knows how long it
+// may sleep
+class BlockedClients {
+public:
+    // conn->block must already be filled in
+    void block(RedisConnection* conn);
+    // Remove conn from every queue it is waiting in
+    void unblock(RedisConnection* conn);
+
+    // Called after a push, the key is served at the end of the command
+    void signalKeyReady(const std::string& key);
+    bool hasReadyKeys() const;
+    std::vector<std::string> takeReadyKeys();
+
+    // First client waiting on key, nullptr if none
+    RedisConnection* firstWaiter(const std::string& key) const;
+
+    // Milliseconds until the nearest deadline, -1 if none
+    int nextTimeoutMs() const;
+    // Clients whose deadline has passed, still blocked
+    std::vector<RedisConnection*> expired(std::chrono::steady_clock::time_point now) const;
+
+    // Clients unblocked since the last call, their pending input can run now
+    std::vector<RedisConnection*> takeUnblocked();
+    // Forget conn entirely, it is being closed
+    void forget(RedisConnection* conn);
+
+    size_t blockedCount() const;
+
+private:
+    std::unordered_map<std::string, std::deque<RedisConnection*>> waiters;
+    std::set<std::pair<std::chrono::steady_clock::time_point, RedisConnection*>> deadlines;
+    std::vector<std::string> readyKeys;
+    std::unordered_set<std::string> readySet;
+    std::vector<RedisConnection*> unblocked;
+    size_t blockedClients = 0;
+};
+
+#endif
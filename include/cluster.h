@@ -0,0 +1,68 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static constexpr unsigned int CLUSTER_SLOTS = 16384;
+
+// CRC16 (XMODEM) of the key mod 16384. When the key holds a non empty
+// {hashtag}, only the tag is hashed so related keys can share a slot
+unsigned int keyHashSlot(const std::string& key);
+
+struct ClusterNode {
+    std::string host;
+    int port;
+
+    std::string address() const;
+};
+
+// Slot map of a cluster node. There is no gossip bus: every node is told the
+// owner of each slot (CLUSTER ADDSLOTS for its own, CLUSTER SETSLOT ... NODE
+// for the others), nodes are addressed by host:port
+class Cluster {
+public:
+    Cluster();
+
+    bool isEnabled() const;
+    void enable(const std::string& host, int port);
+    const ClusterNode& myself() const;
+
+    // nullptr when the slot is not assigned
+    const ClusterNode* slotOwner(unsigned int slot) const;
+    bool ownsSlot(unsigned int slot) const;
+    // Set while the slot is handed over (on the source) / taken over (on the
+    // target), nullptr otherwise
+    const ClusterNode* migratingTo(unsigned int slot) const;
+    const ClusterNode* importingFrom(unsigned int slot) const;
+
+    // Slot changes, false when the request is not valid for the slot
+    bool addSlot(unsigned int slot);
+    bool delSlot(unsigned int slot);
+    void assignSlot(unsigned int slot, const std::string& host, int port);
+    bool setMigrating(unsigned int slot, const std::string& host, int port);
+    bool setImporting(unsigned int slot, const std::string& host, int port);
+    void setStable(unsigned int slot);
+
+    // CLUSTER SLOTS / CLUSTER INFO replies
+    std::string slotsReply() const;
+    std::string infoReply() const;
+
+private:
+    bool enabled;
+    // nodes[0] is this node, slots hold indexes into nodes or -1
+    std::vector<ClusterNode> nodes;
+    std::vector<int> owners;
+    std::unordered_map<unsigned int, int> migrating;
+    std::unordered_map<unsigned int, int> importing;
+
+    int nodeIndex(const std::string& host, int port);
+};
+
+// Send pipelined commands to another node and wait for their replies, each a
+// single status line. Blocks up to timeoutMs per step, like MIGRATE in Redis.
+// Returns the first error reply, empty when every command succeeded
+std::string sendToNode(const std::string& host, int port, const std::string& payload, size_t replies, int timeoutMs);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Classes of client-output-buffer-limit
+enum ClientClass {
+    CLIENT_NORMAL,
+    CLIENT_REPLICA,
+    CLIENT_PUBSUB,
+    CLIENT_CLASS_COUNT
+};
+
+// Reply bytes a client may have queued: reaching hard, or staying at or
+// above soft for softSeconds, closes it. 0 disables a limit
+struct OutputBufferLimit {
+    std::atomic<long long> hard;
+    std::atomic<long long> soft;
+    std::atomic<long long> softSeconds;
+};
+
+// Settings that can be changed at runtime with CONFIG SET. Atomics, as they
+// are also read outside the event loop thread
+struct ServerConfig {
+    // SLOWLOG: commands taking at least this many microseconds are logged,
+    // -1 disables the log
+    std::atomic<long long> slowlogLogSlowerThan{10000};
+    std::atomic<long long> slowlogMaxLen{128};
+    // LATENCY: events taking at least this many milliseconds are sampled,
+    // 0 disables the monitor
+    std::atomic<long long> latencyMonitorThreshold{0};
+    // Connections accepted at once, more are refused with an error
+    std::atomic<long long> maxClients{10000};
+    // Unparsed input a client may accumulate before it is closed
+    std::atomic<long long> clientQueryBufferLimit{1LL << 30};
+    // Keys remembered for CLIENT TRACKING, past it keys are invalidated
+    // early. 0 means no limit
+    std::atomic<long long> trackingTableMaxKeys{1000000};
+    // LFU access counters: a higher log factor makes the counter grow more
+    // slowly, and it loses one every decay time minutes without access
+    std::atomic<long long> lfuLogFactor{10};
+    std::atomic<long long> lfuDecayTime{1};
+    // 0 stops keeping the counters and frees them, for when the extra
+    // table lookup on every access is not worth it
+    std::atomic<long long> lfuTracking{1};
+    // Keys kept by the top-K hot key sketch, 0 turns it off
+    std::atomic<long long> hotkeysTopK{0};
+    // Size a sparse HyperLogLog may reach, header included, before it is
+    // converted to the 12KB dense encoding
+    std::atomic<long long> hllSparseMaxBytes{3000};
+    // Members an integer-only set may hold in the intset encoding before
+    // it is upgraded to a hash set
+    std::atomic<long long> setMaxIntsetEntries{512};
+    OutputBufferLimit outputBufferLimits[CLIENT_CLASS_COUNT] = {
+        {0, 0, 0},
+        {256LL << 20, 64LL << 20, 60},
+        {32LL << 20, 8LL << 20, 60},
+    };
+};
+
+ServerConfig& serverConfig();
+
+// CONFIG GET: name / value pairs of the parameters matching pattern, an
+// exact name or "*"
+std::vector<std::pair<std::string, std::string>> configGet(const std::string& pattern);
+// CONFIG SET: false with error filled in for an unknown parameter or a bad value
+bool configSet(const std::string& name, const std::string& value, std::string& error);
+
+#endif
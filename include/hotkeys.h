@@ -0,0 +1,55 @@
+#ifndef HOTKEYS_H
+#define HOTKEYS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Per key LFU access counter, packed like Redis does it: the minute clock
+// of the last decay in the high 16 bits and a logarithmic 8 bit counter in
+// the low ones. New keys start at LFU_INIT_VAL so they are not the first
+// candidates for anything right after creation
+constexpr uint8_t LFU_INIT_VAL = 5;
+
+// Counter after one more access: decayed by lfu-decay-time, then bumped
+// with probability 1 / ((counter - LFU_INIT_VAL) * lfu-log-factor + 1).
+// rng is an xorshift state owned by the caller
+uint32_t lfuAccess(uint32_t packed, bool created, uint64_t& rng);
+// Counter decayed to now, without counting an access (OBJECT FREQ)
+uint8_t lfuFrequency(uint32_t packed);
+
+// Real-time top-K of the most accessed keys: a count-min sketch estimates
+// every key's accesses in fixed memory and a min-heap keeps the K keys
+// with the highest estimates. Counts are halved every DECAY_INTERVAL
+// accesses so the ranking follows current traffic
+class HotKeySketch {
+public:
+    // Track the top k keys from now on, 0 turns the sketch off and frees it
+    void reset(size_t k);
+    size_t capacity() const;
+    void add(const std::string& key);
+    // Highest estimated count first
+    std::vector<std::pair<std::string, uint64_t>> top() const;
+
+private:
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t WIDTH = 2048;
+    static constexpr uint64_t DECAY_INTERVAL = WIDTH * 64;
+
+    size_t k = 0;
+    std::vector<uint32_t> counters;
+    uint64_t additions = 0;
+    // Min-heap on the estimate, with the heap index of every key in it
+    std::vector<std::pair<uint64_t, std::string>> heap;
+    std::unordered_map<std::string, size_t> positions;
+
+    void swapEntries(size_t a, size_t b);
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    void decay();
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HyperLogLog counters (PFADD / PFCOUNT / PFMERGE), kept in plain string
+// values with the Redis layout so they persist and replicate like any
+// string. A 16 byte header ("HYLL", encoding, cached cardinality) is
+// followed by 16384 registers, either dense (6 bits each, 12KB) or sparse
+// (run length opcodes, a few bytes while most registers are zero). Merges
+// and estimates work on one byte per register, which the SIMD kernels
+// handle 32 registers at a time
+class HyperLogLog {
+public:
+    static constexpr int P = 14;
+    static constexpr size_t REGISTERS = size_t(1) << P;
+    // Hash bits left for the run of zeros, a register holds at most Q + 1
+    static constexpr int Q = 64 - P;
+    static constexpr size_t HEADER_BYTES = 16;
+    static constexpr size_t DENSE_BYTES = HEADER_BYTES + REGISTERS * 6 / 8;
+
+    // Empty counter, sparse
+    static std::string create();
+    // value holds a well formed counter
+    static bool valid(const std::string& value);
+    // Count elements into value, true when a register changed. A sparse
+    // value turns dense past sparseMaxBytes or when a register outgrows
+    // what the sparse encoding can hold
+    static bool add(std::string& value, const std::vector<std::string>& elements, size_t sparseMaxBytes);
+    // Estimated cardinality, from the cached one when no register changed
+    // since it was computed. Caches the result in the header
+    static uint64_t count(std::string& value);
+    // Max the registers of value into registers (REGISTERS bytes)
+    static void merge(const std::string& value, uint8_t* registers);
+    // Counter holding registers, sparse when it fits in sparseMaxBytes
+    static std::string fromRegisters(const uint8_t* registers, size_t sparseMaxBytes);
+    // Ertl's improved estimator, no bias tables or range switches needed
+    static uint64_t estimate(const uint8_t* registers);
+
+    // Kernels, picked at runtime. mergeDense maxes the 6 bit registers of a
+    // dense body into registers, registerSum returns the sum of 2^-r over
+    // all registers and counts those at 0 and at Q + 1
+    static void mergeDense(uint8_t* registers, const uint8_t* dense);
+    static double registerSum(const uint8_t* registers, size_t& zeros, size_t& saturated);
+    // Same, restricted to portable scalar code
+    static void mergeDenseScalar(uint8_t* registers, const uint8_t* dense);
+    static double registerSumScalar(const uint8_t* registers, size_t& zeros, size_t& saturated);
+    // "avx2" or "scalar"
+    static const char* kernelName();
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef INTSET_H
+#define INTSET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sorted array of unique 64 bit integers, the compact encoding of small
+// integer-only sets
+class IntSet {
+public:
+    bool add(int64_t value);
+    // Add many values at once: sorted and merged in one pass, so a bulk
+    // add costs O(n + k log k) instead of k shifting inserts. Returns the
+    // number of values that were not already present
+    size_t add(std::vector<int64_t> values);
+    bool remove(int64_t value);
+    bool contains(int64_t value) const;
+    size_t size() const;
+    const std::vector<int64_t>& values() const;
+
+    // Parse a member that is exactly the canonical decimal form of an int64,
+    // so it is printed back unchanged
+    static bool parseMember(const std::string& member, int64_t& value);
+
+    // Intersect two sorted arrays of unique values into out (room for
+    // min(na, nb) values), returns the number written. Uses galloping search
+    // when the sizes are very different and a SIMD block merge otherwise
+    static size_t intersect(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out);
+
+    // Same as intersect, restricted to the portable scalar merge
+    static size_t intersectScalar(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out);
+
+private:
+    std::vector<int64_t> data;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef IO_THREADS_H
+#define IO_THREADS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that help the event loop with socket reads, parsing and writes.
+// The event loop hands out a batch, works on its own share, and waits until
+// the batch is done, so jobs never overlap with command execution
+class IoThreads {
+public:
+    // threads counts the event loop thread itself
+    explicit IoThreads(size_t threads);
+    ~IoThreads();
+    IoThreads(const IoThreads&) = delete;
+    IoThreads& operator=(const IoThreads&) = delete;
+
+    size_t size() const;
+
+    // Run job(i) for every i in [0, count), job i on thread i % size().
+    // Small batches run inline, a wakeup would cost more than the work.
+    // Returns whether the batch was spread over the threads
+    bool parallelFor(size_t count, const std::function<void(size_t)>& job);
+
+private:
+    // Spins before an idle thread blocks on the condition variable
+    static constexpr int SPIN_ROUNDS = 20000;
+
+    std::vector<std::thread> workers;
+    const std::function<void(size_t)>* currentJob = nullptr;
+    size_t currentCount = 0;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<uint64_t> generation{0};
+    std::atomic<size_t> remaining{0};
+    std::atomic<bool> stopping{false};
+
+    void run(size_t index);
+    void runShare(size_t index);
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// SLOWLOG: the last slowlog-max-len commands that took at least
+// slowlog-log-slower-than microseconds. Owned by the event loop thread
+class SlowLog {
+public:
+    // Arguments kept per entry, and bytes kept per argument
+    static constexpr size_t MAX_ARGS = 32;
+    static constexpr size_t MAX_ARG_LEN = 128;
+
+    // Log the command if it ran for at least the configured threshold
+    void recordIfSlow(const std::vector<std::string>& tokens, uint64_t micros, const std::string& client);
+
+    // SLOWLOG GET / LEN / RESET replies, newest entries first
+    std::string getReply(size_t count) const;
+    size_t length() const;
+    void reset();
+
+private:
+    struct Entry {
+        uint64_t id;
+        time_t time;
+        uint64_t micros;
+        std::vector<std::string> args;
+        std::string client;
+    };
+
+    std::deque<Entry> entries;
+    uint64_t nextId = 0;
+};
+
+// LATENCY: spikes of at least latency-monitor-threshold milliseconds per
+// event class, each class keeps its last samples in a fixed size ring.
+// Events come from the event loop and the persistence thread
+class LatencyMonitor {
+public:
+    static constexpr size_t HISTORY_LEN = 160;
+
+    static LatencyMonitor& getInstance();
+
+    // Cheap when the monitor is disabled or the event was fast: no lock taken
+    void addSampleIfNeeded(const std::string& event, uint64_t millis);
+
+    // LATENCY LATEST / HISTORY replies, RESET returns the number of event
+    // classes cleared (every class when events is empty)
+    std::string latestReply();
+    std::string historyReply(const std::string& event);
+    size_t reset(const std::vector<std::string>& events);
+
+private:
+    LatencyMonitor() = default;
+    LatencyMonitor(const LatencyMonitor&) = delete;
+    LatencyMonitor& operator=(const LatencyMonitor&) = delete;
+
+    struct Sample {
+        time_t time;
+        uint64_t millis;
+    };
+
+    struct Series {
+        // Samples of the same second are merged, keeping the highest
+        std::array<Sample, HISTORY_LEN> samples;
+        size_t next = 0;
+        size_t count = 0;
+        uint64_t maxMillis = 0;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Series> events;
+};
+
+// Samples the time until it goes out of scope as one event, for the long
+// operations that hold db_mutex (dump, snapshot, snapshot-load)
+class LatencyScope {
+public:
+    explicit LatencyScope(const char* event) : event(event), start(std::chrono::steady_clock::now()) {}
+    ~LatencyScope();
+
+private:
+    const char* event;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef LAZY_FREE_H
+#define LAZY_FREE_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+// Background thread that destroys large values detached from the keyspace,
+// so that freeing them never happens while db_mutex is held
+class LazyFree {
+public:
+    static LazyFree& getInstance();
+
+    // Take ownership of obj (moved, O(1) for containers) and destroy it later
+    template <typename T>
+    void release(T&& obj) {
+        enqueue(std::make_shared<std::decay_t<T>>(std::move(obj)));
+    }
+
+    // Number of objects still waiting to be freed
+    size_t pending();
+
+private:
+    LazyFree();
+    ~LazyFree();
+    LazyFree(const LazyFree&) = delete;
+    LazyFree& operator=(const LazyFree&) = delete;
+
+    void enqueue(std::shared_ptr<void> obj);
+    void run();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::shared_ptr<void>> queue;
+    bool stopping;
+    std::thread worker;
+};
+
+#endif
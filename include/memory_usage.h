@@ -0,0 +1,45 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+// Footprint estimates for MEMORY USAGE / STATS, modelled on glibc malloc:
+// a block takes the requested size plus an 8 byte header, rounded up to 16
+// bytes, and at least 32 bytes
+inline size_t allocationSize(size_t bytes) {
+    if (bytes == 0) return 0;
+    return std::max<size_t>((bytes + 8 + 15) & ~static_cast<size_t>(15), 32);
+}
+
+// Heap block of a string, 0 while it fits in the string's inline buffer
+inline size_t stringHeapSize(const std::string& s) {
+    static const size_t inlineCapacity = std::string().capacity();
+    return s.capacity() > inlineCapacity ? allocationSize(s.capacity() + 1) : 0;
+}
+
+// One node of a std::unordered_map / set: next pointer, element and the
+// cached hash
+inline size_t hashNodeSize(size_t elementBytes) {
+    return allocationSize(sizeof(void*) + elementBytes + sizeof(size_t));
+}
+
+// Bucket array and nodes of a hash table, without what the elements point to
+template <typename Table>
+size_t hashTableOverhead(const Table& table) {
+    return allocationSize(table.bucket_count() * sizeof(void*)) +
+           table.size() * hashNodeSize(sizeof(typename Table::value_type));
+}
+
+// Sum of elementBytes over the first samples elements, scaled to count
+// elements. samples 0 walks them all
+template <typename Iterator, typename Measure>
+size_t sampledBytes(Iterator it, size_t count, size_t samples, Measure elementBytes) {
+    size_t walked = (samples == 0 || samples > count) ? count : samples;
+    size_t total = 0;
+    for (size_t i = 0; i < walked; i++, ++it) total += elementBytes(*it);
+    return walked == 0 ? 0 : total * count / walked;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "redis_connection.h"
+
+// Glob patterns (*, ?, [...], \x) stored in a trie whose edges are pattern
+// tokens, so a channel is matched against all patterns in one walk instead
+// of one stringmatch per pattern
+class PatternTrie {
+public:
+    PatternTrie();
+    ~PatternTrie();
+
+    // Returns true if conn was not subscribed to pattern yet
+    bool add(const std::string& pattern, RedisConnection* conn);
+    bool remove(const std::string& pattern, RedisConnection* conn);
+
+    struct Match {
+        const std::string* pattern;
+        const std::unordered_set<RedisConnection*>* subscribers;
+    };
+    std::vector<Match> match(const std::string& channel) const;
+
+    size_t patternCount() const;
+
+private:
+    struct Node;
+    std::unique_ptr<Node> root;
+    size_t patterns;
+
+    static std::vector<std::string> tokenize(const std::string& pattern);
+};
+
+// Channel and pattern subscriptions. PUBLISH serializes the message frame
+// once and queues the same buffer on every subscriber
+class PubSub {
+public:
+    // Each call returns the reply frames for the (un)subscribe confirmations
+    std::string subscribe(RedisConnection& conn, const std::vector<std::string>& channels);
+    std::string unsubscribe(RedisConnection& conn, const std::vector<std::string>& channels);
+    std::string psubscribe(RedisConnection& conn, const std::vector<std::string>& patterns);
+    std::string punsubscribe(RedisConnection& conn, const std::vector<std::string>& patterns);
+
+    // Returns the number of clients that received the message
+    size_t publish(const std::string& channel, const std::string& message);
+
+    // Drop every subscription of a closing connection
+    void removeConnection(RedisConnection& conn);
+
+    size_t channelCount() const;
+    size_t patternCount() const;
+
+private:
+    std::unordered_map<std::string, std::unordered_set<RedisConnection*>> channelSubscribers;
+    PatternTrie patternSubscribers;
+};
+
+#endif
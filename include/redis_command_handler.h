@@ -3,12 +3,72 @@
 
 #include <string>
 #include <typeinfo>
+#include <vector>
+
+#include "blocking.h"
+#include "cluster.h"
+#include "latency.h"
+#include "pubsub.h"
+#include "redis_connection.h"
+#include "replication.h"
+#include "resp_parser.h"
+#include "tracking.h"
 
 class RedisCommandHandler {
 public:
     RedisCommandHandler();
 
-    std::string processCommand(const std::string& commandLine);
+    // Execute one command for conn. Returns the reply, or an empty string
+    // when the command parked the client
+    std::string processCommand(const std::vector<std::string>& tokens, RedisConnection& conn);
+
+    // Hand pushed elements to blocked clients, called after every command
+    void serveBlockedClients();
+    // Reply to blocked clients whose timeout has passed
+    void handleBlockedTimeouts();
+    // Milliseconds the event loop may sleep before the next timeout, -1 if none
+    int nextTimeoutMs() const;
+    // Clients that can process their buffered input again
+    std::vector<RedisConnection*> takeUnblockedClients();
+    void onConnectionClosed(RedisConnection* conn);
+
+    Replication& getReplication();
+    Cluster& getCluster();
+
+private:
+    BlockedClients blockedClients;
+    PubSub pubsub;
+    Replication replication;
+    Cluster cluster;
+    SlowLog slowlog;
+    Tracking tracking;
+
+    // Write commands executed by the current top level command, sent to
+    // the replicas once it finishes (wrapped in MULTI / EXEC for a transaction)
+    std::vector<std::vector<std::string>> propagationQueue;
+    void flushPropagation();
+
+    std::string executeCommand(const std::vector<std::string>& tokens, const std::string& cmd, RedisConnection& conn);
+    // Cluster mode: -MOVED / -ASK / -CROSSSLOT when the keys are not served
+    // here, empty when the command can run
+    std::string clusterRedirect(const std::vector<std::string>& tokens, const std::string& cmd, RedisConnection& conn);
+    std::string handleCluster(const std::vector<std::string>& tokens);
+    std::string handleMigrate(const std::vector<std::string>& tokens);
+    std::string handleReplicationCommand(const std::vector<std::string>& tokens, const std::string& cmd, RedisConnection& conn);
+    std::string handleInfo(const std::vector<std::string>& tokens);
+    std::string handleSlowlog(const std::vector<std::string>& tokens);
+    std::string handleMemory(const std::vector<std::string>& tokens);
+    std::string handleClient(const std::vector<std::string>& tokens, RedisConnection& conn);
+    std::string handleHello(const std::vector<std::string>& tokens, RedisConnection& conn);
+    std::string handleTracking(const std::vector<std::string>& tokens, RedisConnection& conn);
+
+    // CLIENT TRACKING: send invalidations for the keys modified since the
+    // last call, and remember the keys a tracking client just read
+    void flushInvalidations(const RedisConnection* modifier);
+    void trackReads(const std::string& cmd, const std::vector<std::string>& tokens, RedisConnection& conn);
+
+    // Run the commands queued since MULTI under one database lock
+    std::string execTransaction(RedisConnection& conn);
 };
 
-#endif
\ No newline at end of file
+#endif
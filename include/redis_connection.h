@@ -0,0 +1,160 @@
+#ifndef REDIS_CONNECTION_H
+#define REDIS_CONNECTION_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+// What a client parked by BLPOP / BRPOP / BLMOVE is waiting for
+struct BlockState {
+    std::string command;
+    std::vector<std::string> keys;
+
+    // BLMOVE only
+    std::string destination;
+    bool fromLeft = true;
+    bool toLeft = true;
+
+    bool hasDeadline = false;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// CLIENT TRACKING settings of a client
+struct TrackingState {
+    bool enabled = false;
+    // Broadcast mode, notified for every key under prefixes
+    bool bcast = false;
+    std::vector<std::string> prefixes;
+    // Client id the invalidations are sent to
+    uint64_t redirect = 0;
+    // OPTIN: only reads after CLIENT CACHING yes are tracked. OPTOUT: reads
+    // after CLIENT CACHING no are not
+    bool optIn = false;
+    bool optOut = false;
+    // Set by CLIENT CACHING for the next command
+    bool cachingOverride = false;
+    // NOLOOP: no invalidations for keys the client modified itself
+    bool noLoop = false;
+};
+
+// Replica side of the link to a primary
+enum class MasterLinkState {
+    Connecting,   // Non blocking connect in progress
+    Handshake,    // PING, REPLCONF and PSYNC sent, waiting for their replies
+    Transfer,     // Reading the snapshot of a full resync
+    Streaming     // Applying the primary's command stream
+};
+
+// Per client state owned by the event loop
+struct RedisConnection {
+    int fd = -1;
+    uint64_t id = 0;
+    // Peer ip:port, shown in SLOWLOG entries
+    std::string addr;
+    // Set by HELLO SETNAME / CLIENT SETNAME
+    std::string name;
+    // RESP version of the replies, 3 after HELLO 3
+    int protocol = 2;
+    std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+
+    // Bytes read but not parsed yet
+    std::string queryBuffer;
+    // Commands an I/O thread parsed ahead of execution: the first
+    // parsedCount are valid and parsedNext runs next. The token vectors are
+    // reused from batch to batch
+    std::vector<std::vector<std::string>> parsedCommands;
+    size_t parsedCount = 0;
+    size_t parsedNext = 0;
+
+    // Reply bytes not written yet. Chunks may be shared between connections
+    // (a published message is serialized once for every subscriber), only
+    // the last chunk is appended to, and only if this connection owns it
+    std::deque<std::shared_ptr<const std::string>> outputQueue;
+    size_t outputOffset = 0;
+    size_t outputBytes = 0;
+    bool lastChunkPrivate = false;
+
+    // A write is pending: registered for EPOLLOUT because the socket buffer
+    // was full, or an io_uring send is in flight
+    bool writeInterest = false;
+    bool inPendingWrites = false;
+    // Set after a protocol error, the connection closes once the reply is out
+    bool closeAfterReply = false;
+    // Over its output buffer limit: further replies are dropped and the
+    // event loop closes the connection before writing again
+    bool closeAsap = false;
+    // Since when the output has been at or above the soft limit
+    bool overSoftLimit = false;
+    std::chrono::steady_clock::time_point softLimitSince;
+    // Too many replies waiting to be written: no commands run, and with
+    // epoll nothing is read, until the client catches up
+    bool readsPaused = false;
+
+    bool blocked = false;
+    BlockState block;
+
+    // MULTI / EXEC state. watchedKeys holds the version of every WATCHed key
+    // at the time it was watched
+    bool inMulti = false;
+    bool executingMulti = false;
+    std::vector<std::vector<std::string>> multiQueue;
+    std::vector<std::pair<std::string, uint64_t>> watchedKeys;
+
+    // Replication: isMaster marks this node's link to its primary, whose
+    // commands are applied without replies. isReplica marks a replica that
+    // sent PSYNC and now only receives the stream
+    bool isMaster = false;
+    MasterLinkState linkState = MasterLinkState::Connecting;
+    int handshakeReplies = 0;
+    bool isReplica = false;
+
+    // io_uring engine: operations the kernel still holds. A closed
+    // connection stays allocated until they complete, a send in flight
+    // reads from outputQueue through sendIov
+    int inflightOps = 0;
+    bool closed = false;
+    std::vector<iovec> sendIov;
+    msghdr sendMsg{};
+
+    // Cluster mode: the next command may touch a slot being imported
+    bool asking = false;
+
+    TrackingState tracking;
+
+    // Pub/Sub subscriptions, non empty puts a RESP2 client in subscribed mode
+    std::unordered_set<std::string> channels;
+    std::unordered_set<std::string> patterns;
+
+    // Append reply bytes and schedule the connection for writing
+    void addReply(const std::string& reply);
+    // Queue a frame shared with other connections, without copying it
+    void addSharedReply(const std::shared_ptr<const std::string>& frame);
+    bool hasPendingOutput() const;
+    // Drop the first bytes of the output queue once they have been written
+    void consumeOutput(size_t bytes);
+    // Which client-output-buffer-limit applies
+    ClientClass clientClass() const;
+
+private:
+    void scheduleWrite();
+    void checkOutputLimit();
+};
+
+// Connections with output waiting, drained by the event loop after every
+// iteration
+std::vector<RedisConnection*>& pendingWriteConnections();
+
+// Client connections by id, for CLIENT LIST
+std::map<uint64_t, RedisConnection*>& clientConnections();
+
+#endif
@@ -1,29 +1,71 @@
 #ifndef REDIS_DATABASE_H
 #define REDIS_DATABASE_H
 
+#include <atomic>
+#include <ctime>
+#include <functional>
 #include <string>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdio.h>
 #include <sstream>
 #include <vector>
 #include <string>
 #include <chrono>
 
+#include "hotkeys.h"
+#include "redis_set.h"
+#include "sorted_set.h"
+
+// ZADD options, combined as a bit mask
+enum ZAddFlags {
+    ZADD_NX = 1 << 0,
+    ZADD_XX = 1 << 1,
+    ZADD_GT = 1 << 2,
+    ZADD_LT = 1 << 3,
+    ZADD_CH = 1 << 4
+};
+
 class RedisDatabase {
 public:
     // Get the singleton database
     static RedisDatabase& getInstance();
 
+    // Hold db_mutex across several operations (MULTI/EXEC). The mutex is
+    // recursive, so the operations called while it is held only bump a
+    // counter instead of contending for the lock again
+    std::unique_lock<std::recursive_mutex> lockBatch();
+
+    // WATCH support: modifications bump a version counter on watched keys
+    uint64_t watchKey(const std::string& key);
+    void unwatchKey(const std::string& key);
+    uint64_t keyVersion(const std::string& key);
+
+    // CLIENT TRACKING: while enabled every modified key is recorded until
+    // taken. A flush (FLUSHALL, a full resync) is reported as flushed
+    void setRecordModifications(bool enable);
+    std::vector<std::string> takeModifiedKeys(bool& flushed);
+
     // Common commands
-    bool flushAll();
+    // With async set, the old dataset is handed to the lazy-free thread
+    bool flushAll(bool async = false);
 
     // Key value operations
     void set(const std::string& key, const std::string& val);
     bool get(const std::string& key, std::string& val);
+    // Length of a string value, 0 when key holds none
+    size_t strlen(const std::string& key);
     std::vector<std::string> keys();
+    // SCAN: about count keys from cursor on, returns the cursor to continue
+    // from, 0 once every store was walked. Keys present for the whole scan
+    // are returned at least once, a table that grew in between is walked
+    // again from its start
+    uint64_t scan(uint64_t cursor, size_t count, std::vector<std::string>& out);
     std::string type(const std::string& key);
     bool del(const std::string& key);
+    // Like del, but large values are freed in the background
+    bool unlink(const std::string& key);
 
     // Expire
     bool expire(const std::string& key, int sec);
@@ -34,9 +76,60 @@ public:
     // Persistance: Dump/Load the db from a file
     bool dump(const std::string& filename);
     bool load(const std::string& filename);
+    // Unix time of the last successful dump, 0 before the first one
+    time_t lastSaveTime() const;
+    bool lastSaveFailed() const;
+
+    // INFO keyspace: number of keys, and of keys with a TTL
+    size_t keyCount();
+    size_t expiresCount();
+
+    // MEMORY USAGE: estimated bytes of key, its value and its TTL entry.
+    // samples elements of a container are measured, 0 measures all
+    bool memoryUsage(const std::string& key, size_t samples, size_t& bytes);
+    // MEMORY STATS: bucket arrays and nodes of the keyspace tables (main),
+    // of the TTL table (expires) and of the LFU counters (lfu), without the
+    // keys and values
+    void tableOverhead(size_t& main, size_t& expires, size_t& lfu);
+
+    // OBJECT FREQ: LFU access counter of key, decayed to now. Both need
+    // lfu-tracking on
+    bool keyFrequency(const std::string& key, unsigned& freq);
+    // HOTKEYS: the count keys with the highest LFU counters among about
+    // samples keys sampled from the keyspace, highest first
+    std::vector<std::pair<std::string, unsigned>> hotKeys(size_t count, size_t samples);
+    // HOTKEYS TOPK: estimated access counts from the top-K sketch, empty
+    // while hotkeys-topk is 0
+    std::vector<std::pair<std::string, uint64_t>> topKeys();
+
+    // Binary snapshot for replication full resyncs: length prefixed strings,
+    // so keys and values may hold any byte, plus the remaining TTLs. The
+    // streaming form hands it to emit in pieces of about chunkBytes, so no
+    // single buffer holds the whole dataset
+    void snapshot(size_t chunkBytes, const std::function<void(std::string&&)>& emit);
+    std::string snapshot();
+    bool loadSnapshot(const std::string& data);
+
+    // DUMP / RESTORE payload of a single value, used by MIGRATE. restoreValue
+    // replaces an existing key, false means a malformed payload
+    bool dumpValue(const std::string& key, std::string& payload);
+    // Milliseconds left before key expires, rounded up and at least 1 once
+    // the deadline has passed. 0 when it has no TTL, as RESTORE takes it
+    long long remainingTtlMs(const std::string& key);
+    bool restoreValue(const std::string& key, const std::string& payload, long long ttlMs);
+
+    // Cluster mode: keys hashing to slot, read from a per slot index kept up
+    // to date on every key creation and removal. enableSlotIndex builds it
+    // from the current keyspace, the server calls it when it enters cluster
+    // mode (after the dump is loaded)
+    void enableSlotIndex();
+    std::vector<std::string> keysInSlot(unsigned int slot, size_t count);
+    size_t countKeysInSlot(unsigned int slot);
 
     // List ops
-    std::vector<std::string> lget(const std::string& key);
+    // LRANGE: appends elements start..stop (inclusive, negative counts from
+    // the tail) to reply as a RESP array, straight from the list
+    void lrange(const std::string& key, long start, long stop, std::string& reply);
     ssize_t llen(const std::string& key);
     void lpush(const std::string& key, const std::string& value);
     void rpush(const std::string& key, const std::string& value);
@@ -45,6 +138,16 @@ public:
     int lrem(const std::string& key, int count, const std::string& value);
     bool lindex(const std::string& key, int index, std::string& value);
     bool lset(const std::string& key, int index, const std::string& value);
+    // Keep only start..stop, an empty result deletes the key
+    void ltrim(const std::string& key, long start, long stop);
+    // New length, -1 when pivot is not in the list, 0 when there is no list
+    long linsert(const std::string& key, bool before, const std::string& pivot, const std::string& value);
+    // Indexes of up to count (0: all) matches of value, the rank-th match
+    // first (negative ranks search from the tail), comparing at most maxlen
+    // elements (0: all)
+    std::vector<long> lpos(const std::string& key, const std::string& value, long rank, size_t count, size_t maxlen);
+    // Pop from one end of source and push to one end of destination atomically
+    bool lmove(const std::string& source, const std::string& destination, bool fromLeft, bool toLeft, std::string& value);
 
     // Hash ops
     bool hset(const std::string& key, const std::string& field, const std::string& value);
@@ -57,17 +160,105 @@ public:
     ssize_t hlen(const std::string& key);
     bool hmset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues);
 
+    // Sorted set ops
+    // Returns the number of new members, or of changed members with ZADD_CH.
+    // ZADD, ZINCRBY and SADD return -1 when key holds another type
+    long zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& scoreMembers, int flags);
+    size_t zrem(const std::string& key, const std::vector<std::string>& members);
+    bool zscore(const std::string& key, const std::string& member, double& score);
+    // 0 when the new score would be NaN, e.g. inf + -inf
+    int zincrby(const std::string& key, double increment, const std::string& member, double& score);
+    long zrank(const std::string& key, const std::string& member, bool reverse);
+    std::vector<SortedSet::Entry> zrange(const std::string& key, long start, long stop, bool reverse);
+    std::vector<SortedSet::Entry> zrangebyscore(const std::string& key, const ZRangeSpec& range, size_t offset, long count, bool reverse);
+    size_t zcard(const std::string& key);
+
+    // Set ops
+    long sadd(const std::string& key, const std::vector<std::string>& members);
+    size_t srem(const std::string& key, const std::vector<std::string>& members);
+    bool sismember(const std::string& key, const std::string& member);
+    size_t scard(const std::string& key);
+    std::vector<std::string> smembers(const std::string& key);
+    std::vector<std::string> sinter(const std::vector<std::string>& keys);
+    std::vector<std::string> sunion(const std::vector<std::string>& keys);
+    std::vector<std::string> sdiff(const std::vector<std::string>& keys);
+
+    // HyperLogLog ops, on string values holding a counter (hyperloglog.h).
+    // -1 / false when a key holds something else
+    int pfadd(const std::string& key, const std::vector<std::string>& elements);
+    bool pfcount(const std::vector<std::string>& keys, uint64_t& count);
+    bool pfmerge(const std::string& destination, const std::vector<std::string>& sources);
+
 private:
     RedisDatabase() = default;
     ~RedisDatabase() = default;
     RedisDatabase(const RedisDatabase& ) = delete;
     RedisDatabase& operator=(const RedisDatabase&) = delete;
 
-    std::mutex db_mutex;
+    // Containers with more elements than this are freed by the lazy-free thread
+    static constexpr size_t LAZYFREE_THRESHOLD = 64;
+
+    // Caller must hold db_mutex
+    bool keyExists(const std::string& key) const;
+    // Record a modification of key for WATCH, caller must hold db_mutex
+    void touchKey(const std::string& key);
+    // Count an access to an existing (or just created) key in its LFU
+    // counter and the hot key sketch, caller must hold db_mutex
+    void accessKey(const std::string& key);
+    // A value read back from its encoding, not in any store yet. type is
+    // the encoding tag and says which member holds it
+    struct DecodedValue {
+        char type = 0;
+        std::string string;
+        std::vector<std::string> list;
+        std::unordered_map<std::string, std::string> hash;
+        RedisSet set;
+        SortedSet zset;
+    };
+    // Value encoding shared by snapshots and DUMP, caller must hold db_mutex.
+    // Decoding touches no store, storeValue then moves the value in
+    bool encodeValue(const std::string& key, std::string& out) const;
+    static bool decodeValue(const std::string& data, size_t& pos, DecodedValue& value);
+    void storeValue(const std::string& key, DecodedValue&& value);
+    // Remove key from every store, caller must hold db_mutex
+    bool removeKey(const std::string& key, bool lazy);
+    // Slot index upkeep, caller must hold db_mutex. indexKey after key was
+    // created (nothing happens if it is listed already), unindexKey after it
+    // was removed. Both return at once while the index is off
+    void indexKey(const std::string& key);
+    void unindexKey(const std::string& key);
+    void rebuildSlotIndex();
+    // Sets for the given keys, nullptr for missing ones. Caller must hold db_mutex
+    std::vector<const RedisSet*> lookupSets(const std::vector<std::string>& keys) const;
+
+    std::recursive_mutex db_mutex;
     std::unordered_map<std::string, std::string> kv_store;
     std::unordered_map<std::string, std::vector<std::string>> list_store;
     std::unordered_map<std::string, std::unordered_map<std::string, std::string>> hash_store;
+    std::unordered_map<std::string, SortedSet> zset_store;
+    std::unordered_map<std::string, RedisSet> set_store;
     std::unordered_map<std::string, std::chrono::steady_clock::time_point> expiry_map;
+    // Packed LFU counter of every key that was accessed (see hotkeys.h)
+    std::unordered_map<std::string, uint32_t> access_freq;
+    // Cluster mode: the keys of every hash slot, empty while not in cluster
+    // mode
+    std::vector<std::unordered_set<std::string>> slot_keys;
+    HotKeySketch hot_keys;
+    uint64_t lfu_rng = 0x9E3779B97F4A7C15ULL;
+
+    struct WatchedKey {
+        uint64_t version = 0;
+        size_t watchers = 0;
+    };
+    std::unordered_map<std::string, WatchedKey> watched_keys;
+
+    bool record_modifications = false;
+    std::vector<std::string> modified_keys;
+    bool modified_flush = false;
+
+    // Written by the persistence thread, read by INFO
+    std::atomic<time_t> last_save{0};
+    std::atomic<bool> last_save_failed{false};
 };
 
 #endif
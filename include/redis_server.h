@@ -2,21 +2,125 @@
 #define REDIS_SERVER_H
 
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "io_threads.h"
+#include "redis_command_handler.h"
+#include "redis_connection.h"
+#include "uring.h"
+
+// How the event loop talks to sockets. io_uring uses multishot accept and
+// recv with provided buffers and submits all replies of an iteration in one
+// syscall, it falls back to epoll when the kernel lacks support
+enum class IoEngine {
+    Epoll,
+    IoUring
+};
 
 class RedisServer {
 public:
     RedisServer(int port);
+    // Pick the I/O engine, before run()
+    void setIoEngine(IoEngine engine);
+    // Spread socket reads, parsing and writes over this many threads (the
+    // event loop included) while commands still run on the event loop
+    // thread alone. epoll engine only, before run()
+    void setIoThreads(size_t threads);
     void run();
     void shutdown();
+    // Serve only the hash slots assigned to this node, see cluster.h
+    void enableCluster();
 
 private:
     int port;
     int server_socket;
+    int epoll_fd;
     std::atomic<bool> isRunning;
+    IoEngine ioEngine;
+    // Set while the io_uring engine runs
+    std::unique_ptr<IoUring> ring;
+    // Closed connections the kernel still holds operations for, freed when
+    // their last completion arrives
+    std::unordered_map<RedisConnection*, std::unique_ptr<RedisConnection>> retiredConnections;
+
+    size_t ioThreadCount;
+    std::unique_ptr<IoThreads> ioThreads;
+    // Readable clients of this iteration, read and parsed by the I/O threads
+    std::vector<RedisConnection*> readQueue;
+    // Per connection outcome of a threaded batch
+    std::vector<uint8_t> ioResults;
+
+    uint64_t nextClientId;
+    std::unordered_map<int, std::unique_ptr<RedisConnection>> connections;
+    RedisCommandHandler cmdHandler;
+    // Arguments of the command being parsed, reused so steady state parsing
+    // does not allocate
+    std::vector<std::string> commandTokens;
+
+    // Link to our primary when running as a replica
+    RedisConnection* masterLink;
+    uint64_t masterLinkGeneration;
+    std::chrono::steady_clock::time_point nextMasterConnect;
+    // Replication id and offset announced by +FULLRESYNC, applied once the
+    // snapshot is loaded
+    std::string pendingReplid;
+    uint64_t pendingOffset;
 
     // Setup signal to handle graceful shutdown (ctrl + c)
     void setupSignalHandler();
+
+    // Event loop steps, all run on the single event loop thread
+    void runEpoll();
+    int loopTimeoutMs();
+    // Timers, unblocked clients, replication and queued replies, after
+    // every batch of events
+    void beforeSleep();
+    void acceptConnections();
+    RedisConnection* addConnection(int fd);
+    // Return false when the connection was closed
+    bool readFromClient(RedisConnection* conn);
+    // Account and process bytes received on conn, which may be closed on return
+    void handleInput(RedisConnection* conn, const char* data, size_t len);
+    void dispatchInput(RedisConnection* conn);
+    bool writeToClient(RedisConnection* conn);
+    // The socket side of reads and writes, safe on an I/O thread: they touch
+    // nothing but conn. The event loop then acts on the result
+    static bool receive(RedisConnection* conn);
+    static void parseAhead(RedisConnection* conn);
+    static uint8_t sendOutput(RedisConnection* conn);
+    bool finishWrite(RedisConnection* conn, uint8_t result);
+    void processReadQueue();
+    void processInput(RedisConnection* conn);
+    void runCommand(RedisConnection* conn, const std::vector<std::string>& tokens);
+    // Backpressure: stop serving a client whose replies pile up, and serve
+    // it again once they are mostly written
+    void setReadsPaused(RedisConnection* conn, bool paused);
+    void resumeIfDrained(RedisConnection* conn);
+    void processUnblockedClients();
+    void flushPendingWrites();
+    void closeConnection(RedisConnection* conn);
+    void updateWriteInterest(RedisConnection* conn, bool enable);
+    // Register the epoll events conn currently wants
+    void updateEvents(RedisConnection* conn);
+
+    // io_uring engine
+    void runUring();
+    void armAccept();
+    void armRecv(RedisConnection* conn);
+    void submitWrite(RedisConnection* conn);
+    void handleCompletion(const UringCompletion& completion);
+    void handleRecv(RedisConnection* conn, const UringCompletion& completion);
+    void handleSendDone(RedisConnection* conn, int result);
+
+    // Replica side of replication
+    void replicationCron();
+    void connectToMaster();
+    bool finishMasterConnect(RedisConnection* conn);
+    void processMasterInput(RedisConnection* conn);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,45 @@
+#ifndef REDIS_SET_H
+#define REDIS_SET_H
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "intset.h"
+
+// Set value. Starts as an IntSet while every member is an integer and the
+// set is small, then upgrades to a hash set for good
+class RedisSet {
+public:
+    RedisSet();
+
+    // Returns true if the member was added / removed
+    bool add(const std::string& member);
+    bool remove(const std::string& member);
+    // Bulk add, returns the number of members added. Integer members going
+    // into an intset are merged in one pass
+    size_t add(const std::vector<std::string>& members);
+    bool contains(const std::string& member) const;
+    size_t size() const;
+    bool isIntset() const;
+    // Estimated bytes held, see MEMORY USAGE. samples members are measured
+    // and the rest extrapolated, 0 measures all
+    size_t memoryUsage(size_t samples) const;
+    std::vector<std::string> members() const;
+
+    // Set algebra over several sets, null entries stand for missing keys
+    static std::vector<std::string> intersect(std::vector<const RedisSet*> sets);
+    static std::vector<std::string> unite(const std::vector<const RedisSet*>& sets);
+    static std::vector<std::string> difference(const std::vector<const RedisSet*>& sets);
+
+private:
+    bool intsetEncoded;
+    IntSet ints;
+    std::unordered_set<std::string> table;
+
+    void convertToHashtable();
+    // Upgrade once the intset outgrows set-max-intset-entries
+    void checkIntsetSize();
+};
+
+#endif
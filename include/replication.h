@@ -0,0 +1,85 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "redis_connection.h"
+
+// Fixed size ring holding the tail of the replication stream. Offsets are
+// global byte positions in the stream, the first byte ever written is 1
+class ReplicationBacklog {
+public:
+    explicit ReplicationBacklog(size_t capacity);
+
+    void append(const std::string& bytes);
+    // Forget the history, the next byte written gets offset + 1
+    void reset(uint64_t offset);
+
+    // Offset of the last byte written
+    uint64_t offset() const;
+    // Copy everything from offset (inclusive) to the end. False when those
+    // bytes are no longer (or not yet) held
+    bool readFrom(uint64_t offset, std::string& out) const;
+
+private:
+    std::vector<char> buffer;
+    size_t head;       // Where the next byte goes
+    size_t length;     // Bytes held, at most buffer.size()
+    uint64_t endOffset;
+};
+
+// Role of this node and its replication stream. A primary serializes every
+// write into the backlog and onto its replicas' output. A replica applies its
+// primary's stream and feeds the same bytes into its own backlog, keeping the
+// primary's replication id and offsets, so it can answer PSYNC itself
+class Replication {
+public:
+    static constexpr size_t BACKLOG_BYTES = 1024 * 1024;
+
+    Replication();
+
+    bool isReplica() const;
+    const std::string& masterHost() const;
+    int masterPort() const;
+    // Bumped by REPLICAOF, the event loop drops a link of an older generation
+    uint64_t masterGeneration() const;
+
+    // REPLICAOF host port / REPLICAOF NO ONE
+    void setMaster(const std::string& host, int port);
+    void clearMaster();
+
+    // Primary: append a write command to the stream
+    void propagate(const std::vector<std::string>& tokens);
+    // Replica: bytes of the primary's stream that were just applied
+    void feed(const std::string& bytes);
+
+    // PSYNC from conn: registers it as a replica and returns +CONTINUE with
+    // the missing bytes, or +FULLRESYNC followed by a snapshot
+    std::string psync(RedisConnection& conn, const std::string& replid, const std::string& offset);
+    void removeReplica(RedisConnection* conn);
+
+    // Replica: the primary sent +FULLRESYNC / +CONTINUE
+    void startFromMaster(const std::string& replid, uint64_t offset);
+    void continueWithMaster(const std::string& replid);
+
+    const std::string& replicationId() const;
+    uint64_t offset() const;
+    const std::unordered_set<RedisConnection*>& replicas() const;
+
+private:
+    std::string replid;
+    ReplicationBacklog backlog;
+    std::unordered_set<RedisConnection*> replicaConns;
+
+    std::string host;
+    int port;
+    uint64_t generation;
+
+    void appendToStream(const std::string& bytes);
+};
+
+#endif
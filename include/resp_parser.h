@@ -0,0 +1,46 @@
+#ifndef RESP_PARSER_H
+#define RESP_PARSER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ParseStatus {
+    Ok,
+    Incomplete,
+    Error
+};
+
+// How the parser looks for CRLFs past the first 16 bytes of a line (which
+// covers every valid header, those are always scanned one byte at a time).
+// Auto picks the widest vector unit the CPU has, the others force one path
+// (benchmarks and equivalence checks)
+enum class RespScanner {
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+void setRespScanner(RespScanner scanner);
+// The scanner actually in use, never Auto
+RespScanner activeRespScanner();
+const char* respScannerName(RespScanner scanner);
+
+// Position of the first "\r\n" in data[from, len), npos if there is none
+size_t findCrlf(const char* data, size_t from, size_t len);
+
+// Parse one command (RESP multi bulk or inline) from input starting at pos.
+// On Ok, pos is moved past the command and tokens point into input, so
+// they are only valid until input is modified
+ParseStatus parseRespCommand(std::string_view input, size_t& pos, std::vector<std::string_view>& tokens);
+// Same, copying the tokens into the strings already in tokens so a reused
+// vector does not allocate once its strings are large enough. This is the
+// overload the server uses, because command handlers take std::string
+// arguments: every argument is still copied once, so a 64KB value costs a
+// 64KB memcpy per command. The view overload avoids that only for callers
+// that are done with the tokens before the input changes
+ParseStatus parseRespCommand(const std::string& input, size_t& pos, std::vector<std::string>& tokens);
+
+#endif
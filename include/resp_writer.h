@@ -0,0 +1,42 @@
+#ifndef RESP_WRITER_H
+#define RESP_WRITER_H
+
+#include <cstddef>
+#include <string>
+
+// Reply types whose encoding depends on the protocol a client picked with
+// HELLO: RESP2 by default, RESP3 after HELLO 3. Commands run one at a time,
+// so the version of the client whose command is running is kept here for
+// the duration of the command (ReplyProtocolScope) and the helpers use it
+// unless told otherwise. Frames for other clients (Pub/Sub messages,
+// invalidations, served blocked clients) pass the receiver's version
+int replyProtocol();
+
+class ReplyProtocolScope {
+public:
+    explicit ReplyProtocolScope(int protocol);
+    ~ReplyProtocolScope();
+    ReplyProtocolScope(const ReplyProtocolScope&) = delete;
+    ReplyProtocolScope& operator=(const ReplyProtocolScope&) = delete;
+
+private:
+    int saved;
+};
+
+std::string bulkReply(const std::string& value);
+// Missing value: $-1 / *-1 in RESP2, _ in RESP3
+std::string nullBulkReply(int protocol = replyProtocol());
+std::string nullArrayReply(int protocol = replyProtocol());
+// Headers, followed by the elements (key then value for maps). RESP2 sends
+// maps as flat arrays and sets as arrays
+std::string mapHeader(size_t pairs, int protocol = replyProtocol());
+std::string setHeader(size_t count, int protocol = replyProtocol());
+// Out of band frames: Pub/Sub messages and invalidations. In RESP2 they are
+// arrays only a subscribed connection can tell apart from replies
+std::string pushHeader(size_t count, int protocol = replyProtocol());
+// Bulk string in RESP2
+std::string doubleReply(double value, int protocol = replyProtocol());
+// :1 / :0 in RESP2
+std::string boolReply(bool value, int protocol = replyProtocol());
+
+#endif
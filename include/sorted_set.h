@@ -0,0 +1,101 @@
+#ifndef SORTED_SET_H
+#define SORTED_SET_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Score interval used by ZRANGEBYSCORE, ex flags make a bound exclusive
+struct ZRangeSpec {
+    double min;
+    double max;
+    bool minex;
+    bool maxex;
+};
+
+// Shortest representation of score that parses back to the same double
+std::string formatScore(double score);
+
+// Sorted set value. Small sets are a sorted vector of (score, member), larger
+// ones a skiplist with span counters (O(log n) rank) plus a member -> score map
+class SortedSet {
+public:
+    using Entry = std::pair<std::string, double>;
+
+    SortedSet();
+    ~SortedSet();
+    SortedSet(SortedSet&& other) noexcept;
+    SortedSet& operator=(SortedSet&& other) noexcept;
+    SortedSet(const SortedSet&) = delete;
+    SortedSet& operator=(const SortedSet&) = delete;
+
+    size_t size() const;
+    bool isCompact() const;
+    // Estimated bytes held, see MEMORY USAGE. samples members are measured
+    // and the rest extrapolated, 0 measures all
+    size_t memoryUsage(size_t samples) const;
+
+    // Insert member or update its score, returns true if the member is new
+    bool add(const std::string& member, double score);
+    bool remove(const std::string& member);
+    bool score(const std::string& member, double& score) const;
+
+    // 0 based rank, -1 if the member does not exist
+    long rank(const std::string& member, bool reverse) const;
+
+    // start and stop are inclusive, already normalised to [0, size)
+    std::vector<Entry> rangeByRank(size_t start, size_t stop, bool reverse) const;
+
+    // count < 0 means no limit
+    std::vector<Entry> rangeByScore(const ZRangeSpec& range, size_t offset, long count, bool reverse) const;
+
+private:
+    struct Node;
+    struct Level {
+        Node* forward;
+        size_t span;
+    };
+    // Levels are allocated inline after the node, one allocation per member
+    struct Node {
+        double score;
+        Node* backward;
+        std::string member;
+        int height;
+        Level level[1];
+    };
+
+    static constexpr size_t COMPACT_MAX_ENTRIES = 128;
+    static constexpr size_t COMPACT_MAX_VALUE = 64;
+    static constexpr int SKIPLIST_MAXLEVEL = 32;
+
+    // Compact encoding, sorted by (score, member)
+    bool compactEncoded;
+    std::vector<std::pair<double, std::string>> compact;
+
+    // Skiplist encoding
+    Node* header;
+    Node* tail;
+    size_t length;
+    int level;
+    std::unordered_map<std::string, double> dict;
+
+    void convertToSkiplist();
+    void release();
+
+    static Node* createNode(int height, double score, const std::string& member);
+    static void freeNode(Node* node);
+    static int randomLevel();
+    static bool nodeBefore(const Node* node, double score, const std::string& member);
+
+    Node* slInsert(double score, const std::string& member);
+    bool slDelete(double score, const std::string& member);
+    void slDeleteNode(Node* node, Node** update);
+    // Ranks are 1 based inside the skiplist, 0 means not found
+    size_t slRank(double score, const std::string& member) const;
+    Node* slNodeByRank(size_t rank) const;
+    Node* slFirstInRange(const ZRangeSpec& range) const;
+    Node* slLastInRange(const ZRangeSpec& range) const;
+};
+
+#endif
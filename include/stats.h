@@ -0,0 +1,106 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Command latencies in nanoseconds with an HDR layout: 2 significant digits
+// from 1ns up to ~68s, so p99.9 is as exact as p50
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_HALF_COUNT_MAGNITUDE = 7;
+    static constexpr uint64_t SUB_BUCKET_HALF_COUNT = 1ULL << SUB_BUCKET_HALF_COUNT_MAGNITUDE;
+    static constexpr uint64_t SUB_BUCKET_MASK = 2 * SUB_BUCKET_HALF_COUNT - 1;
+    static constexpr uint64_t HIGHEST = 1ULL << 36;
+    // One bucket per power of two above the first 256 values, plus one
+    static constexpr size_t COUNTS = (36 - 8 + 3) * SUB_BUCKET_HALF_COUNT;
+
+    // Only the owning thread records, readers may run on any thread
+    void record(uint64_t nanos);
+    void addTo(std::vector<uint64_t>& counts) const;
+
+    // Highest value equivalent to the recorded ones at percentile (0..100)
+    static uint64_t valueAtPercentile(const std::vector<uint64_t>& counts, double percentile);
+
+private:
+    std::array<std::atomic<uint64_t>, COUNTS> counts;
+
+    static size_t indexOf(uint64_t value);
+    static uint64_t highestEquivalent(size_t index);
+};
+
+// Per command call counts and latencies. Every thread that runs commands
+// records into its own slots, plain relaxed loads and stores with a single
+// writer each, so recording never takes a lock or a locked instruction.
+// INFO sums the slots of every thread when it is asked for
+class CommandStats {
+public:
+    static CommandStats& getInstance();
+
+    // Index of cmd (upper case) in the command table, -1 for unknown commands
+    static int commandId(const std::string& cmd);
+
+    void record(int id, uint64_t nanos, bool failed);
+    // Refused before running: redirected, or a write on a replica
+    void recordRejected(int id);
+
+    uint64_t totalCalls();
+    // INFO commandstats / latencystats sections, commands never called are skipped
+    std::string commandStatsInfo();
+    std::string latencyStatsInfo();
+
+private:
+    CommandStats() = default;
+    CommandStats(const CommandStats&) = delete;
+    CommandStats& operator=(const CommandStats&) = delete;
+
+    struct Counters {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> nanos;
+        std::atomic<uint64_t> failed;
+        std::atomic<uint64_t> rejected;
+        LatencyHistogram latency;
+    };
+
+    // One slot per command, allocated on the first call by the owning thread
+    struct ThreadStats {
+        std::unique_ptr<std::atomic<Counters*>[]> commands;
+    };
+
+    Counters& local(int id);
+
+    // Guards registration of a new thread and the readers walking threads
+    std::mutex threads_mutex;
+    std::vector<std::unique_ptr<ThreadStats>> threads;
+};
+
+// Counters of the event loop, read by INFO
+struct ServerStats {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    int port = 0;
+    // Event loop I/O engine in use, after any fallback
+    const char* ioEngine = "epoll";
+    std::atomic<uint64_t> connectedClients{0};
+    std::atomic<uint64_t> totalConnections{0};
+    std::atomic<uint64_t> netInputBytes{0};
+    std::atomic<uint64_t> netOutputBytes{0};
+    // Refused by maxclients, and closed for going over a buffer limit
+    std::atomic<uint64_t> rejectedConnections{0};
+    std::atomic<uint64_t> queryBufferLimitDisconnections{0};
+    std::atomic<uint64_t> outputBufferLimitDisconnections{0};
+    // I/O threads, counting the event loop. Connections whose read or write
+    // went through a threaded batch
+    size_t ioThreads = 1;
+    std::atomic<uint64_t> ioThreadedReads{0};
+    std::atomic<uint64_t> ioThreadedWrites{0};
+};
+
+ServerStats& serverStats();
+
+#endif
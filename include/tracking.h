@@ -0,0 +1,62 @@
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "redis_connection.h"
+
+// Server assisted client side caching (CLIENT TRACKING). By default the
+// keys a tracking client reads are remembered in a key -> client ids table,
+// and the first modification of such a key sends the client an
+// invalidation and forgets the key. In broadcast mode nothing is
+// remembered per read: the client registers key prefixes and hears about
+// every modified key under them. Invalidations go to the client named by
+// REDIRECT: as a push if it speaks RESP3, otherwise as a message if it is
+// subscribed to __redis__:invalidate. A RESP3 client may leave REDIRECT out
+// and get the pushes on its own connection
+class Tracking {
+public:
+    static constexpr const char* CHANNEL = "__redis__:invalidate";
+
+    // conn->tracking must already be filled in
+    void enable(RedisConnection* conn);
+    void disable(RedisConnection* conn);
+
+    // conn read keys, called after every read only command it ran
+    void rememberKeys(RedisConnection* conn, const std::vector<std::string>& keys);
+    // keys were modified by modifier (nullptr when not a client command).
+    // With flushed set the whole keyspace went away
+    void invalidate(const std::vector<std::string>& keys, bool flushed, const RedisConnection* modifier);
+
+    void onConnectionClosed(RedisConnection* conn);
+
+    // Tracking is on for at least one client
+    bool active() const;
+    size_t clientCount() const;
+    size_t keyCount() const;
+    size_t itemCount() const;
+    size_t prefixCount() const;
+
+private:
+    // Every client with tracking on, by id
+    std::unordered_map<uint64_t, RedisConnection*> clients;
+    // Default mode: clients that may cache each key
+    std::unordered_map<std::string, std::unordered_set<uint64_t>> table;
+    size_t items = 0;
+    // Broadcast mode: clients per registered prefix ("" for every key)
+    std::map<std::string, std::unordered_set<uint64_t>> prefixes;
+
+    // Keep the table within tracking-table-max-keys by invalidating keys
+    // ahead of time
+    void evictKeys();
+    // Queue one invalidation message for client, a null key list means
+    // everything
+    void send(uint64_t clientId, const std::vector<std::string>* keys);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+
+// One completion, as posted by the kernel
+struct UringCompletion {
+    uint64_t userData;
+    int32_t res;
+    uint32_t flags;
+    // Multishot operations stay armed while more is set
+    bool more() const;
+    // Provided buffer the data landed in, when hasBuffer()
+    bool hasBuffer() const;
+    uint16_t bufferId() const;
+};
+
+// Minimal io_uring ring driven through the raw syscalls: a submission and a
+// completion queue, plus a provided buffer ring that multishot recv picks
+// its buffers from. Owned by the event loop thread. Without kernel headers
+// for io_uring every call fails and the server stays on epoll
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Set up the rings and check the kernel supports what the server uses
+    // (multishot accept and recv, buffer rings, timed waits). On failure
+    // error says what is missing
+    bool init(unsigned entries, unsigned bufferCount, size_t bufferSize, std::string& error);
+
+    // Queue operations, false when the submission queue is full even after
+    // submitting what it holds
+    bool prepAcceptMultishot(int fd, uint64_t userData);
+    bool prepRecvMultishot(int fd, uint64_t userData);
+    bool prepSendmsg(int fd, const msghdr* msg, uint64_t userData);
+    bool prepPollOut(int fd, uint64_t userData);
+
+    // Submit everything queued in one syscall and wait for a completion or
+    // timeoutMs (-1 waits forever). Returns a negative errno on failure,
+    // -ETIME on timeout
+    int submitAndWait(int timeoutMs);
+
+    // Pop up to max completions into out, returns how many
+    size_t takeCompletions(UringCompletion* out, size_t max);
+
+    const char* buffer(uint16_t id) const;
+    // Hand a provided buffer back to the kernel once its data is copied
+    void recycleBuffer(uint16_t id);
+
+private:
+    struct Ring;
+    Ring* ring = nullptr;
+
+    // Next free submission entry, zeroed. When the queue is full what it
+    // holds is submitted first, nullptr if that did not make room
+    void* nextEntry();
+};
+
+#endif
@@ -1,4 +1,15 @@
 #include "CLI.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <random>
+#include <unistd.h>
 #include <vector>
 
 // Helper function to remove whitespaces
@@ -9,11 +20,33 @@ static std::string trim(const std::string &s) {
     return s.substr(start, end - start + 1);
 }
 
-CLI::CLI(const std::string &host, int port)
-    : host(host), port(port), redisClient(host, port) {}
+CLI::CLI(const std::string &host, int port, bool clusterMode)
+    : host(host), port(port), redisClient(host, port), clusterMode(clusterMode), router(host, port),
+      rawOutput(!isatty(STDOUT_FILENO)) {}
+
+void CLI::setRawOutput(bool raw) {
+    rawOutput = raw;
+}
+
+bool CLI::runCommand(const std::vector<std::string>& args) {
+    if (clusterMode) {
+        std::cout << ResponseParser::formatReply(router.execute(args), rawOutput) << "\n";
+        return true;
+    }
+
+    std::string command = CommandHandler::buildRESPCommands(args);
+    if (!redisClient.sendCommand(command)) {
+        return false;
+    }
+    // Printed while it is read, so huge replies start showing at once
+    if (!redisClient.replies().streamReply(std::cout, rawOutput)) {
+        std::cout << "\nError: no response or connection close\n";
+    }
+    return true;
+}
 
 void CLI::run(const std::vector<std::string>& args) {
-    if (!redisClient.connectToServer()) {
+    if (clusterMode ? !router.connect() : !redisClient.connectToServer()) {
         return;
     }
 
@@ -21,12 +54,27 @@ void CLI::run(const std::vector<std::string>& args) {
         executeCommand(args);
     }
     
-    std::cout << "Connection successful at " << redisClient.getSocketFD() << "\n"; 
+    // No prompts for scripted input, one round trip per batch of commands
+    if (!clusterMode && !isatty(STDIN_FILENO)) {
+        runBatch();
+        redisClient.disconnect();
+        return;
+    }
+
+    if (clusterMode) {
+        std::cout << "Connection successful to cluster node " << router.currentNode() << "\n";
+    } else {
+        std::cout << "Connection successful at " << redisClient.getSocketFD() << "\n"; 
+    }
     std::string host = "127.0.0.1";
     int port = 6379;
 
     while (true) {
-        std::cout << host << ":" << port << "> ";
+        if (clusterMode) {
+            std::cout << router.currentNode() << "> ";
+        } else {
+            std::cout << host << ":" << port << "> ";
+        }
         std::cout.flush();
         std::string line;
         if (!std::getline(std::cin, line)) break;
@@ -47,14 +95,10 @@ void CLI::run(const std::vector<std::string>& args) {
         std::vector<std::string> args = CommandHandler::splitCommand(line);
         if (args.empty()) continue;
 
-        std::string command = CommandHandler::buildRESPCommands(args);
-        if (!redisClient.sendCommand(command)) {
+        if (!runCommand(args)) {
             std::cerr << "(Error) Failed to send command\n";
             break;
         }
-
-        std::string response = ResponseParser::parseResponse(redisClient.getSocketFD());
-        std::cout << response << "\n";
     }
     redisClient.disconnect();
 }
@@ -62,13 +106,302 @@ void CLI::run(const std::vector<std::string>& args) {
 void CLI::executeCommand(const std::vector<std::string>& args) {
     if (args.empty()) return;
 
-    std::string command = CommandHandler::buildRESPCommands(args);
-    if (!redisClient.sendCommand(command)) {
+    if (!runCommand(args)) {
         std::cerr << "(Error) failed to send command.\n";
-        return;
+    }
+}
+void CLI::runBatch() {
+    std::string payload;
+    size_t pending = 0;
+
+    auto flush = [&]() {
+        if (pending == 0) return true;
+        if (!redisClient.sendCommand(payload)) {
+            std::cerr << "(Error) Failed to send command\n";
+            return false;
+        }
+        for (; pending > 0; pending--) {
+            if (!redisClient.replies().streamReply(std::cout, rawOutput)) {
+                std::cerr << "Error: no response or connection close\n";
+                return false;
+            }
+        }
+        payload.clear();
+        return true;
+    };
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        line = trim(line);
+        if (line.empty()) continue;
+        if (line == "quit") break;
+
+        std::vector<std::string> args = CommandHandler::splitCommand(line);
+        if (args.empty()) continue;
+        payload += CommandHandler::buildRESPCommands(args);
+        if (++pending == BATCH_COMMANDS && !flush()) return;
+    }
+    flush();
+}
+
+static std::string randomMarker() {
+    static const char hex[] = "0123456789abcdef";
+    std::random_device rd;
+    std::string marker(20, '0');
+    for (char& c : marker) c = hex[rd() & 0xf];
+    return marker;
+}
+
+int CLI::runPipe(int timeoutSeconds) {
+    if (!redisClient.connectToServer()) return 1;
+    int fd = redisClient.getSocketFD();
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Once stdin is exhausted an ECHO of a random marker is sent, its reply
+    // is the last one
+    std::string marker = randomMarker();
+    // Either a bulk or a simple string depending on the server
+    std::string markerBulk = "$" + std::to_string(marker.size()) + "\r\n" + marker + "\r\n";
+    std::string markerStatus = "+" + marker + "\r\n";
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now(), lastReply = start;
+    std::string out, in;
+    size_t outPos = 0;
+    bool stdinDone = false, markerSent = false, done = false;
+    uint64_t replies = 0, errors = 0;
+    std::vector<char> chunk(64 * 1024);
+
+    while (!done) {
+        // Refill from stdin only once the previous chunk is on the wire
+        if (outPos == out.size()) {
+            out.clear();
+            outPos = 0;
+            while (!stdinDone) {
+                ssize_t got = read(STDIN_FILENO, chunk.data(), chunk.size());
+                if (got > 0) {
+                    out.append(chunk.data(), got);
+                    break;
+                }
+                if (got < 0 && errno == EINTR) continue;
+                if (got < 0) std::cerr << "Error reading from stdin: " << std::strerror(errno) << "\n";
+                stdinDone = true;
+            }
+            if (stdinDone && !markerSent) {
+                out += CommandHandler::buildRESPCommands({"ECHO", marker});
+                markerSent = true;
+                std::cerr << "All data transferred. Waiting for the last reply...\n";
+            }
+        }
+
+        pollfd pfd{fd, static_cast<short>(POLLIN | (outPos < out.size() ? POLLOUT : 0)), 0};
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "Error polling the connection: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+
+        if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) {
+            while (true) {
+                ssize_t got = recv(fd, chunk.data(), chunk.size(), 0);
+                if (got > 0) {
+                    in.append(chunk.data(), got);
+                    lastReply = Clock::now();
+                    continue;
+                }
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+                std::cerr << "Error reading from the server: connection lost\n";
+                return 1;
+            }
+
+            size_t pos = 0;
+            while (size_t len = ResponseParser::replyLength(in, pos)) {
+                if (markerSent && (in.compare(pos, len, markerBulk) == 0 || in.compare(pos, len, markerStatus) == 0)) {
+                    done = true;
+                } else {
+                    replies++;
+                    if (in[pos] == '-') {
+                        errors++;
+                        std::cerr << in.substr(pos + 1, in.find("\r\n", pos) - pos - 1) << "\n";
+                    }
+                }
+                pos += len;
+            }
+            in.erase(0, pos);
+        }
+
+        if (pfd.revents & POLLOUT) {
+            ssize_t sent = send(fd, out.data() + outPos, out.size() - outPos, MSG_NOSIGNAL);
+            if (sent > 0) {
+                outPos += sent;
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error writing to the server: " << std::strerror(errno) << "\n";
+                return 1;
+            }
+        }
+
+        if (markerSent && timeoutSeconds > 0 && Clock::now() - lastReply > std::chrono::seconds(timeoutSeconds)) {
+            std::cerr << "No replies for " << timeoutSeconds << " seconds: exiting.\n";
+            std::cerr << "errors: " << errors << ", replies: " << replies << "\n";
+            return 1;
+        }
     }
 
-    // Parse and print response 
-    std::string response = ResponseParser::parseResponse(redisClient.getSocketFD());
-    std::cout << response << "\n";
-}
\ No newline at end of file
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cerr << "Last reply received from server.\n";
+    std::cerr << "errors: " << errors << ", replies: " << replies << "\n";
+    std::cerr << "transferred in " << seconds << "s, " << static_cast<uint64_t>(replies / std::max(seconds, 1e-9))
+              << " commands/sec\n";
+    redisClient.disconnect();
+    return errors > 0 ? 1 : 0;
+}
+
+std::vector<RespReply> CLI::pipeline(const std::vector<std::vector<std::string>>& commands) {
+    std::string payload;
+    for (const auto& command : commands) payload += CommandHandler::buildRESPCommands(command);
+    std::vector<RespReply> replies;
+    if (!redisClient.sendCommand(payload)) return replies;
+    for (size_t i = 0; i < commands.size(); i++) {
+        RespReply reply = redisClient.replies().readReply();
+        if (reply.type == 0) return {};
+        replies.push_back(std::move(reply));
+    }
+    return replies;
+}
+
+int CLI::runKeyStats(bool byMemory, int memorySamples) {
+    if (!redisClient.connectToServer()) return 1;
+
+    // Element count command and unit of each type
+    static const std::map<std::string, std::pair<std::string, std::string>> sizeCommands = {
+        {"string", {"STRLEN", "bytes"}}, {"list", {"LLEN", "items"}}, {"hash", {"HLEN", "fields"}},
+        {"set", {"SCARD", "members"}}, {"zset", {"ZCARD", "members"}},
+    };
+    struct TypeStats {
+        uint64_t keys = 0;
+        uint64_t total = 0;
+        std::string biggest;
+        uint64_t biggestSize = 0;
+    };
+    std::map<std::string, TypeStats> types;
+    uint64_t sampled = 0, keyBytes = 0;
+
+    std::cout << "# Scanning the entire keyspace to find the biggest keys" << (byMemory ? " by memory usage" : "")
+              << " as well as\n# average sizes per key type.\n\n";
+
+    std::string cursor = "0";
+    do {
+        std::vector<RespReply> page = pipeline({{"SCAN", cursor, "COUNT", std::to_string(SCAN_BATCH)}});
+        if (page.empty() || page[0].type != '*' || page[0].elements.size() != 2) {
+            std::cerr << "Error: SCAN failed" << (page.empty() ? "" : ": " + page[0].str) << "\n";
+            return 1;
+        }
+        cursor = page[0].elements[0].str;
+        std::vector<std::string> keys;
+        for (const auto& key : page[0].elements[1].elements) keys.push_back(key.str);
+        if (keys.empty()) continue;
+
+        // One round trip for the types, one for the sizes
+        std::vector<std::vector<std::string>> typeCommands;
+        for (const auto& key : keys) typeCommands.push_back({"TYPE", key});
+        std::vector<RespReply> typeReplies = pipeline(typeCommands);
+        if (typeReplies.size() != keys.size()) {
+            std::cerr << "Error: connection lost\n";
+            return 1;
+        }
+
+        std::vector<std::vector<std::string>> sizeCommandList;
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto known = sizeCommands.find(typeReplies[i].str);
+            if (byMemory) {
+                sizeCommandList.push_back({"MEMORY", "USAGE", keys[i], "SAMPLES", std::to_string(memorySamples)});
+            } else {
+                // Deleted meanwhile or of a type we do not size: PING keeps the replies aligned
+                sizeCommandList.push_back(known != sizeCommands.end() ? std::vector<std::string>{known->second.first, keys[i]}
+                                                                      : std::vector<std::string>{"PING"});
+            }
+        }
+        std::vector<RespReply> sizeReplies = pipeline(sizeCommandList);
+        if (sizeReplies.size() != keys.size()) {
+            std::cerr << "Error: connection lost\n";
+            return 1;
+        }
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            const std::string& type = typeReplies[i].str;
+            if (type == "none" || sizeReplies[i].type != ':') continue;
+            uint64_t size = std::strtoull(sizeReplies[i].str.c_str(), nullptr, 10);
+            TypeStats& stats = types[type];
+            stats.keys++;
+            stats.total += size;
+            sampled++;
+            keyBytes += keys[i].size();
+            if (stats.biggest.empty() || size > stats.biggestSize) {
+                stats.biggest = keys[i];
+                stats.biggestSize = size;
+                auto known = sizeCommands.find(type);
+                std::string unit = byMemory || known == sizeCommands.end() ? "bytes" : known->second.second;
+                std::cout << "Biggest " << type << " found so far '\"" << keys[i] << "\"' with " << size << " " << unit
+                          << "\n";
+            }
+        }
+    } while (cursor != "0");
+
+    char avg[32];
+    std::snprintf(avg, sizeof(avg), "%.2f", sampled ? static_cast<double>(keyBytes) / sampled : 0.0);
+    std::cout << "\n-------- summary -------\n\n";
+    std::cout << "Sampled " << sampled << " keys in the keyspace!\n";
+    std::cout << "Total key length in bytes is " << keyBytes << " (avg len " << avg << ")\n\n";
+
+    for (const auto& entry : types) {
+        auto known = sizeCommands.find(entry.first);
+        std::string unit = byMemory || known == sizeCommands.end() ? "bytes" : known->second.second;
+        std::cout << "Biggest " << entry.first << " found '\"" << entry.second.biggest << "\"' has "
+                  << entry.second.biggestSize << " " << unit << "\n";
+    }
+    std::cout << "\n";
+    for (const auto& entry : types) {
+        const TypeStats& stats = entry.second;
+        auto known = sizeCommands.find(entry.first);
+        std::string unit = byMemory || known == sizeCommands.end() ? "bytes" : known->second.second;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%llu %ss with %llu %s (%.2f%% of keys, avg size %.2f)\n",
+                      static_cast<unsigned long long>(stats.keys), entry.first.c_str(),
+                      static_cast<unsigned long long>(stats.total), unit.c_str(), 100.0 * stats.keys / sampled,
+                      static_cast<double>(stats.total) / stats.keys);
+        std::cout << line;
+    }
+    redisClient.disconnect();
+    return 0;
+}
+
+int CLI::runHotKeys(int samples) {
+    if (!redisClient.connectToServer()) return 1;
+
+    std::cout << "# Sampling " << samples << " keys to find the hot keys by LFU access counter.\n\n";
+    std::vector<RespReply> replies = pipeline({{"HOTKEYS", "COUNT", std::to_string(HOT_KEYS), "SAMPLES", std::to_string(samples)},
+                                               {"CONFIG", "GET", "hotkeys-topk"}});
+    if (replies.size() != 2 || replies[0].type != '*') {
+        std::cerr << "Error: HOTKEYS failed" << (replies.empty() ? "" : ": " + replies[0].str) << "\n";
+        return 1;
+    }
+    // Key and counter pairs, hottest first
+    const auto& hot = replies[0].elements;
+    for (size_t i = 0; i + 1 < hot.size(); i += 2) {
+        std::cout << "hot key found with counter: " << hot[i + 1].str << "\tkeyname: " << hot[i].str << "\n";
+    }
+
+    // The real-time sketch has the access counts when the server keeps it
+    const auto& topk = replies[1].elements;
+    if (topk.size() == 2 && topk[1].str != "0") {
+        std::vector<RespReply> top = pipeline({{"HOTKEYS", "TOPK"}});
+        if (!top.empty() && top[0].type == '*') {
+            std::cout << "\n-------- top-K sketch -------\n\n";
+            for (size_t i = 0; i + 1 < top[0].elements.size(); i += 2) {
+                std::cout << top[0].elements[i + 1].str << " accesses\tkeyname: " << top[0].elements[i].str << "\n";
+            }
+        }
+    }
+    redisClient.disconnect();
+    return 0;
+}
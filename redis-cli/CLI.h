@@ -6,17 +6,54 @@
 #include "redis_client.h"
 #include "command_handler.h"
 #include "response_parser.h"
+#include "cluster_router.h"
 
 class CLI {
 public:
-    CLI(const std::string &host, int port);
+    // clusterMode follows -MOVED / -ASK redirects (-c)
+    CLI(const std::string &host, int port, bool clusterMode = false);
     void run(const std::vector<std::string>& args);
     void executeCommand(const std::vector<std::string>& args);
+    // Print replies as they are (--raw) instead of typed, the default when
+    // stdout is not a terminal
+    void setRawOutput(bool raw);
+
+    // --pipe: stream stdin (RESP or inline commands) to the server without
+    // waiting for replies, which are read and counted concurrently. Gives
+    // up when no reply arrives for timeoutSeconds (0 waits forever).
+    // Returns the process exit code
+    int runPipe(int timeoutSeconds);
+
+    // --bigkeys / --memkeys: SCAN the whole keyspace and report the largest
+    // key of every type, by element count (bytes for strings) or by MEMORY
+    // USAGE with memorySamples. Returns the process exit code
+    int runKeyStats(bool byMemory, int memorySamples);
+    // --hotkeys: report the hottest keys by LFU counter among samples keys
+    // sampled by the server (HOTKEYS), plus the top-K sketch if enabled
+    int runHotKeys(int samples);
 
 private:
     std::string host;
     int port;
     RedisClient redisClient;
+    bool clusterMode;
+    ClusterRouter router;
+    bool rawOutput;
+
+    // Commands sent per round trip when stdin is not a terminal
+    static constexpr size_t BATCH_COMMANDS = 1000;
+    // SCAN COUNT of --bigkeys / --memkeys
+    static constexpr int SCAN_BATCH = 100;
+    // Keys listed by --hotkeys
+    static constexpr int HOT_KEYS = 16;
+
+    // Send one command and print its reply, false when it could not be sent
+    bool runCommand(const std::vector<std::string>& args);
+    // Commands read from a pipe or file: sent in batches, replies printed in order
+    void runBatch();
+    // Send commands in one write and read one reply per command, empty on
+    // a connection error
+    std::vector<RespReply> pipeline(const std::vector<std::vector<std::string>>& commands);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "async_client.h"
+#include "command_handler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+AsyncRedisClient::AsyncRedisClient(const std::string& host, int port) : host(host), port(port) {}
+
+AsyncRedisClient::~AsyncRedisClient() {
+    stop();
+}
+
+bool AsyncRedisClient::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped) return false;
+    }
+    if (running) return connected();
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || wakefd < 0) {
+        if (epfd >= 0) close(epfd);
+        if (wakefd >= 0) close(wakefd);
+        epfd = wakefd = -1;
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+    bool ok = connectSocket();
+    running = true;
+    ioThread = std::thread(&AsyncRedisClient::ioLoop, this);
+    return ok;
+}
+
+void AsyncRedisClient::stop() {
+    bool wasRunning;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        wasRunning = running;
+        running = false;
+    }
+    if (wasRunning) {
+        wake();
+        ioThread.join();
+        if (sockfd != -1) close(sockfd);
+        close(epfd);
+        close(wakefd);
+        sockfd = epfd = wakefd = -1;
+        isConnected = false;
+    }
+
+    std::deque<Request> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed.swap(requests);
+        out.clear();
+        written = queued;
+    }
+    for (auto& request : failed) {
+        if (request.callback) request.callback(RespReply());
+    }
+}
+
+void AsyncRedisClient::setPushHandler(Callback handler) {
+    pushHandler = std::move(handler);
+}
+
+void AsyncRedisClient::setConnectionHandler(ConnectionCallback handler) {
+    connectionHandler = std::move(handler);
+}
+
+void AsyncRedisClient::command(const std::vector<std::string>& args, Callback callback) {
+    commandRaw(CommandHandler::buildRESPCommands(args), std::move(callback));
+}
+
+std::future<RespReply> AsyncRedisClient::command(const std::vector<std::string>& args) {
+    auto promise = std::make_shared<std::promise<RespReply>>();
+    std::future<RespReply> reply = promise->get_future();
+    command(args, [promise](RespReply r) { promise->set_value(std::move(r)); });
+    return reply;
+}
+
+void AsyncRedisClient::commandRaw(const std::string& resp, Callback callback) {
+    bool accepted = false;
+    bool wasIdle = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopped) {
+            accepted = true;
+            wasIdle = out.empty();
+            requests.push_back({queued, std::move(callback)});
+            queued += resp.size();
+            out += resp;
+        }
+    }
+    // Stopped: nothing will ever answer
+    if (!accepted) {
+        if (callback) callback(RespReply());
+        return;
+    }
+    // The I/O thread only needs a nudge when the queue was empty, later
+    // commands are picked up by the same write. Before start() commands
+    // just queue up
+    if (wasIdle && running) wake();
+}
+
+bool AsyncRedisClient::connected() const {
+    return isConnected;
+}
+
+size_t AsyncRedisClient::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return requests.size();
+}
+
+void AsyncRedisClient::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wakefd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Wait for a non-blocking connect to finish, false on error or timeout
+static bool waitConnected(int fd, int timeoutMs) {
+    pollfd pfd{fd, POLLOUT, 0};
+    if (poll(&pfd, 1, timeoutMs) != 1) return false;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+bool AsyncRedisClient::connectSocket() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) return false;
+
+    int fd = -1;
+    for (addrinfo* p = res; p != nullptr; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        if (errno == EINPROGRESS && waitConnected(fd, CONNECT_TIMEOUT_MS)) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd == -1) return false;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+    sockfd = fd;
+    writeInterest = false;
+    in.clear();
+    isConnected = true;
+    if (connectionHandler) connectionHandler(true);
+    return true;
+}
+
+void AsyncRedisClient::dropConnection() {
+    close(sockfd);
+    sockfd = -1;
+    isConnected = false;
+    in.clear();
+
+    std::vector<Callback> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!requests.empty() && requests.front().start < written) {
+            failed.push_back(std::move(requests.front().callback));
+            requests.pop_front();
+        }
+        // Resend from the first request that had not started, the tail of a
+        // partly written one is dropped
+        uint64_t resume = requests.empty() ? queued : requests.front().start;
+        out.erase(0, resume - written);
+        written = resume;
+    }
+    for (auto& callback : failed) {
+        if (callback) callback(RespReply());
+    }
+    if (connectionHandler) connectionHandler(false);
+}
+
+bool AsyncRedisClient::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t sent = 0;
+    bool ok = true;
+    while (sent < out.size()) {
+        ssize_t n = send(sockfd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            ok = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            break;
+        }
+    }
+    out.erase(0, sent);
+    written += sent;
+    if (!ok) return false;
+
+    // Only wait for the socket to drain while something is left to write
+    bool wantWrite = !out.empty();
+    if (wantWrite != writeInterest) {
+        writeInterest = wantWrite;
+        epoll_event ev{};
+        ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.fd = sockfd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, sockfd, &ev);
+    }
+    return true;
+}
+
+bool AsyncRedisClient::readReplies() {
+    while (true) {
+        size_t old = in.size();
+        in.resize(old + READ_CHUNK);
+        ssize_t got = recv(sockfd, &in[old], READ_CHUNK, 0);
+        in.resize(old + std::max<ssize_t>(got, 0));
+        if (got > 0) {
+            if (static_cast<size_t>(got) < READ_CHUNK) break;
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+
+    std::vector<RespReply> replies;
+    size_t pos = 0;
+    while (true) {
+        RespReply reply;
+        size_t len = ResponseParser::parseBuffered(in, pos, reply);
+        if (len == 0) break;
+        if (len == std::string::npos) return false;
+        pos += len;
+        replies.push_back(std::move(reply));
+    }
+    in.erase(0, pos);
+    if (replies.empty()) return true;
+
+    // Replies arrive in request order, one lock for the whole batch. RESP3
+    // pushes are out of band whatever is pending, and so is anything no
+    // request waits for
+    std::vector<std::pair<bool, Callback>> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& reply : replies) {
+            if (reply.type == '>' || requests.empty()) {
+                done.emplace_back(true, nullptr);
+                continue;
+            }
+            done.emplace_back(false, std::move(requests.front().callback));
+            requests.pop_front();
+        }
+    }
+    for (size_t i = 0; i < done.size(); i++) {
+        Callback& callback = done[i].first ? pushHandler : done[i].second;
+        if (callback) callback(std::move(replies[i]));
+    }
+    return true;
+}
+
+void AsyncRedisClient::ioLoop() {
+    int backoff = RECONNECT_MIN_MS;
+    epoll_event events[2];
+    while (running) {
+        if (sockfd == -1) {
+            if (!connectSocket()) {
+                // Sleep on the wake fd so stop() does not wait for the backoff
+                epoll_wait(epfd, events, 2, backoff);
+                uint64_t count;
+                while (read(wakefd, &count, sizeof(count)) > 0) {}
+                backoff = std::min(backoff * 2, RECONNECT_MAX_MS);
+                continue;
+            }
+            backoff = RECONNECT_MIN_MS;
+        }
+
+        if (!flush()) {
+            dropConnection();
+            continue;
+        }
+
+        int n = epoll_wait(epfd, events, 2, -1);
+        for (int i = 0; i < n && sockfd != -1; i++) {
+            if (events[i].data.fd == wakefd) {
+                uint64_t count;
+                while (read(wakefd, &count, sizeof(count)) > 0) {}
+            } else if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !readReplies()) {
+                dropConnection();
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef ASYNC_CLIENT_H
+#define ASYNC_CLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "response_parser.h"
+
+// Non-blocking pipelined client for applications. Commands can be issued
+// from any thread without waiting: they are queued, written by a background
+// I/O thread as soon as the socket accepts them, and completed in order as
+// the replies arrive, so a single caller can keep thousands of requests in
+// flight. A lost connection is re-established in the background
+class AsyncRedisClient {
+public:
+    // Runs on the I/O thread and must not block. A reply of type 0 means the
+    // request was lost with its connection or the client was stopped
+    using Callback = std::function<void(RespReply)>;
+    // Runs on the I/O thread (on the caller's for the first connect in
+    // start()) each time the connection comes up or is lost
+    using ConnectionCallback = std::function<void(bool connected)>;
+
+    AsyncRedisClient(const std::string& host, int port);
+    ~AsyncRedisClient();
+
+    // Connect and start the I/O thread. False when the first attempt failed,
+    // the client keeps retrying in the background anyway
+    bool start();
+    // Stop the I/O thread and fail every outstanding request, the client
+    // can not be restarted
+    void stop();
+
+    // Both are set before start(). RESP3 pushes (after HELLO 3) and replies
+    // no request waits for, such as Pub/Sub messages on a RESP2 subscribed
+    // connection, go to the push handler
+    void setPushHandler(Callback handler);
+    void setConnectionHandler(ConnectionCallback handler);
+
+    // Commands issued before start() are sent once it connects
+    void command(const std::vector<std::string>& args, Callback callback);
+    std::future<RespReply> command(const std::vector<std::string>& args);
+    // Same, with a command already encoded as RESP
+    void commandRaw(const std::string& resp, Callback callback);
+
+    bool connected() const;
+    // Requests queued or waiting for their reply
+    size_t pending() const;
+
+private:
+    static constexpr int CONNECT_TIMEOUT_MS = 2000;
+    static constexpr int RECONNECT_MIN_MS = 100;
+    static constexpr int RECONNECT_MAX_MS = 5000;
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+
+    // Commands are numbered by their byte offsets in the output stream
+    struct Request {
+        uint64_t start;
+        Callback callback;
+    };
+
+    std::string host;
+    int port;
+    Callback pushHandler;
+    ConnectionCallback connectionHandler;
+
+    mutable std::mutex mutex;
+    // Unsent bytes, out[0] is at stream offset written
+    std::string out;
+    uint64_t written = 0;
+    uint64_t queued = 0;
+    std::deque<Request> requests;
+    bool stopped = false;
+
+    // Owned by the I/O thread
+    int sockfd = -1;
+    int epfd = -1;
+    int wakefd = -1;
+    bool writeInterest = false;
+    std::string in;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> isConnected{false};
+    std::thread ioThread;
+
+    bool connectSocket();
+    // Close the socket and fail the requests already (even partly) written:
+    // whether the server ran them is unknown. Unsent ones wait for the next
+    // connection
+    void dropConnection();
+    void ioLoop();
+    bool readReplies();
+    bool flush();
+    void wake();
+};
+
+#endif
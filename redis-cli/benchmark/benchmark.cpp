@@ -0,0 +1,366 @@
+#include "../command_handler.h"
+#include "../redis_client.h"
+#include "hdr_histogram.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Distinct prebuilt requests per test, cycled so building commands never
+// becomes the bottleneck
+static constexpr size_t REQUEST_POOL = 65536;
+static constexpr size_t READ_CHUNK = 64 * 1024;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    int clients = 50;
+    int pipeline = 1;
+    uint64_t requests = 100000;
+    double duration = 0;       // Seconds, replaces requests when set
+    uint64_t keyspace = 100000;
+    size_t valueSize = 3;
+    std::vector<std::string> tests = {"ping", "set", "get", "lpush", "lpop", "hset", "sadd", "zadd"};
+    std::string mix;           // e.g. "get=90,set=10", runs a single mixed test
+    std::string format = "text";
+    bool quiet = false;
+};
+
+struct Result {
+    std::string name;
+    uint64_t completed = 0;
+    double seconds = 0;
+    HdrHistogram latency;      // Microseconds
+};
+
+static void usage() {
+    std::cout <<
+        "Usage: my_redis_benchmark [-h host] [-p port] [-c clients] [-n requests] [-P pipeline]\n"
+        "                          [-d value size] [-r keyspace] [-t tests] [--mix cmd=weight,...]\n"
+        "                          [--duration seconds] [--csv | --json] [-q]\n\n"
+        " -c  parallel connections (default 50)\n"
+        " -n  total requests per test (default 100000)\n"
+        " -P  requests in flight per connection (default 1, no pipelining)\n"
+        " -d  value size in bytes for SET/LPUSH/HSET/SADD/ZADD (default 3)\n"
+        " -r  random keys are picked from key:0 .. key:<r-1> (default 100000)\n"
+        " -t  comma separated tests: ping,set,get,lpush,rpush,lpop,rpop,hset,hget,sadd,zadd\n"
+        " --mix       run one test with a weighted command mix, e.g. get=80,set=20\n"
+        " --duration  run each test for this many seconds instead of -n requests\n"
+        " --csv / --json  machine readable output for regression tracking\n";
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Arguments of one request of the given type against key number n
+static bool makeCommand(const std::string& type, uint64_t n, const std::string& value, std::vector<std::string>& args) {
+    std::string id = std::to_string(n);
+    if (type == "ping") args = {"PING"};
+    else if (type == "set") args = {"SET", "key:" + id, value};
+    else if (type == "get") args = {"GET", "key:" + id};
+    else if (type == "lpush") args = {"LPUSH", "list:" + id, value};
+    else if (type == "rpush") args = {"RPUSH", "list:" + id, value};
+    else if (type == "lpop") args = {"LPOP", "list:" + id};
+    else if (type == "rpop") args = {"RPOP", "list:" + id};
+    else if (type == "hset") args = {"HSET", "hash:" + id, "field:" + std::to_string(n % 100), value};
+    else if (type == "hget") args = {"HGET", "hash:" + id, "field:" + std::to_string(n % 100)};
+    else if (type == "sadd") args = {"SADD", "set:" + id, value + std::to_string(n % 1000)};
+    else if (type == "zadd") args = {"ZADD", "zset:" + id, std::to_string(n % 1000), value + std::to_string(n % 1000)};
+    else return false;
+    return true;
+}
+
+// Prebuild the RESP requests of a test. weights pairs a command type with
+// its share of the mix
+static bool buildRequests(const std::vector<std::pair<std::string, int>>& weights, const Options& opts,
+                          std::vector<std::string>& requests) {
+    std::mt19937_64 rng(42);
+    int totalWeight = 0;
+    for (const auto& w : weights) totalWeight += w.second;
+    if (totalWeight <= 0) return false;
+
+    std::string value(opts.valueSize, 'x');
+    std::vector<std::string> args;
+    requests.clear();
+    for (size_t i = 0; i < REQUEST_POOL; i++) {
+        int pick = static_cast<int>(rng() % totalWeight);
+        size_t w = 0;
+        while (pick >= weights[w].second) pick -= weights[w++].second;
+        uint64_t key = opts.keyspace ? rng() % opts.keyspace : 0;
+        if (!makeCommand(weights[w].first, key, value, args)) return false;
+        requests.push_back(CommandHandler::buildRESPCommands(args));
+    }
+    return true;
+}
+
+struct Connection {
+    std::unique_ptr<RedisClient> client;
+    int fd = -1;
+    std::string out;
+    size_t outOffset = 0;
+    std::string in;
+    std::deque<Clock::time_point> sentAt;
+    bool writeInterest = false;
+};
+
+static bool runTest(const std::string& name, const std::vector<std::string>& requests, const Options& opts, Result& result) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0) return false;
+
+    std::vector<Connection> conns(opts.clients);
+    for (size_t i = 0; i < conns.size(); i++) {
+        Connection& c = conns[i];
+        c.client = std::make_unique<RedisClient>(opts.host, opts.port);
+        if (!c.client->connectToServer()) {
+            close(epfd);
+            return false;
+        }
+        c.fd = c.client->getSocketFD();
+        fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL, 0) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    result.name = name;
+    result.completed = 0;
+    result.latency = HdrHistogram();
+
+    uint64_t issued = 0;
+    size_t next = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.duration));
+    auto moreToSend = [&](Clock::time_point now) {
+        return opts.duration > 0 ? now < deadline : issued < opts.requests;
+    };
+
+    // Keep every connection at its pipeline depth until the test is over
+    auto refill = [&](Connection& c, Clock::time_point now) {
+        while (static_cast<int>(c.sentAt.size()) < opts.pipeline && moreToSend(now)) {
+            c.out += requests[next];
+            next = (next + 1) % requests.size();
+            c.sentAt.push_back(now);
+            issued++;
+        }
+        while (c.outOffset < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.outOffset, c.out.size() - c.outOffset, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            c.outOffset += n;
+        }
+        if (c.outOffset == c.out.size()) {
+            c.out.clear();
+            c.outOffset = 0;
+        }
+        bool wantWrite = !c.out.empty();
+        if (wantWrite != c.writeInterest) {
+            c.writeInterest = wantWrite;
+            epoll_event ev{};
+            ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.u64 = &c - conns.data();
+            epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+        }
+    };
+
+    for (auto& c : conns) refill(c, start);
+
+    uint64_t outstanding = issued;
+    std::vector<epoll_event> events(conns.size());
+    char buffer[READ_CHUNK];
+    bool failed = false;
+    while (outstanding > 0 && !failed) {
+        int n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 1000);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int e = 0; e < n; e++) {
+            Connection& c = conns[events[e].data.u64];
+            if (events[e].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                ssize_t got = recv(c.fd, buffer, sizeof(buffer), 0);
+                if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+                    std::cerr << "Connection lost during " << name << "\n";
+                    failed = true;
+                    break;
+                }
+                if (got > 0) c.in.append(buffer, got);
+            }
+
+            // Replies come back in order, each one completes the oldest request
+            Clock::time_point now = Clock::now();
+            size_t pos = 0;
+            while (!c.sentAt.empty()) {
+                size_t len = ResponseParser::replyLength(c.in, pos);
+                if (len == 0) break;
+                pos += len;
+                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now - c.sentAt.front()).count();
+                result.latency.record(std::max<int64_t>(micros, 1));
+                c.sentAt.pop_front();
+                result.completed++;
+                outstanding--;
+            }
+            c.in.erase(0, pos);
+
+            uint64_t before = issued;
+            refill(c, now);
+            outstanding += issued - before;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    close(epfd);
+    return !failed;
+}
+
+static std::string upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+static void printResult(const Result& r, const Options& opts) {
+    double rps = r.seconds > 0 ? r.completed / r.seconds : 0;
+    const HdrHistogram& h = r.latency;
+    if (opts.quiet) {
+        std::cout << r.name << ": " << std::fixed << std::setprecision(2) << rps << " requests per second, p50="
+                  << h.valueAtPercentile(50) << " usec\n";
+        return;
+    }
+    std::cout << "====== " << r.name << " ======\n"
+              << "  " << r.completed << " requests completed in " << std::fixed << std::setprecision(2) << r.seconds << " seconds\n"
+              << "  " << opts.clients << " parallel clients, pipeline " << opts.pipeline << ", "
+              << opts.valueSize << " bytes payload, keyspace " << opts.keyspace << "\n\n"
+              << "  throughput: " << rps << " requests per second\n"
+              << "  latency (usec): avg " << h.mean() << " min " << h.min()
+              << " p50 " << h.valueAtPercentile(50) << " p99 " << h.valueAtPercentile(99)
+              << " p99.9 " << h.valueAtPercentile(99.9) << " max " << h.max() << "\n\n";
+}
+
+static void printCsv(const std::vector<Result>& results) {
+    std::cout << "\"test\",\"rps\",\"avg_latency_us\",\"min_latency_us\",\"p50_latency_us\",\"p99_latency_us\",\"p999_latency_us\",\"max_latency_us\"\n";
+    for (const auto& r : results) {
+        const HdrHistogram& h = r.latency;
+        std::cout << std::fixed << std::setprecision(2) << "\"" << r.name << "\",\"" << (r.seconds > 0 ? r.completed / r.seconds : 0)
+                  << "\",\"" << h.mean() << "\",\"" << h.min() << "\",\"" << h.valueAtPercentile(50) << "\",\""
+                  << h.valueAtPercentile(99) << "\",\"" << h.valueAtPercentile(99.9) << "\",\"" << h.max() << "\"\n";
+    }
+}
+
+static void printJson(const std::vector<Result>& results, const Options& opts) {
+    std::cout << "{\n  \"clients\": " << opts.clients << ",\n  \"pipeline\": " << opts.pipeline
+              << ",\n  \"value_size\": " << opts.valueSize << ",\n  \"keyspace\": " << opts.keyspace << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        const HdrHistogram& h = r.latency;
+        std::cout << std::fixed << std::setprecision(2)
+                  << "    {\"test\": \"" << r.name << "\", \"requests\": " << r.completed
+                  << ", \"seconds\": " << r.seconds << ", \"rps\": " << (r.seconds > 0 ? r.completed / r.seconds : 0)
+                  << ", \"latency_us\": {\"avg\": " << h.mean() << ", \"min\": " << h.min()
+                  << ", \"p50\": " << h.valueAtPercentile(50) << ", \"p99\": " << h.valueAtPercentile(99)
+                  << ", \"p999\": " << h.valueAtPercentile(99.9) << ", \"max\": " << h.max() << "}}"
+                  << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "-h" && hasValue) opts.host = argv[++i];
+            else if (arg == "-p" && hasValue) opts.port = std::stoi(argv[++i]);
+            else if (arg == "-c" && hasValue) opts.clients = std::stoi(argv[++i]);
+            else if (arg == "-n" && hasValue) opts.requests = std::stoull(argv[++i]);
+            else if (arg == "-P" && hasValue) opts.pipeline = std::stoi(argv[++i]);
+            else if (arg == "-d" && hasValue) opts.valueSize = std::stoul(argv[++i]);
+            else if (arg == "-r" && hasValue) opts.keyspace = std::stoull(argv[++i]);
+            else if (arg == "-t" && hasValue) opts.tests = splitList(argv[++i]);
+            else if (arg == "--mix" && hasValue) opts.mix = argv[++i];
+            else if (arg == "--duration" && hasValue) opts.duration = std::stod(argv[++i]);
+            else if (arg == "--csv") opts.format = "csv";
+            else if (arg == "--json") opts.format = "json";
+            else if (arg == "-q") opts.quiet = true;
+            else {
+                usage();
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+    } catch (const std::exception&) {
+        usage();
+        return 1;
+    }
+    if (opts.clients <= 0 || opts.pipeline <= 0) {
+        usage();
+        return 1;
+    }
+
+    // Each entry is one test: its name and the weighted commands it sends
+    std::vector<std::pair<std::string, std::vector<std::pair<std::string, int>>>> plan;
+    if (!opts.mix.empty()) {
+        std::vector<std::pair<std::string, int>> weights;
+        for (const auto& item : splitList(opts.mix)) {
+            size_t eq = item.find('=');
+            std::string type = item.substr(0, eq);
+            int weight = 1;
+            try {
+                if (eq != std::string::npos) weight = std::stoi(item.substr(eq + 1));
+            } catch (const std::exception&) {
+                weight = -1;
+            }
+            if (weight < 0) {
+                std::cerr << "Invalid weight in --mix: " << item << "\n";
+                return 1;
+            }
+            weights.emplace_back(type, weight);
+        }
+        plan.emplace_back("MIX " + upper(opts.mix), weights);
+    } else {
+        for (const auto& test : opts.tests) {
+            plan.emplace_back(upper(test), std::vector<std::pair<std::string, int>>{{test, 1}});
+        }
+    }
+
+    std::vector<Result> results;
+    for (const auto& test : plan) {
+        std::vector<std::string> requests;
+        if (!buildRequests(test.second, opts, requests)) {
+            std::cerr << "Unknown test in " << test.first << "\n";
+            return 1;
+        }
+        Result result;
+        if (!runTest(test.first, requests, opts, result)) {
+            std::cerr << "Benchmark " << test.first << " failed, is the server running on "
+                      << opts.host << ":" << opts.port << "?\n";
+            return 1;
+        }
+        if (opts.format == "text") printResult(result, opts);
+        results.push_back(std::move(result));
+    }
+
+    if (opts.format == "csv") printCsv(results);
+    if (opts.format == "json") printJson(results, opts);
+    return 0;
+}
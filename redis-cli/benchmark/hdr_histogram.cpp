@@ -0,0 +1,88 @@
+#include "hdr_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+HdrHistogram::HdrHistogram(uint64_t highest, int significantDigits)
+    : highest(highest), total(0), minValue(UINT64_MAX), maxValue(0), sum(0) {
+    // Enough sub buckets to tell 10^digits values apart within any power of two
+    uint64_t largestSingleUnitValue = 2 * static_cast<uint64_t>(std::pow(10, significantDigits));
+    int subBucketCountMagnitude = static_cast<int>(std::ceil(std::log2(static_cast<double>(largestSingleUnitValue))));
+    subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+    subBucketHalfCount = 1ULL << subBucketHalfCountMagnitude;
+    subBucketMask = (1ULL << subBucketCountMagnitude) - 1;
+
+    // Each bucket doubles the range covered by the previous one
+    int buckets = 1;
+    uint64_t covered = 1ULL << subBucketCountMagnitude;
+    while (covered <= highest && buckets < 64 - subBucketCountMagnitude) {
+        covered <<= 1;
+        buckets++;
+    }
+    counts.assign((buckets + 1) * subBucketHalfCount, 0);
+}
+
+size_t HdrHistogram::indexOf(uint64_t value) const {
+    int bucket = (63 - __builtin_clzll(value | subBucketMask)) - subBucketHalfCountMagnitude;
+    uint64_t subBucket = value >> bucket;
+    return ((bucket + 1) << subBucketHalfCountMagnitude) + (subBucket - subBucketHalfCount);
+}
+
+uint64_t HdrHistogram::highestEquivalent(size_t index) const {
+    int bucket = static_cast<int>(index >> subBucketHalfCountMagnitude) - 1;
+    uint64_t subBucket = (index & (subBucketHalfCount - 1)) + subBucketHalfCount;
+    if (bucket < 0) {
+        subBucket -= subBucketHalfCount;
+        bucket = 0;
+    }
+    return (subBucket << bucket) + (1ULL << bucket) - 1;
+}
+
+void HdrHistogram::record(uint64_t value) {
+    value = std::min(value, highest);
+    counts[indexOf(value)]++;
+    total++;
+    sum += value;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+}
+
+void HdrHistogram::merge(const HdrHistogram& other) {
+    size_t n = std::min(counts.size(), other.counts.size());
+    for (size_t i = 0; i < n; i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+uint64_t HdrHistogram::count() const {
+    return total;
+}
+
+uint64_t HdrHistogram::min() const {
+    return total ? minValue : 0;
+}
+
+uint64_t HdrHistogram::max() const {
+    return maxValue;
+}
+
+double HdrHistogram::mean() const {
+    return total ? static_cast<double>(sum / total) : 0.0;
+}
+
+uint64_t HdrHistogram::valueAtPercentile(double percentile) const {
+    if (total == 0) return 0;
+    uint64_t wanted = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    wanted = std::max<uint64_t>(wanted, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= wanted) return std::min(highestEquivalent(i), maxValue);
+    }
+    return maxValue;
+}
@@ -0,0 +1,41 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// High dynamic range histogram: values from 1 to highest are kept with a
+// fixed number of significant digits, so p99.9 of a run with a few slow
+// outliers is as exact as p50. Recording is a couple of shifts and an add
+class HdrHistogram {
+public:
+    explicit HdrHistogram(uint64_t highest = 3600ULL * 1000 * 1000, int significantDigits = 3);
+
+    void record(uint64_t value);
+    void merge(const HdrHistogram& other);
+
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+    // Highest value equivalent to the recorded ones at percentile (0..100)
+    uint64_t valueAtPercentile(double percentile) const;
+
+private:
+    int subBucketHalfCountMagnitude;
+    uint64_t subBucketHalfCount;
+    uint64_t subBucketMask;
+    uint64_t highest;
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t minValue;
+    uint64_t maxValue;
+    long double sum;
+
+    size_t indexOf(uint64_t value) const;
+    uint64_t highestEquivalent(size_t index) const;
+};
+
+#endif
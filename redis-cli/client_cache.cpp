@@ -0,0 +1,131 @@
+#include "client_cache.h"
+
+CachingRedisClient::CachingRedisClient(const std::string& host, int port, size_t maxKeys)
+    : client(host, port), maxKeys(maxKeys) {
+    client.setPushHandler([this](RespReply push) { onPush(push); });
+    client.setConnectionHandler([this](bool up) {
+        if (up) {
+            onConnected();
+        } else {
+            onConnectionLost();
+        }
+    });
+}
+
+CachingRedisClient::~CachingRedisClient() {
+    stop();
+}
+
+bool CachingRedisClient::start() {
+    return client.start();
+}
+
+void CachingRedisClient::stop() {
+    client.stop();
+    std::lock_guard<std::mutex> lock(mutex);
+    tracking = false;
+    cache.clear();
+}
+
+void CachingRedisClient::onConnected() {
+    uint64_t startEpoch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tracking = false;
+        startEpoch = epoch;
+    }
+    // Requests left unsent by the previous connection go out first, their
+    // replies are not cached (see get)
+    client.command({"HELLO", "3"}, nullptr);
+    client.command({"CLIENT", "TRACKING", "ON"}, [this, startEpoch](RespReply reply) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (reply.type == '+' && startEpoch == epoch) tracking = true;
+    });
+}
+
+void CachingRedisClient::onConnectionLost() {
+    std::lock_guard<std::mutex> lock(mutex);
+    tracking = false;
+    epoch++;
+    cache.clear();
+}
+
+void CachingRedisClient::onPush(const RespReply& push) {
+    // ["invalidate", keys], keys is null when the server flushed
+    if (push.elements.size() != 2 || push.elements[0].str != "invalidate") return;
+    const RespReply& keys = push.elements[1];
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (keys.isNull) {
+        cache.clear();
+        return;
+    }
+    for (const auto& key : keys.elements) cache.erase(key.str);
+}
+
+void CachingRedisClient::get(const std::string& key, AsyncRedisClient::Callback callback) {
+    bool cacheable;
+    uint64_t sentEpoch;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cacheable = tracking;
+        sentEpoch = epoch;
+        auto hit = cacheable ? cache.find(key) : cache.end();
+        if (hit != cache.end()) {
+            RespReply reply = hit->second;
+            lock.unlock();
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+            if (callback) callback(std::move(reply));
+            return;
+        }
+    }
+    missCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Invalidations share the connection with the replies, so one that
+    // arrives before this reply is about an older value and the reply is
+    // safe to keep. Replies from before tracking was on, or from a lost
+    // connection, are not
+    client.command({"GET", key}, [this, key, cacheable, sentEpoch, callback](RespReply reply) {
+        if (cacheable && (reply.type == '$' || reply.type == '_')) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tracking && sentEpoch == epoch) {
+                if (cache.size() >= maxKeys && !cache.count(key)) cache.erase(cache.begin());
+                cache[key] = reply;
+            }
+        }
+        if (callback) callback(std::move(reply));
+    });
+}
+
+std::future<RespReply> CachingRedisClient::get(const std::string& key) {
+    auto promise = std::make_shared<std::promise<RespReply>>();
+    std::future<RespReply> reply = promise->get_future();
+    get(key, [promise](RespReply r) { promise->set_value(std::move(r)); });
+    return reply;
+}
+
+void CachingRedisClient::command(const std::vector<std::string>& args, AsyncRedisClient::Callback callback) {
+    client.command(args, std::move(callback));
+}
+
+std::future<RespReply> CachingRedisClient::command(const std::vector<std::string>& args) {
+    return client.command(args);
+}
+
+bool CachingRedisClient::caching() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tracking;
+}
+
+size_t CachingRedisClient::cachedKeys() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cache.size();
+}
+
+uint64_t CachingRedisClient::hits() const {
+    return hitCount.load(std::memory_order_relaxed);
+}
+
+uint64_t CachingRedisClient::misses() const {
+    return missCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,65 @@
+#ifndef CLIENT_CACHE_H
+#define CLIENT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "async_client.h"
+
+// GET with a local cache kept coherent by the server (CLIENT TRACKING).
+// The connection speaks RESP3 so the server can push an invalidation for
+// every cached key that changes on the same connection as the replies,
+// and repeated reads of hot keys never leave the process. Nothing is
+// cached while the connection is down, and the cache is dropped whenever
+// it is lost since invalidations may have been missed
+class CachingRedisClient {
+public:
+    // maxKeys bounds the cache, arbitrary keys are dropped beyond it
+    CachingRedisClient(const std::string& host, int port, size_t maxKeys = 100000);
+    ~CachingRedisClient();
+
+    // Connect, false when the first attempt failed. Caching starts once
+    // tracking is confirmed by the server
+    bool start();
+    void stop();
+
+    // A hit completes on the calling thread before returning, a miss on the
+    // I/O thread like any other command
+    void get(const std::string& key, AsyncRedisClient::Callback callback);
+    std::future<RespReply> get(const std::string& key);
+    // Everything else goes straight to the server, writes reach the cache
+    // through the invalidations they cause
+    void command(const std::vector<std::string>& args, AsyncRedisClient::Callback callback);
+    std::future<RespReply> command(const std::vector<std::string>& args);
+
+    // Tracking is on and replies are being cached
+    bool caching() const;
+    size_t cachedKeys() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    AsyncRedisClient client;
+    size_t maxKeys;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, RespReply> cache;
+    bool tracking = false;
+    // Bumped every time the connection is lost, replies to GETs sent before
+    // are not cached
+    uint64_t epoch = 0;
+
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+
+    void onConnected();
+    void onConnectionLost();
+    void onPush(const RespReply& push);
+};
+
+#endif
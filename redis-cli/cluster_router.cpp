@@ -0,0 +1,144 @@
+#include "cluster_router.h"
+#include "command_handler.h"
+
+#include <cstdint>
+#include <iostream>
+
+static constexpr unsigned int CLUSTER_SLOTS = 16384;
+
+// CRC16 XMODEM, must match the server's keyHashSlot
+static uint16_t crc16(const char* data, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= static_cast<uint16_t>(static_cast<unsigned char>(data[i]) << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+unsigned int ClusterRouter::keyHashSlot(const std::string& key) {
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (CLUSTER_SLOTS - 1);
+}
+
+static bool splitNode(const std::string& node, std::string& host, int& port) {
+    size_t colon = node.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = node.substr(0, colon);
+    try {
+        port = std::stoi(node.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+ClusterRouter::ClusterRouter(const std::string& host, int port)
+    : seed(host + ":" + std::to_string(port)), current(seed), slots(CLUSTER_SLOTS) {}
+
+bool ClusterRouter::connect() {
+    RedisClient* client = clientFor(seed);
+    if (!client) return false;
+    refreshSlots(client);
+    return true;
+}
+
+const std::string& ClusterRouter::currentNode() const {
+    return current;
+}
+
+RedisClient* ClusterRouter::clientFor(const std::string& node) {
+    auto it = clients.find(node);
+    if (it != clients.end()) return it->second.get();
+
+    std::string host;
+    int port;
+    if (!splitNode(node, host, port)) return nullptr;
+    auto client = std::make_unique<RedisClient>(host, port);
+    if (!client->connectToServer()) return nullptr;
+    RedisClient* raw = client.get();
+    clients[node] = std::move(client);
+    return raw;
+}
+
+void ClusterRouter::refreshSlots(RedisClient* client) {
+    RespReply reply = send(client, {{"CLUSTER", "SLOTS"}});
+    if (reply.type != '*') return;
+
+    // Each entry: start, end, [host, port, ...]
+    for (const auto& range : reply.elements) {
+        if (range.elements.size() < 3 || range.elements[2].elements.size() < 2) continue;
+        const auto& master = range.elements[2].elements;
+        std::string node = master[0].str + ":" + master[1].str;
+        unsigned long start = std::stoul(range.elements[0].str);
+        unsigned long end = std::stoul(range.elements[1].str);
+        for (unsigned long slot = start; slot <= end && slot < CLUSTER_SLOTS; slot++) {
+            slots[slot] = node;
+        }
+    }
+}
+
+RespReply ClusterRouter::send(RedisClient* client, const std::vector<std::vector<std::string>>& commands) {
+    std::string payload;
+    for (const auto& command : commands) {
+        payload += CommandHandler::buildRESPCommands(command);
+    }
+    if (!client->sendCommand(payload)) return RespReply();
+
+    // Only the reply to the last command matters (ASKING is always +OK)
+    RespReply reply;
+    for (size_t i = 0; i < commands.size(); i++) {
+        reply = client->replies().readReply();
+    }
+    return reply;
+}
+
+RespReply ClusterRouter::execute(const std::vector<std::string>& args) {
+    // The first argument is the key for nearly every command, keyless ones
+    // go to whichever node we talked to last
+    std::string node = current;
+    if (args.size() > 1 && !slots[keyHashSlot(args[1])].empty()) {
+        node = slots[keyHashSlot(args[1])];
+    }
+
+    bool asking = false;
+    for (int attempt = 0; attempt < MAX_REDIRECTS; attempt++) {
+        RedisClient* client = clientFor(node);
+        if (!client) return RespReply();
+        current = node;
+
+        RespReply reply = asking ? send(client, {{"ASKING"}, args}) : send(client, {args});
+        if (reply.type == 0) {
+            // Drop the broken connection, the next command reconnects
+            clients.erase(node);
+            return reply;
+        }
+        if (reply.type != '-') return reply;
+
+        // -MOVED <slot> <host:port> is permanent, -ASK only for this command
+        bool moved = reply.str.compare(0, 6, "MOVED ") == 0;
+        bool ask = reply.str.compare(0, 4, "ASK ") == 0;
+        if (!moved && !ask) return reply;
+
+        size_t space = reply.str.find(' ', moved ? 6 : 4);
+        if (space == std::string::npos) return reply;
+        node = reply.str.substr(space + 1);
+        asking = ask;
+        if (moved) {
+            slots[std::stoul(reply.str.substr(6, space - 6))] = node;
+            std::cout << "-> Redirected to slot [" << reply.str.substr(6, space - 6) << "] located at " << node << "\n";
+        }
+    }
+    RespReply error;
+    error.type = '-';
+    error.str = " Too many cluster redirections";
+    return error;
+}
@@ -0,0 +1,43 @@
+#ifndef CLUSTER_ROUTER_H
+#define CLUSTER_ROUTER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "redis_client.h"
+#include "response_parser.h"
+
+// Cluster mode (-c): learns the slot map with CLUSTER SLOTS, sends every
+// command straight to the node owning its key and follows -MOVED / -ASK
+// redirects, updating the map on MOVED
+class ClusterRouter {
+public:
+    ClusterRouter(const std::string& host, int port);
+
+    // Connect to the seed node and load the slot map
+    bool connect();
+    RespReply execute(const std::vector<std::string>& args);
+
+    // Node the last command went to, for the prompt
+    const std::string& currentNode() const;
+
+    static unsigned int keyHashSlot(const std::string& key);
+
+private:
+    static constexpr int MAX_REDIRECTS = 16;
+
+    std::string seed;
+    std::string current;
+    // Slot owners as host:port, empty when unknown
+    std::vector<std::string> slots;
+    std::unordered_map<std::string, std::unique_ptr<RedisClient>> clients;
+
+    // Connected client for host:port, nullptr on failure
+    RedisClient* clientFor(const std::string& node);
+    void refreshSlots(RedisClient* client);
+    RespReply send(RedisClient* client, const std::vector<std::vector<std::string>>& commands);
+};
+
+#endif
@@ -6,7 +6,7 @@ std::vector<std::string> CommandHandler::splitCommand(const std::string &input)
     std::vector<std::string> tokens;
 
     // Regex to match non whitespace words or quoted strings
-    std::regex rgx(R"((\"[^\"]+\"|\S+))");
+    static const std::regex rgx(R"((\"[^\"]+\"|\S+))");
     auto words_begin = std::sregex_iterator(input.begin(), input.end(), rgx);
     auto words_end = std::sregex_iterator();
 
@@ -0,0 +1,53 @@
+#include "connection_pool.h"
+
+#include <algorithm>
+
+ConnectionPool::ConnectionPool(const std::string& host, int port, size_t size) {
+    for (size_t i = 0; i < std::max<size_t>(size, 1); i++) {
+        clients.push_back(std::make_unique<AsyncRedisClient>(host, port));
+    }
+}
+
+bool ConnectionPool::start() {
+    bool all = true;
+    for (auto& client : clients) {
+        all = client->start() && all;
+    }
+    return all;
+}
+
+void ConnectionPool::stop() {
+    for (auto& client : clients) {
+        client->stop();
+    }
+}
+
+AsyncRedisClient& ConnectionPool::get() {
+    // Scan from a rotating start so equally loaded connections take turns,
+    // skipping connections that are down while another one is up
+    size_t start = next.fetch_add(1, std::memory_order_relaxed);
+    AsyncRedisClient* best = nullptr;
+    size_t bestPending = 0;
+    for (size_t i = 0; i < clients.size(); i++) {
+        AsyncRedisClient* client = clients[(start + i) % clients.size()].get();
+        if (best && best->connected() && !client->connected()) continue;
+        size_t pending = client->pending();
+        if (!best || (client->connected() && !best->connected()) || pending < bestPending) {
+            best = client;
+            bestPending = pending;
+        }
+    }
+    return *best;
+}
+
+void ConnectionPool::command(const std::vector<std::string>& args, AsyncRedisClient::Callback callback) {
+    get().command(args, std::move(callback));
+}
+
+std::future<RespReply> ConnectionPool::command(const std::vector<std::string>& args) {
+    return get().command(args);
+}
+
+size_t ConnectionPool::size() const {
+    return clients.size();
+}
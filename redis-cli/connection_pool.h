@@ -0,0 +1,35 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_client.h"
+
+// A fixed set of async connections to one server, shared by any number of
+// threads. Each command goes to the connection with the fewest requests
+// pending, so one slow reply does not hold back the others
+class ConnectionPool {
+public:
+    ConnectionPool(const std::string& host, int port, size_t size);
+
+    // Connect every client, true when all of them are up. The ones that
+    // failed keep retrying in the background
+    bool start();
+    void stop();
+
+    AsyncRedisClient& get();
+    void command(const std::vector<std::string>& args, AsyncRedisClient::Callback callback);
+    std::future<RespReply> command(const std::vector<std::string>& args);
+
+    size_t size() const;
+
+private:
+    std::vector<std::unique_ptr<AsyncRedisClient>> clients;
+    std::atomic<size_t> next{0};
+};
+
+#endif
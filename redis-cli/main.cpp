@@ -8,15 +8,49 @@ int main(int argc, char* argv[]) {
 
     int port = 6379;
     int i = 1;
+    bool clusterMode = false;
+    // -1: typed output on a terminal, raw otherwise
+    int rawOutput = -1;
+    bool pipeMode = false;
+    int pipeTimeout = 30;
+    // --bigkeys / --memkeys
+    bool bigKeys = false;
+    bool memKeys = false;
+    int memKeysSamples = 0;
+    // --hotkeys
+    bool hotKeys = false;
+    int hotKeysSamples = 1000;
     std::vector<std::string> commandArgs;
 
-    // Parse command line args for -h and -p 
+    // Parse command line args for -h, -p, -c, --pipe [--pipe-timeout s],
+    // --bigkeys, --memkeys [--memkeys-samples n], --hotkeys [--hotkeys-samples n]
+    // and --raw / --no-raw
     while (i < argc) {
         std::string arg = argv[i];
         if (arg == "-h" && i + 1 < argc) {
             host = argv[++i];
         } else if (arg == "-p" && i + 1 < argc) {
             port = std::stoi(argv[++i]);
+        } else if (arg == "-c") {
+            clusterMode = true;
+        } else if (arg == "--pipe") {
+            pipeMode = true;
+        } else if (arg == "--pipe-timeout" && i + 1 < argc) {
+            pipeTimeout = std::stoi(argv[++i]);
+        } else if (arg == "--bigkeys") {
+            bigKeys = true;
+        } else if (arg == "--memkeys") {
+            memKeys = true;
+        } else if (arg == "--memkeys-samples" && i + 1 < argc) {
+            memKeysSamples = std::stoi(argv[++i]);
+        } else if (arg == "--hotkeys") {
+            hotKeys = true;
+        } else if (arg == "--hotkeys-samples" && i + 1 < argc) {
+            hotKeysSamples = std::stoi(argv[++i]);
+        } else if (arg == "--raw") {
+            rawOutput = 1;
+        } else if (arg == "--no-raw") {
+            rawOutput = 0;
         } else {
             while (i < argc) {
                 commandArgs.push_back(argv[i]);
@@ -27,7 +61,11 @@ int main(int argc, char* argv[]) {
     }
 
     // Handle REPL and one shot command modes
-    CLI cli(host, port);
+    CLI cli(host, port, clusterMode);
+    if (rawOutput != -1) cli.setRawOutput(rawOutput == 1);
+    if (pipeMode) return cli.runPipe(pipeTimeout);
+    if (hotKeys) return cli.runHotKeys(hotKeysSamples);
+    if (bigKeys || memKeys) return cli.runKeyStats(memKeys, memKeysSamples);
     cli.run(commandArgs);
     
     return 0;
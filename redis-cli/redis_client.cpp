@@ -29,7 +29,7 @@ bool RedisClient::connectToServer() {
         return false;
     }
 
-    for (auto p = res; p != nullptr; p->ai_next) {
+    for (auto p = res; p != nullptr; p = p->ai_next) {
         sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
         if (sockfd == -1) continue;
         if (connect(sockfd, p->ai_addr, p->ai_addrlen) == 0) break;
@@ -44,20 +44,26 @@ bool RedisClient::connectToServer() {
         return false;
     }
 
+    parser.reset(sockfd);
     return true;
 }
 
 void RedisClient::disconnect() {
-    if (sockfd == -1) {
+    if (sockfd != -1) {
         close(sockfd);
         sockfd = -1;
     }
+    parser.reset(-1);
 }
 
 int RedisClient::getSocketFD() const {
     return sockfd;
 }
 
+ResponseParser& RedisClient::replies() {
+    return parser;
+}
+
 bool RedisClient::sendCommand(const std::string &command) {
     if (sockfd == -1) return false;
     ssize_t sent = send(sockfd, command.c_str(), command.size(), 0);
@@ -1,11 +1,14 @@
 #ifndef REDIS_CLIENT_H
 #define REDIS_CLIENT_H
 
+#include <cstring>
 #include <string>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "response_parser.h"
+
 class RedisClient {
 public: 
     RedisClient(const std::string &host, int port);
@@ -15,11 +18,14 @@ public:
     void disconnect();
     int getSocketFD() const;
     bool sendCommand(const std::string &command);
+    // Buffered reader for the replies of this connection
+    ResponseParser& replies();
 
 private:
     std::string host;
     int port;
     int sockfd;
+    ResponseParser parser;
 };
 
 #endif
\ No newline at end of file
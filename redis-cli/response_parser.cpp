@@ -1,99 +1,436 @@
 #include "response_parser.h"
 
-#include <iostream>
-#include <sstream>
-#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <sys/socket.h>
+#include <unistd.h>
 
-// Function to read a single char from the socket
-static bool readChar(int sockfd, char &c) {
-    ssize_t r = recv(sockfd, &c, 1, 0);
-    return r == 1;
+// RESP3 adds lines (',' double, '#' boolean, '(' big number, '_' null),
+// bulks ('!' error, '=' verbatim) and aggregates ('~' set, '%' map, '>'
+// push, '|' attribute) to the RESP2 types
+static bool isLineType(char type) {
+    return type == '+' || type == '-' || type == ':' || type == ',' || type == '#' || type == '(' || type == '_';
 }
 
-// Function to read a line of text from socket
-std::string readLine(int sockfd) {
-    std::string line;
-    char c;
-    while (readChar(sockfd, c)) {
-        if (c == '\r') {
-            readChar(sockfd, c);
-            break;
+static bool isBulkType(char type) {
+    return type == '$' || type == '!' || type == '=';
+}
+
+static bool isAggregateType(char type) {
+    return type == '*' || type == '~' || type == '%' || type == '>' || type == '|';
+}
+
+// Elements following an aggregate header, maps and attributes count pairs
+static size_t elementCount(char type, long long count) {
+    return (type == '%' || type == '|') ? static_cast<size_t>(count) * 2 : static_cast<size_t>(count);
+}
+
+ResponseParser::ResponseParser(int sockfd) : sockfd(sockfd), pos(0), end(0) {}
+
+void ResponseParser::reset(int fd) {
+    sockfd = fd;
+    pos = 0;
+    end = 0;
+}
+
+bool ResponseParser::fill() {
+    if (sockfd < 0) return false;
+
+    // Keep only the unparsed tail, at the front of the buffer
+    if (pos == end) {
+        pos = end = 0;
+    } else if (pos > 0) {
+        std::memmove(&buffer[0], buffer.data() + pos, end - pos);
+        end -= pos;
+        pos = 0;
+    }
+    if (buffer.size() < end + READ_CHUNK) buffer.resize(end + READ_CHUNK);
+
+    while (true) {
+        ssize_t got = recv(sockfd, &buffer[end], buffer.size() - end, 0);
+        if (got > 0) {
+            end += got;
+            return true;
         }
-        line.push_back(c);
+        if (got < 0 && errno == EINTR) continue;
+        return false;
     }
-    return line;
 }
 
-std::string ResponseParser::parseResponse(int sockfd) {
-    char prefix;
+bool ResponseParser::readLine(std::string& line) {
+    size_t searched = pos;
+    while (true) {
+        const char* start = buffer.data() + searched;
+        const char* cr = static_cast<const char*>(std::memchr(start, '\r', end - searched));
+        if (cr && cr + 1 < buffer.data() + end) {
+            size_t at = cr - buffer.data();
+            if (buffer[at + 1] == '\n') {
+                line.assign(buffer.data() + pos, at - pos);
+                pos = at + 2;
+                return true;
+            }
+            searched = at + 1;
+            continue;
+        }
+        // A CR at the very end may be followed by the LF of the next chunk
+        size_t scanned = (cr ? cr - buffer.data() : end) - pos;
+        if (!fill()) return false;
+        searched = pos + scanned;
+    }
+}
 
-    if (!readChar(sockfd, prefix)) {
-        return "Error: no response or connection close";
+bool ResponseParser::readLength(long long& value) {
+    std::string line;
+    if (!readLine(line)) return false;
+    char* parsedEnd = nullptr;
+    errno = 0;
+    value = std::strtoll(line.c_str(), &parsedEnd, 10);
+    return !line.empty() && errno == 0 && *parsedEnd == '\0' && value >= -1;
+}
+
+bool ResponseParser::readBulk(size_t n, std::string& out) {
+    out.resize(n);
+    size_t copied = std::min(n, end - pos);
+    std::memcpy(&out[0], buffer.data() + pos, copied);
+    pos += copied;
+
+    // Whatever is not buffered yet goes straight from the socket into out
+    while (copied < n) {
+        ssize_t got = recv(sockfd, &out[copied], n - copied, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        copied += got;
     }
 
-    switch (prefix) {
-        case '+': return parseSimpleString(sockfd);
-        case '-': return parseSimpleError(sockfd);
-        case ':': return parseInteger(sockfd);
-        case '$': return parseBulkString(sockfd);
-        case '*': return parseArray(sockfd);
-        default:
-            return "Error: unknown reply type";
+    // Trailing CRLF
+    while (end - pos < 2) {
+        if (!fill()) return false;
     }
+    pos += 2;
+    return true;
 }
 
-std::string ResponseParser::parseSimpleString(int sockfd) {
-    return readLine(sockfd);
+bool ResponseParser::parseInto(RespReply& reply) {
+    if (pos == end && !fill()) return false;
+    reply.type = buffer[pos++];
+
+    long long length;
+    if (isLineType(reply.type)) {
+        reply.isNull = reply.type == '_';
+        return readLine(reply.str);
+    }
+    if (!isBulkType(reply.type) && !isAggregateType(reply.type)) return false;
+    if (!readLength(length)) return false;
+    if (length == -1) {
+        reply.isNull = true;
+        return true;
+    }
+    if (isBulkType(reply.type)) return readBulk(static_cast<size_t>(length), reply.str);
+
+    reply.elements.resize(elementCount(reply.type, length));
+    for (auto& element : reply.elements) {
+        if (!parseInto(element)) return false;
+    }
+    // Attributes annotate the reply that follows, which is what the caller wants
+    if (reply.type == '|') {
+        reply = RespReply();
+        return parseInto(reply);
+    }
+    return true;
 }
 
-std::string ResponseParser::parseSimpleError(int sockfd) {
-    return "(Error)" + readLine(sockfd);
+RespReply ResponseParser::readReply() {
+    RespReply reply;
+    if (!parseInto(reply)) {
+        // Out of sync with the stream, the connection can not be reused
+        reset(-1);
+        return RespReply();
+    }
+    return reply;
 }
 
-std::string ResponseParser::parseInteger(int sockfd) {
-    return readLine(sockfd);
+std::string ResponseParser::parseResponse(bool raw) {
+    return formatReply(readReply(), raw);
 }
 
-std::string ResponseParser::parseBulkString(int sockfd) {
-    std::string lenStr = readLine(sockfd);
-    int length = std::stoi(lenStr);
-    if (length == -1) {
-        return "(nil)";
-    }
-    std::string bulk;
-    bulk.resize(length);
-    int totalRead = 0;
-    while (totalRead < length) {
-        ssize_t r = recv(sockfd, &bulk[totalRead], length - totalRead, 0);
-        if (r <= 0) {
-            return "(Error) Incomplete bulk data";
+// Quote a string the way redis-cli shows bulk replies
+static void appendQuoted(const char* data, size_t len, std::string& out) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\a': out += "\\a"; break;
+            case '\b': out += "\\b"; break;
+            default:
+                if (c >= 0x20 && c < 0x7f) {
+                    out += static_cast<char>(c);
+                } else {
+                    char hex[5];
+                    std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+                    out += hex;
+                }
         }
-        totalRead += r;
     }
+}
 
-    //Continue trailing crlf
-    char dummy;
-    readChar(sockfd, dummy);
-    readChar(sockfd, dummy);
+// "1) ", " 2) " ... right aligned to the widest index of the array. Like
+// redis-cli, sets number their elements "1~" and maps their pairs "1#"
+static std::string elementPrefix(size_t index, size_t count, char type = '*') {
+    std::string number = std::to_string(index + 1);
+    std::string widest = std::to_string(count);
+    char marker = type == '~' ? '~' : (type == '%' ? '#' : ')');
+    return std::string(widest.size() - number.size(), ' ') + number + marker + " ";
+}
 
-    return bulk;    
+static const char* emptyAggregate(char type) {
+    if (type == '~') return "(empty set)\n";
+    if (type == '%') return "(empty hash)\n";
+    return "(empty array)\n";
 }
 
-std::string ResponseParser::parseArray(int sockfd) {
-    std::string countStr = readLine(sockfd);
-    int count = std::stoi(countStr);
-    if (count == -1) {
-        return "(nil)";
+void ResponseParser::formatInto(const RespReply& reply, bool raw, const std::string& indent, std::string& out) {
+    switch (reply.type) {
+        case 0: out += "Error: no response or connection close\n"; return;
+        case '+': out += reply.str + "\n"; return;
+        case '-':
+        case '!': out += (raw ? "(Error)" : "(error) ") + reply.str + "\n"; return;
+        case ':': out += (raw ? "" : "(integer) ") + reply.str + "\n"; return;
+        case ',': out += (raw ? "" : "(double) ") + reply.str + "\n"; return;
+        case '(': out += (raw ? "" : "(big number) ") + reply.str + "\n"; return;
+        case '#': out += reply.str == "t" ? "(true)\n" : "(false)\n"; return;
+        case '_': out += "(nil)\n"; return;
+        // Verbatim text starts with its format, "txt:"
+        case '=': out += (reply.str.size() >= 4 ? reply.str.substr(4) : reply.str) + "\n"; return;
+        case '$':
+        case '*':
+        case '~':
+        case '%':
+        case '>':
+            break;
+        default:
+            out += "Error: unknown reply type\n";
+            return;
     }
 
-    std::ostringstream oss;
-    for (int i = 0; i < count; i++) {
-        oss << parseResponse(sockfd);
-        if (i != count - 1) {
-            oss << "\n";
+    if (reply.isNull) {
+        out += "(nil)\n";
+    } else if (reply.type == '$') {
+        if (raw) {
+            out += reply.str;
+        } else {
+            out += '"';
+            appendQuoted(reply.str.data(), reply.str.size(), out);
+            out += '"';
+        }
+        out += "\n";
+    } else if (reply.elements.empty()) {
+        out += raw ? "\n" : emptyAggregate(reply.type);
+    } else if (reply.type == '%' && !raw) {
+        size_t pairs = reply.elements.size() / 2;
+        for (size_t i = 0; i < pairs; i++) {
+            if (i > 0) out += indent;
+            std::string prefix = elementPrefix(i, pairs, reply.type);
+            out += prefix;
+            std::string key = formatReply(reply.elements[2 * i], raw);
+            out += key + " => ";
+            formatInto(reply.elements[2 * i + 1], raw, indent + std::string(prefix.size() + key.size() + 4, ' '), out);
+        }
+    } else {
+        for (size_t i = 0; i < reply.elements.size(); i++) {
+            if (raw) {
+                formatInto(reply.elements[i], raw, indent, out);
+                continue;
+            }
+            if (i > 0) out += indent;
+            std::string prefix = elementPrefix(i, reply.elements.size(), reply.type);
+            out += prefix;
+            formatInto(reply.elements[i], raw, indent + std::string(prefix.size(), ' '), out);
         }
     }
-    return oss.str();
+}
+
+std::string ResponseParser::formatReply(const RespReply& reply, bool raw) {
+    std::string out;
+    formatInto(reply, raw, "", out);
+    if (!out.empty() && out.back() == '\n') out.pop_back();
+    return out;
+}
+
+bool ResponseParser::streamValue(std::ostream& out, bool raw, const std::string& indent) {
+    if (pos == end && !fill()) return false;
+    char type = buffer[pos];
+
+    // Only bulk strings and aggregates are worth streaming, anything else
+    // is small enough to parse first
+    if (type != '$' && type != '*' && type != '~' && type != '%' && type != '>') {
+        RespReply reply;
+        if (!parseInto(reply)) return false;
+        out << formatReply(reply, raw) << "\n";
+        return true;
+    }
+    pos++;
+
+    long long length;
+    if (!readLength(length)) return false;
+    if (length == -1) {
+        out << "(nil)\n";
+        return true;
+    }
+
+    if (type == '$') {
+        // Written piece by piece as it arrives, a huge value never has
+        // to fit in memory at once
+        if (!raw) out << '"';
+        size_t remaining = static_cast<size_t>(length);
+        std::string quoted;
+        while (remaining > 0) {
+            if (pos == end && !fill()) return false;
+            size_t take = std::min(remaining, end - pos);
+            if (raw) {
+                out.write(buffer.data() + pos, take);
+            } else {
+                quoted.clear();
+                appendQuoted(buffer.data() + pos, take, quoted);
+                out << quoted;
+            }
+            pos += take;
+            remaining -= take;
+        }
+        while (end - pos < 2) {
+            if (!fill()) return false;
+        }
+        pos += 2;
+        out << (raw ? "\n" : "\"\n");
+        return true;
+    }
+
+    if (length == 0) {
+        out << (raw ? "\n" : emptyAggregate(type));
+        return true;
+    }
+    size_t count = static_cast<size_t>(length);
+    for (size_t i = 0; i < count; i++) {
+        if (raw) {
+            if (!streamValue(out, raw, indent)) return false;
+            if (type == '%' && !streamValue(out, raw, indent)) return false;
+            continue;
+        }
+        if (i > 0) out << indent;
+        std::string prefix = elementPrefix(i, count, type);
+        out << prefix;
+        std::string nested = indent + std::string(prefix.size(), ' ');
+        if (type == '%') {
+            // Map keys are short, printed inline before their value
+            RespReply key;
+            if (!parseInto(key)) return false;
+            std::string formatted = formatReply(key, raw);
+            out << formatted << " => ";
+            nested += std::string(formatted.size() + 4, ' ');
+        }
+        if (!streamValue(out, raw, nested)) return false;
+    }
+    return true;
+}
+
+bool ResponseParser::streamReply(std::ostream& out, bool raw) {
+    if (!streamValue(out, raw, "")) {
+        reset(-1);
+        return false;
+    }
+    return true;
+}
+
+size_t ResponseParser::replyLength(const std::string& buf, size_t pos) {
+    if (pos >= buf.size()) return 0;
+    size_t crlf = buf.find("\r\n", pos);
+    if (crlf == std::string::npos) return 0;
+    size_t end = crlf + 2;
+
+    char type = buf[pos];
+    if (isBulkType(type)) {
+        long len = std::strtol(buf.c_str() + pos + 1, nullptr, 10);
+        if (len < 0) return end - pos;
+        if (buf.size() < end + len + 2) return 0;
+        return end + len + 2 - pos;
+    }
+    if (isAggregateType(type)) {
+        long count = std::strtol(buf.c_str() + pos + 1, nullptr, 10);
+        size_t cur = end;
+        for (size_t i = 0; count > 0 && i < elementCount(type, count); i++) {
+            size_t len = replyLength(buf, cur);
+            if (len == 0) return 0;
+            cur += len;
+        }
+        // An attribute is followed by the reply it annotates
+        if (type == '|') {
+            size_t len = replyLength(buf, cur);
+            if (len == 0) return 0;
+            cur += len;
+        }
+        return cur - pos;
+    }
+    return end - pos;
+}
+
+// Length header of a bulk or aggregate reply ending at crlf, false unless it is all digits
+static bool bufferedLength(const std::string& buf, size_t from, size_t crlf, long long& value) {
+    char* parsedEnd = nullptr;
+    errno = 0;
+    value = std::strtoll(buf.c_str() + from, &parsedEnd, 10);
+    return crlf > from && errno == 0 && parsedEnd == buf.c_str() + crlf && value >= -1;
+}
+
+size_t ResponseParser::parseBuffered(const std::string& buf, size_t pos, RespReply& reply) {
+    if (pos >= buf.size()) return 0;
+    size_t crlf = buf.find("\r\n", pos);
+    if (crlf == std::string::npos) return 0;
+    size_t end = crlf + 2;
+
+    reply.type = buf[pos];
+    reply.isNull = false;
+    reply.str.clear();
+    reply.elements.clear();
+
+    long long length;
+    if (isLineType(reply.type)) {
+        reply.isNull = reply.type == '_';
+        reply.str.assign(buf, pos + 1, crlf - pos - 1);
+        return end - pos;
+    }
+    if (!isBulkType(reply.type) && !isAggregateType(reply.type)) return std::string::npos;
+    if (!bufferedLength(buf, pos + 1, crlf, length)) return std::string::npos;
+    if (length == -1) {
+        reply.isNull = true;
+        return end - pos;
+    }
+
+    if (isBulkType(reply.type)) {
+        if (buf.size() < end + length + 2) return 0;
+        reply.str.assign(buf, end, static_cast<size_t>(length));
+        return end + length + 2 - pos;
+    }
+
+    // Every element takes at least a byte, do not allocate for elements
+    // that have not arrived
+    size_t count = elementCount(reply.type, length);
+    if (count > buf.size() - end) return 0;
+    reply.elements.resize(count);
+    for (auto& element : reply.elements) {
+        size_t len = parseBuffered(buf, end, element);
+        if (len == 0 || len == std::string::npos) return len;
+        end += len;
+    }
+    if (reply.type == '|') {
+        size_t len = parseBuffered(buf, end, reply);
+        if (len == 0 || len == std::string::npos) return len;
+        end += len;
+    }
+    return end - pos;
 }
@@ -1,22 +1,74 @@
 #ifndef RESPONSE_PARSER_H
 #define RESPONSE_PARSER_H
 
+#include <ostream>
 #include <string>
+#include <vector>
 
+// A reply as received, type is the RESP prefix: '+', '-', ':', '$', '*'
+// and after HELLO 3 also ',', '#', '(', '_', '!', '=', '~', '%' and '>'.
+// Maps keep their keys and values alternating in elements, attributes are
+// skipped. 0 when the connection failed
+struct RespReply {
+    char type = 0;
+    bool isNull = false;
+    std::string str;
+    std::vector<RespReply> elements;
+};
+
+// Reads replies from one socket through a buffer: the socket is drained in
+// large chunks and replies are parsed from memory, so a reply costs a
+// handful of recv calls whatever its size. Bytes past the current reply
+// stay buffered for the next one (pipelining)
 class ResponseParser {
 public:
-    // Read from the given socket and return parsed response as a string
-    // If it fails, return empty string
-    static std::string parseResponse(int sockfd);  
+    explicit ResponseParser(int sockfd = -1);
+
+    // Start over on a new socket, dropping anything buffered
+    void reset(int sockfd);
+
+    // Read one reply keeping its structure, for callers that inspect it
+    RespReply readReply();
+    // Read one reply and return it rendered, empty string if it fails
+    std::string parseResponse(bool raw = true);
+    // Print one reply to out while it is read, without holding the whole
+    // reply in memory: large arrays and bulk strings are written as they
+    // arrive. Returns false when the connection failed or the reply was
+    // malformed
+    bool streamReply(std::ostream& out, bool raw);
+
+    // Render a reply. raw prints values as they are, one array element per
+    // line; otherwise output is typed like redis-cli: (integer), quoted
+    // strings, (nil), numbered and indented nested arrays
+    static std::string formatReply(const RespReply& reply, bool raw = true);
+
+    // Length of the first complete reply in buf starting at pos, 0 if
+    // incomplete. For callers that read the socket themselves
+    static size_t replyLength(const std::string& buf, size_t pos);
+    // Parse the first reply of buf starting at pos into reply and return its
+    // length: 0 if it is incomplete, npos if it is malformed
+    static size_t parseBuffered(const std::string& buf, size_t pos, RespReply& reply);
 
 private:
-    // Redis Serialization Protocol 2
-    static std::string parseSimpleString(int sockfd);
-    static std::string parseSimpleError(int sockfd);
-    static std::string parseInteger(int sockfd);
-    static std::string parseBulkString(int sockfd);
-    static std::string parseArray(int sockfd);
-};
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+
+    int sockfd;
+    // Unparsed bytes are buffer[pos, end)
+    std::string buffer;
+    size_t pos;
+    size_t end;
 
+    // Pull the next chunk from the socket, false on EOF or error
+    bool fill();
+    bool readLine(std::string& line);
+    bool readLength(long long& value);
+    // Copy n bytes plus the trailing CRLF, large payloads go straight from
+    // the socket into out
+    bool readBulk(size_t n, std::string& out);
+    bool parseInto(RespReply& reply);
+    bool streamValue(std::ostream& out, bool raw, const std::string& indent);
+
+    static void formatInto(const RespReply& reply, bool raw, const std::string& indent, std::string& out);
+};
 
-#endif
\ No newline at end of file
+#endif
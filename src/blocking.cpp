@@ -0,0 +1,92 @@
+#include "blocking.h"
+
+#include <algorithm>
+
+void BlockedClients::block(RedisConnection* conn) {
+    conn->blocked = true;
+    blockedClients++;
+    for (const auto& key : conn->block.keys) {
+        waiters[key].push_back(conn);
+    }
+    if (conn->block.hasDeadline) {
+        deadlines.emplace(conn->block.deadline, conn);
+    }
+}
+
+void BlockedClients::unblock(RedisConnection* conn) {
+    if (!conn->blocked) return;
+
+    for (const auto& key : conn->block.keys) {
+        auto it = waiters.find(key);
+        if (it == waiters.end()) continue;
+        auto& queue = it->second;
+        queue.erase(std::remove(queue.begin(), queue.end(), conn), queue.end());
+        if (queue.empty()) waiters.erase(it);
+    }
+    if (conn->block.hasDeadline) {
+        deadlines.erase({conn->block.deadline, conn});
+    }
+
+    conn->blocked = false;
+    conn->block = BlockState();
+    blockedClients--;
+    unblocked.push_back(conn);
+}
+
+void BlockedClients::signalKeyReady(const std::string& key) {
+    // Nobody waits on most pushed keys, keep that path cheap
+    if (waiters.find(key) == waiters.end()) return;
+    if (readySet.insert(key).second) readyKeys.push_back(key);
+}
+
+bool BlockedClients::hasReadyKeys() const {
+    return !readyKeys.empty();
+}
+
+std::vector<std::string> BlockedClients::takeReadyKeys() {
+    std::vector<std::string> keys;
+    keys.swap(readyKeys);
+    readySet.clear();
+    return keys;
+}
+
+RedisConnection* BlockedClients::firstWaiter(const std::string& key) const {
+    auto it = waiters.find(key);
+    if (it == waiters.end() || it->second.empty()) return nullptr;
+    return it->second.front();
+}
+
+int BlockedClients::nextTimeoutMs() const {
+    if (deadlines.empty()) return -1;
+    auto now = std::chrono::steady_clock::now();
+    auto first = deadlines.begin()->first;
+    if (first <= now) return 0;
+
+    // Round up so the loop never wakes just before the deadline
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(first - now).count() + 1;
+    return static_cast<int>(std::min<long long>(ms, 1000 * 60));
+}
+
+std::vector<RedisConnection*> BlockedClients::expired(std::chrono::steady_clock::time_point now) const {
+    std::vector<RedisConnection*> result;
+    for (const auto& entry : deadlines) {
+        if (entry.first > now) break;
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+std::vector<RedisConnection*> BlockedClients::takeUnblocked() {
+    std::vector<RedisConnection*> result;
+    result.swap(unblocked);
+    return result;
+}
+
+void BlockedClients::forget(RedisConnection* conn) {
+    unblock(conn);
+    unblocked.erase(std::remove(unblocked.begin(), unblocked.end(), conn), unblocked.end());
+}
+
+size_t BlockedClients::blockedCount() const {
+    return blockedClients;
+}
@@ -0,0 +1,222 @@
+#include "cluster.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// CRC16 XMODEM (polynomial 0x1021), the variant Redis Cluster uses
+static uint16_t crc16(const char* data, size_t len) {
+    static uint16_t table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (int i = 0; i < 256; i++) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+            table[i] = crc;
+        }
+        initialized = true;
+    }
+
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = static_cast<uint16_t>((crc << 8) ^ table[((crc >> 8) ^ static_cast<unsigned char>(data[i])) & 0xff]);
+    }
+    return crc;
+}
+
+unsigned int keyHashSlot(const std::string& key) {
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        // "{}" is not a tag, the whole key is hashed
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (CLUSTER_SLOTS - 1);
+}
+
+std::string ClusterNode::address() const {
+    return host + ":" + std::to_string(port);
+}
+
+Cluster::Cluster() : enabled(false), nodes(1), owners(CLUSTER_SLOTS, -1) {}
+
+bool Cluster::isEnabled() const {
+    return enabled;
+}
+
+void Cluster::enable(const std::string& host, int port) {
+    enabled = true;
+    nodes[0].host = host;
+    nodes[0].port = port;
+}
+
+const ClusterNode& Cluster::myself() const {
+    return nodes[0];
+}
+
+int Cluster::nodeIndex(const std::string& host, int port) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].host == host && nodes[i].port == port) return static_cast<int>(i);
+    }
+    nodes.push_back({host, port});
+    return static_cast<int>(nodes.size() - 1);
+}
+
+const ClusterNode* Cluster::slotOwner(unsigned int slot) const {
+    int owner = owners[slot];
+    return owner < 0 ? nullptr : &nodes[owner];
+}
+
+bool Cluster::ownsSlot(unsigned int slot) const {
+    return owners[slot] == 0;
+}
+
+const ClusterNode* Cluster::migratingTo(unsigned int slot) const {
+    auto it = migrating.find(slot);
+    return it == migrating.end() ? nullptr : &nodes[it->second];
+}
+
+const ClusterNode* Cluster::importingFrom(unsigned int slot) const {
+    auto it = importing.find(slot);
+    return it == importing.end() ? nullptr : &nodes[it->second];
+}
+
+bool Cluster::addSlot(unsigned int slot) {
+    if (owners[slot] >= 0) return false;
+    owners[slot] = 0;
+    return true;
+}
+
+bool Cluster::delSlot(unsigned int slot) {
+    if (owners[slot] < 0) return false;
+    owners[slot] = -1;
+    setStable(slot);
+    return true;
+}
+
+void Cluster::assignSlot(unsigned int slot, const std::string& host, int port) {
+    owners[slot] = nodeIndex(host, port);
+    setStable(slot);
+}
+
+bool Cluster::setMigrating(unsigned int slot, const std::string& host, int port) {
+    if (!ownsSlot(slot)) return false;
+    migrating[slot] = nodeIndex(host, port);
+    return true;
+}
+
+bool Cluster::setImporting(unsigned int slot, const std::string& host, int port) {
+    if (ownsSlot(slot)) return false;
+    importing[slot] = nodeIndex(host, port);
+    return true;
+}
+
+void Cluster::setStable(unsigned int slot) {
+    migrating.erase(slot);
+    importing.erase(slot);
+}
+
+static std::string bulk(const std::string& value) {
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+std::string Cluster::slotsReply() const {
+    // One entry per run of consecutive slots with the same owner:
+    // start, end, [host, port]
+    std::string body;
+    size_t ranges = 0;
+    unsigned int slot = 0;
+    while (slot < CLUSTER_SLOTS) {
+        int owner = owners[slot];
+        unsigned int end = slot;
+        while (end + 1 < CLUSTER_SLOTS && owners[end + 1] == owner) end++;
+        if (owner >= 0) {
+            body += "*3\r\n:" + std::to_string(slot) + "\r\n:" + std::to_string(end) + "\r\n";
+            body += "*2\r\n" + bulk(nodes[owner].host) + ":" + std::to_string(nodes[owner].port) + "\r\n";
+            ranges++;
+        }
+        slot = end + 1;
+    }
+    return "*" + std::to_string(ranges) + "\r\n" + body;
+}
+
+std::string Cluster::infoReply() const {
+    size_t assigned = 0;
+    for (int owner : owners) {
+        if (owner >= 0) assigned++;
+    }
+    std::string info = "cluster_enabled:" + std::string(enabled ? "1" : "0") + "\r\n" +
+                       "cluster_state:" + std::string(assigned == CLUSTER_SLOTS ? "ok" : "fail") + "\r\n" +
+                       "cluster_slots_assigned:" + std::to_string(assigned) + "\r\n" +
+                       "cluster_known_nodes:" + std::to_string(nodes.size()) + "\r\n";
+    return bulk(info);
+}
+
+static bool waitFd(int fd, short events, int timeoutMs) {
+    pollfd pfd{fd, events, 0};
+    return poll(&pfd, 1, timeoutMs) == 1 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+
+std::string sendToNode(const std::string& host, int port, const std::string& payload, size_t replies, int timeoutMs) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) {
+        return "-IOERR error resolving target instance";
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return "-IOERR error creating socket";
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if ((rc < 0 && errno != EINPROGRESS) || !waitFd(fd, POLLOUT, timeoutMs) ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        close(fd);
+        return "-IOERR error or timeout connecting to the target instance";
+    }
+
+    size_t sent = 0;
+    while (sent < payload.size()) {
+        if (!waitFd(fd, POLLOUT, timeoutMs)) break;
+        ssize_t n = send(fd, payload.data() + sent, payload.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+        if (n > 0) sent += n;
+    }
+
+    // Every reply is a single status line, the first error wins
+    std::string buffer, result;
+    size_t seen = 0, pos = 0;
+    while (sent == payload.size() && seen < replies) {
+        size_t crlf = buffer.find("\r\n", pos);
+        if (crlf != std::string::npos) {
+            if (buffer[pos] == '-' && result.empty()) result = buffer.substr(pos, crlf - pos);
+            pos = crlf + 2;
+            seen++;
+            continue;
+        }
+        char chunk[4096];
+        if (!waitFd(fd, POLLIN, timeoutMs)) break;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) break;
+        if (n > 0) buffer.append(chunk, n);
+    }
+    close(fd);
+
+    if (seen < replies) return "-IOERR error or timeout talking to the target instance";
+    return result;
+}
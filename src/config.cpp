@@ -0,0 +1,147 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+ServerConfig& serverConfig() {
+    static ServerConfig config;
+    return config;
+}
+
+struct ConfigParam {
+    const char* name;
+    std::atomic<long long> ServerConfig::*value;
+    long long min;
+    long long max;
+    // Accepts the kb / mb / gb units
+    bool memory;
+};
+
+static const ConfigParam CONFIG_PARAMS[] = {
+    {"slowlog-log-slower-than", &ServerConfig::slowlogLogSlowerThan, -1, 1LL << 40, false},
+    {"slowlog-max-len", &ServerConfig::slowlogMaxLen, 0, 1LL << 30, false},
+    {"latency-monitor-threshold", &ServerConfig::latencyMonitorThreshold, 0, 1LL << 40, false},
+    {"maxclients", &ServerConfig::maxClients, 1, 1LL << 20, false},
+    {"client-query-buffer-limit", &ServerConfig::clientQueryBufferLimit, 1LL << 20, 1LL << 40, true},
+    {"tracking-table-max-keys", &ServerConfig::trackingTableMaxKeys, 0, 1LL << 40, false},
+    {"lfu-log-factor", &ServerConfig::lfuLogFactor, 0, 1LL << 30, false},
+    {"lfu-decay-time", &ServerConfig::lfuDecayTime, 0, 1LL << 30, false},
+    {"lfu-tracking", &ServerConfig::lfuTracking, 0, 1, false},
+    {"hotkeys-topk", &ServerConfig::hotkeysTopK, 0, 100000, false},
+    {"hll-sparse-max-bytes", &ServerConfig::hllSparseMaxBytes, 0, 100000, true},
+    {"set-max-intset-entries", &ServerConfig::setMaxIntsetEntries, 0, 1LL << 30, false},
+};
+
+// Not a single number: "<class> <hard> <soft> <soft seconds>" per class
+static const char* const OUTPUT_LIMIT_PARAM = "client-output-buffer-limit";
+static const char* const CLIENT_CLASS_NAMES[CLIENT_CLASS_COUNT] = {"normal", "replica", "pubsub"};
+
+static std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// A whole number, with a k / kb / m / mb / g / gb suffix when memory is set
+static bool parseNumber(const std::string& value, bool memory, long long& number) {
+    size_t used = 0;
+    try {
+        number = std::stoll(value, &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (used == 0) return false;
+    std::string unit = lowercase(value.substr(used));
+    if (unit.empty()) return true;
+    if (!memory) return false;
+
+    int shift;
+    if (unit == "k" || unit == "kb") {
+        shift = 10;
+    } else if (unit == "m" || unit == "mb") {
+        shift = 20;
+    } else if (unit == "g" || unit == "gb") {
+        shift = 30;
+    } else {
+        return false;
+    }
+    if (number < 0 || number > (1LL << (62 - shift))) return false;
+    number <<= shift;
+    return true;
+}
+
+static std::string outputLimitsValue() {
+    std::string value;
+    for (int i = 0; i < CLIENT_CLASS_COUNT; i++) {
+        const OutputBufferLimit& limit = serverConfig().outputBufferLimits[i];
+        if (!value.empty()) value += " ";
+        value += std::string(CLIENT_CLASS_NAMES[i]) + " " + std::to_string(limit.hard.load()) + " " +
+                 std::to_string(limit.soft.load()) + " " + std::to_string(limit.softSeconds.load());
+    }
+    return value;
+}
+
+// Every class named is replaced, the others keep their limits. Nothing is
+// applied unless the whole value parses
+static bool setOutputLimits(const std::string& value, std::string& error) {
+    std::istringstream in(value);
+    std::vector<std::string> words;
+    for (std::string word; in >> word;) words.push_back(word);
+
+    long long parsed[CLIENT_CLASS_COUNT][3];
+    bool given[CLIENT_CLASS_COUNT] = {};
+    bool ok = !words.empty() && words.size() % 4 == 0;
+    for (size_t i = 0; ok && i < words.size(); i += 4) {
+        std::string name = lowercase(words[i]);
+        // Old name of the replica class
+        if (name == "slave") name = "replica";
+        int cls = 0;
+        while (cls < CLIENT_CLASS_COUNT && name != CLIENT_CLASS_NAMES[cls]) cls++;
+        ok = cls < CLIENT_CLASS_COUNT && parseNumber(words[i + 1], true, parsed[cls][0]) &&
+             parseNumber(words[i + 2], true, parsed[cls][1]) && parseNumber(words[i + 3], false, parsed[cls][2]) &&
+             parsed[cls][0] >= 0 && parsed[cls][1] >= 0 && parsed[cls][2] >= 0;
+        if (ok) given[cls] = true;
+    }
+    if (!ok) {
+        error = std::string("Invalid argument '") + value + "' for CONFIG SET '" + OUTPUT_LIMIT_PARAM + "'";
+        return false;
+    }
+
+    for (int cls = 0; cls < CLIENT_CLASS_COUNT; cls++) {
+        if (!given[cls]) continue;
+        OutputBufferLimit& limit = serverConfig().outputBufferLimits[cls];
+        limit.hard.store(parsed[cls][0]);
+        limit.soft.store(parsed[cls][1]);
+        limit.softSeconds.store(parsed[cls][2]);
+    }
+    return true;
+}
+
+std::vector<std::pair<std::string, std::string>> configGet(const std::string& pattern) {
+    std::string wanted = lowercase(pattern);
+    std::vector<std::pair<std::string, std::string>> out;
+    for (const auto& param : CONFIG_PARAMS) {
+        if (wanted != "*" && wanted != param.name) continue;
+        out.emplace_back(param.name, std::to_string((serverConfig().*param.value).load()));
+    }
+    if (wanted == "*" || wanted == OUTPUT_LIMIT_PARAM) out.emplace_back(OUTPUT_LIMIT_PARAM, outputLimitsValue());
+    return out;
+}
+
+bool configSet(const std::string& name, const std::string& value, std::string& error) {
+    std::string wanted = lowercase(name);
+    if (wanted == OUTPUT_LIMIT_PARAM) return setOutputLimits(value, error);
+    for (const auto& param : CONFIG_PARAMS) {
+        if (wanted != param.name) continue;
+
+        long long number;
+        if (!parseNumber(value, param.memory, number) || number < param.min || number > param.max) {
+            error = "Invalid argument '" + value + "' for CONFIG SET '" + param.name + "'";
+            return false;
+        }
+        (serverConfig().*param.value).store(number);
+        return true;
+    }
+    error = "Unknown option or number of arguments for CONFIG SET - '" + name + "'";
+    return false;
+}
@@ -0,0 +1,137 @@
+#include "hotkeys.h"
+#include "config.h"
+
+#include <algorithm>
+#include <functional>
+#include <time.h>
+
+// Minutes, wrapping at 16 bits like the clock stored in the counters. The
+// coarse clock (one tick per jiffy) is plenty for minutes and reads much
+// faster than steady_clock, which matters as every access asks for it
+static uint16_t lfuMinutes() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return static_cast<uint16_t>((now.tv_sec / 60) & 0xFFFF);
+}
+
+static uint8_t decayed(uint32_t packed, uint16_t now) {
+    uint16_t last = static_cast<uint16_t>(packed >> 8);
+    uint8_t counter = static_cast<uint8_t>(packed & 0xFF);
+    long long decayTime = serverConfig().lfuDecayTime.load(std::memory_order_relaxed);
+    if (decayTime <= 0) return counter;
+    unsigned elapsed = now >= last ? now - last : 65535 - last + now;
+    unsigned periods = static_cast<unsigned>(elapsed / decayTime);
+    return periods >= counter ? 0 : static_cast<uint8_t>(counter - periods);
+}
+
+uint32_t lfuAccess(uint32_t packed, bool created, uint64_t& rng) {
+    uint16_t now = lfuMinutes();
+    if (created) return (static_cast<uint32_t>(now) << 8) | LFU_INIT_VAL;
+    uint8_t counter = decayed(packed, now);
+    if (counter < 255) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        double r = static_cast<double>(rng >> 11) / static_cast<double>(1ULL << 53);
+        double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+        long long factor = serverConfig().lfuLogFactor.load(std::memory_order_relaxed);
+        if (r < 1.0 / (base * factor + 1)) counter++;
+    }
+    return (static_cast<uint32_t>(now) << 8) | counter;
+}
+
+uint8_t lfuFrequency(uint32_t packed) {
+    return decayed(packed, lfuMinutes());
+}
+
+void HotKeySketch::reset(size_t newK) {
+    k = newK;
+    additions = 0;
+    heap.clear();
+    positions.clear();
+    if (k == 0) {
+        std::vector<uint32_t>().swap(counters);
+    } else {
+        counters.assign(DEPTH * WIDTH, 0);
+    }
+}
+
+size_t HotKeySketch::capacity() const {
+    return k;
+}
+
+void HotKeySketch::add(const std::string& key) {
+    if (k == 0) return;
+
+    // Rows are indexed by h1 + row * h2 (double hashing) from one hash
+    uint64_t hash = std::hash<std::string>{}(key);
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    size_t slots[DEPTH];
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < DEPTH; row++) {
+        slots[row] = row * WIDTH + ((h1 + row * h2) & (WIDTH - 1));
+        estimate = std::min(estimate, counters[slots[row]]);
+    }
+    // Conservative update: only the counters at the minimum grow, which
+    // keeps the overestimate from collisions down
+    for (size_t row = 0; row < DEPTH; row++) {
+        if (counters[slots[row]] == estimate) counters[slots[row]]++;
+    }
+    estimate++;
+
+    auto known = positions.find(key);
+    if (known != positions.end()) {
+        heap[known->second].first = estimate;
+        siftDown(known->second);
+    } else if (heap.size() < k) {
+        heap.emplace_back(estimate, key);
+        positions[key] = heap.size() - 1;
+        siftUp(heap.size() - 1);
+    } else if (estimate > heap[0].first) {
+        positions.erase(heap[0].second);
+        heap[0] = {estimate, key};
+        positions[key] = 0;
+        siftDown(0);
+    }
+
+    if (++additions % DECAY_INTERVAL == 0) decay();
+}
+
+std::vector<std::pair<std::string, uint64_t>> HotKeySketch::top() const {
+    std::vector<std::pair<std::string, uint64_t>> out;
+    for (const auto& entry : heap) out.emplace_back(entry.second, entry.first);
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    return out;
+}
+
+void HotKeySketch::swapEntries(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    positions[heap[a].second] = a;
+    positions[heap[b].second] = b;
+}
+
+void HotKeySketch::siftUp(size_t i) {
+    while (i > 0 && heap[(i - 1) / 2].first > heap[i].first) {
+        swapEntries(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void HotKeySketch::siftDown(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap.size(); child++) {
+            if (heap[child].first < heap[smallest].first) smallest = child;
+        }
+        if (smallest == i) return;
+        swapEntries(i, smallest);
+        i = smallest;
+    }
+}
+
+// Halving is monotonic, the heap stays ordered
+void HotKeySketch::decay() {
+    for (auto& counter : counters) counter >>= 1;
+    for (auto& entry : heap) entry.first >>= 1;
+}
@@ -0,0 +1,462 @@
+#include "hyperloglog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HLL_HAVE_X86 1
+#endif
+
+// Header: magic, encoding, 3 unused bytes, then the cached cardinality in
+// little endian with its top bit set while it is stale
+static const char MAGIC[] = "HYLL";
+static constexpr uint8_t DENSE = 0;
+static constexpr uint8_t SPARSE = 1;
+static constexpr size_t ENCODING_OFFSET = 4;
+static constexpr size_t CARD_OFFSET = 8;
+static constexpr uint8_t STALE = 0x80;
+
+// Sparse opcodes: ZERO 00xxxxxx (1..64 zero registers), XZERO 01xxxxxx
+// xxxxxxxx (1..16384 zero registers), VAL 1vvvvvxx (1..4 registers set to
+// 1..32)
+static constexpr int SPARSE_MAX_VALUE = 32;
+static constexpr size_t ZERO_MAX_RUN = 64;
+static constexpr size_t XZERO_MAX_RUN = 16384;
+static constexpr size_t VAL_MAX_RUN = 4;
+
+static constexpr uint8_t MAX_REGISTER = HyperLogLog::Q + 1;
+
+// MurmurHash64A with the seed Redis uses, so a counter counts the same
+// elements the same way
+static uint64_t murmurHash64A(const void* key, size_t len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0xadc83b19ULL ^ (len * m);
+
+    const uint8_t* data = static_cast<const uint8_t*>(key);
+    const uint8_t* end = data + (len - (len & 7));
+    while (data != end) {
+        uint64_t k;
+        std::memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        data += 8;
+    }
+
+    switch (len & 7) {
+        case 7: h ^= static_cast<uint64_t>(data[6]) << 48; [[fallthrough]];
+        case 6: h ^= static_cast<uint64_t>(data[5]) << 40; [[fallthrough]];
+        case 5: h ^= static_cast<uint64_t>(data[4]) << 32; [[fallthrough]];
+        case 4: h ^= static_cast<uint64_t>(data[3]) << 24; [[fallthrough]];
+        case 3: h ^= static_cast<uint64_t>(data[2]) << 16; [[fallthrough]];
+        case 2: h ^= static_cast<uint64_t>(data[1]) << 8; [[fallthrough]];
+        case 1:
+            h ^= static_cast<uint64_t>(data[0]);
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Register of element and the value it proposes: the low P hash bits pick
+// the register, the run of zeros in the rest (plus one) is the value
+static uint8_t registerFor(const std::string& element, size_t& index) {
+    uint64_t hash = murmurHash64A(element.data(), element.size());
+    index = hash & (HyperLogLog::REGISTERS - 1);
+    hash >>= HyperLogLog::P;
+    hash |= uint64_t(1) << HyperLogLog::Q;
+    return static_cast<uint8_t>(__builtin_ctzll(hash) + 1);
+}
+
+static uint8_t denseGet(const uint8_t* dense, size_t index) {
+    size_t bit = index * 6;
+    size_t byte = bit >> 3;
+    unsigned shift = bit & 7;
+    unsigned value = dense[byte] >> shift;
+    if (shift > 2) value |= dense[byte + 1] << (8 - shift);
+    return value & 63;
+}
+
+static void denseSet(uint8_t* dense, size_t index, uint8_t value) {
+    size_t bit = index * 6;
+    size_t byte = bit >> 3;
+    unsigned shift = bit & 7;
+    dense[byte] = static_cast<uint8_t>((dense[byte] & ~(63u << shift)) | (value << shift));
+    if (shift > 2) {
+        dense[byte + 1] = static_cast<uint8_t>((dense[byte + 1] & ~(63u >> (8 - shift))) | (value >> (8 - shift)));
+    }
+}
+
+static uint8_t* body(std::string& value) {
+    return reinterpret_cast<uint8_t*>(&value[HyperLogLog::HEADER_BYTES]);
+}
+
+static const uint8_t* body(const std::string& value) {
+    return reinterpret_cast<const uint8_t*>(value.data() + HyperLogLog::HEADER_BYTES);
+}
+
+static std::string header(uint8_t encoding) {
+    std::string out(HyperLogLog::HEADER_BYTES, '\0');
+    std::memcpy(&out[0], MAGIC, 4);
+    out[ENCODING_OFFSET] = static_cast<char>(encoding);
+    out[CARD_OFFSET + 7] = static_cast<char>(STALE);
+    return out;
+}
+
+// Registers that are not zero, by index
+using SparseEntries = std::vector<std::pair<uint16_t, uint8_t>>;
+
+// Walk the opcodes of a sparse body, calling set(index, run, value) for
+// every VAL. False when the opcodes do not cover exactly REGISTERS
+template <typename SetRun>
+static bool walkSparse(const uint8_t* p, const uint8_t* end, SetRun set) {
+    size_t index = 0;
+    while (p < end) {
+        uint8_t op = *p++;
+        if (op & 0x80) {
+            size_t run = (op & 3) + 1;
+            if (index + run > HyperLogLog::REGISTERS) return false;
+            set(index, run, static_cast<uint8_t>(((op >> 2) & 0x1f) + 1));
+            index += run;
+        } else if (op & 0x40) {
+            if (p == end) return false;
+            index += (((op & 0x3f) << 8) | *p++) + 1;
+        } else {
+            index += (op & 0x3f) + 1;
+        }
+        if (index > HyperLogLog::REGISTERS) return false;
+    }
+    return index == HyperLogLog::REGISTERS;
+}
+
+static void putZeros(std::string& out, size_t run) {
+    while (run > ZERO_MAX_RUN) {
+        size_t n = std::min(run, XZERO_MAX_RUN);
+        out += static_cast<char>(0x40 | ((n - 1) >> 8));
+        out += static_cast<char>((n - 1) & 0xff);
+        run -= n;
+    }
+    if (run > 0) out += static_cast<char>(run - 1);
+}
+
+// Sparse counter from entries sorted by index, values up to
+// SPARSE_MAX_VALUE
+static std::string encodeSparse(const SparseEntries& entries) {
+    std::string out = header(SPARSE);
+    size_t next = 0;
+    for (size_t i = 0; i < entries.size();) {
+        size_t index = entries[i].first;
+        uint8_t value = entries[i].second;
+        putZeros(out, index - next);
+        size_t run = 1;
+        while (run < VAL_MAX_RUN && i + run < entries.size() && entries[i + run].first == index + run &&
+               entries[i + run].second == value) {
+            run++;
+        }
+        out += static_cast<char>(0x80 | ((value - 1) << 2) | (run - 1));
+        next = index + run;
+        i += run;
+    }
+    putZeros(out, HyperLogLog::REGISTERS - next);
+    return out;
+}
+
+static std::string encodeDense(const uint8_t* registers) {
+    std::string out = header(DENSE);
+    out.resize(HyperLogLog::DENSE_BYTES);
+    uint8_t* dense = body(out);
+    for (size_t i = 0; i < HyperLogLog::REGISTERS; i += 4, dense += 3) {
+        const uint8_t* r = registers + i;
+        dense[0] = static_cast<uint8_t>(r[0] | (r[1] << 6));
+        dense[1] = static_cast<uint8_t>((r[1] >> 2) | (r[2] << 4));
+        dense[2] = static_cast<uint8_t>((r[2] >> 4) | (r[3] << 2));
+    }
+    return out;
+}
+
+static bool cachedCount(const std::string& value, uint64_t& count) {
+    if (static_cast<uint8_t>(value[CARD_OFFSET + 7]) & STALE) return false;
+    count = 0;
+    for (int i = 0; i < 8; i++) count |= static_cast<uint64_t>(static_cast<uint8_t>(value[CARD_OFFSET + i])) << (8 * i);
+    return true;
+}
+
+static void setCachedCount(std::string& value, uint64_t count) {
+    for (int i = 0; i < 8; i++) value[CARD_OFFSET + i] = static_cast<char>((count >> (8 * i)) & 0xff);
+}
+
+std::string HyperLogLog::create() {
+    std::string out = encodeSparse({});
+    setCachedCount(out, 0);
+    return out;
+}
+
+bool HyperLogLog::valid(const std::string& value) {
+    if (value.size() < HEADER_BYTES || value.compare(0, 4, MAGIC) != 0) return false;
+    uint8_t encoding = static_cast<uint8_t>(value[ENCODING_OFFSET]);
+    if (encoding == DENSE) return value.size() == DENSE_BYTES;
+    if (encoding != SPARSE) return false;
+    const uint8_t* p = body(value);
+    return walkSparse(p, p + value.size() - HEADER_BYTES, [](size_t, size_t, uint8_t) {});
+}
+
+bool HyperLogLog::add(std::string& value, const std::vector<std::string>& elements, size_t sparseMaxBytes) {
+    bool changed = false;
+    if (static_cast<uint8_t>(value[ENCODING_OFFSET]) == DENSE) {
+        uint8_t* dense = body(value);
+        for (const auto& element : elements) {
+            size_t index;
+            uint8_t count = registerFor(element, index);
+            if (count > denseGet(dense, index)) {
+                denseSet(dense, index, count);
+                changed = true;
+            }
+        }
+        if (changed) value[CARD_OFFSET + 7] = static_cast<char>(value[CARD_OFFSET + 7] | STALE);
+        return changed;
+    }
+
+    // Sparse: update the list of set registers, then encode it again
+    SparseEntries entries;
+    const uint8_t* p = body(value);
+    walkSparse(p, p + value.size() - HEADER_BYTES, [&](size_t index, size_t run, uint8_t v) {
+        for (size_t i = 0; i < run; i++) entries.emplace_back(static_cast<uint16_t>(index + i), v);
+    });
+    uint8_t highest = 0;
+    for (const auto& element : elements) {
+        size_t index;
+        uint8_t count = registerFor(element, index);
+        auto it = std::lower_bound(entries.begin(), entries.end(), std::make_pair(static_cast<uint16_t>(index), uint8_t(0)));
+        if (it != entries.end() && it->first == index) {
+            if (count <= it->second) continue;
+            it->second = count;
+        } else {
+            entries.insert(it, {static_cast<uint16_t>(index), count});
+        }
+        highest = std::max(highest, count);
+        changed = true;
+    }
+    if (!changed) return false;
+
+    std::string sparse;
+    if (highest <= SPARSE_MAX_VALUE) sparse = encodeSparse(entries);
+    if (sparse.empty() || sparse.size() > sparseMaxBytes) {
+        uint8_t registers[REGISTERS] = {};
+        for (const auto& entry : entries) registers[entry.first] = entry.second;
+        value = encodeDense(registers);
+    } else {
+        value = std::move(sparse);
+    }
+    return true;
+}
+
+uint64_t HyperLogLog::count(std::string& value) {
+    uint64_t count;
+    if (cachedCount(value, count)) return count;
+    uint8_t registers[REGISTERS] = {};
+    merge(value, registers);
+    count = estimate(registers);
+    setCachedCount(value, count);
+    return count;
+}
+
+void HyperLogLog::merge(const std::string& value, uint8_t* registers) {
+    const uint8_t* p = body(value);
+    if (static_cast<uint8_t>(value[ENCODING_OFFSET]) == DENSE) {
+        mergeDense(registers, p);
+        return;
+    }
+    walkSparse(p, p + value.size() - HEADER_BYTES, [registers](size_t index, size_t run, uint8_t v) {
+        for (size_t i = index; i < index + run; i++) registers[i] = std::max(registers[i], v);
+    });
+}
+
+std::string HyperLogLog::fromRegisters(const uint8_t* registers, size_t sparseMaxBytes) {
+    SparseEntries entries;
+    bool sparse = true;
+    for (size_t i = 0; i < REGISTERS && sparse; i++) {
+        if (registers[i] == 0) continue;
+        if (registers[i] > SPARSE_MAX_VALUE) sparse = false;
+        // A VAL opcode covers at most 4 registers, beyond this the
+        // encoding can not fit anyway
+        if (entries.size() >= sparseMaxBytes * VAL_MAX_RUN) sparse = false;
+        entries.emplace_back(static_cast<uint16_t>(i), registers[i]);
+    }
+    if (sparse) {
+        std::string out = encodeSparse(entries);
+        if (out.size() <= sparseMaxBytes) return out;
+    }
+    return encodeDense(registers);
+}
+
+// Corrections of the estimator for registers that are still zero (sigma)
+// and for those that hit Q + 1 (tau), see Ertl, "New cardinality
+// estimation algorithms for HyperLogLog sketches"
+static double sigma(double x) {
+    if (x == 1.0) return INFINITY;
+    double y = 1.0, z = x, previous;
+    do {
+        x *= x;
+        previous = z;
+        z += x * y;
+        y += y;
+    } while (previous != z);
+    return z;
+}
+
+static double tau(double x) {
+    if (x == 0.0 || x == 1.0) return 0.0;
+    double y = 1.0, z = 1.0 - x, previous;
+    do {
+        x = std::sqrt(x);
+        previous = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (previous != z);
+    return z / 3;
+}
+
+uint64_t HyperLogLog::estimate(const uint8_t* registers) {
+    size_t zeros, saturated;
+    double sum = registerSum(registers, zeros, saturated);
+    if (zeros == REGISTERS) return 0;
+
+    const double m = REGISTERS;
+    // Registers 1..Q weigh 2^-r, the two ends are replaced by their
+    // corrections
+    double z = sum - zeros - saturated * std::ldexp(1.0, -(Q + 1));
+    z += m * tau(1.0 - saturated / m) * std::ldexp(1.0, -Q);
+    z += m * sigma(zeros / m);
+    return static_cast<uint64_t>(std::llround(0.5 / std::log(2.0) * m * m / z));
+}
+
+void HyperLogLog::mergeDenseScalar(uint8_t* registers, const uint8_t* dense) {
+    // Four 6 bit registers in every three bytes
+    for (size_t i = 0; i < REGISTERS; i += 4, dense += 3) {
+        uint8_t r0 = dense[0] & 63;
+        uint8_t r1 = ((dense[0] >> 6) | (dense[1] << 2)) & 63;
+        uint8_t r2 = ((dense[1] >> 4) | (dense[2] << 4)) & 63;
+        uint8_t r3 = dense[2] >> 2;
+        registers[i] = std::max(registers[i], r0);
+        registers[i + 1] = std::max(registers[i + 1], r1);
+        registers[i + 2] = std::max(registers[i + 2], r2);
+        registers[i + 3] = std::max(registers[i + 3], r3);
+    }
+}
+
+double HyperLogLog::registerSumScalar(const uint8_t* registers, size_t& zeros, size_t& saturated) {
+    static const auto weights = []() {
+        std::vector<double> table(64);
+        for (int r = 0; r < 64; r++) table[r] = std::ldexp(1.0, -r);
+        return table;
+    }();
+    double sum = 0;
+    zeros = saturated = 0;
+    for (size_t i = 0; i < REGISTERS; i++) {
+        sum += weights[registers[i] & 63];
+        zeros += registers[i] == 0;
+        saturated += registers[i] == MAX_REGISTER;
+    }
+    return sum;
+}
+
+#ifdef HLL_HAVE_X86
+// 24 dense bytes become 32 registers: each 128 bit lane takes 12 bytes,
+// spreads every 3 byte group into a 32 bit word and moves its four 6 bit
+// fields into separate bytes
+__attribute__((target("avx2")))
+static void mergeDenseAVX2(uint8_t* registers, const uint8_t* dense) {
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i field0 = _mm256_set1_epi32(0x3F);
+    const __m256i field1 = _mm256_set1_epi32(0x3F00);
+    const __m256i field2 = _mm256_set1_epi32(0x3F0000);
+    const __m256i field3 = _mm256_set1_epi32(0x3F000000);
+    const size_t denseBytes = HyperLogLog::REGISTERS * 6 / 8;
+
+    size_t i = 0, offset = 0;
+    // The second 16 byte load reads 4 bytes past the group, the last one is
+    // left to the scalar tail
+    for (; offset + 28 <= denseBytes; offset += 24, i += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dense + offset));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dense + offset + 12));
+        __m256i words = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+        __m256i unpacked = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(words, field0), _mm256_and_si256(_mm256_slli_epi32(words, 2), field1)),
+            _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(words, 4), field2),
+                            _mm256_and_si256(_mm256_slli_epi32(words, 6), field3)));
+        __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(registers + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(registers + i), _mm256_max_epu8(current, unpacked));
+    }
+    for (; i < HyperLogLog::REGISTERS; i += 4, offset += 3) {
+        const uint8_t* d = dense + offset;
+        registers[i] = std::max<uint8_t>(registers[i], d[0] & 63);
+        registers[i + 1] = std::max<uint8_t>(registers[i + 1], ((d[0] >> 6) | (d[1] << 2)) & 63);
+        registers[i + 2] = std::max<uint8_t>(registers[i + 2], ((d[1] >> 4) | (d[2] << 4)) & 63);
+        registers[i + 3] = std::max<uint8_t>(registers[i + 3], d[2] >> 2);
+    }
+}
+
+// 2^-r is built directly as a double: exponent 1023 - r, zero mantissa
+__attribute__((target("avx2")))
+static double registerSumAVX2(const uint8_t* registers, size_t& zeros, size_t& saturated) {
+    const __m256i bias = _mm256_set1_epi64x(1023);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi8(static_cast<char>(MAX_REGISTER));
+    __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+    size_t zeroCount = 0, fullCount = 0;
+
+    for (size_t i = 0; i < HyperLogLog::REGISTERS; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(registers + i));
+        zeroCount += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero))));
+        fullCount += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, full))));
+        for (size_t j = 0; j < 32; j += 4) {
+            int32_t four;
+            std::memcpy(&four, registers + i + j, sizeof(four));
+            __m256i r = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(four));
+            __m256d weight = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(bias, r), 52));
+            acc[(j / 4) & 3] = _mm256_add_pd(acc[(j / 4) & 3], weight);
+        }
+    }
+
+    __m256d total = _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]), _mm256_add_pd(acc[2], acc[3]));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    zeros = zeroCount;
+    saturated = fullCount;
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static bool cpuHasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+void HyperLogLog::mergeDense(uint8_t* registers, const uint8_t* dense) {
+#ifdef HLL_HAVE_X86
+    if (cpuHasAVX2()) return mergeDenseAVX2(registers, dense);
+#endif
+    mergeDenseScalar(registers, dense);
+}
+
+double HyperLogLog::registerSum(const uint8_t* registers, size_t& zeros, size_t& saturated) {
+#ifdef HLL_HAVE_X86
+    if (cpuHasAVX2()) return registerSumAVX2(registers, zeros, saturated);
+#endif
+    return registerSumScalar(registers, zeros, saturated);
+}
+
+const char* HyperLogLog::kernelName() {
+#ifdef HLL_HAVE_X86
+    if (cpuHasAVX2()) return "avx2";
+#endif
+    return "scalar";
+}
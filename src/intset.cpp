@@ -0,0 +1,163 @@
+#include "intset.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iterator>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INTSET_HAVE_X86 1
+#endif
+
+// Use galloping once one side is this many times larger than the other
+static constexpr size_t GALLOP_RATIO = 32;
+
+bool IntSet::add(int64_t value) {
+    // Ascending inserts, as from a loader or a counter, append
+    if (data.empty() || data.back() < value) {
+        data.push_back(value);
+        return true;
+    }
+    auto it = std::lower_bound(data.begin(), data.end(), value);
+    if (it != data.end() && *it == value) return false;
+    data.insert(it, value);
+    return true;
+}
+
+size_t IntSet::add(std::vector<int64_t> values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    size_t before = data.size();
+    if (values.empty()) return 0;
+    if (data.empty() || data.back() < values.front()) {
+        data.insert(data.end(), values.begin(), values.end());
+        return data.size() - before;
+    }
+
+    std::vector<int64_t> merged;
+    merged.reserve(data.size() + values.size());
+    std::set_union(data.begin(), data.end(), values.begin(), values.end(), std::back_inserter(merged));
+    data.swap(merged);
+    return data.size() - before;
+}
+
+bool IntSet::remove(int64_t value) {
+    auto it = std::lower_bound(data.begin(), data.end(), value);
+    if (it == data.end() || *it != value) return false;
+    data.erase(it);
+    return true;
+}
+
+bool IntSet::contains(int64_t value) const {
+    return std::binary_search(data.begin(), data.end(), value);
+}
+
+size_t IntSet::size() const {
+    return data.size();
+}
+
+const std::vector<int64_t>& IntSet::values() const {
+    return data;
+}
+
+bool IntSet::parseMember(const std::string& member, int64_t& value) {
+    if (member.empty() || member.size() > 20) return false;
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(member.c_str(), &end, 10);
+    if (errno != 0 || end != member.c_str() + member.size()) return false;
+
+    // Reject "+1", "01", " 1" and friends, they must stay strings
+    if (std::to_string(parsed) != member) return false;
+    value = parsed;
+    return true;
+}
+
+size_t IntSet::intersectScalar(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+// small is much shorter than large: exponential search forward in large for
+// every value of small, then binary search inside the bracket
+static size_t intersectGalloping(const int64_t* small, size_t ns, const int64_t* large, size_t nl, int64_t* out) {
+    size_t k = 0, lo = 0;
+    for (size_t i = 0; i < ns && lo < nl; i++) {
+        int64_t value = small[i];
+        size_t step = 1, hi = lo;
+        while (hi < nl && large[hi] < value) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        if (hi > nl) hi = nl;
+
+        const int64_t* pos = std::lower_bound(large + lo, large + hi + (hi < nl ? 1 : 0), value);
+        lo = pos - large;
+        if (lo < nl && large[lo] == value) out[k++] = value;
+    }
+    return k;
+}
+
+#ifdef INTSET_HAVE_X86
+// Compare blocks of 4 against 4 with every rotation of the b block, emit the
+// a values that matched and advance whichever block has the smaller maximum
+__attribute__((target("avx2")))
+static size_t intersectAVX2(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+
+        __m256i eq = _mm256_cmpeq_epi64(va, vb);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        while (mask) {
+            out[k++] = a[i + __builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+
+        int64_t amax = a[i + 3], bmax = b[j + 3];
+        i += (amax <= bmax) * 4;
+        j += (bmax <= amax) * 4;
+    }
+
+    // Matches already emitted were against earlier b blocks, so the scalar
+    // tail cannot produce duplicates
+    return k + IntSet::intersectScalar(a + i, na - i, b + j, nb - j, out + k);
+}
+
+static bool cpuHasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+size_t IntSet::intersect(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    if (na == 0 || nb == 0) return 0;
+    if (na > nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if (nb / na >= GALLOP_RATIO) return intersectGalloping(a, na, b, nb, out);
+
+#ifdef INTSET_HAVE_X86
+    if (cpuHasAVX2()) return intersectAVX2(a, na, b, nb, out);
+#endif
+    return intersectScalar(a, na, b, nb, out);
+}
@@ -0,0 +1,81 @@
+#include "io_threads.h"
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+IoThreads::IoThreads(size_t threads) {
+    for (size_t i = 1; i < threads; i++) {
+        workers.emplace_back([this, i]() { run(i); });
+    }
+}
+
+IoThreads::~IoThreads() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        generation++;
+    }
+    wakeup.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t IoThreads::size() const {
+    return workers.size() + 1;
+}
+
+void IoThreads::runShare(size_t index) {
+    for (size_t i = index; i < currentCount; i += size()) {
+        (*currentJob)(i);
+    }
+}
+
+bool IoThreads::parallelFor(size_t count, const std::function<void(size_t)>& job) {
+    if (workers.empty() || count < size() * 2) {
+        for (size_t i = 0; i < count; i++) job(i);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = &job;
+        currentCount = count;
+        remaining.store(workers.size(), std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    wakeup.notify_all();
+
+    runShare(0);
+    // Give the CPU away when a worker has not been scheduled yet
+    for (int spin = 0; remaining.load(std::memory_order_acquire) > 0; spin++) {
+        if (spin < SPIN_ROUNDS) {
+            cpuRelax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+void IoThreads::run(size_t index) {
+    uint64_t seen = 0;
+    while (true) {
+        // Batches come back to back under load, spin a little before sleeping
+        for (int spin = 0; spin < SPIN_ROUNDS && generation.load(std::memory_order_acquire) == seen; spin++) {
+            cpuRelax();
+        }
+        if (generation.load(std::memory_order_acquire) == seen) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [&]() { return generation.load(std::memory_order_relaxed) != seen; });
+        }
+        seen = generation.load(std::memory_order_acquire);
+
+        if (stopping) return;
+        runShare(index);
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
@@ -0,0 +1,129 @@
+#include "latency.h"
+#include "config.h"
+
+#include <algorithm>
+
+static std::string bulk(const std::string& value) {
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+static std::string integer(uint64_t value) {
+    return ":" + std::to_string(value) + "\r\n";
+}
+
+void SlowLog::recordIfSlow(const std::vector<std::string>& tokens, uint64_t micros, const std::string& client) {
+    long long threshold = serverConfig().slowlogLogSlowerThan.load(std::memory_order_relaxed);
+    if (threshold < 0 || micros < static_cast<uint64_t>(threshold)) return;
+
+    // Huge commands are truncated so the log stays small
+    Entry entry{nextId++, std::time(nullptr), micros, {}, client};
+    size_t kept = std::min(tokens.size(), MAX_ARGS);
+    for (size_t i = 0; i < kept; i++) {
+        if (kept < tokens.size() && i == kept - 1) {
+            entry.args.push_back("... (" + std::to_string(tokens.size() - kept + 1) + " more arguments)");
+        } else if (tokens[i].size() > MAX_ARG_LEN) {
+            entry.args.push_back(tokens[i].substr(0, MAX_ARG_LEN) + "... (" +
+                                 std::to_string(tokens[i].size() - MAX_ARG_LEN) + " more bytes)");
+        } else {
+            entry.args.push_back(tokens[i]);
+        }
+    }
+    entries.push_front(std::move(entry));
+
+    size_t maxLen = static_cast<size_t>(serverConfig().slowlogMaxLen.load(std::memory_order_relaxed));
+    while (entries.size() > maxLen) entries.pop_back();
+}
+
+std::string SlowLog::getReply(size_t count) const {
+    count = std::min(count, entries.size());
+    // Each entry: id, unix time, microseconds, arguments, client address, client name
+    std::string reply = "*" + std::to_string(count) + "\r\n";
+    for (size_t i = 0; i < count; i++) {
+        const Entry& entry = entries[i];
+        reply += "*6\r\n" + integer(entry.id) + integer(entry.time) + integer(entry.micros);
+        reply += "*" + std::to_string(entry.args.size()) + "\r\n";
+        for (const auto& arg : entry.args) reply += bulk(arg);
+        reply += bulk(entry.client) + bulk("");
+    }
+    return reply;
+}
+
+size_t SlowLog::length() const {
+    return entries.size();
+}
+
+void SlowLog::reset() {
+    entries.clear();
+}
+
+LatencyMonitor& LatencyMonitor::getInstance() {
+    static LatencyMonitor instance;
+    return instance;
+}
+
+void LatencyMonitor::addSampleIfNeeded(const std::string& event, uint64_t millis) {
+    long long threshold = serverConfig().latencyMonitorThreshold.load(std::memory_order_relaxed);
+    if (threshold <= 0 || millis < static_cast<uint64_t>(threshold)) return;
+
+    time_t now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(mutex);
+    Series& series = events[event];
+    series.maxMillis = std::max(series.maxMillis, millis);
+
+    if (series.count > 0) {
+        Sample& last = series.samples[(series.next + HISTORY_LEN - 1) % HISTORY_LEN];
+        if (last.time == now) {
+            last.millis = std::max(last.millis, millis);
+            return;
+        }
+    }
+    series.samples[series.next] = {now, millis};
+    series.next = (series.next + 1) % HISTORY_LEN;
+    series.count = std::min(series.count + 1, HISTORY_LEN);
+}
+
+std::string LatencyMonitor::latestReply() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Each event: name, unix time of the latest spike, its latency, the all time max
+    std::string reply = "*" + std::to_string(events.size()) + "\r\n";
+    for (const auto& entry : events) {
+        const Series& series = entry.second;
+        const Sample& last = series.samples[(series.next + HISTORY_LEN - 1) % HISTORY_LEN];
+        reply += "*4\r\n" + bulk(entry.first) + integer(last.time) + integer(last.millis) + integer(series.maxMillis);
+    }
+    return reply;
+}
+
+std::string LatencyMonitor::historyReply(const std::string& event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = events.find(event);
+    if (it == events.end()) return "*0\r\n";
+
+    // Oldest sample first
+    const Series& series = it->second;
+    std::string reply = "*" + std::to_string(series.count) + "\r\n";
+    size_t first = (series.next + HISTORY_LEN - series.count) % HISTORY_LEN;
+    for (size_t i = 0; i < series.count; i++) {
+        const Sample& sample = series.samples[(first + i) % HISTORY_LEN];
+        reply += "*2\r\n" + integer(sample.time) + integer(sample.millis);
+    }
+    return reply;
+}
+
+size_t LatencyMonitor::reset(const std::vector<std::string>& names) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (names.empty()) {
+        size_t cleared = events.size();
+        events.clear();
+        return cleared;
+    }
+    size_t cleared = 0;
+    for (const auto& name : names) cleared += events.erase(name);
+    return cleared;
+}
+
+LatencyScope::~LatencyScope() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    LatencyMonitor::getInstance().addSampleIfNeeded(
+        event, std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
@@ -0,0 +1,47 @@
+#include "lazy_free.h"
+
+LazyFree& LazyFree::getInstance() {
+    static LazyFree instance;
+    return instance;
+}
+
+LazyFree::LazyFree() : stopping(false) {
+    worker = std::thread([this]() { run(); });
+}
+
+LazyFree::~LazyFree() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+void LazyFree::enqueue(std::shared_ptr<void> obj) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(obj));
+    }
+    queue_cv.notify_one();
+}
+
+size_t LazyFree::pending() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return queue.size();
+}
+
+void LazyFree::run() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        queue_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty() && stopping) return;
+
+        // Swap the batch out so the destructors run without the queue lock
+        std::deque<std::shared_ptr<void>> batch;
+        batch.swap(queue);
+        lock.unlock();
+        batch.clear();
+        lock.lock();
+    }
+}
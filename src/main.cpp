@@ -2,12 +2,33 @@
 #include "redis_database.h"
 
 #include <iostream>
+#include <string>
 #include <thread>
 #include <chrono>
 
 int main(int argc, char* argv[]) {
     int port = 6379;
-    if (argc >= 2) port = std::stoi(argv[1]);
+    bool clusterEnabled = false;
+    IoEngine ioEngine = IoEngine::Epoll;
+    int ioThreads = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cluster-enabled") {
+            clusterEnabled = true;
+        } else if (arg == "--io-threads" && i + 1 < argc) {
+            ioThreads = std::stoi(argv[++i]);
+        } else if (arg == "--io-engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "io_uring") {
+                ioEngine = IoEngine::IoUring;
+            } else if (engine != "epoll") {
+                std::cerr << "Unknown I/O engine " << engine << ", expected epoll or io_uring\n";
+                return 1;
+            }
+        } else {
+            port = std::stoi(arg);
+        }
+    }
 
     if (RedisDatabase::getInstance().load("dump.my_rdb")) {
         std::cout << "Database loaded from dump.my_rdb\n";
@@ -16,6 +37,9 @@ int main(int argc, char* argv[]) {
     }
 
     RedisServer server(port);
+    if (clusterEnabled) server.enableCluster();
+    server.setIoEngine(ioEngine);
+    server.setIoThreads(ioThreads);
 
     // Save the database every 5 mins, persistance storage
     std::thread persistanceThread([](){
@@ -0,0 +1,325 @@
+#include "pubsub.h"
+#include "resp_writer.h"
+
+#include <set>
+#include <utility>
+
+// Edge tokens: 'L' + char for a literal, "?" and "*" for wildcards, '[' + body
+// for a character class
+struct PatternTrie::Node {
+    std::unordered_map<char, std::unique_ptr<Node>> literals;
+    std::unique_ptr<Node> any;
+    std::unique_ptr<Node> star;
+    std::vector<std::pair<std::string, std::unique_ptr<Node>>> classes;
+
+    // Patterns ending at this node. Several spellings can share a node
+    // ("a**" and "a*", "\\a" and "a"), so subscribers are kept per pattern
+    std::unordered_map<std::string, std::unordered_set<RedisConnection*>> subscribers;
+
+    bool empty() const {
+        return literals.empty() && !any && !star && classes.empty() && subscribers.empty();
+    }
+};
+
+PatternTrie::PatternTrie() : root(std::make_unique<Node>()), patterns(0) {}
+
+PatternTrie::~PatternTrie() = default;
+
+std::vector<std::string> PatternTrie::tokenize(const std::string& pattern) {
+    std::vector<std::string> tokens;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '*') {
+            // "a**b" matches exactly like "a*b"
+            if (tokens.empty() || tokens.back() != "*") tokens.push_back("*");
+        } else if (c == '?') {
+            tokens.push_back("?");
+        } else if (c == '[') {
+            size_t end = i + 1;
+            while (end < pattern.size() && pattern[end] != ']') {
+                if (pattern[end] == '\\' && end + 1 < pattern.size()) end++;
+                end++;
+            }
+            tokens.push_back("[" + pattern.substr(i + 1, end - i - 1));
+            i = end;
+        } else if (c == '\\' && i + 1 < pattern.size()) {
+            tokens.push_back(std::string(1, 'L') + pattern[++i]);
+        } else {
+            tokens.push_back(std::string(1, 'L') + c);
+        }
+    }
+    return tokens;
+}
+
+// Same rules as the [...] branch of Redis' stringmatchlen
+static bool classMatches(const std::string& body, char c) {
+    size_t i = 0;
+    bool negate = false;
+    if (i < body.size() && body[i] == '^') {
+        negate = true;
+        i++;
+    }
+
+    bool matched = false;
+    while (i < body.size()) {
+        if (body[i] == '\\' && i + 1 < body.size()) {
+            if (body[i + 1] == c) matched = true;
+            i += 2;
+        } else if (i + 2 < body.size() && body[i + 1] == '-') {
+            char lo = body[i], hi = body[i + 2];
+            if (lo > hi) std::swap(lo, hi);
+            if (c >= lo && c <= hi) matched = true;
+            i += 3;
+        } else {
+            if (body[i] == c) matched = true;
+            i++;
+        }
+    }
+    return negate ? !matched : matched;
+}
+
+bool PatternTrie::add(const std::string& pattern, RedisConnection* conn) {
+    Node* node = root.get();
+    for (const auto& token : tokenize(pattern)) {
+        std::unique_ptr<Node>* next = nullptr;
+        if (token[0] == 'L') {
+            next = &node->literals[token[1]];
+        } else if (token == "?") {
+            next = &node->any;
+        } else if (token == "*") {
+            next = &node->star;
+        } else {
+            for (auto& cls : node->classes) {
+                if (cls.first == token) next = &cls.second;
+            }
+            if (!next) {
+                node->classes.emplace_back(token, nullptr);
+                next = &node->classes.back().second;
+            }
+        }
+        if (!*next) *next = std::make_unique<Node>();
+        node = next->get();
+    }
+
+    auto& subscribers = node->subscribers[pattern];
+    if (subscribers.empty()) patterns++;
+    return subscribers.insert(conn).second;
+}
+
+bool PatternTrie::remove(const std::string& pattern, RedisConnection* conn) {
+    std::vector<std::string> tokens = tokenize(pattern);
+
+    // Remember the path so empty nodes can be pruned bottom up
+    std::vector<std::pair<Node*, size_t>> path;
+    Node* node = root.get();
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const std::string& token = tokens[i];
+        Node* next = nullptr;
+        if (token[0] == 'L') {
+            auto it = node->literals.find(token[1]);
+            if (it != node->literals.end()) next = it->second.get();
+        } else if (token == "?") {
+            next = node->any.get();
+        } else if (token == "*") {
+            next = node->star.get();
+        } else {
+            for (auto& cls : node->classes) {
+                if (cls.first == token) next = cls.second.get();
+            }
+        }
+        if (!next) return false;
+        path.emplace_back(node, i);
+        node = next;
+    }
+
+    auto it = node->subscribers.find(pattern);
+    if (it == node->subscribers.end() || it->second.erase(conn) == 0) return false;
+    if (it->second.empty()) {
+        node->subscribers.erase(it);
+        patterns--;
+    }
+
+    for (size_t i = path.size(); i-- > 0;) {
+        Node* parent = path[i].first;
+        const std::string& token = tokens[path[i].second];
+        Node* child = (i + 1 < path.size()) ? path[i + 1].first : node;
+        if (!child->empty()) break;
+
+        if (token[0] == 'L') {
+            parent->literals.erase(token[1]);
+        } else if (token == "?") {
+            parent->any.reset();
+        } else if (token == "*") {
+            parent->star.reset();
+        } else {
+            for (auto cls = parent->classes.begin(); cls != parent->classes.end(); ++cls) {
+                if (cls->first == token) {
+                    parent->classes.erase(cls);
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+namespace {
+struct MatchState {
+    const std::string& channel;
+    std::vector<PatternTrie::Match>& out;
+    std::unordered_set<const void*> reported;
+    // (star node, channel offset) pairs already explored, bounds the walk for
+    // patterns with several stars
+    std::set<std::pair<const void*, size_t>> visitedStars;
+};
+}
+
+template <typename NodeT>
+static void collectMatches(const NodeT* node, size_t i, MatchState& state) {
+    const std::string& channel = state.channel;
+
+    // A star consumes any number of characters, including none
+    if (node->star) {
+        const NodeT* star = node->star.get();
+        for (size_t k = i; k <= channel.size(); k++) {
+            if (state.visitedStars.emplace(star, k).second) collectMatches(star, k, state);
+        }
+    }
+
+    if (i == channel.size()) {
+        if (!node->subscribers.empty() && state.reported.insert(node).second) {
+            for (const auto& entry : node->subscribers) {
+                state.out.push_back({&entry.first, &entry.second});
+            }
+        }
+        return;
+    }
+
+    char c = channel[i];
+    auto it = node->literals.find(c);
+    if (it != node->literals.end()) collectMatches(it->second.get(), i + 1, state);
+    if (node->any) collectMatches(node->any.get(), i + 1, state);
+    for (const auto& cls : node->classes) {
+        if (classMatches(cls.first.substr(1), c)) collectMatches(cls.second.get(), i + 1, state);
+    }
+}
+
+std::vector<PatternTrie::Match> PatternTrie::match(const std::string& channel) const {
+    std::vector<Match> out;
+    if (patterns == 0) return out;
+    MatchState state{channel, out, {}, {}};
+    collectMatches(root.get(), 0, state);
+    return out;
+}
+
+size_t PatternTrie::patternCount() const {
+    return patterns;
+}
+
+// PubSub. RESP3 clients get confirmations and messages as pushes
+static std::string confirmation(const char* kind, const std::string* name, size_t count, int protocol) {
+    std::string frame = pushHeader(3, protocol) + bulkReply(kind);
+    frame += name ? bulkReply(*name) : nullBulkReply(protocol);
+    frame += ":" + std::to_string(count) + "\r\n";
+    return frame;
+}
+
+std::string PubSub::subscribe(RedisConnection& conn, const std::vector<std::string>& channels) {
+    std::string reply;
+    for (const auto& channel : channels) {
+        if (conn.channels.insert(channel).second) {
+            channelSubscribers[channel].insert(&conn);
+        }
+        reply += confirmation("subscribe", &channel, conn.channels.size() + conn.patterns.size(), conn.protocol);
+    }
+    return reply;
+}
+
+std::string PubSub::unsubscribe(RedisConnection& conn, const std::vector<std::string>& channels) {
+    // No arguments means every channel
+    std::vector<std::string> targets = channels;
+    if (targets.empty()) targets.assign(conn.channels.begin(), conn.channels.end());
+    if (targets.empty()) return confirmation("unsubscribe", nullptr, conn.patterns.size(), conn.protocol);
+
+    std::string reply;
+    for (const auto& channel : targets) {
+        if (conn.channels.erase(channel)) {
+            auto it = channelSubscribers.find(channel);
+            if (it != channelSubscribers.end()) {
+                it->second.erase(&conn);
+                if (it->second.empty()) channelSubscribers.erase(it);
+            }
+        }
+        reply += confirmation("unsubscribe", &channel, conn.channels.size() + conn.patterns.size(), conn.protocol);
+    }
+    return reply;
+}
+
+std::string PubSub::psubscribe(RedisConnection& conn, const std::vector<std::string>& patterns) {
+    std::string reply;
+    for (const auto& pattern : patterns) {
+        if (conn.patterns.insert(pattern).second) {
+            patternSubscribers.add(pattern, &conn);
+        }
+        reply += confirmation("psubscribe", &pattern, conn.channels.size() + conn.patterns.size(), conn.protocol);
+    }
+    return reply;
+}
+
+std::string PubSub::punsubscribe(RedisConnection& conn, const std::vector<std::string>& patterns) {
+    std::vector<std::string> targets = patterns;
+    if (targets.empty()) targets.assign(conn.patterns.begin(), conn.patterns.end());
+    if (targets.empty()) return confirmation("punsubscribe", nullptr, conn.channels.size(), conn.protocol);
+
+    std::string reply;
+    for (const auto& pattern : targets) {
+        if (conn.patterns.erase(pattern)) {
+            patternSubscribers.remove(pattern, &conn);
+        }
+        reply += confirmation("punsubscribe", &pattern, conn.channels.size() + conn.patterns.size(), conn.protocol);
+    }
+    return reply;
+}
+
+size_t PubSub::publish(const std::string& channel, const std::string& message) {
+    size_t receivers = 0;
+
+    auto it = channelSubscribers.find(channel);
+    if (it != channelSubscribers.end()) {
+        // Serialized once per protocol in use, every subscriber queues a
+        // reference to the same buffer
+        std::shared_ptr<const std::string> frames[2];
+        std::string body = bulkReply("message") + bulkReply(channel) + bulkReply(message);
+        for (RedisConnection* conn : it->second) {
+            auto& frame = frames[conn->protocol >= 3];
+            if (!frame) frame = std::make_shared<const std::string>(pushHeader(3, conn->protocol) + body);
+            conn->addSharedReply(frame);
+        }
+        receivers += it->second.size();
+    }
+
+    for (const auto& match : patternSubscribers.match(channel)) {
+        std::shared_ptr<const std::string> frames[2];
+        std::string body = bulkReply("pmessage") + bulkReply(*match.pattern) + bulkReply(channel) + bulkReply(message);
+        for (RedisConnection* conn : *match.subscribers) {
+            auto& frame = frames[conn->protocol >= 3];
+            if (!frame) frame = std::make_shared<const std::string>(pushHeader(4, conn->protocol) + body);
+            conn->addSharedReply(frame);
+        }
+        receivers += match.subscribers->size();
+    }
+    return receivers;
+}
+
+void PubSub::removeConnection(RedisConnection& conn) {
+    if (!conn.channels.empty()) unsubscribe(conn, {});
+    if (!conn.patterns.empty()) punsubscribe(conn, {});
+}
+
+size_t PubSub::channelCount() const {
+    return channelSubscribers.size();
+}
+
+size_t PubSub::patternCount() const {
+    return patternSubscribers.patternCount();
+}
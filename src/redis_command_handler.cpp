@@ -1,57 +1,27 @@
 #include "redis_command_handler.h"
 #include "redis_database.h"
+#include "config.h"
+#include "lazy_free.h"
+#include "memory_usage.h"
+#include "resp_writer.h"
+#include "stats.h"
 
+#include <unordered_set>
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <malloc.h>
+#include <unistd.h>
 
-std::vector<std::string> parseRespCommand(const std::string& input) {
-    std::vector<std::string> tokens;
-    if (input.empty()) return tokens;
-
-    if (input[0] != '*') {
-        std::istringstream iss(input);
-        std::string token;
-
-        while (iss >> token) {
-            tokens.push_back(token);
-        }
-        return tokens;
-    }
-
-    size_t pos = 0;
-
-    if (input[pos] != '*') return tokens;
-    pos++;
-
-    size_t crlf = input.find("\r\n", pos);
-    if (crlf == std::string::npos) return tokens;
-
-    int numElements = std::stoi(input.substr(pos, crlf - pos));
-    pos = crlf + 2;
-
-    for (int i = 0; i < numElements; i++) {
-        // Break whenever the input is in the incorrect format
-        if (pos >= input.size() || input[pos] != '$') break;
-
-        // Skip the input $
-        pos++; 
-
-        size_t crlf = input.find("\r\n", pos);
-        if (crlf == std::string::npos) break;
-        int len = std::stoi(input.substr(pos, crlf - pos));
-        pos = crlf + 2;
-
-        if (pos + len > input.size()) break;
-        std::string token = input.substr(pos, len);
-        tokens.push_back(token);
-
-        // Skip len and token
-        pos += len + 2;
-    }
-    return tokens;
-}
+// Reply to a command run against a key that holds another type
+static const char* const WRONG_TYPE = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
 
 // Common commands
 static std::string handlePing(const std::vector<std::string>& /*tokens*/, RedisDatabase& /*db*/) {
@@ -64,7 +34,14 @@ static std::string handleEcho(const std::vector<std::string>& tokens, RedisDatab
 }
 
 static std::string handleFlushAll(const std::vector<std::string>& tokens, RedisDatabase& db) {
-    db.flushAll();
+    bool async = false;
+    if (tokens.size() >= 2) {
+        std::string mode = tokens[1];
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode == "ASYNC") async = true;
+        else if (mode != "SYNC") return "-Error: FLUSHALL accepts only ASYNC or SYNC\r\n";
+    }
+    db.flushAll(async);
     return "+OK\r\n";
 }
 
@@ -87,7 +64,7 @@ static std::string handleGet(const std::vector<std::string>& tokens, RedisDataba
         if (db.get(tokens[1], value)) {
             return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
         } else {
-            return "$-1\r\n";
+            return nullBulkReply();
         }
     } 
 }
@@ -102,6 +79,11 @@ static std::string handleKeys(const std::vector<std::string>& tokens, RedisDatab
     return output;
 }
 
+static std::string handleStrlen(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: STRLEN requires key\r\n";
+    return ":" + std::to_string(db.strlen(tokens[1])) + "\r\n";
+}
+
 static std::string handleType(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 2) {
         return "-Error: TYPE requires key\r\n";
@@ -114,8 +96,13 @@ static std::string handleDelAndUnlink(const std::vector<std::string>& tokens, Re
     if (tokens.size() < 2) {
         return "-Error: " + cmd + " requires key\r\n";
     } else {
-        bool res = db.del(tokens[1]);
-        return  ":" + std::to_string(res ? 1 : 0) + "\r\n"; 
+        // UNLINK only detaches the value, large ones are freed in the background
+        int removed = 0;
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            bool res = (cmd == "UNLINK") ? db.unlink(tokens[i]) : db.del(tokens[i]);
+            if (res) removed++;
+        }
+        return  ":" + std::to_string(removed) + "\r\n"; 
     }
 }
 
@@ -123,8 +110,13 @@ static std::string handleExpire(const std::vector<std::string>& tokens, RedisDat
     if (tokens.size() < 3) {
         return "-Error: EXPIRES requires key and time(s)\r\n";
     } else {
-        if (db.expire(tokens[1], stoi(tokens[2]))) {
-            return "+OK\r\n"; 
+        try {
+            if (db.expire(tokens[1], std::stoi(tokens[2]))) {
+                return "+OK\r\n"; 
+            }
+            return "-Error: key does not exist\r\n";
+        } catch (const std::exception&) {
+            return "-Error: Invalid time\r\n";
         }
     }
 }
@@ -136,9 +128,41 @@ static std::string handleRename(const std::vector<std::string>& tokens, RedisDat
         if (db.rename(tokens[1], tokens[2])) {
             return "+OK\r\n"; 
         }
+        return "-Error: key does not exist\r\n";
     }
 }
 
+// DUMP key, RESTORE key ttl payload [REPLACE]
+static std::string handleDump(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 2) return "-Error: DUMP requires key\r\n";
+    std::string payload;
+    if (!db.dumpValue(tokens[1], payload)) return nullBulkReply();
+    return "$" + std::to_string(payload.size()) + "\r\n" + payload + "\r\n";
+}
+
+static std::string handleRestore(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4 && tokens.size() != 5) return "-Error: RESTORE requires key, ttl and payload\r\n";
+    bool replace = false;
+    if (tokens.size() == 5) {
+        std::string option = tokens[4];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "REPLACE") return "-Error: syntax error\r\n";
+        replace = true;
+    }
+
+    long long ttl;
+    try {
+        ttl = std::stoll(tokens[2]);
+    } catch (const std::exception&) {
+        return "-Error: invalid TTL value\r\n";
+    }
+    if (ttl < 0) return "-Error: invalid TTL value, must be >= 0\r\n";
+
+    if (!replace && db.type(tokens[1]) != "none") return "-BUSYKEY Target key name already exists.\r\n";
+    if (!db.restoreValue(tokens[1], tokens[3], ttl)) return "-Error: DUMP payload version or checksum are wrong\r\n";
+    return "+OK\r\n";
+}
+
 static std::string handleUnknownCommand(const std::vector<std::string>& tokens, RedisDatabase& db) {
     return "-Error: unknown command\r\n";
 }
@@ -146,14 +170,78 @@ static std::string handleUnknownCommand(const std::vector<std::string>& tokens,
 // List ops
 static std::string handleLget(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 2) return "-Error: LGET requires a key\r\n";
+    std::string reply;
+    db.lrange(tokens[1], 0, -1, reply);
+    return reply;
+}
 
-    auto elems = db.lget(tokens[1]);
-    std::ostringstream oss;
-    oss << "*" << elems.size() << "\r\n";
-    for (const auto& elem : elems) {
-        oss << "$" << elem.size() << "\r\n" << elem << "\r\n";
+// LRANGE key start stop, both inclusive, negative indexes count from the tail
+static std::string handleLrange(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4) return "-Error: LRANGE requires key, start and stop\r\n";
+    try {
+        long start = std::stol(tokens[2]);
+        long stop = std::stol(tokens[3]);
+        std::string reply;
+        db.lrange(tokens[1], start, stop, reply);
+        return reply;
+    } catch (const std::exception&) {
+        return "-Error: Invalid index\r\n";
     }
-    return oss.str();
+}
+
+static std::string handleLtrim(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 4) return "-Error: LTRIM requires key, start and stop\r\n";
+    try {
+        long start = std::stol(tokens[2]);
+        long stop = std::stol(tokens[3]);
+        db.ltrim(tokens[1], start, stop);
+        return "+OK\r\n";
+    } catch (const std::exception&) {
+        return "-Error: Invalid index\r\n";
+    }
+}
+
+// LINSERT key BEFORE|AFTER pivot element
+static std::string handleLinsert(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 5) return "-Error: LINSERT requires key, BEFORE|AFTER, pivot and element\r\n";
+    std::string where = tokens[2];
+    std::transform(where.begin(), where.end(), where.begin(), ::toupper);
+    if (where != "BEFORE" && where != "AFTER") return "-Error: syntax error\r\n";
+    long len = db.linsert(tokens[1], where == "BEFORE", tokens[3], tokens[4]);
+    return ":" + std::to_string(len) + "\r\n";
+}
+
+// LPOS key element [RANK rank] [COUNT count] [MAXLEN len]: an index, or an
+// array of them with COUNT
+static std::string handleLpos(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3 || tokens.size() % 2 == 0) return "-Error: LPOS requires key and element\r\n";
+    long long rank = 1, count = -1, maxlen = 0;
+    for (size_t i = 3; i < tokens.size(); i += 2) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        long long value;
+        try {
+            value = std::stoll(tokens[i + 1]);
+        } catch (const std::exception&) {
+            return "-Error: value is not an integer or out of range\r\n";
+        }
+        if (option == "RANK") {
+            if (value == 0) return "-Error: RANK can't be zero\r\n";
+            if (value == LLONG_MIN) return "-Error: value is out of range\r\n";
+            rank = value;
+        } else if (option == "COUNT" || option == "MAXLEN") {
+            if (value < 0) return "-Error: " + option + " can't be negative\r\n";
+            (option == "COUNT" ? count : maxlen) = value;
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+    }
+
+    auto matches = db.lpos(tokens[1], tokens[2], rank, count < 0 ? 1 : static_cast<size_t>(count), static_cast<size_t>(maxlen));
+    if (count < 0) return matches.empty() ? nullBulkReply() : ":" + std::to_string(matches[0]) + "\r\n";
+    std::string reply = "*" + std::to_string(matches.size()) + "\r\n";
+    for (long index : matches) reply += ":" + std::to_string(index) + "\r\n";
+    return reply;
 }
 
 static std::string handleLlen(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -162,20 +250,22 @@ static std::string handleLlen(const std::vector<std::string>& tokens, RedisDatab
     return ":" + std::to_string(len) + "\r\n";
 }
 
-static std::string handleLpush(const std::vector<std::string>& tokens, RedisDatabase& db) {
+static std::string handleLpush(const std::vector<std::string>& tokens, RedisDatabase& db, BlockedClients& blocked) {
     if (tokens.size() < 3) return "-Error: LPUSH requires key and value\r\n";
     for (size_t i = 2; i < tokens.size(); ++i) {
         db.lpush(tokens[1], tokens[i]);
     }
+    blocked.signalKeyReady(tokens[1]);
     ssize_t len = db.llen(tokens[1]);
     return ":" + std::to_string(len) + "\r\n";
 }
 
-static std::string handleRpush(const std::vector<std::string>& tokens, RedisDatabase& db) {
+static std::string handleRpush(const std::vector<std::string>& tokens, RedisDatabase& db, BlockedClients& blocked) {
     if (tokens.size() < 3) return "-Error: RPUSH requires key and value\r\n";
     for (size_t i = 2; i < tokens.size(); ++i) {
         db.rpush(tokens[1], tokens[i]);
     }    
+    blocked.signalKeyReady(tokens[1]);
     ssize_t len = db.llen(tokens[1]);
     return ":" + std::to_string(len) + "\r\n";
 }
@@ -184,14 +274,14 @@ static std::string handleLpop(const std::vector<std::string>& tokens, RedisDatab
     if (tokens.size() < 2) return "-Error: LPOP requires key\r\n";
     std::string val;
     if (db.lpop(tokens[1], val)) return "$" + std::to_string(val.size()) + "\r\n" + val + "\r\n";
-    return "$-1\r\n";
+    return nullBulkReply();
 }
 
 static std::string handleRpop(const std::vector<std::string>& tokens, RedisDatabase& db) {
     if (tokens.size() < 2) return "-Error: RPOP requires key\r\n";
     std::string val;
     if (db.rpop(tokens[1], val)) return "$" + std::to_string(val.size()) + "\r\n" + val + "\r\n";
-    return "$-1\r\n";
+    return nullBulkReply();
 }
 
 static std::string handleLrem(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -211,7 +301,7 @@ static std::string handleLindex(const std::vector<std::string>& tokens, RedisDat
         int index = std::stoi(tokens[2]);
         std::string value;
         if (db.lindex(tokens[1], index, value)) return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
-        else return "$-1\r\n";
+        else return nullBulkReply();
     } catch (const std::exception&) {
         return "-Error: Invalid index\r\n";
     }
@@ -254,7 +344,7 @@ static std::string handleHget(const std::vector<std::string>& tokens, RedisDatab
     std::string value;
     if (db.hget(tokens[1], tokens[2], value))
         return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
-    return "$-1\r\n";
+    return nullBulkReply();
 }
 
 static std::string handleHexists(const std::vector<std::string>& tokens, RedisDatabase& db) {
@@ -273,7 +363,7 @@ static std::string handleHgetall (const std::vector<std::string>& tokens, RedisD
     if (tokens.size() < 2) return "-Error: HGETALL requires key\r\n";
     auto hash = db.hgetall(tokens[1]);
     std::ostringstream oss;
-    oss << "*" << hash.size() * 2 << "\r\n";
+    oss << mapHeader(hash.size());
     for (const auto& pair: hash) {
         oss << "$" << pair.first.size() << "\r\n" << pair.first << "\r\n";
         oss << "$" << pair.second.size() << "\r\n" << pair.second << "\r\n";
@@ -319,39 +409,1515 @@ static std::string handleHmset(const std::vector<std::string>& tokens, RedisData
     return "+OK\r\n";
 }
 
+// Sorted set ops
+static bool parseScore(const std::string& str, double& score) {
+    if (str.empty()) return false;
+    char* end = nullptr;
+    score = std::strtod(str.c_str(), &end);
+    return end == str.c_str() + str.size() && !std::isnan(score);
+}
+
+// A leading '(' makes the bound exclusive, as in "(1.5"
+static bool parseScoreBound(const std::string& str, double& score, bool& exclusive) {
+    exclusive = !str.empty() && str[0] == '(';
+    return parseScore(exclusive ? str.substr(1) : str, score);
+}
+
+// WITHSCORES: member and score alternate in RESP2, RESP3 nests [member, score]
+// pairs with the score as a double
+static std::string zsetEntriesReply(const std::vector<SortedSet::Entry>& entries, bool withScores) {
+    bool pairs = withScores && replyProtocol() >= 3;
+    std::ostringstream oss;
+    oss << "*" << (withScores && !pairs ? entries.size() * 2 : entries.size()) << "\r\n";
+    for (const auto& entry : entries) {
+        if (pairs) oss << "*2\r\n";
+        oss << "$" << entry.first.size() << "\r\n" << entry.first << "\r\n";
+        if (withScores) oss << doubleReply(entry.second);
+    }
+    return oss.str();
+}
+
+static std::string handleZadd(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4) return "-Error: ZADD requires key followed by score member pairs\r\n";
+
+    int flags = 0;
+    size_t i = 2;
+    for (; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "NX") flags |= ZADD_NX;
+        else if (opt == "XX") flags |= ZADD_XX;
+        else if (opt == "GT") flags |= ZADD_GT;
+        else if (opt == "LT") flags |= ZADD_LT;
+        else if (opt == "CH") flags |= ZADD_CH;
+        else break;
+    }
+
+    if ((flags & ZADD_NX) && (flags & (ZADD_XX | ZADD_GT | ZADD_LT))) {
+        return "-Error: ZADD NX is not compatible with XX, GT or LT\r\n";
+    }
+    if ((flags & ZADD_GT) && (flags & ZADD_LT)) {
+        return "-Error: ZADD GT and LT are not compatible\r\n";
+    }
+    if (i >= tokens.size() || (tokens.size() - i) % 2 != 0) {
+        return "-Error: ZADD requires key followed by score member pairs\r\n";
+    }
+
+    std::vector<std::pair<double, std::string>> scoreMembers;
+    for (; i + 1 < tokens.size(); i += 2) {
+        double score;
+        if (!parseScore(tokens[i], score)) return "-Error: score is not a valid float\r\n";
+        scoreMembers.emplace_back(score, tokens[i + 1]);
+    }
+
+    long count = db.zadd(tokens[1], scoreMembers, flags);
+    if (count < 0) return WRONG_TYPE;
+    return ":" + std::to_string(count) + "\r\n";
+}
+
+static std::string handleZrem(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3) return "-Error: ZREM requires key and member\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    size_t removed = db.zrem(tokens[1], members);
+    return ":" + std::to_string(removed) + "\r\n";
+}
+
+static std::string handleZscore(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3) return "-Error: ZSCORE requires key and member\r\n";
+    double score;
+    if (!db.zscore(tokens[1], tokens[2], score)) return nullBulkReply();
+    return doubleReply(score);
+}
+
+static std::string handleZincrby(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 4) return "-Error: ZINCRBY requires key, increment and member\r\n";
+    double increment, score;
+    if (!parseScore(tokens[2], increment)) return "-Error: increment is not a valid float\r\n";
+    int result = db.zincrby(tokens[1], increment, tokens[3], score);
+    if (result < 0) return WRONG_TYPE;
+    if (result == 0) return "-Error: resulting score is not a number\r\n";
+    return doubleReply(score);
+}
+
+static std::string handleZrank(const std::vector<std::string>& tokens, RedisDatabase& db, bool reverse) {
+    if (tokens.size() < 3) return "-Error: ZRANK requires key and member\r\n";
+    long rank = db.zrank(tokens[1], tokens[2], reverse);
+    if (rank < 0) return nullBulkReply();
+    return ":" + std::to_string(rank) + "\r\n";
+}
+
+// ZRANGE key start stop [BYSCORE] [REV] [LIMIT offset count] [WITHSCORES]
+// ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
+static std::string handleZrange(const std::vector<std::string>& tokens, RedisDatabase& db, bool byScore) {
+    if (tokens.size() < 4) return "-Error: " + std::string(byScore ? "ZRANGEBYSCORE" : "ZRANGE") + " requires key, start and stop\r\n";
+
+    bool reverse = false, withScores = false, hasLimit = false;
+    long offset = 0, count = -1;
+    for (size_t i = 4; i < tokens.size(); ++i) {
+        std::string opt = tokens[i];
+        std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+        if (opt == "WITHSCORES") {
+            withScores = true;
+        } else if (opt == "BYSCORE") {
+            byScore = true;
+        } else if (opt == "REV") {
+            reverse = true;
+        } else if (opt == "LIMIT" && i + 2 < tokens.size()) {
+            try {
+                offset = std::stol(tokens[i + 1]);
+                count = std::stol(tokens[i + 2]);
+            } catch (const std::exception&) {
+                return "-Error: Invalid LIMIT\r\n";
+            }
+            hasLimit = true;
+            i += 2;
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+    }
+
+    if (hasLimit && !byScore) return "-Error: LIMIT is only supported with BYSCORE\r\n";
+
+    if (byScore) {
+        // With REV the first bound is the maximum
+        ZRangeSpec range;
+        const std::string& minStr = reverse ? tokens[3] : tokens[2];
+        const std::string& maxStr = reverse ? tokens[2] : tokens[3];
+        if (!parseScoreBound(minStr, range.min, range.minex) || !parseScoreBound(maxStr, range.max, range.maxex)) {
+            return "-Error: min or max is not a float\r\n";
+        }
+        if (offset < 0) return zsetEntriesReply({}, withScores);
+        return zsetEntriesReply(db.zrangebyscore(tokens[1], range, offset, count, reverse), withScores);
+    }
+
+    try {
+        long start = std::stol(tokens[2]);
+        long stop = std::stol(tokens[3]);
+        return zsetEntriesReply(db.zrange(tokens[1], start, stop, reverse), withScores);
+    } catch (const std::exception&) {
+        return "-Error: Invalid index\r\n";
+    }
+}
+
+static std::string handleZcard(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: ZCARD requires key\r\n";
+    return ":" + std::to_string(db.zcard(tokens[1])) + "\r\n";
+}
+
+// Set ops. isSet replies are RESP3 sets
+static std::string membersReply(const std::vector<std::string>& members, bool isSet = false) {
+    std::ostringstream oss;
+    oss << (isSet ? setHeader(members.size()) : "*" + std::to_string(members.size()) + "\r\n");
+    for (const auto& member : members) {
+        oss << "$" << member.size() << "\r\n" << member << "\r\n";
+    }
+    return oss.str();
+}
+
+static std::string handleSadd(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3) return "-Error: SADD requires key and member\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    long added = db.sadd(tokens[1], members);
+    if (added < 0) return WRONG_TYPE;
+    return ":" + std::to_string(added) + "\r\n";
+}
+
+static std::string handleSrem(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3) return "-Error: SREM requires key and member\r\n";
+    std::vector<std::string> members(tokens.begin() + 2, tokens.end());
+    return ":" + std::to_string(db.srem(tokens[1], members)) + "\r\n";
+}
+
+static std::string handleSismember(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 3) return "-Error: SISMEMBER requires key and member\r\n";
+    bool res = db.sismember(tokens[1], tokens[2]);
+    return ":" + std::to_string(res ? 1 : 0) + "\r\n";
+}
+
+static std::string handleScard(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: SCARD requires key\r\n";
+    return ":" + std::to_string(db.scard(tokens[1])) + "\r\n";
+}
+
+static std::string handleSmembers(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: SMEMBERS requires key\r\n";
+    return membersReply(db.smembers(tokens[1]), true);
+}
+
+static std::string handleSetAlgebra(const std::vector<std::string>& tokens, RedisDatabase& db, const std::string& cmd) {
+    if (tokens.size() < 2) return "-Error: " + cmd + " requires at least one key\r\n";
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+    if (cmd == "SINTER") return membersReply(db.sinter(keys), true);
+    if (cmd == "SUNION") return membersReply(db.sunion(keys), true);
+    return membersReply(db.sdiff(keys), true);
+}
+
+// Blocking list ops
+static std::string bulkString(const std::string& value) {
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+static bool parseWhere(const std::string& token, bool& left) {
+    std::string where = token;
+    std::transform(where.begin(), where.end(), where.begin(), ::toupper);
+    if (where == "LEFT") left = true;
+    else if (where == "RIGHT") left = false;
+    else return false;
+    return true;
+}
+
+// LMOVE source destination LEFT|RIGHT LEFT|RIGHT, RPOPLPUSH source destination
+static std::string handleLmove(const std::vector<std::string>& tokens, RedisDatabase& db, BlockedClients& blocked,
+                               const std::string& cmd) {
+    bool fromLeft = false, toLeft = true;
+    if (cmd == "RPOPLPUSH") {
+        if (tokens.size() != 3) return "-Error: RPOPLPUSH requires source and destination\r\n";
+    } else {
+        if (tokens.size() != 5) return "-Error: LMOVE requires source, destination, wherefrom and whereto\r\n";
+        if (!parseWhere(tokens[3], fromLeft) || !parseWhere(tokens[4], toLeft)) {
+            return "-Error: wherefrom and whereto must be LEFT or RIGHT\r\n";
+        }
+    }
+    std::string value;
+    if (!db.lmove(tokens[1], tokens[2], fromLeft, toLeft, value)) return nullBulkReply();
+    blocked.signalKeyReady(tokens[2]);
+    return bulkString(value);
+}
+
+// Try to pop for a blocked (or about to block) command from key. On success
+// the reply is stored in reply
+static bool tryBlockingPop(const BlockState& state, const std::string& key, RedisDatabase& db, std::string& reply) {
+    std::string value;
+    if (state.command == "BLMOVE") {
+        if (!db.lmove(key, state.destination, state.fromLeft, state.toLeft, value)) return false;
+        reply = bulkString(value);
+        return true;
+    }
+
+    bool popped = (state.command == "BLPOP") ? db.lpop(key, value) : db.rpop(key, value);
+    if (!popped) return false;
+    reply = "*2\r\n" + bulkString(key) + bulkString(value);
+    return true;
+}
+
+// What a served blocking pop did, in a form a replica can replay without blocking
+static std::vector<std::string> blockingPopEffect(const BlockState& state, const std::string& key) {
+    if (state.command == "BLPOP") return {"LPOP", key};
+    if (state.command == "BRPOP") return {"RPOP", key};
+    return {"BLMOVE", key, state.destination, state.fromLeft ? "LEFT" : "RIGHT", state.toLeft ? "LEFT" : "RIGHT", "0"};
+}
+
+// BLPOP key [key ...] timeout, BRPOP likewise, BLMOVE source destination LEFT|RIGHT LEFT|RIGHT timeout.
+// effect is filled in when an element was popped right away
+static std::string handleBlockingPop(const std::vector<std::string>& tokens, RedisDatabase& db, RedisConnection& conn,
+                                     BlockedClients& blocked, const std::string& cmd, std::vector<std::string>& effect) {
+    BlockState state;
+    state.command = cmd;
+    if (cmd == "BLMOVE") {
+        if (tokens.size() != 6) return "-Error: BLMOVE requires source, destination, wherefrom, whereto and timeout\r\n";
+        if (!parseWhere(tokens[3], state.fromLeft) || !parseWhere(tokens[4], state.toLeft)) {
+            return "-Error: wherefrom and whereto must be LEFT or RIGHT\r\n";
+        }
+        state.keys.push_back(tokens[1]);
+        state.destination = tokens[2];
+    } else {
+        if (tokens.size() < 3) return "-Error: " + cmd + " requires key and timeout\r\n";
+        state.keys.assign(tokens.begin() + 1, tokens.end() - 1);
+    }
+
+    double timeout;
+    try {
+        timeout = std::stod(tokens.back());
+    } catch (const std::exception&) {
+        return "-Error: timeout is not a float or out of range\r\n";
+    }
+    if (timeout < 0 || std::isnan(timeout)) return "-Error: timeout is negative\r\n";
+
+    // Serve right away when one of the keys already has data
+    std::string reply;
+    for (const auto& key : state.keys) {
+        if (tryBlockingPop(state, key, db, reply)) {
+            if (cmd == "BLMOVE") blocked.signalKeyReady(state.destination);
+            effect = blockingPopEffect(state, key);
+            return reply;
+        }
+    }
+
+    // Inside EXEC the transaction cannot wait, behave like a timeout. The
+    // link to our primary must never stall either
+    if (conn.executingMulti || conn.isMaster) return (cmd == "BLMOVE") ? nullBulkReply() : nullArrayReply();
+
+    // 0 means wait forever
+    if (timeout > 0) {
+        state.hasDeadline = true;
+        state.deadline = std::chrono::steady_clock::now() +
+                         std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+    }
+    conn.block = std::move(state);
+    blocked.block(&conn);
+    return "";
+}
+
+// Keyspace scans. globMatch is SCAN MATCH: *, ?, [abc], [^a-z] and \x
+static bool globMatch(const char* pattern, const char* pe, const char* s, const char* se) {
+    while (pattern < pe) {
+        switch (*pattern) {
+            case '*':
+                while (pattern + 1 < pe && pattern[1] == '*') pattern++;
+                if (pattern + 1 == pe) return true;
+                for (; s <= se; s++) {
+                    if (globMatch(pattern + 1, pe, s, se)) return true;
+                }
+                return false;
+            case '?':
+                if (s == se) return false;
+                s++;
+                break;
+            case '[': {
+                if (s == se) return false;
+                pattern++;
+                bool negate = pattern < pe && (*pattern == '^' || *pattern == '!');
+                if (negate) pattern++;
+                bool matched = false;
+                for (; pattern < pe && *pattern != ']'; pattern++) {
+                    if (*pattern == '\\' && pattern + 1 < pe) {
+                        matched |= *++pattern == *s;
+                    } else if (pattern + 2 < pe && pattern[1] == '-' && pattern[2] != ']') {
+                        char lo = std::min(pattern[0], pattern[2]), hi = std::max(pattern[0], pattern[2]);
+                        matched |= *s >= lo && *s <= hi;
+                        pattern += 2;
+                    } else {
+                        matched |= *pattern == *s;
+                    }
+                }
+                if (matched == negate) return false;
+                s++;
+                break;
+            }
+            case '\\':
+                if (pattern + 1 < pe) pattern++;
+                // fall through
+            default:
+                if (s == se || *pattern != *s) return false;
+                s++;
+                break;
+        }
+        pattern++;
+    }
+    return s == se;
+}
+
+static bool globMatch(const std::string& pattern, const std::string& s) {
+    return globMatch(pattern.data(), pattern.data() + pattern.size(), s.data(), s.data() + s.size());
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count] [TYPE type]. MATCH and TYPE
+// filter the keys after they are read, so a page may come back empty
+// before the scan is over
+static std::string handleScan(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: SCAN requires a cursor\r\n";
+    uint64_t cursor;
+    try {
+        size_t used = 0;
+        cursor = std::stoull(tokens[1], &used);
+        if (used != tokens[1].size() || tokens[1][0] == '-') return "-Error: invalid cursor\r\n";
+    } catch (const std::exception&) {
+        return "-Error: invalid cursor\r\n";
+    }
+
+    std::string pattern, type;
+    long count = 10;
+    for (size_t i = 2; i < tokens.size(); i += 2) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (i + 1 >= tokens.size()) return "-Error: syntax error\r\n";
+        if (option == "MATCH") {
+            pattern = tokens[i + 1];
+        } else if (option == "COUNT") {
+            try {
+                count = std::stol(tokens[i + 1]);
+            } catch (const std::exception&) {
+                count = 0;
+            }
+            if (count < 1) return "-Error: value is not an integer or out of range\r\n";
+        } else if (option == "TYPE") {
+            type = tokens[i + 1];
+            std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+    }
+
+    std::vector<std::string> keys;
+    uint64_t next = db.scan(cursor, static_cast<size_t>(count), keys);
+    std::string page;
+    size_t kept = 0;
+    for (const auto& key : keys) {
+        if (!pattern.empty() && pattern != "*" && !globMatch(pattern, key)) continue;
+        if (!type.empty() && db.type(key) != type) continue;
+        page += bulkString(key);
+        kept++;
+    }
+    return "*2\r\n" + bulkString(std::to_string(next)) + "*" + std::to_string(kept) + "\r\n" + page;
+}
+
+// LFU access counters. HOTKEYS [COUNT n] [SAMPLES m]: the n keys with the
+// highest LFU counters among about m sampled keys. HOTKEYS TOPK: the
+// real-time top-K sketch, with estimated access counts
+static std::string handleHotkeys(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() == 2) {
+        std::string sub = tokens[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub != "TOPK") return "-Error: syntax error\r\n";
+        if (serverConfig().hotkeysTopK.load(std::memory_order_relaxed) == 0) {
+            return "-Error: the top-K sketch is disabled, set hotkeys-topk first\r\n";
+        }
+        auto top = db.topKeys();
+        std::string reply = mapHeader(top.size());
+        for (const auto& entry : top) reply += bulkString(entry.first) + ":" + std::to_string(entry.second) + "\r\n";
+        return reply;
+    }
+
+    if (!serverConfig().lfuTracking.load(std::memory_order_relaxed)) {
+        return "-Error: access counters are not kept, set lfu-tracking first\r\n";
+    }
+    long long count = 10, samples = 1000;
+    for (size_t i = 1; i < tokens.size(); i += 2) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (i + 1 >= tokens.size() || (option != "COUNT" && option != "SAMPLES")) return "-Error: syntax error\r\n";
+        long long value;
+        try {
+            value = std::stoll(tokens[i + 1]);
+        } catch (const std::exception&) {
+            value = 0;
+        }
+        if (value < 1) return "-Error: value is not an integer or out of range\r\n";
+        (option == "COUNT" ? count : samples) = value;
+    }
+
+    auto hot = db.hotKeys(static_cast<size_t>(count), static_cast<size_t>(samples));
+    std::string reply = mapHeader(hot.size());
+    for (const auto& entry : hot) reply += bulkString(entry.first) + ":" + std::to_string(entry.second) + "\r\n";
+    return reply;
+}
+
+// OBJECT FREQ key: the key's LFU counter, decayed to now
+static std::string handleObject(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() != 3) return "-Error: OBJECT requires a subcommand and a key\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    if (sub != "FREQ") return "-Error: Unknown OBJECT subcommand '" + tokens[1] + "'\r\n";
+    if (!serverConfig().lfuTracking.load(std::memory_order_relaxed)) {
+        return "-Error: access counters are not kept, set lfu-tracking first\r\n";
+    }
+    unsigned freq;
+    if (!db.keyFrequency(tokens[2], freq)) return nullBulkReply();
+    return ":" + std::to_string(freq) + "\r\n";
+}
+
+// HyperLogLog
+static const char* const NOT_HLL = "-Error: Key is not a valid HyperLogLog string value\r\n";
+
+static std::string handlePfadd(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: PFADD requires a key\r\n";
+    int result = db.pfadd(tokens[1], std::vector<std::string>(tokens.begin() + 2, tokens.end()));
+    if (result < 0) return NOT_HLL;
+    return ":" + std::to_string(result) + "\r\n";
+}
+
+static std::string handlePfcount(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: PFCOUNT requires at least one key\r\n";
+    uint64_t count;
+    if (!db.pfcount(std::vector<std::string>(tokens.begin() + 1, tokens.end()), count)) return NOT_HLL;
+    return ":" + std::to_string(count) + "\r\n";
+}
+
+static std::string handlePfmerge(const std::vector<std::string>& tokens, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: PFMERGE requires a destination key\r\n";
+    if (!db.pfmerge(tokens[1], std::vector<std::string>(tokens.begin() + 2, tokens.end()))) return NOT_HLL;
+    return "+OK\r\n";
+}
+
+// Pub/Sub
+static std::string handlePubSub(const std::vector<std::string>& tokens, RedisConnection& conn, PubSub& pubsub, const std::string& cmd) {
+    std::vector<std::string> names(tokens.begin() + 1, tokens.end());
+    if (cmd == "SUBSCRIBE" || cmd == "PSUBSCRIBE") {
+        if (names.empty()) return "-Error: " + cmd + " requires at least one channel\r\n";
+        return cmd == "SUBSCRIBE" ? pubsub.subscribe(conn, names) : pubsub.psubscribe(conn, names);
+    }
+    if (cmd == "UNSUBSCRIBE") return pubsub.unsubscribe(conn, names);
+    return pubsub.punsubscribe(conn, names);
+}
+
+static std::string handlePublish(const std::vector<std::string>& tokens, PubSub& pubsub) {
+    if (tokens.size() < 3) return "-Error: PUBLISH requires channel and message\r\n";
+    size_t receivers = pubsub.publish(tokens[1], tokens[2]);
+    return ":" + std::to_string(receivers) + "\r\n";
+}
+
+// Transactions
+static void unwatchAll(RedisConnection& conn, RedisDatabase& db) {
+    for (const auto& watched : conn.watchedKeys) {
+        db.unwatchKey(watched.first);
+    }
+    conn.watchedKeys.clear();
+}
+
+static std::string handleWatch(const std::vector<std::string>& tokens, RedisConnection& conn, RedisDatabase& db) {
+    if (tokens.size() < 2) return "-Error: WATCH requires at least one key\r\n";
+    if (conn.inMulti) return "-Error: WATCH inside MULTI is not allowed\r\n";
+    for (size_t i = 1; i < tokens.size(); i++) {
+        const std::string& key = tokens[i];
+        bool already = std::any_of(conn.watchedKeys.begin(), conn.watchedKeys.end(),
+                                   [&](const std::pair<std::string, uint64_t>& w) { return w.first == key; });
+        if (!already) conn.watchedKeys.emplace_back(key, db.watchKey(key));
+    }
+    return "+OK\r\n";
+}
+
+// Commands that modify the dataset: rejected on a replica, sent to replicas
+// on a primary. Blocking pops are replicated through blockingPopEffect
+static bool isWriteCommand(const std::string& cmd) {
+    static const std::unordered_set<std::string> writeCommands = {
+        "SET", "DEL", "UNLINK", "EXPIRE", "RENAME", "FLUSHALL",
+        "LPUSH", "RPUSH", "LPOP", "RPOP", "LREM", "LSET", "LTRIM", "LINSERT", "LMOVE", "RPOPLPUSH",
+        "BLPOP", "BRPOP", "BLMOVE",
+        "HSET", "HDEL", "HMSET",
+        "ZADD", "ZREM", "ZINCRBY",
+        "SADD", "SREM", "PFADD", "PFMERGE", "RESTORE"
+    };
+    return writeCommands.count(cmd) > 0;
+}
+
+static bool isBlockingPop(const std::string& cmd) {
+    return cmd == "BLPOP" || cmd == "BRPOP" || cmd == "BLMOVE";
+}
+
 RedisCommandHandler::RedisCommandHandler() {}
 
-std::string RedisCommandHandler::processCommand(const std::string& commandLine) {
-    // Use RESP Parser
-    auto tokens = parseRespCommand(commandLine);
-    if (tokens.empty()) return "Error: Empty Commands\r\n";
+Replication& RedisCommandHandler::getReplication() {
+    return replication;
+}
+
+Cluster& RedisCommandHandler::getCluster() {
+    return cluster;
+}
+
+void RedisCommandHandler::flushPropagation() {
+    // A replica forwards its primary's stream as is, never its own commands
+    if (propagationQueue.empty() || replication.isReplica()) {
+        propagationQueue.clear();
+        return;
+    }
+
+    bool transaction = propagationQueue.size() > 1;
+    if (transaction) replication.propagate({"MULTI"});
+    for (const auto& tokens : propagationQueue) {
+        replication.propagate(tokens);
+    }
+    if (transaction) replication.propagate({"EXEC"});
+    propagationQueue.clear();
+}
+
+// Keys a command reads or writes, for routing in cluster mode
+static std::vector<std::string> commandKeys(const std::string& cmd, const std::vector<std::string>& tokens) {
+    static const std::unordered_set<std::string> keyless = {
+        "PING", "ECHO", "INFO", "SLOWLOG", "LATENCY", "CONFIG", "CLIENT", "HELLO", "KEYS", "SCAN", "HOTKEYS", "FLUSHALL", "MULTI", "EXEC", "DISCARD", "UNWATCH", "ASKING", "CLUSTER", "MIGRATE",
+        "SUBSCRIBE", "UNSUBSCRIBE", "PSUBSCRIBE", "PUNSUBSCRIBE", "PUBLISH",
+        "REPLICAOF", "SLAVEOF", "REPLCONF", "PSYNC", "ROLE"
+    };
+    if (tokens.size() < 2 || keyless.count(cmd)) return {};
+
+    if (cmd == "DEL" || cmd == "UNLINK" || cmd == "WATCH" || cmd == "SINTER" || cmd == "SUNION" || cmd == "SDIFF" ||
+        cmd == "PFCOUNT" || cmd == "PFMERGE") {
+        return std::vector<std::string>(tokens.begin() + 1, tokens.end());
+    }
+    if (cmd == "BLPOP" || cmd == "BRPOP") return std::vector<std::string>(tokens.begin() + 1, tokens.end() - 1);
+    if (cmd == "OBJECT") return tokens.size() > 2 ? std::vector<std::string>{tokens[2]} : std::vector<std::string>{};
+    if (cmd == "MEMORY") {
+        std::string sub = tokens[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "USAGE" && tokens.size() > 2) return {tokens[2]};
+        return {};
+    }
+    if ((cmd == "RENAME" || cmd == "BLMOVE" || cmd == "LMOVE" || cmd == "RPOPLPUSH") && tokens.size() > 2) return {tokens[1], tokens[2]};
+    return {tokens[1]};
+}
+
+std::string RedisCommandHandler::clusterRedirect(const std::vector<std::string>& tokens, const std::string& cmd,
+                                                 RedisConnection& conn) {
+    std::vector<std::string> keys = commandKeys(cmd, tokens);
+    if (keys.empty()) return "";
+
+    unsigned int slot = keyHashSlot(keys[0]);
+    for (size_t i = 1; i < keys.size(); i++) {
+        if (keyHashSlot(keys[i]) != slot) return "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+    }
+
+    if (cluster.ownsSlot(slot)) {
+        // While the slot is handed over, keys already moved live on the target
+        const ClusterNode* target = cluster.migratingTo(slot);
+        if (target) {
+            RedisDatabase& db = RedisDatabase::getInstance();
+            for (const auto& key : keys) {
+                if (db.type(key) == "none") {
+                    return "-ASK " + std::to_string(slot) + " " + target->address() + "\r\n";
+                }
+            }
+        }
+        return "";
+    }
+
+    if (conn.asking && cluster.importingFrom(slot)) return "";
+
+    const ClusterNode* owner = cluster.slotOwner(slot);
+    if (!owner) return "-CLUSTERDOWN Hash slot not served\r\n";
+    return "-MOVED " + std::to_string(slot) + " " + owner->address() + "\r\n";
+}
+
+static bool parseSlot(const std::string& token, unsigned int& slot) {
+    try {
+        long value = std::stol(token);
+        if (value < 0 || value >= static_cast<long>(CLUSTER_SLOTS)) return false;
+        slot = static_cast<unsigned int>(value);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+static bool parseNodeAddress(const std::string& token, std::string& host, int& port) {
+    size_t colon = token.rfind(':');
+    if (colon == std::string::npos || colon == 0) return false;
+    host = token.substr(0, colon);
+    try {
+        port = std::stoi(token.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return port > 0 && port <= 65535;
+}
+
+// CLUSTER KEYSLOT | SLOTS | INFO | MYID | ADDSLOTS | ADDSLOTSRANGE | DELSLOTS |
+// SETSLOT slot NODE|MIGRATING|IMPORTING host:port | SETSLOT slot STABLE |
+// GETKEYSINSLOT | COUNTKEYSINSLOT
+std::string RedisCommandHandler::handleCluster(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-Error: CLUSTER requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "KEYSLOT") {
+        if (tokens.size() != 3) return "-Error: CLUSTER KEYSLOT requires key\r\n";
+        return ":" + std::to_string(keyHashSlot(tokens[2])) + "\r\n";
+    }
+    if (sub == "INFO") return cluster.infoReply();
+    if (!cluster.isEnabled()) return "-Error: This instance has cluster support disabled\r\n";
+
+    if (sub == "SLOTS") return cluster.slotsReply();
+    if (sub == "MYID") return bulkString(cluster.myself().address());
+
+    if (sub == "ADDSLOTS" || sub == "DELSLOTS" || sub == "ADDSLOTSRANGE") {
+        bool range = (sub == "ADDSLOTSRANGE");
+        if (tokens.size() < 3 || (range && tokens.size() % 2 != 0)) return "-Error: wrong number of arguments for CLUSTER " + sub + "\r\n";
+
+        // Validate everything first so a bad slot changes nothing
+        std::vector<unsigned int> slots;
+        for (size_t i = 2; i < tokens.size(); i += range ? 2 : 1) {
+            unsigned int first, last;
+            if (!parseSlot(tokens[i], first)) return "-Error: Invalid or out of range slot\r\n";
+            last = first;
+            if (range && (!parseSlot(tokens[i + 1], last) || last < first)) return "-Error: Invalid or out of range slot\r\n";
+            for (unsigned int slot = first; slot <= last; slot++) {
+                bool assigned = cluster.slotOwner(slot) != nullptr;
+                if (sub != "DELSLOTS" && assigned) return "-Error: Slot " + std::to_string(slot) + " is already busy\r\n";
+                if (sub == "DELSLOTS" && !assigned) return "-Error: Slot " + std::to_string(slot) + " is already unassigned\r\n";
+                slots.push_back(slot);
+            }
+        }
+        for (unsigned int slot : slots) {
+            if (sub == "DELSLOTS") cluster.delSlot(slot);
+            else cluster.addSlot(slot);
+        }
+        return "+OK\r\n";
+    }
+
+    if (sub == "SETSLOT") {
+        unsigned int slot;
+        if (tokens.size() < 4 || !parseSlot(tokens[2], slot)) return "-Error: CLUSTER SETSLOT requires slot and action\r\n";
+        std::string action = tokens[3];
+        std::transform(action.begin(), action.end(), action.begin(), ::toupper);
+        if (action == "STABLE") {
+            cluster.setStable(slot);
+            return "+OK\r\n";
+        }
+
+        std::string host;
+        int port;
+        if (tokens.size() != 5 || !parseNodeAddress(tokens[4], host, port)) return "-Error: node must be given as host:port\r\n";
+        if (action == "NODE") {
+            cluster.assignSlot(slot, host, port);
+        } else if (action == "MIGRATING") {
+            if (!cluster.setMigrating(slot, host, port)) return "-Error: I'm not the owner of hash slot " + std::to_string(slot) + "\r\n";
+        } else if (action == "IMPORTING") {
+            if (!cluster.setImporting(slot, host, port)) return "-Error: I'm already the owner of hash slot " + std::to_string(slot) + "\r\n";
+        } else {
+            return "-Error: Invalid CLUSTER SETSLOT action or number of arguments\r\n";
+        }
+        return "+OK\r\n";
+    }
+
+    if (sub == "GETKEYSINSLOT" || sub == "COUNTKEYSINSLOT") {
+        unsigned int slot;
+        if (tokens.size() < 3 || !parseSlot(tokens[2], slot)) return "-Error: Invalid slot\r\n";
+        RedisDatabase& db = RedisDatabase::getInstance();
+        if (sub == "COUNTKEYSINSLOT") return ":" + std::to_string(db.countKeysInSlot(slot)) + "\r\n";
+
+        long count;
+        try {
+            count = (tokens.size() > 3) ? std::stol(tokens[3]) : 10;
+        } catch (const std::exception&) {
+            return "-Error: Invalid number of keys\r\n";
+        }
+        if (count < 0) return "-Error: Invalid number of keys\r\n";
+        return membersReply(db.keysInSlot(slot, static_cast<size_t>(count)));
+    }
+
+    return "-Error: Unknown CLUSTER subcommand '" + tokens[1] + "'\r\n";
+}
+
+// MIGRATE host port key|"" db timeout [COPY] [REPLACE] [KEYS key ...]. Keys
+// go over as RESTORE commands with their remaining TTL, each preceded by
+// ASKING so the target accepts them while it imports the slot. sendToNode
+// is synchronous: the whole server is blocked for up to timeout ms at each
+// step (connect, write, every reply), as in Redis
+std::string RedisCommandHandler::handleMigrate(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 6) return "-Error: MIGRATE requires host, port, key, db and timeout\r\n";
+
+    int port, timeout;
+    try {
+        port = std::stoi(tokens[2]);
+        timeout = std::stoi(tokens[5]);
+    } catch (const std::exception&) {
+        return "-Error: invalid port or timeout\r\n";
+    }
+    if (timeout <= 0) timeout = 1000;
+
+    bool copy = false, replace = false;
+    std::vector<std::string> keys;
+    if (!tokens[3].empty()) keys.push_back(tokens[3]);
+    for (size_t i = 6; i < tokens.size(); i++) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option == "COPY") {
+            copy = true;
+        } else if (option == "REPLACE") {
+            replace = true;
+        } else if (option == "KEYS" && tokens[3].empty()) {
+            keys.assign(tokens.begin() + i + 1, tokens.end());
+            break;
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+    }
+
+    RedisDatabase& db = RedisDatabase::getInstance();
+    std::string payload;
+    std::vector<std::string> moved;
+    for (const auto& key : keys) {
+        std::string value;
+        if (!db.dumpValue(key, value)) continue;
+        // The TTL goes along, or the key would become permanent there
+        std::vector<std::string> restore = {"RESTORE", key, std::to_string(db.remainingTtlMs(key)), value};
+        if (replace) restore.push_back("REPLACE");
+        payload += "*1\r\n$6\r\nASKING\r\n";
+        payload += "*" + std::to_string(restore.size()) + "\r\n";
+        for (const auto& arg : restore) {
+            payload += bulkString(arg);
+        }
+        moved.push_back(key);
+    }
+    if (moved.empty()) return "+NOKEY\r\n";
+
+    std::string error = sendToNode(tokens[1], port, payload, moved.size() * 2, timeout);
+    if (!error.empty()) return error + "\r\n";
+
+    if (!copy) {
+        for (const auto& key : moved) {
+            db.del(key);
+            propagationQueue.push_back({"DEL", key});
+        }
+    }
+    return "+OK\r\n";
+}
+
+// REPLICAOF host port | NO ONE, REPLCONF, PSYNC replid offset, ROLE
+std::string RedisCommandHandler::handleReplicationCommand(const std::vector<std::string>& tokens, const std::string& cmd,
+                                                          RedisConnection& conn) {
+    if (cmd == "REPLICAOF" || cmd == "SLAVEOF") {
+        if (tokens.size() != 3) return "-Error: " + cmd + " requires host and port, or NO ONE\r\n";
+        std::string host = tokens[1], port = tokens[2];
+        std::transform(host.begin(), host.end(), host.begin(), ::toupper);
+        std::transform(port.begin(), port.end(), port.begin(), ::toupper);
+        if (host == "NO" && port == "ONE") {
+            replication.clearMaster();
+            return "+OK\r\n";
+        }
+
+        int portNumber;
+        try {
+            portNumber = std::stoi(tokens[2]);
+        } catch (const std::exception&) {
+            return "-Error: invalid port\r\n";
+        }
+        if (portNumber <= 0 || portNumber > 65535) return "-Error: invalid port\r\n";
+        if (replication.isReplica() && replication.masterHost() == tokens[1] && replication.masterPort() == portNumber) {
+            return "+OK Already connected to specified master\r\n";
+        }
+        replication.setMaster(tokens[1], portNumber);
+        return "+OK\r\n";
+    }
 
-    std::cout << commandLine << "\n";
+    if (cmd == "REPLCONF") return "+OK\r\n";
 
-    for (auto& token : tokens) {
-        std::cout << token << "\n";
+    if (cmd == "PSYNC") {
+        if (tokens.size() != 3) return "-Error: PSYNC requires replication id and offset\r\n";
+        // A full resync queues the snapshot straight on the connection
+        if (conn.executingMulti) return "-Error: PSYNC is not allowed inside MULTI\r\n";
+        if (replication.isReplica() && replication.offset() == 0) {
+            return "-Error: can't PSYNC while not connected with my master\r\n";
+        }
+        return replication.psync(conn, tokens[1], tokens[2]);
     }
 
+    // ROLE: master, offset and replica count, or slave, host, port and offset
+    std::string offset = ":" + std::to_string(replication.offset()) + "\r\n";
+    if (replication.isReplica()) {
+        return "*4\r\n" + bulkString("slave") + bulkString(replication.masterHost()) +
+               ":" + std::to_string(replication.masterPort()) + "\r\n" + offset;
+    }
+    return "*3\r\n" + bulkString("master") + offset + ":" + std::to_string(replication.replicas().size()) + "\r\n";
+}
+
+static std::string humanBytes(uint64_t bytes) {
+    static const char* units[] = {"B", "K", "M", "G", "T"};
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    char out[32];
+    std::snprintf(out, sizeof(out), unit ? "%.2f%s" : "%.0f%s", value, units[unit]);
+    return out;
+}
+
+// Resident set size from /proc, 0 when it can not be read
+static uint64_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+// MEMORY USAGE key [SAMPLES count] / MEMORY STATS. STATS splits the heap
+// the allocator reports into keyspace tables, client buffers and the
+// replication backlog, the rest is counted as dataset
+std::string RedisCommandHandler::handleMemory(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-Error: MEMORY requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    RedisDatabase& db = RedisDatabase::getInstance();
+
+    if (sub == "USAGE") {
+        if (tokens.size() != 3 && tokens.size() != 5) return "-Error: MEMORY USAGE requires key [SAMPLES count]\r\n";
+        // Like Redis, five elements of a container are measured by default
+        long long samples = 5;
+        if (tokens.size() == 5) {
+            std::string option = tokens[3];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+            try {
+                samples = std::stoll(tokens[4]);
+            } catch (const std::exception&) {
+                samples = -1;
+            }
+            if (option != "SAMPLES" || samples < 0) return "-Error: syntax error\r\n";
+        }
+        size_t bytes;
+        if (!db.memoryUsage(tokens[2], static_cast<size_t>(samples), bytes)) return nullBulkReply();
+        return ":" + std::to_string(bytes) + "\r\n";
+    }
+
+    if (sub == "STATS") {
+        struct mallinfo2 heap = mallinfo2();
+        uint64_t total = heap.uordblks + heap.hblkhd;
+        uint64_t rss = residentBytes();
+
+        uint64_t replicaBuffers = 0, normalBuffers = 0;
+        for (const auto& entry : clientConnections()) {
+            const RedisConnection& c = *entry.second;
+            uint64_t bytes = sizeof(RedisConnection) + stringHeapSize(c.queryBuffer) + c.outputBytes;
+            (c.isReplica ? replicaBuffers : normalBuffers) += bytes;
+        }
+        size_t mainTables, expiresTable, lfuTable;
+        db.tableOverhead(mainTables, expiresTable, lfuTable);
+        uint64_t backlog = Replication::BACKLOG_BYTES;
+        uint64_t overhead = backlog + replicaBuffers + normalBuffers + mainTables + expiresTable + lfuTable;
+        uint64_t dataset = total > overhead ? total - overhead : 0;
+        size_t keys = db.keyCount();
+
+        double percentage = total ? 100.0 * dataset / total : 0.0;
+        double fragmentation = total ? static_cast<double>(rss) / total : 0.0;
+
+        std::vector<std::pair<std::string, std::string>> fields = {
+            {"total.allocated", ":" + std::to_string(total) + "\r\n"},
+            {"replication.backlog", ":" + std::to_string(backlog) + "\r\n"},
+            {"clients.slaves", ":" + std::to_string(replicaBuffers) + "\r\n"},
+            {"clients.normal", ":" + std::to_string(normalBuffers) + "\r\n"},
+            {"overhead.hashtable.main", ":" + std::to_string(mainTables) + "\r\n"},
+            {"overhead.hashtable.expires", ":" + std::to_string(expiresTable) + "\r\n"},
+            {"overhead.hashtable.lfu", ":" + std::to_string(lfuTable) + "\r\n"},
+            {"overhead.total", ":" + std::to_string(overhead) + "\r\n"},
+            {"keys.count", ":" + std::to_string(keys) + "\r\n"},
+            {"keys.bytes-per-key", ":" + std::to_string(keys ? total / keys : 0) + "\r\n"},
+            {"dataset.bytes", ":" + std::to_string(dataset) + "\r\n"},
+            {"dataset.percentage", doubleReply(std::round(percentage * 100) / 100)},
+            {"allocator.resident", ":" + std::to_string(rss) + "\r\n"},
+            {"fragmentation", doubleReply(std::round(fragmentation * 100) / 100)},
+        };
+        std::string reply = mapHeader(fields.size());
+        for (const auto& field : fields) reply += bulkString(field.first) + field.second;
+        return reply;
+    }
+    return "-Error: Unknown MEMORY subcommand '" + tokens[1] + "'\r\n";
+}
+
+// INFO [section ...]: every section is built from counters kept up to date
+// by the event loop, so scraping it does not walk the keyspace. The default
+// set leaves out commandstats and latencystats, "all" includes them
+std::string RedisCommandHandler::handleInfo(const std::vector<std::string>& tokens) {
+    std::unordered_set<std::string> wanted;
+    for (size_t i = 1; i < tokens.size(); i++) {
+        std::string section = tokens[i];
+        std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+        wanted.insert(section);
+    }
+    bool all = wanted.count("all") || wanted.count("everything");
+    bool defaults = wanted.empty() || wanted.count("default");
+    auto include = [&](const std::string& section, bool byDefault) {
+        return all || wanted.count(section) || (defaults && byDefault);
+    };
+
+    RedisDatabase& db = RedisDatabase::getInstance();
+    ServerStats& stats = serverStats();
+    std::string info;
+    auto field = [&info](const std::string& name, const std::string& value) {
+        info += name + ":" + value + "\r\n";
+    };
+    auto header = [&info](const std::string& title) {
+        if (!info.empty()) info += "\r\n";
+        info += "# " + title + "\r\n";
+    };
+
+    if (include("server", true)) {
+        long long uptime = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - stats.startTime).count();
+        header("Server");
+        field("my_redis_version", "1.0.0");
+        field("redis_mode", cluster.isEnabled() ? "cluster" : "standalone");
+        field("multiplexing_api", stats.ioEngine);
+        field("process_id", std::to_string(getpid()));
+        field("tcp_port", std::to_string(stats.port));
+        field("uptime_in_seconds", std::to_string(uptime));
+        field("uptime_in_days", std::to_string(uptime / 86400));
+    }
+
+    if (include("clients", true)) {
+        header("Clients");
+        field("connected_clients", std::to_string(stats.connectedClients.load()));
+        field("blocked_clients", std::to_string(blockedClients.blockedCount()));
+        field("maxclients", std::to_string(serverConfig().maxClients.load()));
+        field("tracking_clients", std::to_string(tracking.clientCount()));
+    }
+
+    if (include("memory", true)) {
+        struct mallinfo2 heap = mallinfo2();
+        uint64_t used = heap.uordblks + heap.hblkhd;
+        uint64_t rss = residentBytes();
+        header("Memory");
+        field("used_memory", std::to_string(used));
+        field("used_memory_human", humanBytes(used));
+        field("used_memory_rss", std::to_string(rss));
+        field("used_memory_rss_human", humanBytes(rss));
+        field("lazyfree_pending_objects", std::to_string(LazyFree::getInstance().pending()));
+    }
+
+    if (include("persistence", true)) {
+        header("Persistence");
+        field("loading", "0");
+        field("rdb_last_save_time", std::to_string(db.lastSaveTime()));
+        field("rdb_last_bgsave_status", db.lastSaveFailed() ? "err" : "ok");
+    }
+
+    if (include("stats", true)) {
+        header("Stats");
+        field("total_connections_received", std::to_string(stats.totalConnections.load()));
+        field("total_commands_processed", std::to_string(CommandStats::getInstance().totalCalls()));
+        field("total_net_input_bytes", std::to_string(stats.netInputBytes.load()));
+        field("total_net_output_bytes", std::to_string(stats.netOutputBytes.load()));
+        field("rejected_connections", std::to_string(stats.rejectedConnections.load()));
+        field("client_query_buffer_limit_disconnections", std::to_string(stats.queryBufferLimitDisconnections.load()));
+        field("client_output_buffer_limit_disconnections", std::to_string(stats.outputBufferLimitDisconnections.load()));
+        field("pubsub_channels", std::to_string(pubsub.channelCount()));
+        field("pubsub_patterns", std::to_string(pubsub.patternCount()));
+        field("tracking_total_keys", std::to_string(tracking.keyCount()));
+        field("tracking_total_items", std::to_string(tracking.itemCount()));
+        field("tracking_total_prefixes", std::to_string(tracking.prefixCount()));
+        field("io_threads_active", stats.ioThreads > 1 ? "1" : "0");
+        field("io_threaded_reads_processed", std::to_string(stats.ioThreadedReads.load()));
+        field("io_threaded_writes_processed", std::to_string(stats.ioThreadedWrites.load()));
+    }
+
+    if (include("replication", true)) {
+        header("Replication");
+        field("role", replication.isReplica() ? "slave" : "master");
+        if (replication.isReplica()) {
+            field("master_host", replication.masterHost());
+            field("master_port", std::to_string(replication.masterPort()));
+        }
+        field("connected_slaves", std::to_string(replication.replicas().size()));
+        field("master_replid", replication.replicationId());
+        field("master_repl_offset", std::to_string(replication.offset()));
+        field("repl_backlog_size", std::to_string(Replication::BACKLOG_BYTES));
+    }
+
+    if (include("cluster", true)) {
+        header("Cluster");
+        field("cluster_enabled", cluster.isEnabled() ? "1" : "0");
+    }
+
+    if (include("commandstats", false)) {
+        header("Commandstats");
+        info += CommandStats::getInstance().commandStatsInfo();
+    }
+
+    if (include("latencystats", false)) {
+        header("Latencystats");
+        info += CommandStats::getInstance().latencyStatsInfo();
+    }
+
+    if (include("keyspace", true)) {
+        header("Keyspace");
+        size_t keys = db.keyCount();
+        if (keys > 0) field("db0", "keys=" + std::to_string(keys) + ",expires=" + std::to_string(db.expiresCount()));
+    }
+
+    return bulkString(info);
+}
+
+// SLOWLOG GET [count] / LEN / RESET
+std::string RedisCommandHandler::handleSlowlog(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-Error: SLOWLOG requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "GET") {
+        long long count = 10;
+        if (tokens.size() > 2) {
+            try {
+                count = std::stoll(tokens[2]);
+            } catch (const std::exception&) {
+                return "-Error: value is not an integer or out of range\r\n";
+            }
+        }
+        // -1 returns the whole log
+        if (count < -1) return "-Error: count should be greater than or equal to -1\r\n";
+        return slowlog.getReply(count == -1 ? slowlog.length() : static_cast<size_t>(count));
+    }
+    if (sub == "LEN") return ":" + std::to_string(slowlog.length()) + "\r\n";
+    if (sub == "RESET") {
+        slowlog.reset();
+        return "+OK\r\n";
+    }
+    return "-Error: Unknown SLOWLOG subcommand '" + tokens[1] + "'\r\n";
+}
+
+// LATENCY LATEST / HISTORY event / RESET [event ...]
+static std::string handleLatency(const std::vector<std::string>& tokens, RedisDatabase& /*db*/) {
+    if (tokens.size() < 2) return "-Error: LATENCY requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    LatencyMonitor& monitor = LatencyMonitor::getInstance();
+
+    if (sub == "LATEST") return monitor.latestReply();
+    if (sub == "HISTORY") {
+        if (tokens.size() != 3) return "-Error: LATENCY HISTORY requires an event name\r\n";
+        return monitor.historyReply(tokens[2]);
+    }
+    if (sub == "RESET") {
+        return ":" + std::to_string(monitor.reset(std::vector<std::string>(tokens.begin() + 2, tokens.end()))) + "\r\n";
+    }
+    return "-Error: Unknown LATENCY subcommand '" + tokens[1] + "'\r\n";
+}
+
+// One CLIENT LIST line: flags N normal, S replica, M primary link, P
+// subscribed, b blocked, x in MULTI, t tracking. events shows whether the client is
+// read (r, not while paused for its output) and waiting to be written (w)
+static std::string describeClient(const RedisConnection& c) {
+    std::string flags;
+    if (c.isReplica) flags += 'S';
+    if (c.isMaster) flags += 'M';
+    if (!c.channels.empty() || !c.patterns.empty()) flags += 'P';
+    if (c.blocked) flags += 'b';
+    if (c.inMulti) flags += 'x';
+    if (c.tracking.enabled) flags += 't';
+    if (flags.empty()) flags = "N";
+    std::string events;
+    if (!c.readsPaused) events += 'r';
+    if (c.writeInterest) events += 'w';
+
+    long long age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - c.created).count();
+    return "id=" + std::to_string(c.id) + " addr=" + c.addr + " fd=" + std::to_string(c.fd) + " name=" + c.name +
+           " age=" + std::to_string(age) + " flags=" + flags + " sub=" + std::to_string(c.channels.size()) +
+           " psub=" + std::to_string(c.patterns.size()) +
+           " multi=" + (c.inMulti ? std::to_string(c.multiQueue.size()) : "-1") +
+           " qbuf=" + std::to_string(c.queryBuffer.size()) + " oll=" + std::to_string(c.outputQueue.size()) +
+           " omem=" + std::to_string(c.outputBytes) + " events=" + events + " resp=" + std::to_string(c.protocol) + "\n";
+}
+
+// Client names are shown in CLIENT LIST, which separates fields by spaces
+static bool validClientName(const std::string& name) {
+    return std::all_of(name.begin(), name.end(), [](char c) { return c > ' ' && c <= '~'; });
+}
+
+// CLIENT ID / LIST / SETNAME / GETNAME / TRACKING / CACHING / GETREDIRECT
+std::string RedisCommandHandler::handleClient(const std::vector<std::string>& tokens, RedisConnection& conn) {
+    if (tokens.size() < 2) return "-Error: CLIENT requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "ID") return ":" + std::to_string(conn.id) + "\r\n";
+    if (sub == "SETNAME") {
+        if (tokens.size() != 3) return "-Error: CLIENT SETNAME requires a name\r\n";
+        if (!validClientName(tokens[2])) return "-Error: Client names cannot contain spaces, newlines or special characters.\r\n";
+        conn.name = tokens[2];
+        return "+OK\r\n";
+    }
+    if (sub == "GETNAME") return conn.name.empty() ? nullBulkReply() : bulkString(conn.name);
+    if (sub == "LIST") {
+        std::string list;
+        for (const auto& entry : clientConnections()) list += describeClient(*entry.second);
+        return bulkString(list);
+    }
+    if (sub == "TRACKING") return handleTracking(tokens, conn);
+    if (sub == "CACHING") {
+        if (tokens.size() != 3) return "-Error: CLIENT CACHING requires YES or NO\r\n";
+        std::string value = tokens[2];
+        std::transform(value.begin(), value.end(), value.begin(), ::toupper);
+        if (value == "YES" && conn.tracking.optIn) {
+            conn.tracking.cachingOverride = true;
+        } else if (value == "NO" && conn.tracking.optOut) {
+            conn.tracking.cachingOverride = true;
+        } else if (value == "YES" || value == "NO") {
+            return "-Error: CLIENT CACHING " + value + " is only valid with tracking on in OPT" +
+                   (value == "YES" ? "IN" : "OUT") + " mode\r\n";
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+        return "+OK\r\n";
+    }
+    if (sub == "GETREDIRECT") {
+        if (!conn.tracking.enabled) return ":-1\r\n";
+        return ":" + std::to_string(conn.tracking.redirect) + "\r\n";
+    }
+    return "-Error: Unknown CLIENT subcommand '" + tokens[1] + "'\r\n";
+}
+
+// CLIENT TRACKING ON|OFF [REDIRECT id] [BCAST] [PREFIX p ...] [OPTIN]
+// [OPTOUT] [NOLOOP]. Turning it on again replaces the previous settings
+std::string RedisCommandHandler::handleTracking(const std::vector<std::string>& tokens, RedisConnection& conn) {
+    if (tokens.size() < 3) return "-Error: CLIENT TRACKING requires ON or OFF\r\n";
+    std::string onOff = tokens[2];
+    std::transform(onOff.begin(), onOff.end(), onOff.begin(), ::toupper);
+    if (onOff != "ON" && onOff != "OFF") return "-Error: syntax error\r\n";
+
+    TrackingState state;
+    state.enabled = onOff == "ON";
+    for (size_t i = 3; i < tokens.size(); i++) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        bool hasValue = i + 1 < tokens.size();
+        if (option == "REDIRECT" && hasValue) {
+            try {
+                state.redirect = std::stoull(tokens[++i]);
+            } catch (const std::exception&) {
+                return "-Error: value is not an integer or out of range\r\n";
+            }
+        } else if (option == "PREFIX" && hasValue) {
+            state.prefixes.push_back(tokens[++i]);
+        } else if (option == "BCAST") {
+            state.bcast = true;
+        } else if (option == "OPTIN") {
+            state.optIn = true;
+        } else if (option == "OPTOUT") {
+            state.optOut = true;
+        } else if (option == "NOLOOP") {
+            state.noLoop = true;
+        } else {
+            return "-Error: syntax error\r\n";
+        }
+    }
+
+    RedisDatabase& db = RedisDatabase::getInstance();
+    if (!state.enabled) {
+        if (conn.tracking.enabled) tracking.disable(&conn);
+        db.setRecordModifications(tracking.active());
+        return "+OK\r\n";
+    }
+
+    if (!state.prefixes.empty() && !state.bcast) return "-Error: PREFIX option requires BCAST mode to be enabled\r\n";
+    if (state.optIn && state.optOut) return "-Error: You can't use both OPTIN and OPTOUT\r\n";
+    if (state.bcast && (state.optIn || state.optOut)) return "-Error: OPTIN and OPTOUT are not compatible with BCAST\r\n";
+    // RESP3 clients get their invalidations as pushes, RESP2 ones need a
+    // subscribed connection to carry them
+    if (state.redirect == 0 && conn.protocol < 3) {
+        return "-Error: CLIENT TRACKING requires REDIRECT to a client subscribed to __redis__:invalidate, or HELLO 3\r\n";
+    }
+    if (state.redirect != 0 && (state.redirect == conn.id || !clientConnections().count(state.redirect))) {
+        return "-Error: The client ID you want redirect to does not exist\r\n";
+    }
+
+    if (conn.tracking.enabled) tracking.disable(&conn);
+    conn.tracking = state;
+    tracking.enable(&conn);
+    db.setRecordModifications(true);
+    return "+OK\r\n";
+}
+
+void RedisCommandHandler::flushInvalidations(const RedisConnection* modifier) {
+    if (!tracking.active()) return;
+    bool flushed;
+    std::vector<std::string> keys = RedisDatabase::getInstance().takeModifiedKeys(flushed);
+    if (flushed || !keys.empty()) tracking.invalidate(keys, flushed, modifier);
+}
+
+void RedisCommandHandler::trackReads(const std::string& cmd, const std::vector<std::string>& tokens,
+                                     RedisConnection& conn) {
+    TrackingState& state = conn.tracking;
+    bool wanted = !state.bcast && (state.optIn ? state.cachingOverride : !(state.optOut && state.cachingOverride));
+    // CLIENT CACHING covers the next command, or the whole transaction
+    std::string sub = tokens.size() > 1 ? tokens[1] : "";
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    if (!(cmd == "CLIENT" && sub == "CACHING") && !conn.executingMulti && !conn.inMulti) state.cachingOverride = false;
+    if (!wanted) return;
+
+    std::vector<std::string> keys = commandKeys(cmd, tokens);
+    if (!keys.empty()) tracking.rememberKeys(&conn, keys);
+}
+
+// HELLO [protover [SETNAME name]]: switch the reply protocol and describe
+// the server. There are no users to AUTH as
+std::string RedisCommandHandler::handleHello(const std::vector<std::string>& tokens, RedisConnection& conn) {
+    int protocol = conn.protocol;
+    if (tokens.size() >= 2) {
+        if (tokens[1] == "2" || tokens[1] == "3") {
+            protocol = tokens[1][0] - '0';
+        } else {
+            return "-NOPROTO unsupported protocol version\r\n";
+        }
+    }
+    std::string name = conn.name;
+    for (size_t i = 2; i < tokens.size(); i++) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option == "SETNAME" && i + 1 < tokens.size()) {
+            name = tokens[++i];
+            if (!validClientName(name)) return "-Error: Client names cannot contain spaces, newlines or special characters.\r\n";
+        } else if (option == "AUTH") {
+            return "-Error: AUTH is not supported, no users are configured\r\n";
+        } else {
+            return "-Error: syntax error in HELLO option '" + tokens[i] + "'\r\n";
+        }
+    }
+
+    // The reply already uses the new protocol
+    conn.protocol = protocol;
+    conn.name = name;
+    ReplyProtocolScope scope(protocol);
+    std::string reply = mapHeader(7);
+    reply += bulkString("server") + bulkString("redis");
+    reply += bulkString("version") + bulkString("1.0.0");
+    reply += bulkString("proto") + ":" + std::to_string(protocol) + "\r\n";
+    reply += bulkString("id") + ":" + std::to_string(conn.id) + "\r\n";
+    reply += bulkString("mode") + bulkString(cluster.isEnabled() ? "cluster" : "standalone");
+    reply += bulkString("role") + bulkString(replication.isReplica() ? "replica" : "master");
+    reply += bulkString("modules") + "*0\r\n";
+    return reply;
+}
+
+// CONFIG GET parameter / SET parameter value
+static std::string handleConfig(const std::vector<std::string>& tokens, RedisDatabase& /*db*/) {
+    if (tokens.size() < 2) return "-Error: CONFIG requires a subcommand\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if (sub == "GET") {
+        if (tokens.size() != 3) return "-Error: CONFIG GET requires a parameter\r\n";
+        auto params = configGet(tokens[2]);
+        std::string reply = mapHeader(params.size());
+        for (const auto& param : params) reply += bulkString(param.first) + bulkString(param.second);
+        return reply;
+    }
+    if (sub == "SET") {
+        if (tokens.size() != 4) return "-Error: CONFIG SET requires a parameter and a value\r\n";
+        std::string error;
+        if (!configSet(tokens[2], tokens[3], error)) return "-Error: " + error + "\r\n";
+        return "+OK\r\n";
+    }
+    return "-Error: Unknown CONFIG subcommand '" + tokens[1] + "'\r\n";
+}
+
+std::string RedisCommandHandler::execTransaction(RedisConnection& conn) {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    std::vector<std::vector<std::string>> queue = std::move(conn.multiQueue);
+    conn.multiQueue.clear();
+    conn.inMulti = false;
+
+    // One critical section for the whole batch: checking the watched keys
+    // and running every queued command happen without another writer
+    // getting in between
+    std::unique_lock<std::recursive_mutex> batch = db.lockBatch();
+
+    for (const auto& watched : conn.watchedKeys) {
+        if (db.keyVersion(watched.first) != watched.second) {
+            batch.unlock();
+            unwatchAll(conn, db);
+            return nullArrayReply();
+        }
+    }
+
+    std::string reply = "*" + std::to_string(queue.size()) + "\r\n";
+    conn.executingMulti = true;
+    for (const auto& tokens : queue) {
+        reply += processCommand(tokens, conn);
+    }
+    conn.executingMulti = false;
+    batch.unlock();
+
+    unwatchAll(conn, db);
+    return reply;
+}
+
+std::string RedisCommandHandler::processCommand(const std::vector<std::string>& tokens, RedisConnection& conn) {
+    if (tokens.empty()) return "-Error: Empty Commands\r\n";
+    ReplyProtocolScope protocol(conn.protocol);
+
     std::string cmd = tokens[0];
     std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+
+    int statsId = CommandStats::commandId(cmd);
+
+    // Replicas serve reads, writes only arrive through the primary's stream
+    bool write = isWriteCommand(cmd);
+    if (write && replication.isReplica() && !conn.isMaster) {
+        CommandStats::getInstance().recordRejected(statsId);
+        return "-READONLY You can't write against a read only replica\r\n";
+    }
+
+    // Keys of foreign slots are redirected. The primary's stream and the
+    // commands of a transaction were already checked
+    if (cluster.isEnabled() && !conn.isMaster && !conn.executingMulti) {
+        // ASKING only covers the command right after it
+        if (cmd == "ASKING") {
+            conn.asking = true;
+            return "+OK\r\n";
+        }
+        std::string redirect = clusterRedirect(tokens, cmd, conn);
+        conn.asking = false;
+        if (!redirect.empty()) {
+            CommandStats::getInstance().recordRejected(statsId);
+            return redirect;
+        }
+    }
+
+    // Commands queued by MULTI are counted when EXEC runs them
+    bool queued = conn.inMulti && cmd != "EXEC" && cmd != "DISCARD" && cmd != "WATCH" && cmd != "MULTI";
+    auto start = std::chrono::steady_clock::now();
+    std::string reply = executeCommand(tokens, cmd, conn);
+    if (!queued) {
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        CommandStats::getInstance().record(statsId, nanos, !reply.empty() && reply[0] == '-');
+        slowlog.recordIfSlow(tokens, nanos / 1000, conn.addr);
+        LatencyMonitor::getInstance().addSampleIfNeeded("command", nanos / 1000000);
+    }
+
+    // Queued commands are propagated by EXEC, failed ones not at all
+    if (write && !isBlockingPop(cmd) && !conn.inMulti && (reply.empty() || reply[0] != '-')) {
+        propagationQueue.push_back(tokens);
+    }
+
+    flushInvalidations(&conn);
+    if (conn.tracking.enabled && !write && !queued && (reply.empty() || reply[0] != '-')) {
+        trackReads(cmd, tokens, conn);
+    }
+    if (!conn.executingMulti) flushPropagation();
+    return reply;
+}
+
+std::string RedisCommandHandler::executeCommand(const std::vector<std::string>& tokens, const std::string& cmd,
+                                                RedisConnection& conn) {
     std::ostringstream response;
 
     // Connect to database 
     RedisDatabase& db = RedisDatabase::getInstance();
 
+    // A subscribed RESP2 client may only manage its subscriptions, RESP3
+    // tells messages and replies apart
+    if (conn.protocol < 3 && (!conn.channels.empty() || !conn.patterns.empty())) {
+        if (cmd == "PING") return "*2\r\n$4\r\npong\r\n$0\r\n\r\n";
+        if (cmd != "SUBSCRIBE" && cmd != "UNSUBSCRIBE" && cmd != "PSUBSCRIBE" && cmd != "PUNSUBSCRIBE") {
+            return "-Error: only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context\r\n";
+        }
+    }
+
+    // Queue everything but the transaction commands themselves until EXEC
+    if (conn.inMulti) {
+        if (cmd == "MULTI") return "-Error: MULTI calls can not be nested\r\n";
+        if (cmd != "EXEC" && cmd != "DISCARD" && cmd != "WATCH") {
+            conn.multiQueue.push_back(tokens);
+            return "+QUEUED\r\n";
+        }
+    }
+
     // Check commands
-    if (cmd == "PING") {
+    if (cmd == "MULTI") {
+        conn.inMulti = true;
+        return "+OK\r\n";
+    } else if (cmd == "EXEC") {
+        if (!conn.inMulti) return "-Error: EXEC without MULTI\r\n";
+        return execTransaction(conn);
+    } else if (cmd == "DISCARD") {
+        if (!conn.inMulti) return "-Error: DISCARD without MULTI\r\n";
+        conn.inMulti = false;
+        conn.multiQueue.clear();
+        unwatchAll(conn, db);
+        return "+OK\r\n";
+    } else if (cmd == "WATCH") {
+        return handleWatch(tokens, conn, db);
+    } else if (cmd == "UNWATCH") {
+        unwatchAll(conn, db);
+        return "+OK\r\n";
+    } else if (cmd == "REPLICAOF" || cmd == "SLAVEOF" || cmd == "REPLCONF" || cmd == "PSYNC" || cmd == "ROLE") {
+        return handleReplicationCommand(tokens, cmd, conn);
+    } else if (cmd == "CLUSTER") {
+        return handleCluster(tokens);
+    } else if (cmd == "ASKING") {
+        return cluster.isEnabled() ? "+OK\r\n" : "-Error: This instance has cluster support disabled\r\n";
+    } else if (cmd == "MIGRATE") {
+        return handleMigrate(tokens);
+    } else if (cmd == "DUMP") {
+        return handleDump(tokens, db);
+    } else if (cmd == "RESTORE") {
+        return handleRestore(tokens, db);
+    } else if (cmd == "INFO") {
+        return handleInfo(tokens);
+    } else if (cmd == "SLOWLOG") {
+        return handleSlowlog(tokens);
+    } else if (cmd == "LATENCY") {
+        return handleLatency(tokens, db);
+    } else if (cmd == "CONFIG") {
+        return handleConfig(tokens, db);
+    } else if (cmd == "CLIENT") {
+        return handleClient(tokens, conn);
+    } else if (cmd == "HELLO") {
+        return handleHello(tokens, conn);
+    } else if (cmd == "PING") {
         return handlePing(tokens, db);
     } else if (cmd == "ECHO") {
         return handleEcho(tokens, db);
+    } else if (cmd == "SUBSCRIBE" || cmd == "UNSUBSCRIBE" || cmd == "PSUBSCRIBE" || cmd == "PUNSUBSCRIBE") {
+        return handlePubSub(tokens, conn, pubsub, cmd);
+    } else if (cmd == "PUBLISH") {
+        return handlePublish(tokens, pubsub);
     } else if (cmd == "FLUSHALL") {
         return handleFlushAll(tokens, db);
     } else if (cmd == "SET") { 
         return handleSet(tokens, db);
     } else if (cmd == "GET") {
         return handleGet(tokens, db);
+    } else if (cmd == "STRLEN") {
+        return handleStrlen(tokens, db);
     } else if (cmd == "KEYS") {
         return handleKeys(tokens, db);
+    } else if (cmd == "SCAN") {
+        return handleScan(tokens, db);
+    } else if (cmd == "MEMORY") {
+        return handleMemory(tokens);
+    } else if (cmd == "HOTKEYS") {
+        return handleHotkeys(tokens, db);
+    } else if (cmd == "OBJECT") {
+        return handleObject(tokens, db);
     } else if (cmd == "TYPE") { 
         return handleType(tokens, db);
     } else if (cmd == "DEL" || cmd == "UNLINK") {
@@ -362,12 +1928,27 @@ std::string RedisCommandHandler::processCommand(const std::string& commandLine)
         return handleRename(tokens, db);
     } else if (cmd == "LGET") {
         return handleLget(tokens, db);
+    } else if (cmd == "LRANGE") {
+        return handleLrange(tokens, db);
+    } else if (cmd == "LTRIM") {
+        return handleLtrim(tokens, db);
+    } else if (cmd == "LINSERT") {
+        return handleLinsert(tokens, db);
+    } else if (cmd == "LPOS") {
+        return handleLpos(tokens, db);
+    } else if (cmd == "LMOVE" || cmd == "RPOPLPUSH") {
+        return handleLmove(tokens, db, blockedClients, cmd);
     } else if (cmd == "LLEN") {
         return handleLlen(tokens, db);
     } else if (cmd == "LPUSH") {
-        return handleLpush(tokens, db);
+        return handleLpush(tokens, db, blockedClients);
     } else if (cmd == "RPUSH") {
-        return handleRpush(tokens, db);
+        return handleRpush(tokens, db, blockedClients);
+    } else if (cmd == "BLPOP" || cmd == "BRPOP" || cmd == "BLMOVE") {
+        std::vector<std::string> effect;
+        std::string reply = handleBlockingPop(tokens, db, conn, blockedClients, cmd, effect);
+        if (!effect.empty()) propagationQueue.push_back(std::move(effect));
+        return reply;
     } else if (cmd == "LPOP") {
         return handleLpop(tokens, db);
     } else if (cmd == "RPOP") {
@@ -396,9 +1977,90 @@ std::string RedisCommandHandler::processCommand(const std::string& commandLine)
         return handleHlen(tokens, db);
     } else if (cmd == "HMSET") {
         return handleHmset(tokens, db);
+    } else if (cmd == "ZADD") {
+        return handleZadd(tokens, db);
+    } else if (cmd == "ZREM") {
+        return handleZrem(tokens, db);
+    } else if (cmd == "ZSCORE") {
+        return handleZscore(tokens, db);
+    } else if (cmd == "ZINCRBY") {
+        return handleZincrby(tokens, db);
+    } else if (cmd == "ZRANK" || cmd == "ZREVRANK") {
+        return handleZrank(tokens, db, cmd == "ZREVRANK");
+    } else if (cmd == "ZRANGE" || cmd == "ZRANGEBYSCORE") {
+        return handleZrange(tokens, db, cmd == "ZRANGEBYSCORE");
+    } else if (cmd == "ZCARD") {
+        return handleZcard(tokens, db);
+    } else if (cmd == "SADD") {
+        return handleSadd(tokens, db);
+    } else if (cmd == "SREM") {
+        return handleSrem(tokens, db);
+    } else if (cmd == "SISMEMBER") {
+        return handleSismember(tokens, db);
+    } else if (cmd == "SCARD") {
+        return handleScard(tokens, db);
+    } else if (cmd == "SMEMBERS") {
+        return handleSmembers(tokens, db);
+    } else if (cmd == "SINTER" || cmd == "SUNION" || cmd == "SDIFF") {
+        return handleSetAlgebra(tokens, db, cmd);
+    } else if (cmd == "PFADD") {
+        return handlePfadd(tokens, db);
+    } else if (cmd == "PFCOUNT") {
+        return handlePfcount(tokens, db);
+    } else if (cmd == "PFMERGE") {
+        return handlePfmerge(tokens, db);
     } else {
         return handleUnknownCommand(tokens, db);
     }
 
     return response.str();
-}
\ No newline at end of file
+}
+
+void RedisCommandHandler::serveBlockedClients() {
+    RedisDatabase& db = RedisDatabase::getInstance();
+
+    // BLMOVE pushes to its destination, which may make more keys ready
+    while (blockedClients.hasReadyKeys()) {
+        for (const auto& key : blockedClients.takeReadyKeys()) {
+            // FIFO: each element goes to the client that has waited longest
+            while (RedisConnection* waiter = blockedClients.firstWaiter(key)) {
+                std::string reply;
+                if (!tryBlockingPop(waiter->block, key, db, reply)) break;
+
+                if (waiter->block.command == "BLMOVE") blockedClients.signalKeyReady(waiter->block.destination);
+                propagationQueue.push_back(blockingPopEffect(waiter->block, key));
+                flushPropagation();
+                blockedClients.unblock(waiter);
+                waiter->addReply(reply);
+            }
+        }
+    }
+    flushInvalidations(nullptr);
+}
+
+void RedisCommandHandler::handleBlockedTimeouts() {
+    for (RedisConnection* conn : blockedClients.expired(std::chrono::steady_clock::now())) {
+        std::string reply = (conn->block.command == "BLMOVE") ? nullBulkReply(conn->protocol) : nullArrayReply(conn->protocol);
+        blockedClients.unblock(conn);
+        conn->addReply(reply);
+    }
+}
+
+int RedisCommandHandler::nextTimeoutMs() const {
+    return blockedClients.nextTimeoutMs();
+}
+
+std::vector<RedisConnection*> RedisCommandHandler::takeUnblockedClients() {
+    return blockedClients.takeUnblocked();
+}
+
+void RedisCommandHandler::onConnectionClosed(RedisConnection* conn) {
+    if (conn->tracking.enabled) {
+        tracking.onConnectionClosed(conn);
+        RedisDatabase::getInstance().setRecordModifications(tracking.active());
+    }
+    blockedClients.forget(conn);
+    pubsub.removeConnection(*conn);
+    unwatchAll(*conn, RedisDatabase::getInstance());
+    replication.removeReplica(conn);
+}
@@ -0,0 +1,92 @@
+#include "redis_connection.h"
+
+// Private chunks stop growing past this size so writes stay bounded
+static constexpr size_t REPLY_CHUNK_BYTES = 16 * 1024;
+
+std::vector<RedisConnection*>& pendingWriteConnections() {
+    static std::vector<RedisConnection*> pending;
+    return pending;
+}
+
+std::map<uint64_t, RedisConnection*>& clientConnections() {
+    static std::map<uint64_t, RedisConnection*> clients;
+    return clients;
+}
+
+ClientClass RedisConnection::clientClass() const {
+    if (isReplica) return CLIENT_REPLICA;
+    if (!channels.empty() || !patterns.empty()) return CLIENT_PUBSUB;
+    return CLIENT_NORMAL;
+}
+
+void RedisConnection::checkOutputLimit() {
+    const OutputBufferLimit& limit = serverConfig().outputBufferLimits[clientClass()];
+    long long hard = limit.hard.load(std::memory_order_relaxed);
+    long long soft = limit.soft.load(std::memory_order_relaxed);
+    long long bytes = static_cast<long long>(outputBytes);
+
+    if (hard > 0 && bytes >= hard) {
+        closeAsap = true;
+    } else if (soft > 0 && bytes >= soft) {
+        auto now = std::chrono::steady_clock::now();
+        if (!overSoftLimit) {
+            overSoftLimit = true;
+            softLimitSince = now;
+        } else if (now - softLimitSince >= std::chrono::seconds(limit.softSeconds.load(std::memory_order_relaxed))) {
+            closeAsap = true;
+        }
+    } else {
+        overSoftLimit = false;
+    }
+}
+
+void RedisConnection::scheduleWrite() {
+    if (!inPendingWrites) {
+        inPendingWrites = true;
+        pendingWriteConnections().push_back(this);
+    }
+}
+
+void RedisConnection::addReply(const std::string& reply) {
+    if (reply.empty() || closeAsap) return;
+
+    // Coalesce small replies (e.g. a pipeline) into the chunk this connection
+    // owns. Private chunks are created non-const, so the cast is well defined
+    if (lastChunkPrivate && outputQueue.back()->size() + reply.size() <= REPLY_CHUNK_BYTES) {
+        const_cast<std::string&>(*outputQueue.back()) += reply;
+    } else {
+        outputQueue.push_back(std::make_shared<std::string>(reply));
+        lastChunkPrivate = true;
+    }
+    outputBytes += reply.size();
+    checkOutputLimit();
+    scheduleWrite();
+}
+
+void RedisConnection::addSharedReply(const std::shared_ptr<const std::string>& frame) {
+    if (frame->empty() || closeAsap) return;
+    outputQueue.push_back(frame);
+    lastChunkPrivate = false;
+    outputBytes += frame->size();
+    checkOutputLimit();
+    scheduleWrite();
+}
+
+bool RedisConnection::hasPendingOutput() const {
+    return !outputQueue.empty();
+}
+
+void RedisConnection::consumeOutput(size_t bytes) {
+    outputBytes -= bytes;
+    while (bytes > 0 && !outputQueue.empty()) {
+        size_t left = outputQueue.front()->size() - outputOffset;
+        if (bytes < left) {
+            outputOffset += bytes;
+            return;
+        }
+        bytes -= left;
+        outputQueue.pop_front();
+        outputOffset = 0;
+    }
+    if (outputQueue.empty()) lastChunkPrivate = false;
+}
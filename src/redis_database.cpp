@@ -1,6 +1,16 @@
 #include "redis_database.h"
+#include "cluster.h"
+#include "config.h"
+#include "hyperloglog.h"
+#include "latency.h"
+#include "lazy_free.h"
+#include "memory_usage.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <random>
 
 RedisDatabase& RedisDatabase::getInstance() {
     static RedisDatabase instance;
@@ -13,12 +23,24 @@ file -> memory - load()
 */
 
 bool RedisDatabase::dump(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    LatencyScope latency("dump");
     std::ofstream ofs(filename, std::ios::binary);
-    if (!ofs) return false;
+    if (!ofs) {
+        last_save_failed = true;
+        return false;
+    }
 
+    static const char HEX[] = "0123456789abcdef";
     for (const auto& kv : kv_store) {
-        ofs << "K" << kv.first << " " << kv.second << "\n";
+        if (!HyperLogLog::valid(kv.second)) {
+            ofs << "K" << kv.first << " " << kv.second << "\n";
+            continue;
+        }
+        // HyperLogLog bodies are binary, they go out as hex
+        ofs << "P" << kv.first << " ";
+        for (unsigned char c : kv.second) ofs << HEX[c >> 4] << HEX[c & 15];
+        ofs << "\n";
     }
 
     for (const auto& kv : list_store) {
@@ -39,11 +61,48 @@ bool RedisDatabase::dump(const std::string& filename) {
         ofs << "\n";
     }
 
-    return true;
+    for (const auto& kv : set_store) {
+        ofs << "S" << kv.first;
+        for (const auto& member : kv.second.members()) {
+            ofs << " " << member;
+        }
+        ofs << "\n";
+    }
+
+    for (const auto& kv : zset_store) {
+        ofs << "Z" << kv.first;
+        for (const auto& entry : kv.second.rangeByRank(0, kv.second.size() - 1, false)) {
+            ofs << " " << formatScore(entry.second) << ":" << entry.first;
+        }
+        ofs << "\n";
+    }
+
+    ofs.flush();
+    last_save_failed = !ofs;
+    if (ofs) last_save = std::time(nullptr);
+    return static_cast<bool>(ofs);
+}
+
+time_t RedisDatabase::lastSaveTime() const {
+    return last_save;
+}
+
+bool RedisDatabase::lastSaveFailed() const {
+    return last_save_failed;
+}
+
+size_t RedisDatabase::keyCount() {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return kv_store.size() + list_store.size() + hash_store.size() + zset_store.size() + set_store.size();
+}
+
+size_t RedisDatabase::expiresCount() {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return expiry_map.size();
 }
 
 bool RedisDatabase::load(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
 
     std::ifstream ifs(filename, std::ios::binary);
     if (!ifs) return false;
@@ -51,6 +110,12 @@ bool RedisDatabase::load(const std::string& filename) {
     kv_store.clear();
     list_store.clear();
     hash_store.clear();
+    zset_store.clear();
+    set_store.clear();
+    access_freq.clear();
+    for (auto& entry : watched_keys) {
+        entry.second.version++;
+    }
 
     std::string line;
     while (std::getline(ifs, line)) {
@@ -61,6 +126,25 @@ bool RedisDatabase::load(const std::string& filename) {
             std::string key, value;
             iss >> key >> value;
             kv_store[key] = value;
+        } else if (type == 'P') {
+            // Hex decoded by hand, a damaged record is skipped rather than
+            // throwing out of load() at startup
+            std::string key, hex, value;
+            iss >> key >> hex;
+            auto nibble = [](char c) {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                return -1;
+            };
+            bool ok = hex.size() % 2 == 0;
+            value.reserve(hex.size() / 2);
+            for (size_t i = 0; ok && i < hex.size(); i += 2) {
+                int high = nibble(hex[i]), low = nibble(hex[i + 1]);
+                ok = high >= 0 && low >= 0;
+                value += static_cast<char>(high << 4 | low);
+            }
+            if (ok && HyperLogLog::valid(value)) kv_store[key] = std::move(value);
         } else if (type == 'L') {
             std::string key;
             iss >> key;
@@ -84,37 +168,491 @@ bool RedisDatabase::load(const std::string& filename) {
                 }
             }
             hash_store[key] = hash;
+        } else if (type == 'Z') {
+            std::string key;
+            iss >> key;
+            SortedSet zset;
+            std::string pr;
+            while (iss >> pr) {
+                // Scores never contain ':', so split at the first one
+                auto pos = pr.find(':');
+                if (pos != std::string::npos) {
+                    try {
+                        zset.add(pr.substr(pos+1), std::stod(pr.substr(0, pos)));
+                    } catch (const std::exception&) {
+                        continue;
+                    }
+                }
+            }
+            zset_store[key] = std::move(zset);
+        } else if (type == 'S') {
+            std::string key;
+            iss >> key;
+            RedisSet set;
+            std::vector<std::string> members;
+            std::string member;
+            while (iss >> member) {
+                members.push_back(std::move(member));
+            }
+            set.add(members);
+            set_store[key] = std::move(set);
+        }
+    }
+
+    rebuildSlotIndex();
+    return true;
+}
+
+// Snapshot encoding: per key the key, its TTL in ms plus one (0 for none)
+// and the value. A value (also the DUMP payload) is a type byte, the element
+// count and the elements. Integers are LEB128 varints
+static void putLength(std::string& out, uint64_t n) {
+    while (n >= 0x80) {
+        out += static_cast<char>((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    out += static_cast<char>(n);
+}
+
+static void putString(std::string& out, const std::string& str) {
+    putLength(out, str.size());
+    out += str;
+}
+
+static bool getLength(const std::string& in, size_t& pos, uint64_t& n) {
+    n = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        unsigned char byte = in[pos++];
+        n |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool getString(const std::string& in, size_t& pos, std::string& str) {
+    uint64_t len;
+    if (!getLength(in, pos, len) || len > in.size() - pos) return false;
+    str.assign(in, pos, len);
+    pos += len;
+    return true;
+}
+
+bool RedisDatabase::encodeValue(const std::string& key, std::string& out) const {
+    auto itKv = kv_store.find(key);
+    if (itKv != kv_store.end()) {
+        out += 'K';
+        putLength(out, 1);
+        putString(out, itKv->second);
+        return true;
+    }
+    auto itList = list_store.find(key);
+    if (itList != list_store.end()) {
+        out += 'L';
+        putLength(out, itList->second.size());
+        for (const auto& item : itList->second) putString(out, item);
+        return true;
+    }
+    auto itHash = hash_store.find(key);
+    if (itHash != hash_store.end()) {
+        out += 'H';
+        putLength(out, itHash->second.size());
+        for (const auto& field_val : itHash->second) {
+            putString(out, field_val.first);
+            putString(out, field_val.second);
+        }
+        return true;
+    }
+    auto itSet = set_store.find(key);
+    if (itSet != set_store.end()) {
+        std::vector<std::string> members = itSet->second.members();
+        out += 'S';
+        putLength(out, members.size());
+        for (const auto& member : members) putString(out, member);
+        return true;
+    }
+    auto itZset = zset_store.find(key);
+    if (itZset != zset_store.end()) {
+        const SortedSet& zset = itZset->second;
+        out += 'Z';
+        putLength(out, zset.size());
+        for (const auto& entry : zset.rangeByRank(0, zset.size() - 1, false)) {
+            putString(out, entry.first);
+            putString(out, formatScore(entry.second));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool RedisDatabase::decodeValue(const std::string& data, size_t& pos, DecodedValue& value) {
+    if (pos >= data.size()) return false;
+    value.type = data[pos++];
+    uint64_t count;
+    if (!getLength(data, pos, count)) return false;
+
+    if (value.type == 'K') {
+        return getString(data, pos, value.string);
+    } else if (value.type == 'L') {
+        for (uint64_t i = 0; i < count; i++) {
+            std::string item;
+            if (!getString(data, pos, item)) return false;
+            value.list.push_back(std::move(item));
+        }
+    } else if (value.type == 'H') {
+        for (uint64_t i = 0; i < count; i++) {
+            std::string field, fieldValue;
+            if (!getString(data, pos, field) || !getString(data, pos, fieldValue)) return false;
+            value.hash[field] = std::move(fieldValue);
+        }
+    } else if (value.type == 'S') {
+        std::vector<std::string> members;
+        for (uint64_t i = 0; i < count; i++) {
+            std::string member;
+            if (!getString(data, pos, member)) return false;
+            members.push_back(std::move(member));
+        }
+        value.set.add(members);
+    } else if (value.type == 'Z') {
+        for (uint64_t i = 0; i < count; i++) {
+            std::string member, score;
+            if (!getString(data, pos, member) || !getString(data, pos, score)) return false;
+            value.zset.add(member, std::strtod(score.c_str(), nullptr));
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void RedisDatabase::storeValue(const std::string& key, DecodedValue&& value) {
+    switch (value.type) {
+    case 'K': kv_store[key] = std::move(value.string); break;
+    case 'L': list_store[key] = std::move(value.list); break;
+    case 'H': hash_store[key] = std::move(value.hash); break;
+    case 'S': set_store[key] = std::move(value.set); break;
+    case 'Z': zset_store[key] = std::move(value.zset); break;
+    }
+    indexKey(key);
+}
+
+void RedisDatabase::snapshot(size_t chunkBytes, const std::function<void(std::string&&)>& emit) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    LatencyScope latency("snapshot");
+    std::string out;
+    out.reserve(chunkBytes);
+    auto now = std::chrono::steady_clock::now();
+
+    // Walk the stores in place rather than copying keys() first, and hand
+    // off a chunk whenever it fills
+    auto putEntry = [&](const std::string& key) {
+        putString(out, key);
+        uint64_t ttl = 0;
+        auto it = expiry_map.find(key);
+        if (it != expiry_map.end() && it->second > now) {
+            ttl = std::chrono::duration_cast<std::chrono::milliseconds>(it->second - now).count() + 1;
+        }
+        putLength(out, ttl);
+        encodeValue(key, out);
+        if (out.size() >= chunkBytes) {
+            emit(std::move(out));
+            out = std::string();
+            out.reserve(chunkBytes);
         }
+    };
+    for (const auto& pr : kv_store) putEntry(pr.first);
+    for (const auto& pr : list_store) putEntry(pr.first);
+    for (const auto& pr : hash_store) putEntry(pr.first);
+    for (const auto& pr : zset_store) putEntry(pr.first);
+    for (const auto& pr : set_store) putEntry(pr.first);
+    if (!out.empty()) emit(std::move(out));
+}
+
+std::string RedisDatabase::snapshot() {
+    std::string whole;
+    snapshot(64 * 1024, [&whole](std::string&& chunk) { whole += chunk; });
+    return whole;
+}
+
+bool RedisDatabase::loadSnapshot(const std::string& data) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    LatencyScope latency("snapshot-load");
+    flushAll(true);
+
+    auto now = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (pos < data.size()) {
+        std::string key;
+        uint64_t ttl;
+        DecodedValue value;
+        if (!getString(data, pos, key) || !getLength(data, pos, ttl)) return false;
+        if (!decodeValue(data, pos, value)) return false;
+        storeValue(key, std::move(value));
+        if (ttl > 0) expiry_map[key] = now + std::chrono::milliseconds(ttl - 1);
     }
+    return true;
+}
 
+bool RedisDatabase::dumpValue(const std::string& key, std::string& payload) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    payload.clear();
+    return encodeValue(key, payload);
+}
+
+long long RedisDatabase::remainingTtlMs(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = expiry_map.find(key);
+    if (it == expiry_map.end()) return 0;
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(it->second - std::chrono::steady_clock::now());
+    return std::max<long long>(left.count(), 1);
+}
+
+bool RedisDatabase::restoreValue(const std::string& key, const std::string& payload, long long ttlMs) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    // A malformed payload must leave the current value alone
+    DecodedValue value;
+    size_t pos = 0;
+    if (!decodeValue(payload, pos, value) || pos != payload.size()) return false;
+    removeKey(key, true);
+    storeValue(key, std::move(value));
+    if (ttlMs > 0) expiry_map[key] = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttlMs);
+    touchKey(key);
+    accessKey(key);
     return true;
 }
 
-bool RedisDatabase::flushAll() {
-    std::lock_guard<std::mutex> lock(db_mutex);
+void RedisDatabase::enableSlotIndex() {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    slot_keys.assign(CLUSTER_SLOTS, {});
+    rebuildSlotIndex();
+}
+
+void RedisDatabase::rebuildSlotIndex() {
+    if (slot_keys.empty()) return;
+    for (auto& keys : slot_keys) keys.clear();
+    auto add = [this](const auto& store) {
+        for (const auto& entry : store) slot_keys[keyHashSlot(entry.first)].insert(entry.first);
+    };
+    add(kv_store);
+    add(list_store);
+    add(hash_store);
+    add(zset_store);
+    add(set_store);
+}
+
+void RedisDatabase::indexKey(const std::string& key) {
+    if (!slot_keys.empty()) slot_keys[keyHashSlot(key)].insert(key);
+}
+
+void RedisDatabase::unindexKey(const std::string& key) {
+    if (!slot_keys.empty()) slot_keys[keyHashSlot(key)].erase(key);
+}
+
+std::vector<std::string> RedisDatabase::keysInSlot(unsigned int slot, size_t count) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    std::vector<std::string> result;
+    if (slot_keys.empty()) return result;
+    const auto& keys = slot_keys[slot];
+    result.reserve(std::min(count, keys.size()));
+    for (auto it = keys.begin(); it != keys.end() && result.size() < count; ++it) result.push_back(*it);
+    return result;
+}
+
+size_t RedisDatabase::countKeysInSlot(unsigned int slot) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return slot_keys.empty() ? 0 : slot_keys[slot].size();
+}
+
+bool RedisDatabase::flushAll(bool async) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (async) {
+        // Moving the maps out is O(1), the background thread pays for the frees
+        LazyFree& lazyFree = LazyFree::getInstance();
+        lazyFree.release(std::move(kv_store));
+        lazyFree.release(std::move(list_store));
+        lazyFree.release(std::move(hash_store));
+        lazyFree.release(std::move(zset_store));
+        lazyFree.release(std::move(set_store));
+        lazyFree.release(std::move(expiry_map));
+        lazyFree.release(std::move(access_freq));
+    }
+    for (auto& keys : slot_keys) keys.clear();
     kv_store.clear();
     list_store.clear();
     hash_store.clear();
+    zset_store.clear();
+    set_store.clear();
+    expiry_map.clear();
+    access_freq.clear();
+
+    // Every watched key may have existed, abort their transactions
+    for (auto& entry : watched_keys) {
+        entry.second.version++;
+    }
+    if (record_modifications) modified_flush = true;
     return true;
 }
 
+void RedisDatabase::setRecordModifications(bool enable) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    record_modifications = enable;
+    if (!enable) {
+        modified_keys.clear();
+        modified_flush = false;
+    }
+}
+
+std::vector<std::string> RedisDatabase::takeModifiedKeys(bool& flushed) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    flushed = modified_flush;
+    modified_flush = false;
+    std::vector<std::string> keys;
+    keys.swap(modified_keys);
+    return keys;
+}
+
+std::unique_lock<std::recursive_mutex> RedisDatabase::lockBatch() {
+    return std::unique_lock<std::recursive_mutex>(db_mutex);
+}
+
+void RedisDatabase::touchKey(const std::string& key) {
+    if (record_modifications) modified_keys.push_back(key);
+    // Only watched keys carry a version, nothing to do for everything else
+    if (watched_keys.empty()) return;
+    auto it = watched_keys.find(key);
+    if (it != watched_keys.end()) it->second.version++;
+}
+
+void RedisDatabase::accessKey(const std::string& key) {
+    if (serverConfig().lfuTracking.load(std::memory_order_relaxed)) {
+        auto [it, created] = access_freq.try_emplace(key, 0);
+        it->second = lfuAccess(it->second, created, lfu_rng);
+    } else if (!access_freq.empty()) {
+        // Turned off: drop the counters, off the event loop
+        LazyFree::getInstance().release(std::move(access_freq));
+        access_freq.clear();
+    }
+
+    // The sketch follows hotkeys-topk, resized on the first access after
+    // a CONFIG SET
+    long long k = serverConfig().hotkeysTopK.load(std::memory_order_relaxed);
+    if (static_cast<size_t>(k) != hot_keys.capacity()) hot_keys.reset(k);
+    if (k > 0) hot_keys.add(key);
+}
+
+uint64_t RedisDatabase::watchKey(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto& entry = watched_keys[key];
+    entry.watchers++;
+    return entry.version;
+}
+
+void RedisDatabase::unwatchKey(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = watched_keys.find(key);
+    if (it == watched_keys.end()) return;
+    if (--it->second.watchers == 0) watched_keys.erase(it);
+}
+
+uint64_t RedisDatabase::keyVersion(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = watched_keys.find(key);
+    return (it != watched_keys.end()) ? it->second.version : 0;
+}
+
+bool RedisDatabase::keyExists(const std::string& key) const {
+    return (kv_store.find(key) != kv_store.end()) ||
+           (list_store.find(key) != list_store.end()) ||
+           (hash_store.find(key) != hash_store.end()) ||
+           (zset_store.find(key) != zset_store.end()) ||
+           (set_store.find(key) != set_store.end());
+}
+
+bool RedisDatabase::removeKey(const std::string& key, bool lazy) {
+    bool erased = kv_store.erase(key) > 0;
+    expiry_map.erase(key);
+    access_freq.erase(key);
+
+    auto itList = list_store.find(key);
+    if (itList != list_store.end()) {
+        if (lazy && itList->second.size() > LAZYFREE_THRESHOLD) {
+            LazyFree::getInstance().release(std::move(itList->second));
+        }
+        list_store.erase(itList);
+        erased = true;
+    }
+
+    auto itHash = hash_store.find(key);
+    if (itHash != hash_store.end()) {
+        if (lazy && itHash->second.size() > LAZYFREE_THRESHOLD) {
+            LazyFree::getInstance().release(std::move(itHash->second));
+        }
+        hash_store.erase(itHash);
+        erased = true;
+    }
+
+    auto itZset = zset_store.find(key);
+    if (itZset != zset_store.end()) {
+        if (lazy && itZset->second.size() > LAZYFREE_THRESHOLD) {
+            LazyFree::getInstance().release(std::move(itZset->second));
+        }
+        zset_store.erase(itZset);
+        erased = true;
+    }
+
+    auto itSet = set_store.find(key);
+    if (itSet != set_store.end()) {
+        if (lazy && itSet->second.size() > LAZYFREE_THRESHOLD) {
+            LazyFree::getInstance().release(std::move(itSet->second));
+        }
+        set_store.erase(itSet);
+        erased = true;
+    }
+
+    if (erased) {
+        unindexKey(key);
+        touchKey(key);
+    }
+    return erased;
+}
+
 // Key value operations
 void RedisDatabase::set(const std::string& key, const std::string& val){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    touchKey(key);
+    auto it = kv_store.find(key);
+    if (it != kv_store.end()) {
+        it->second = val;
+        accessKey(key);
+        return;
+    }
+
+    // SET overwrites any type, a large list or hash is freed in the background
+    removeKey(key, true);
     kv_store[key] = val;
+    indexKey(key);
+    accessKey(key);
 }
 bool RedisDatabase::get(const std::string& key, std::string& val){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = kv_store.find(key);
     if (it != kv_store.end()) {
         val = it->second;
+        accessKey(key);
         return true;
     }
     return false;
 }
 
+size_t RedisDatabase::strlen(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    if (it == kv_store.end()) return 0;
+    accessKey(key);
+    return it->second.size();
+}
+
 std::vector<std::string> RedisDatabase::keys(){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     std::vector<std::string> result;
     for (const auto& pr : kv_store) {
         result.push_back(pr.first);
@@ -127,33 +665,190 @@ std::vector<std::string> RedisDatabase::keys(){
     for (const auto& pr : hash_store) {
         result.push_back(pr.first);
     }
+
+    for (const auto& pr : zset_store) {
+        result.push_back(pr.first);
+    }
+
+    for (const auto& pr : set_store) {
+        result.push_back(pr.first);
+    }
     return result;
 }
 
+// SCAN cursor layout: store index in bits 60-62, bucket count of that store
+// (its low 28 bits) in bits 32-59, bucket index in bits 0-31
+static constexpr int SCAN_STORE_SHIFT = 60;
+static constexpr int SCAN_TAG_SHIFT = 32;
+static constexpr uint64_t SCAN_TAG_MASK = (1ULL << 28) - 1;
+
+template <typename Table>
+static bool scanTable(const Table& table, uint64_t& bucket, size_t count, std::vector<std::string>& out) {
+    size_t buckets = table.bucket_count();
+    while (bucket < buckets && out.size() < count) {
+        for (auto it = table.begin(bucket); it != table.end(bucket); ++it) out.push_back(it->first);
+        bucket++;
+    }
+    return bucket >= buckets;
+}
+
+uint64_t RedisDatabase::scan(uint64_t cursor, size_t count, std::vector<std::string>& out) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    unsigned store = static_cast<unsigned>(cursor >> SCAN_STORE_SHIFT);
+    uint64_t tag = (cursor >> SCAN_TAG_SHIFT) & SCAN_TAG_MASK;
+    uint64_t bucket = cursor & 0xFFFFFFFFULL;
+
+    auto bucketCount = [&](unsigned s) -> size_t {
+        switch (s) {
+            case 0: return kv_store.bucket_count();
+            case 1: return list_store.bucket_count();
+            case 2: return hash_store.bucket_count();
+            case 3: return zset_store.bucket_count();
+            default: return set_store.bucket_count();
+        }
+    };
+    // Rehashed since the cursor was handed out: buckets no longer line up
+    if (store < 5 && (bucketCount(store) & SCAN_TAG_MASK) != tag) bucket = 0;
+
+    while (store < 5 && out.size() < count) {
+        bool done;
+        switch (store) {
+            case 0: done = scanTable(kv_store, bucket, count, out); break;
+            case 1: done = scanTable(list_store, bucket, count, out); break;
+            case 2: done = scanTable(hash_store, bucket, count, out); break;
+            case 3: done = scanTable(zset_store, bucket, count, out); break;
+            default: done = scanTable(set_store, bucket, count, out); break;
+        }
+        if (!done) break;
+        store++;
+        bucket = 0;
+    }
+    if (store >= 5) return 0;
+    return (static_cast<uint64_t>(store) << SCAN_STORE_SHIFT) |
+           ((bucketCount(store) & SCAN_TAG_MASK) << SCAN_TAG_SHIFT) | bucket;
+}
+
+bool RedisDatabase::memoryUsage(const std::string& key, size_t samples, size_t& bytes) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    size_t keyBytes = stringHeapSize(key);
+
+    if (auto it = kv_store.find(key); it != kv_store.end()) {
+        bytes = hashNodeSize(sizeof(*it)) + stringHeapSize(it->second);
+    } else if (auto it = list_store.find(key); it != list_store.end()) {
+        const auto& list = it->second;
+        bytes = hashNodeSize(sizeof(*it)) + allocationSize(list.capacity() * sizeof(std::string)) +
+                sampledBytes(list.begin(), list.size(), samples, [](const std::string& item) { return stringHeapSize(item); });
+    } else if (auto it = hash_store.find(key); it != hash_store.end()) {
+        const auto& hash = it->second;
+        bytes = hashNodeSize(sizeof(*it)) + hashTableOverhead(hash) +
+                sampledBytes(hash.begin(), hash.size(), samples, [](const std::pair<const std::string, std::string>& field) {
+                    return stringHeapSize(field.first) + stringHeapSize(field.second);
+                });
+    } else if (auto it = zset_store.find(key); it != zset_store.end()) {
+        bytes = hashNodeSize(sizeof(*it)) + it->second.memoryUsage(samples);
+    } else if (auto it = set_store.find(key); it != set_store.end()) {
+        bytes = hashNodeSize(sizeof(*it)) + it->second.memoryUsage(samples);
+    } else {
+        return false;
+    }
+
+    bytes += keyBytes;
+    if (expiry_map.count(key)) bytes += hashNodeSize(sizeof(*expiry_map.begin())) + keyBytes;
+    if (access_freq.count(key)) bytes += hashNodeSize(sizeof(*access_freq.begin())) + keyBytes;
+    return true;
+}
+
+void RedisDatabase::tableOverhead(size_t& main, size_t& expires, size_t& lfu) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    main = hashTableOverhead(kv_store) + hashTableOverhead(list_store) + hashTableOverhead(hash_store) +
+           hashTableOverhead(zset_store) + hashTableOverhead(set_store);
+    expires = hashTableOverhead(expiry_map);
+    lfu = hashTableOverhead(access_freq);
+}
+
+bool RedisDatabase::keyFrequency(const std::string& key, unsigned& freq) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!keyExists(key)) return false;
+    auto it = access_freq.find(key);
+    freq = lfuFrequency(it != access_freq.end() ? it->second : 0);
+    return true;
+}
+
+std::vector<std::pair<std::string, unsigned>> RedisDatabase::hotKeys(size_t count, size_t samples) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::vector<std::pair<std::string, unsigned>> sampled;
+    auto consider = [&](const std::string& key) {
+        auto it = access_freq.find(key);
+        sampled.emplace_back(key, lfuFrequency(it != access_freq.end() ? it->second : 0));
+    };
+
+    // Every store gives its share of the samples, taken from consecutive
+    // buckets starting at a random one so no full walk is needed
+    auto sample = [&](const auto& store, size_t total) {
+        if (store.empty()) return;
+        size_t quota = (samples >= total) ? store.size()
+                                          : std::max<size_t>(1, samples * store.size() / total);
+        if (quota >= store.size()) {
+            for (const auto& entry : store) consider(entry.first);
+            return;
+        }
+        size_t buckets = store.bucket_count();
+        size_t bucket = std::uniform_int_distribution<size_t>(0, buckets - 1)(gen);
+        for (size_t walked = 0, taken = 0; walked < buckets && taken < quota; walked++) {
+            for (auto it = store.begin(bucket); it != store.end(bucket) && taken < quota; ++it, taken++) {
+                consider(it->first);
+            }
+            bucket = (bucket + 1) % buckets;
+        }
+    };
+
+    size_t total = kv_store.size() + list_store.size() + hash_store.size() + zset_store.size() + set_store.size();
+    if (total == 0) return {};
+    sample(kv_store, total);
+    sample(list_store, total);
+    sample(hash_store, total);
+    sample(zset_store, total);
+    sample(set_store, total);
+
+    size_t keep = std::min(count, sampled.size());
+    std::partial_sort(sampled.begin(), sampled.begin() + keep, sampled.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    sampled.resize(keep);
+    return sampled;
+}
+
+std::vector<std::pair<std::string, uint64_t>> RedisDatabase::topKeys() {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return hot_keys.top();
+}
+
 std::string RedisDatabase::type(const std::string& key){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (kv_store.find(key) != kv_store.end()) return "string";
     if (list_store.find(key) != list_store.end()) return "list";
     if (hash_store.find(key) != hash_store.end()) return "hash";
+    if (zset_store.find(key) != zset_store.end()) return "zset";
+    if (set_store.find(key) != set_store.end()) return "set";
     else return "none";
 }
 
 bool RedisDatabase::del(const std::string& key){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
-    bool erased = false;
-    erased |= kv_store.erase(key) > 0;
-    erased |= list_store.erase(key) > 0;
-    erased |= hash_store.erase(key) > 0;
-    return erased;
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return removeKey(key, false);
+}
+
+bool RedisDatabase::unlink(const std::string& key){ 
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return removeKey(key, true);
 }
 
 // Expire
 bool RedisDatabase::expire(const std::string& key, int sec){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
-    bool exists = (kv_store.find(key) != kv_store.end()) ||
-                 (list_store.find(key) != list_store.end()) || 
-                 (hash_store.find(key) != hash_store.end());
-    if (!exists) return false;
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!keyExists(key)) return false;
+    touchKey(key);
+    accessKey(key);
 
     expiry_map[key] = std::chrono::steady_clock::now() + std::chrono::seconds(sec);
     return true;
@@ -161,83 +856,167 @@ bool RedisDatabase::expire(const std::string& key, int sec){
 
 // Rename 
 bool RedisDatabase::rename(const std::string& oldKey, const std::string& newKey){ 
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     bool found = false;
+    if (oldKey == newKey) return keyExists(oldKey);
+
+    // The overwritten destination value may be large, free it in the background
+    if (keyExists(oldKey)) {
+        removeKey(newKey, true);
+        touchKey(oldKey);
+        touchKey(newKey);
+    }
 
     auto itKv = kv_store.find(oldKey);
     if (itKv != kv_store.end()) {
-        kv_store[newKey] = itKv->second;
+        // Erase before inserting, a rehash would invalidate the iterator
+        std::string value = std::move(itKv->second);
         kv_store.erase(itKv);
+        kv_store[newKey] = std::move(value);
         found = true;
     }
 
     auto itList = list_store.find(oldKey);
     if (itList != list_store.end()) {
-        list_store[newKey] = itList->second;
+        std::vector<std::string> value = std::move(itList->second);
         list_store.erase(itList);
+        list_store[newKey] = std::move(value);
         found = true;
     }
 
     auto itHash = hash_store.find(oldKey);
     if (itHash != hash_store.end()) {
-        hash_store[newKey] = itHash->second;
+        std::unordered_map<std::string, std::string> value = std::move(itHash->second);
         hash_store.erase(itHash);
+        hash_store[newKey] = std::move(value);
+        found = true;
+    }
+
+    auto itZset = zset_store.find(oldKey);
+    if (itZset != zset_store.end()) {
+        SortedSet value = std::move(itZset->second);
+        zset_store.erase(itZset);
+        zset_store[newKey] = std::move(value);
+        found = true;
+    }
+
+    auto itSet = set_store.find(oldKey);
+    if (itSet != set_store.end()) {
+        RedisSet value = std::move(itSet->second);
+        set_store.erase(itSet);
+        set_store[newKey] = std::move(value);
         found = true;
     }
 
     auto itExpire = expiry_map.find(oldKey);
     if (itExpire != expiry_map.end()) {
-        expiry_map[newKey] = itExpire->second;
+        auto when = itExpire->second;
         expiry_map.erase(itExpire);
+        expiry_map[newKey] = when;
         found = true;
     }
+
+    // The counter travels with the value
+    auto itFreq = access_freq.find(oldKey);
+    if (itFreq != access_freq.end()) {
+        uint32_t packed = itFreq->second;
+        access_freq.erase(itFreq);
+        access_freq[newKey] = packed;
+    }
+    if (found) {
+        unindexKey(oldKey);
+        indexKey(newKey);
+    }
     return found;
 }
 
 // List ops
-std::vector<std::string> RedisDatabase::lget(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+// Clamp an inclusive start..stop range with negative indexes to size,
+// false when it selects nothing
+static bool clampRange(long& start, long& stop, long size) {
+    if (start < 0) start += size;
+    if (stop < 0) stop += size;
+    if (start < 0) start = 0;
+    if (stop >= size) stop = size - 1;
+    return start <= stop && start < size;
+}
+
+void RedisDatabase::lrange(const std::string& key, long start, long stop, std::string& reply) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
-    if (it != list_store.end()) return it->second; 
+    if (it == list_store.end() || !clampRange(start, stop, static_cast<long>(it->second.size()))) {
+        reply += "*0\r\n";
+        return;
+    }
+    accessKey(key);
 
-    return {}; 
+    // Size the reply first so the range is copied exactly once
+    const auto& lst = it->second;
+    size_t bytes = 0;
+    for (long i = start; i <= stop; i++) bytes += lst[i].size() + 16;
+    reply.reserve(reply.size() + bytes + 16);
+    reply += "*" + std::to_string(stop - start + 1) + "\r\n";
+    for (long i = start; i <= stop; i++) {
+        reply += "$";
+        reply += std::to_string(lst[i].size());
+        reply += "\r\n";
+        reply += lst[i];
+        reply += "\r\n";
+    }
 }
 
 ssize_t RedisDatabase::llen(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
-    if (it != list_store.end()) 
+    if (it != list_store.end()) {
+        accessKey(key);
         return it->second.size();
+    }
     return 0;
 }
 
 void RedisDatabase::lpush(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    list_store[key].insert(list_store[key].begin(), value);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    touchKey(key);
+    auto [it, created] = list_store.try_emplace(key);
+    it->second.insert(it->second.begin(), value);
+    if (created) indexKey(key);
+    accessKey(key);
 }
 
 void RedisDatabase::rpush(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    list_store[key].push_back(value);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    touchKey(key);
+    auto [it, created] = list_store.try_emplace(key);
+    it->second.push_back(value);
+    if (created) indexKey(key);
+    accessKey(key);
 }
 
 bool RedisDatabase::lpop(const std::string& key, std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
     if (it != list_store.end() && !it->second.empty()) {
         value = it->second.front();
         it->second.erase(it->second.begin());
+        touchKey(key);
+        // Popping the last element deletes the key
+        if (it->second.empty()) removeKey(key, false);
+        else accessKey(key);
         return true;
     }
     return false;
 }
 
 bool RedisDatabase::rpop(const std::string& key, std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
     if (it != list_store.end() && !it->second.empty()) {
         value = it->second.back();
         it->second.pop_back();
+        touchKey(key);
+        if (it->second.empty()) removeKey(key, false);
+        else accessKey(key);
         return true;
     }
     return false;
@@ -245,7 +1024,7 @@ bool RedisDatabase::rpop(const std::string& key, std::string& value) {
 
 // If count is positive, remove from start, else remove from left
 int RedisDatabase::lrem(const std::string& key, int count, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     int removed = 0;
     auto it = list_store.find(key);
     if (it == list_store.end()) 
@@ -290,16 +1069,20 @@ int RedisDatabase::lrem(const std::string& key, int count, const std::string& va
             }
         }
     }
+    if (removed > 0) touchKey(key);
+    if (lst.empty()) removeKey(key, false);
+    else accessKey(key);
     return removed;
 }
 
 // Retrieve corresponding item in the selected list using index
 bool RedisDatabase::lindex(const std::string& key, int index, std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
 
     // If list doesnt exists
     if (it == list_store.end()) return false;
+    accessKey(key);
 
     const auto& lst = it->second;
 
@@ -314,7 +1097,7 @@ bool RedisDatabase::lindex(const std::string& key, int index, std::string& value
 }
 
 bool RedisDatabase::lset(const std::string& key, int index, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = list_store.find(key);
     if (it == list_store.end()) return false;
 
@@ -323,22 +1106,116 @@ bool RedisDatabase::lset(const std::string& key, int index, const std::string& v
     if (index < 0 || index >= static_cast<int>(lst.size())) return false;
     
     lst[index] = value;
+    touchKey(key);
+    accessKey(key);
+    return true;
+}
+
+void RedisDatabase::ltrim(const std::string& key, long start, long stop) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = list_store.find(key);
+    if (it == list_store.end()) return;
+
+    auto& lst = it->second;
+    if (!clampRange(start, stop, static_cast<long>(lst.size()))) {
+        removeKey(key, true);
+        return;
+    }
+    // Tail first, the head erase then only shifts what is kept
+    lst.erase(lst.begin() + stop + 1, lst.end());
+    lst.erase(lst.begin(), lst.begin() + start);
+    touchKey(key);
+    accessKey(key);
+}
+
+long RedisDatabase::linsert(const std::string& key, bool before, const std::string& pivot, const std::string& value) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = list_store.find(key);
+    if (it == list_store.end()) return 0;
+    accessKey(key);
+
+    auto& lst = it->second;
+    auto at = std::find(lst.begin(), lst.end(), pivot);
+    if (at == lst.end()) return -1;
+    lst.insert(before ? at : at + 1, value);
+    touchKey(key);
+    return static_cast<long>(lst.size());
+}
+
+std::vector<long> RedisDatabase::lpos(const std::string& key, const std::string& value, long rank, size_t count, size_t maxlen) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = list_store.find(key);
+    if (it == list_store.end()) return {};
+    accessKey(key);
+
+    const auto& lst = it->second;
+    long size = static_cast<long>(lst.size());
+    long step = rank < 0 ? -1 : 1;
+    // Matches to pass over, in unsigned so that -LONG_MIN cannot overflow
+    unsigned long skip = (rank < 0 ? 0UL - static_cast<unsigned long>(rank) : static_cast<unsigned long>(rank)) - 1;
+    std::vector<long> matches;
+    size_t compared = 0;
+    for (long i = rank < 0 ? size - 1 : 0; i >= 0 && i < size; i += step) {
+        if (maxlen && compared++ >= maxlen) break;
+        if (lst[i] != value) continue;
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        matches.push_back(i);
+        if (count && matches.size() >= count) break;
+    }
+    return matches;
+}
+
+bool RedisDatabase::lmove(const std::string& source, const std::string& destination, bool fromLeft, bool toLeft, std::string& value) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = list_store.find(source);
+    if (it == list_store.end() || it->second.empty()) return false;
+
+    auto& src = it->second;
+    if (fromLeft) {
+        value = std::move(src.front());
+        src.erase(src.begin());
+    } else {
+        value = std::move(src.back());
+        src.pop_back();
+    }
+
+    auto [itDst, created] = list_store.try_emplace(destination);
+    auto& dst = itDst->second;
+    if (toLeft) dst.insert(dst.begin(), value);
+    else dst.push_back(value);
+    if (created) indexKey(destination);
+    touchKey(source);
+    touchKey(destination);
+    // The source goes once empty. Checked after the push, as it may also be
+    // the destination, and found again since the push may have rehashed
+    it = list_store.find(source);
+    if (it->second.empty()) removeKey(source, false);
+    else accessKey(source);
+    accessKey(destination);
     return true;
 }
 
 // Hash Ops
 bool RedisDatabase::hset(const std::string& key, const std::string& field, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    hash_store[key][field] = value;
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    touchKey(key);
+    auto [it, created] = hash_store.try_emplace(key);
+    it->second[field] = value;
+    if (created) indexKey(key);
+    accessKey(key);
     return true;
 }
 
 bool RedisDatabase::hget(const std::string& key, const std::string& field, std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
 
     // Find by key then by field
     auto it = hash_store.find(key);
     if (it != hash_store.end()) {
+        accessKey(key);
         auto fieldIt = it->second.find(field);
         if (fieldIt != it->second.end()) {
             value = fieldIt->second;
@@ -349,32 +1226,40 @@ bool RedisDatabase::hget(const std::string& key, const std::string& field, std::
 }
 
 bool RedisDatabase::hexists(const std::string& key, const std::string& field) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = hash_store.find(key);
-    if (it != hash_store.end()) return it->second.find(field) != it->second.end();
-    return false;
+    if (it == hash_store.end()) return false;
+    accessKey(key);
+    return it->second.find(field) != it->second.end();
 }
 
 bool RedisDatabase::hdel(const std::string& key, const std::string& field) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = hash_store.find(key);
-    if (it != hash_store.end()) return it->second.erase(field) > 0;
+    if (it != hash_store.end() && it->second.erase(field) > 0) {
+        touchKey(key);
+        accessKey(key);
+        return true;
+    }
     return false;
 }
 
 std::unordered_map<std::string, std::string> RedisDatabase::hgetall(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    if (hash_store.find(key) != hash_store.end()) return hash_store[key];
-    return {};
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = hash_store.find(key);
+    if (it == hash_store.end()) return {};
+    accessKey(key);
+    return it->second;
 }
 
 std::vector<std::string> RedisDatabase::hkeys(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
 
     // push a copy of the fields
     std::vector<std::string> fields;
     auto it = hash_store.find(key);
     if (it != hash_store.end()) {
+        accessKey(key);
         for (const auto& pair: it->second)
             fields.push_back(pair.first);
     }
@@ -382,10 +1267,11 @@ std::vector<std::string> RedisDatabase::hkeys(const std::string& key) {
 }
 
 std::vector<std::string> RedisDatabase::hvals(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     std::vector<std::string> values;
     auto it = hash_store.find(key);
     if (it != hash_store.end()) {
+        accessKey(key);
         for (const auto& pair: it->second)
             values.push_back(pair.second);
     }
@@ -393,15 +1279,309 @@ std::vector<std::string> RedisDatabase::hvals(const std::string& key) {
 }
 
 ssize_t RedisDatabase::hlen(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     auto it = hash_store.find(key);
-    return (it != hash_store.end()) ? it->second.size() : 0;
+    if (it == hash_store.end()) return 0;
+    accessKey(key);
+    return it->second.size();
 }
 
 bool RedisDatabase::hmset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    touchKey(key);
+    auto [it, created] = hash_store.try_emplace(key);
     for (const auto& pair: fieldValues) {
-        hash_store[key][pair.first] = pair.second;
+        it->second[pair.first] = pair.second;
+    }
+    if (created) indexKey(key);
+    accessKey(key);
+    return true;
+}
+
+// Sorted set ops
+long RedisDatabase::zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& scoreMembers, int flags) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) {
+        if (keyExists(key)) return -1;
+        // XX never creates a key
+        if (flags & ZADD_XX) return 0;
+        it = zset_store.emplace(key, SortedSet()).first;
+        indexKey(key);
+    }
+
+    auto& zset = it->second;
+    size_t added = 0;
+    size_t updated = 0;
+    for (const auto& pr : scoreMembers) {
+        double current;
+        bool exists = zset.score(pr.second, current);
+        if (exists) {
+            if (flags & ZADD_NX) continue;
+            if ((flags & ZADD_GT) && pr.first <= current) continue;
+            if ((flags & ZADD_LT) && pr.first >= current) continue;
+            if (current != pr.first) {
+                zset.add(pr.second, pr.first);
+                updated++;
+            }
+        } else {
+            if (flags & ZADD_XX) continue;
+            zset.add(pr.second, pr.first);
+            added++;
+        }
+    }
+
+    if (added + updated > 0) touchKey(key);
+    if (zset.size() == 0) {
+        zset_store.erase(it);
+        access_freq.erase(key);
+        unindexKey(key);
+    } else {
+        accessKey(key);
+    }
+    return (flags & ZADD_CH) ? added + updated : added;
+}
+
+size_t RedisDatabase::zrem(const std::string& key, const std::vector<std::string>& members) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return 0;
+
+    size_t removed = 0;
+    for (const auto& member : members) {
+        if (it->second.remove(member)) removed++;
+    }
+    if (removed > 0) touchKey(key);
+    if (it->second.size() == 0) {
+        zset_store.erase(it);
+        access_freq.erase(key);
+        unindexKey(key);
+    } else {
+        accessKey(key);
     }
+    return removed;
+}
+
+bool RedisDatabase::zscore(const std::string& key, const std::string& member, double& score) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return false;
+    accessKey(key);
+    return it->second.score(member, score);
+}
+
+int RedisDatabase::zincrby(const std::string& key, double increment, const std::string& member, double& score) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    double current = 0;
+    auto it = zset_store.find(key);
+    if (it != zset_store.end()) it->second.score(member, current);
+    else if (keyExists(key)) return -1;
+
+    score = current + increment;
+    if (std::isnan(score)) return 0;
+    zset_store[key].add(member, score);
+    if (it == zset_store.end()) indexKey(key);
+    touchKey(key);
+    accessKey(key);
+    return 1;
+}
+
+long RedisDatabase::zrank(const std::string& key, const std::string& member, bool reverse) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return -1;
+    accessKey(key);
+    return it->second.rank(member, reverse);
+}
+
+std::vector<SortedSet::Entry> RedisDatabase::zrange(const std::string& key, long start, long stop, bool reverse) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return {};
+    accessKey(key);
+
+    // Negative indexes count from the end of the set
+    long size = static_cast<long>(it->second.size());
+    if (start < 0) start += size;
+    if (stop < 0) stop += size;
+    if (start < 0) start = 0;
+    if (start > stop || start >= size) return {};
+    if (stop >= size) stop = size - 1;
+
+    return it->second.rangeByRank(start, stop, reverse);
+}
+
+std::vector<SortedSet::Entry> RedisDatabase::zrangebyscore(const std::string& key, const ZRangeSpec& range, size_t offset, long count, bool reverse) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return {};
+    accessKey(key);
+    return it->second.rangeByScore(range, offset, count, reverse);
+}
+
+size_t RedisDatabase::zcard(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return 0;
+    accessKey(key);
+    return it->second.size();
+}
+
+// Set ops
+long RedisDatabase::sadd(const std::string& key, const std::vector<std::string>& members) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = set_store.find(key);
+    if (it == set_store.end()) {
+        if (keyExists(key)) return -1;
+        it = set_store.emplace(key, RedisSet()).first;
+        indexKey(key);
+    }
+    long added = static_cast<long>(it->second.add(members));
+    if (added > 0) touchKey(key);
+    accessKey(key);
+    return added;
+}
+
+size_t RedisDatabase::srem(const std::string& key, const std::vector<std::string>& members) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = set_store.find(key);
+    if (it == set_store.end()) return 0;
+
+    size_t removed = 0;
+    for (const auto& member : members) {
+        if (it->second.remove(member)) removed++;
+    }
+    if (removed > 0) touchKey(key);
+    if (it->second.size() == 0) {
+        set_store.erase(it);
+        access_freq.erase(key);
+        unindexKey(key);
+    } else {
+        accessKey(key);
+    }
+    return removed;
+}
+
+bool RedisDatabase::sismember(const std::string& key, const std::string& member) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = set_store.find(key);
+    if (it == set_store.end()) return false;
+    accessKey(key);
+    return it->second.contains(member);
+}
+
+size_t RedisDatabase::scard(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = set_store.find(key);
+    if (it == set_store.end()) return 0;
+    accessKey(key);
+    return it->second.size();
+}
+
+std::vector<std::string> RedisDatabase::smembers(const std::string& key) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = set_store.find(key);
+    if (it == set_store.end()) return {};
+    accessKey(key);
+    return it->second.members();
+}
+
+std::vector<const RedisSet*> RedisDatabase::lookupSets(const std::vector<std::string>& keys) const {
+    std::vector<const RedisSet*> sets;
+    sets.reserve(keys.size());
+    for (const auto& key : keys) {
+        auto it = set_store.find(key);
+        sets.push_back(it != set_store.end() ? &it->second : nullptr);
+    }
+    return sets;
+}
+
+std::vector<std::string> RedisDatabase::sinter(const std::vector<std::string>& keys) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return RedisSet::intersect(lookupSets(keys));
+}
+
+std::vector<std::string> RedisDatabase::sunion(const std::vector<std::string>& keys) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return RedisSet::unite(lookupSets(keys));
+}
+
+std::vector<std::string> RedisDatabase::sdiff(const std::vector<std::string>& keys) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return RedisSet::difference(lookupSets(keys));
+}
+
+// HyperLogLog ops
+int RedisDatabase::pfadd(const std::string& key, const std::vector<std::string>& elements) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    bool created = false;
+    if (it == kv_store.end()) {
+        if (keyExists(key)) return -1;
+        it = kv_store.emplace(key, HyperLogLog::create()).first;
+        indexKey(key);
+        created = true;
+    } else if (!HyperLogLog::valid(it->second)) {
+        return -1;
+    }
+
+    size_t sparseMax = static_cast<size_t>(serverConfig().hllSparseMaxBytes.load(std::memory_order_relaxed));
+    bool changed = HyperLogLog::add(it->second, elements, sparseMax) || created;
+    if (changed) touchKey(key);
+    accessKey(key);
+    return changed ? 1 : 0;
+}
+
+bool RedisDatabase::pfcount(const std::vector<std::string>& keys, uint64_t& count) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    // A single key answers from, and refreshes, its cached cardinality
+    if (keys.size() == 1) {
+        auto it = kv_store.find(keys[0]);
+        if (it == kv_store.end()) {
+            count = 0;
+            return !keyExists(keys[0]);
+        }
+        if (!HyperLogLog::valid(it->second)) return false;
+        accessKey(keys[0]);
+        count = HyperLogLog::count(it->second);
+        return true;
+    }
+
+    uint8_t registers[HyperLogLog::REGISTERS] = {};
+    for (const auto& key : keys) {
+        auto it = kv_store.find(key);
+        if (it == kv_store.end()) {
+            if (keyExists(key)) return false;
+            continue;
+        }
+        if (!HyperLogLog::valid(it->second)) return false;
+        accessKey(key);
+        HyperLogLog::merge(it->second, registers);
+    }
+    count = HyperLogLog::estimate(registers);
+    return true;
+}
+
+bool RedisDatabase::pfmerge(const std::string& destination, const std::vector<std::string>& sources) {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    // The destination counts as a source too
+    uint8_t registers[HyperLogLog::REGISTERS] = {};
+    std::vector<std::string> keys = sources;
+    keys.push_back(destination);
+    for (const auto& key : keys) {
+        auto it = kv_store.find(key);
+        if (it == kv_store.end()) {
+            if (keyExists(key)) return false;
+            continue;
+        }
+        if (!HyperLogLog::valid(it->second)) return false;
+        HyperLogLog::merge(it->second, registers);
+    }
+
+    size_t sparseMax = static_cast<size_t>(serverConfig().hllSparseMaxBytes.load(std::memory_order_relaxed));
+    kv_store[destination] = HyperLogLog::fromRegisters(registers, sparseMax);
+    indexKey(destination);
+    touchKey(destination);
+    accessKey(destination);
     return true;
 }
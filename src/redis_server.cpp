@@ -1,16 +1,64 @@
 #include "redis_server.h"
+#include "config.h"
 #include "redis_command_handler.h"
 #include "redis_database.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
-#include <sys/socket.h>
-#include <unistd.h>
+#include <sstream>
+#include <netdb.h>
 #include <netinet/in.h>
-#include <thread>
+#include <netinet/tcp.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
 
 static RedisServer* globalServer = nullptr;
 
+// Bytes read from a socket per recv call
+static constexpr size_t READ_CHUNK = 16 * 1024;
+static constexpr int MAX_EVENTS = 256;
+// Output chunks handed to a single sendmsg call
+static constexpr int WRITE_IOV_MAX = 64;
+// A client stops being served once this many reply bytes wait for it, and
+// resumes when the backlog is below half of it
+static constexpr size_t OUTPUT_PAUSE_BYTES = 1024 * 1024;
+// Delay before reconnecting to a primary after the link failed
+static constexpr int MASTER_RETRY_MS = 1000;
+
+// io_uring engine: submission queue size and provided receive buffers, each
+// READ_CHUNK bytes
+static constexpr unsigned RING_ENTRIES = 4096;
+static constexpr unsigned RECV_BUFFERS = 1024;
+// Operation kinds in the low bits of user_data, the rest is the connection
+// pointer (null for the listening socket)
+enum UringOp : uint64_t {
+    OP_ACCEPT = 0,
+    OP_RECV = 1,
+    OP_SEND = 2,
+    OP_CONNECT = 3
+};
+static constexpr uint64_t OP_MASK = 3;
+
+static uint64_t opData(RedisConnection* conn, UringOp op) {
+    return reinterpret_cast<uint64_t>(conn) | op;
+}
+
+// Outcome of sendOutput
+enum WriteResult : uint8_t {
+    WRITE_DONE,
+    WRITE_BLOCKED,
+    WRITE_FAILED
+};
+
 void signalHandler(int signum) {
     if (globalServer) {
         std::cout << "\nSignal caught " << signum << ", shutting down\n";
@@ -19,13 +67,43 @@ void signalHandler(int signum) {
     exit(signum);
 }
 
-RedisServer::RedisServer(int port) : port(port), server_socket(-1), isRunning(true) {
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static std::string peerAddress(int fd) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    char ip[INET_ADDRSTRLEN];
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0 ||
+        !inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip))) {
+        return "";
+    }
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+RedisServer::RedisServer(int port)
+    : port(port), server_socket(-1), epoll_fd(-1), isRunning(true), ioEngine(IoEngine::Epoll), ioThreadCount(1),
+      nextClientId(1),
+      masterLink(nullptr), masterLinkGeneration(0), pendingOffset(0) {
     globalServer = this;
+    serverStats().port = port;
     setupSignalHandler();
 }
 
+void RedisServer::setIoEngine(IoEngine engine) {
+    ioEngine = engine;
+}
+
+void RedisServer::setIoThreads(size_t threads) {
+    ioThreadCount = std::max<size_t>(threads, 1);
+}
+
 void RedisServer::setupSignalHandler() {
     signal(SIGINT, signalHandler);
+    // A client closing its socket must not kill the server mid write
+    signal(SIGPIPE, SIG_IGN);
 }
 
 void RedisServer::shutdown() {
@@ -45,6 +123,517 @@ void RedisServer::shutdown() {
     std::cout << "Server Shutdown Completed\n";
 }
 
+void RedisServer::enableCluster() {
+    // Nodes are meant to run as local processes, they announce the loopback address
+    cmdHandler.getCluster().enable("127.0.0.1", port);
+    RedisDatabase::getInstance().enableSlotIndex();
+}
+
+// Over maxclients the client gets an error instead of a connection
+static bool admitClient(int fd) {
+    if (serverStats().connectedClients.load() < static_cast<uint64_t>(serverConfig().maxClients.load())) return true;
+    static const char error[] = "-Error: max number of clients reached\r\n";
+    ssize_t ignored = send(fd, error, sizeof(error) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    (void)ignored;
+    close(fd);
+    serverStats().rejectedConnections++;
+    return false;
+}
+
+void RedisServer::acceptConnections() {
+    while (true) {
+        int client_socket = accept(server_socket, nullptr, nullptr);
+        if (client_socket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && isRunning) {
+                std::cerr << "Error occured when accepting new client connection\n";
+            }
+            return;
+        }
+
+        if (!admitClient(client_socket)) continue;
+        setNonBlocking(client_socket);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = client_socket;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+            close(client_socket);
+            continue;
+        }
+        addConnection(client_socket);
+    }
+}
+
+RedisConnection* RedisServer::addConnection(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    auto conn = std::make_unique<RedisConnection>();
+    conn->fd = fd;
+    conn->id = nextClientId++;
+    conn->addr = peerAddress(fd);
+    RedisConnection* added = conn.get();
+    connections[fd] = std::move(conn);
+    clientConnections()[added->id] = added;
+    serverStats().connectedClients++;
+    serverStats().totalConnections++;
+    return added;
+}
+
+// An endless command must not grow the buffer without bound. The link to
+// our primary is trusted
+static bool queryBufferOverLimit(const RedisConnection* conn) {
+    if (conn->isMaster || conn->queryBuffer.size() <= static_cast<size_t>(serverConfig().clientQueryBufferLimit.load())) {
+        return false;
+    }
+    serverStats().queryBufferLimitDisconnections++;
+    std::cerr << "Closing client id=" << conn->id << " that reached max query buffer length\n";
+    return true;
+}
+
+bool RedisServer::receive(RedisConnection* conn) {
+    char buffer[READ_CHUNK];
+    ssize_t bytes = recv(conn->fd, buffer, sizeof(buffer), 0);
+    if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        return false;
+    }
+    if (bytes > 0) {
+        serverStats().netInputBytes += bytes;
+        conn->queryBuffer.append(buffer, bytes);
+    }
+    return !queryBufferOverLimit(conn);
+}
+
+bool RedisServer::readFromClient(RedisConnection* conn) {
+    if (!receive(conn)) {
+        closeConnection(conn);
+        return false;
+    }
+    dispatchInput(conn);
+    return true;
+}
+
+void RedisServer::handleInput(RedisConnection* conn, const char* data, size_t len) {
+    serverStats().netInputBytes += len;
+    conn->queryBuffer.append(data, len);
+    if (queryBufferOverLimit(conn)) {
+        closeConnection(conn);
+        return;
+    }
+    dispatchInput(conn);
+}
+
+void RedisServer::dispatchInput(RedisConnection* conn) {
+    if (conn->isMaster) {
+        processMasterInput(conn);
+    } else {
+        processInput(conn);
+    }
+}
+
+void RedisServer::parseAhead(RedisConnection* conn) {
+    size_t pos = 0;
+    while (true) {
+        if (conn->parsedCount == conn->parsedCommands.size()) conn->parsedCommands.emplace_back();
+        // A protocol error is left in the buffer, processInput hits it
+        // again after the commands before it
+        if (parseRespCommand(conn->queryBuffer, pos, conn->parsedCommands[conn->parsedCount]) != ParseStatus::Ok) break;
+        if (!conn->parsedCommands[conn->parsedCount].empty()) conn->parsedCount++;
+    }
+    conn->queryBuffer.erase(0, pos);
+}
+
+static bool readyForCommands(const RedisConnection* conn) {
+    return !conn->blocked && !conn->closeAfterReply && !conn->closeAsap && !conn->readsPaused;
+}
+
+void RedisServer::runCommand(RedisConnection* conn, const std::vector<std::string>& tokens) {
+    conn->addReply(cmdHandler.processCommand(tokens, *conn));
+    cmdHandler.serveBlockedClients();
+    // Replicas are bounded by their output limit alone, their input is
+    // just acknowledgements
+    if (conn->outputBytes >= OUTPUT_PAUSE_BYTES && !conn->isReplica) setReadsPaused(conn, true);
+}
+
+void RedisServer::processInput(RedisConnection* conn) {
+    // Commands an I/O thread parsed come first. A blocked or paused client
+    // keeps the rest, parsed or not, until it is served
+    while (conn->parsedNext < conn->parsedCount && readyForCommands(conn)) {
+        runCommand(conn, conn->parsedCommands[conn->parsedNext++]);
+    }
+    if (conn->parsedNext < conn->parsedCount) return;
+    conn->parsedNext = conn->parsedCount = 0;
+
+    size_t pos = 0;
+    std::vector<std::string>& tokens = commandTokens;
+
+    while (readyForCommands(conn)) {
+        ParseStatus status = parseRespCommand(conn->queryBuffer, pos, tokens);
+        if (status == ParseStatus::Incomplete) break;
+        if (status == ParseStatus::Error) {
+            conn->addReply("-Error: Protocol error\r\n");
+            conn->closeAfterReply = true;
+            break;
+        }
+        if (tokens.empty()) continue;
+
+        runCommand(conn, tokens);
+    }
+
+    conn->queryBuffer.erase(0, pos);
+}
+
+void RedisServer::processUnblockedClients() {
+    std::vector<RedisConnection*> unblocked = cmdHandler.takeUnblockedClients();
+    while (!unblocked.empty()) {
+        for (RedisConnection* conn : unblocked) {
+            processInput(conn);
+        }
+        unblocked = cmdHandler.takeUnblockedClients();
+    }
+}
+
+uint8_t RedisServer::sendOutput(RedisConnection* conn) {
+    while (conn->hasPendingOutput()) {
+        // Gather queued chunks (private replies and shared pub/sub frames) into one syscall
+        iovec iov[WRITE_IOV_MAX];
+        int count = 0;
+        size_t offset = conn->outputOffset;
+        for (const auto& chunk : conn->outputQueue) {
+            if (count == WRITE_IOV_MAX) break;
+            iov[count].iov_base = const_cast<char*>(chunk->data()) + offset;
+            iov[count].iov_len = chunk->size() - offset;
+            offset = 0;
+            count++;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent > 0) {
+            serverStats().netOutputBytes += sent;
+            conn->consumeOutput(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        // Socket buffer full, epoll tells us when to continue
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return WRITE_BLOCKED;
+        return WRITE_FAILED;
+    }
+    return WRITE_DONE;
+}
+
+bool RedisServer::finishWrite(RedisConnection* conn, uint8_t result) {
+    if (result == WRITE_FAILED) {
+        closeConnection(conn);
+        return false;
+    }
+    updateWriteInterest(conn, result == WRITE_BLOCKED);
+
+    if (result == WRITE_DONE && conn->closeAfterReply) {
+        closeConnection(conn);
+        return false;
+    }
+    resumeIfDrained(conn);
+    return true;
+}
+
+void RedisServer::setReadsPaused(RedisConnection* conn, bool paused) {
+    if (conn->readsPaused == paused) return;
+    conn->readsPaused = paused;
+    // io_uring keeps receiving, the query buffer limit bounds that input
+    if (!ring) updateEvents(conn);
+}
+
+void RedisServer::resumeIfDrained(RedisConnection* conn) {
+    if (!conn->readsPaused || conn->outputBytes >= OUTPUT_PAUSE_BYTES / 2) return;
+    setReadsPaused(conn, false);
+    // Commands that arrived meanwhile, their replies go out next iteration
+    processInput(conn);
+}
+
+bool RedisServer::writeToClient(RedisConnection* conn) {
+    return finishWrite(conn, sendOutput(conn));
+}
+
+void RedisServer::flushPendingWrites() {
+    std::vector<RedisConnection*> pending;
+    pending.swap(pendingWriteConnections());
+
+    // Already waiting for EPOLLOUT or a send completion, the event loop
+    // will resume the write. Clients over their output limit are dropped
+    size_t ready = 0;
+    for (RedisConnection* conn : pending) {
+        conn->inPendingWrites = false;
+        if (conn->closeAsap) {
+            serverStats().outputBufferLimitDisconnections++;
+            std::cerr << "Client id=" << conn->id << " addr=" << conn->addr
+                      << " closed for overcoming of output buffer limits\n";
+            closeConnection(conn);
+        } else if (!conn->writeInterest) {
+            pending[ready++] = conn;
+        }
+    }
+    pending.resize(ready);
+
+    if (ring) {
+        for (RedisConnection* conn : pending) submitWrite(conn);
+        return;
+    }
+    if (!ioThreads) {
+        for (RedisConnection* conn : pending) writeToClient(conn);
+        return;
+    }
+
+    ioResults.resize(pending.size());
+    bool threaded = ioThreads->parallelFor(pending.size(), [&](size_t i) { ioResults[i] = sendOutput(pending[i]); });
+    if (threaded) serverStats().ioThreadedWrites += pending.size();
+    for (size_t i = 0; i < pending.size(); i++) {
+        finishWrite(pending[i], ioResults[i]);
+    }
+}
+
+void RedisServer::processReadQueue() {
+    ioResults.resize(readQueue.size());
+    bool threaded = ioThreads->parallelFor(readQueue.size(), [&](size_t i) {
+        RedisConnection* conn = readQueue[i];
+        ioResults[i] = receive(conn);
+        if (ioResults[i]) parseAhead(conn);
+    });
+    if (threaded) serverStats().ioThreadedReads += readQueue.size();
+
+    // Commands run here, one connection after the other in event order
+    for (size_t i = 0; i < readQueue.size(); i++) {
+        if (ioResults[i]) {
+            processInput(readQueue[i]);
+        } else {
+            closeConnection(readQueue[i]);
+        }
+    }
+    readQueue.clear();
+}
+
+void RedisServer::updateWriteInterest(RedisConnection* conn, bool enable) {
+    if (conn->writeInterest == enable) return;
+    conn->writeInterest = enable;
+    updateEvents(conn);
+}
+
+void RedisServer::updateEvents(RedisConnection* conn) {
+    epoll_event ev{};
+    ev.events = (conn->readsPaused ? 0 : EPOLLIN) | (conn->writeInterest ? EPOLLOUT : 0);
+    ev.data.fd = conn->fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void RedisServer::closeConnection(RedisConnection* conn) {
+    cmdHandler.onConnectionClosed(conn);
+
+    if (!conn->isMaster) serverStats().connectedClients--;
+    clientConnections().erase(conn->id);
+    if (conn == masterLink) {
+        masterLink = nullptr;
+        nextMasterConnect = std::chrono::steady_clock::now() + std::chrono::milliseconds(MASTER_RETRY_MS);
+    }
+
+    if (conn->inPendingWrites) {
+        auto& pending = pendingWriteConnections();
+        pending.erase(std::remove(pending.begin(), pending.end(), conn), pending.end());
+    }
+
+    int fd = conn->fd;
+    if (ring) {
+        // Ends the multishot recv, the kernel holds the socket until then
+        ::shutdown(fd, SHUT_RDWR);
+        close(fd);
+        auto it = connections.find(fd);
+        if (conn->inflightOps > 0) {
+            conn->closed = true;
+            retiredConnections[conn] = std::move(it->second);
+        }
+        connections.erase(it);
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+void RedisServer::replicationCron() {
+    Replication& replication = cmdHandler.getReplication();
+
+    // REPLICAOF changed the primary, the current link is stale
+    if (masterLinkGeneration != replication.masterGeneration()) {
+        masterLinkGeneration = replication.masterGeneration();
+        if (masterLink) closeConnection(masterLink);
+        nextMasterConnect = std::chrono::steady_clock::now();
+    }
+
+    if (replication.isReplica() && !masterLink && std::chrono::steady_clock::now() >= nextMasterConnect) {
+        connectToMaster();
+    }
+}
+
+void RedisServer::connectToMaster() {
+    Replication& replication = cmdHandler.getReplication();
+    nextMasterConnect = std::chrono::steady_clock::now() + std::chrono::milliseconds(MASTER_RETRY_MS);
+
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string portStr = std::to_string(replication.masterPort());
+    if (getaddrinfo(replication.masterHost().c_str(), portStr.c_str(), &hints, &res) != 0 || !res) {
+        std::cerr << "Error resolving master " << replication.masterHost() << "\n";
+        return;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return;
+    }
+    setNonBlocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return;
+    }
+
+    auto conn = std::make_unique<RedisConnection>();
+    conn->fd = fd;
+    conn->id = nextClientId++;
+    conn->isMaster = true;
+    conn->linkState = MasterLinkState::Connecting;
+
+    // The handshake is sent once the socket reports writable: EPOLLOUT, or
+    // a POLLOUT completion with io_uring
+    if (ring) {
+        if (!ring->prepPollOut(fd, opData(conn.get(), OP_CONNECT))) {
+            close(fd);
+            return;
+        }
+        conn->inflightOps++;
+    } else {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            return;
+        }
+        conn->writeInterest = true;
+    }
+    masterLink = conn.get();
+    connections[fd] = std::move(conn);
+    std::cout << "Connecting to master " << replication.masterHost() << ":" << replication.masterPort() << "\n";
+}
+
+static std::string encodeCommand(const std::vector<std::string>& tokens) {
+    std::string out = "*" + std::to_string(tokens.size()) + "\r\n";
+    for (const auto& token : tokens) {
+        out += "$" + std::to_string(token.size()) + "\r\n" + token + "\r\n";
+    }
+    return out;
+}
+
+bool RedisServer::finishMasterConnect(RedisConnection* conn) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        closeConnection(conn);
+        return false;
+    }
+
+    // Pipelined, the replies are checked in order by processMasterInput.
+    // We ask for the byte after the last one applied
+    Replication& replication = cmdHandler.getReplication();
+    conn->linkState = MasterLinkState::Handshake;
+    conn->handshakeReplies = 0;
+    conn->addReply(encodeCommand({"PING"}) +
+                   encodeCommand({"REPLCONF", "listening-port", std::to_string(port)}) +
+                   encodeCommand({"PSYNC", replication.replicationId(), std::to_string(replication.offset() + 1)}));
+    return true;
+}
+
+void RedisServer::processMasterInput(RedisConnection* conn) {
+    Replication& replication = cmdHandler.getReplication();
+    std::string& buffer = conn->queryBuffer;
+    size_t pos = 0;
+    std::vector<std::string> tokens;
+
+    while (pos < buffer.size()) {
+        if (conn->linkState == MasterLinkState::Handshake) {
+            size_t crlf = buffer.find("\r\n", pos);
+            if (crlf == std::string::npos) break;
+            std::string line = buffer.substr(pos, crlf - pos);
+            pos = crlf + 2;
+
+            // +PONG and the REPLCONF +OK
+            if (++conn->handshakeReplies < 3) continue;
+
+            std::istringstream iss(line);
+            std::string status, replid;
+            iss >> status >> replid;
+            if (status == "+FULLRESYNC") {
+                pendingReplid = replid;
+                iss >> pendingOffset;
+                conn->linkState = MasterLinkState::Transfer;
+            } else if (status == "+CONTINUE") {
+                replication.continueWithMaster(replid);
+                conn->linkState = MasterLinkState::Streaming;
+                std::cout << "Partial resync with master from offset " << replication.offset() + 1 << "\n";
+            } else {
+                std::cerr << "Master refused PSYNC: " << line << "\n";
+                closeConnection(conn);
+                return;
+            }
+        } else if (conn->linkState == MasterLinkState::Transfer) {
+            // $<length>\r\n<snapshot>, without a trailing CRLF
+            size_t crlf = buffer.find("\r\n", pos);
+            if (crlf == std::string::npos) break;
+            size_t length = std::strtoull(buffer.c_str() + pos + 1, nullptr, 10);
+            if (buffer.size() - (crlf + 2) < length) break;
+
+            if (!RedisDatabase::getInstance().loadSnapshot(buffer.substr(crlf + 2, length))) {
+                std::cerr << "Error loading snapshot from master\n";
+                closeConnection(conn);
+                return;
+            }
+            pos = crlf + 2 + length;
+            replication.startFromMaster(pendingReplid, pendingOffset);
+            conn->linkState = MasterLinkState::Streaming;
+            std::cout << "Full resync with master done, " << length << " bytes\n";
+
+            // Our own replicas hold a history that no longer exists
+            std::vector<RedisConnection*> replicas(replication.replicas().begin(), replication.replicas().end());
+            for (RedisConnection* replica : replicas) {
+                closeConnection(replica);
+            }
+        } else {
+            size_t start = pos;
+            ParseStatus status = parseRespCommand(buffer, pos, tokens);
+            if (status == ParseStatus::Incomplete) break;
+            if (status == ParseStatus::Error) {
+                std::cerr << "Protocol error in master stream\n";
+                closeConnection(conn);
+                return;
+            }
+
+            // Replies to the primary are dropped, the bytes go on to our
+            // backlog and replicas unchanged
+            if (!tokens.empty()) cmdHandler.processCommand(tokens, *conn);
+            cmdHandler.serveBlockedClients();
+            replication.feed(buffer.substr(start, pos - start));
+        }
+    }
+
+    buffer.erase(0, pos);
+}
+
 void RedisServer::run() {
     server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket < 0) {
@@ -65,40 +654,55 @@ void RedisServer::run() {
         return;
     }
 
-    if (listen(server_socket, 10) < 0) {
+    if (listen(server_socket, SOMAXCONN) < 0) {
         std::cerr << "Error Listening On Server Socket\n";
         return;
     } 
 
-    std::cout << "Redis Server Started Successfully On Port " << port << "\n";
+    if (ioEngine == IoEngine::IoUring) {
+        ring = std::make_unique<IoUring>();
+        std::string error;
+        if (!ring->init(RING_ENTRIES, RECV_BUFFERS, READ_CHUNK, error)) {
+            std::cerr << "io_uring unavailable (" << error << "), falling back to epoll\n";
+            ring.reset();
+        }
+    }
+    serverStats().ioEngine = ring ? "io_uring" : "epoll";
 
-    std::vector<std::thread> threads;
-    RedisCommandHandler cmdHandler;
+    std::cout << "Redis Server Started Successfully On Port " << port << " (" << serverStats().ioEngine << ")\n";
 
-    while (isRunning) {
-        int client_socket = accept(server_socket, nullptr, nullptr);
-        if (client_socket < 0) {
-            if (isRunning) std::cerr << "Error occured when accepting new client connection\n";
-            break;
+    if (ioThreadCount > 1 && ring) {
+        std::cerr << "I/O threads are not used with io_uring\n";
+    } else if (ioThreadCount > 1) {
+        // Spinning threads on shared cores only slow the event loop down
+        size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        if (ioThreadCount > cpus) {
+            std::cerr << "I/O threads capped at " << cpus << ", the number of CPUs\n";
+            ioThreadCount = cpus;
         }
-        threads.emplace_back([client_socket, &cmdHandler]() {
-            char buffer[1024];
-            while (true) {
-                memset(buffer, 0, sizeof(buffer));
-                int bytes = recv(client_socket, buffer, sizeof(buffer)-1, 0);
-                if (bytes < 0) break;
+    }
+    if (ioThreadCount > 1 && !ring) {
+        ioThreads = std::make_unique<IoThreads>(ioThreadCount);
+        serverStats().ioThreads = ioThreadCount;
+        std::cout << "I/O threads: " << ioThreadCount << "\n";
+    }
 
-                std::string request(buffer, bytes);
-                std::string response = cmdHandler.processCommand(request);
-                send(client_socket, response.c_str(), response.size(), 0);
-            }
-            close(client_socket);
-        });
+    if (ring) {
+        runUring();
+    } else {
+        runEpoll();
     }
+    ioThreads.reset();
 
-    for (auto& thread : threads) {
-        if (thread.joinable()) thread.join();
+    for (auto& entry : connections) {
+        close(entry.first);
     }
+    connections.clear();
+    // Closing the ring cancels what it still holds, then retired
+    // connections can go
+    ring.reset();
+    retiredConnections.clear();
+    if (epoll_fd >= 0) close(epoll_fd);
 
     // Handle Shutdown
     // Persist the database 
@@ -108,3 +712,232 @@ void RedisServer::run() {
         std::cerr << "Error dumping database\n";
     }
 }
+
+int RedisServer::loopTimeoutMs() {
+    // Sleep no longer than the nearest blocked client timeout, or the next
+    // attempt to reach our primary
+    int timeout = cmdHandler.nextTimeoutMs();
+    if (cmdHandler.getReplication().isReplica() && !masterLink && (timeout < 0 || timeout > MASTER_RETRY_MS)) {
+        timeout = MASTER_RETRY_MS;
+    }
+    // Replies of clients resumed while flushing are written right away
+    if (!pendingWriteConnections().empty()) timeout = 0;
+    return timeout;
+}
+
+void RedisServer::beforeSleep() {
+    cmdHandler.handleBlockedTimeouts();
+    processUnblockedClients();
+    replicationCron();
+    flushPendingWrites();
+}
+
+void RedisServer::runEpoll() {
+    setNonBlocking(server_socket);
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        std::cerr << "Error Creating Epoll Instance\n";
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = server_socket;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &ev);
+
+    // Single threaded event loop: every command runs here, one at a time
+    epoll_event events[MAX_EVENTS];
+    while (isRunning) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, loopTimeoutMs());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error waiting for events\n";
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server_socket) {
+                acceptConnections();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            RedisConnection* conn = it->second.get();
+
+            uint32_t mask = events[i].events;
+            // With I/O threads, clients are read after the loop in one batch.
+            // The link to our primary and replicas stay on this thread,
+            // their input can close other connections
+            bool queued = false;
+            if (mask & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                if (ioThreads && !conn->isMaster && !conn->isReplica) {
+                    readQueue.push_back(conn);
+                    queued = true;
+                } else if (!readFromClient(conn)) {
+                    continue;
+                }
+            }
+            if (mask & EPOLLOUT) {
+                if (conn->isMaster && conn->linkState == MasterLinkState::Connecting && !finishMasterConnect(conn)) continue;
+                if (!writeToClient(conn) && queued) readQueue.pop_back();
+            }
+        }
+        if (!readQueue.empty()) processReadQueue();
+
+        beforeSleep();
+    }
+}
+
+// Same loop on io_uring: sockets stay blocking (the ring never blocks on
+// them), reads land in provided buffers, and the replies queued during an
+// iteration go out with the next wait in a single io_uring_enter
+void RedisServer::runUring() {
+    armAccept();
+
+    UringCompletion completions[MAX_EVENTS];
+    while (isRunning) {
+        int ret = ring->submitAndWait(loopTimeoutMs());
+        if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EBUSY && ret != -EAGAIN) {
+            std::cerr << "Error waiting for completions: " << std::strerror(-ret) << "\n";
+            break;
+        }
+
+        size_t n;
+        while ((n = ring->takeCompletions(completions, MAX_EVENTS)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                handleCompletion(completions[i]);
+            }
+        }
+
+        beforeSleep();
+    }
+}
+
+void RedisServer::armAccept() {
+    if (!ring->prepAcceptMultishot(server_socket, opData(nullptr, OP_ACCEPT))) {
+        std::cerr << "Error arming accept\n";
+    }
+}
+
+void RedisServer::armRecv(RedisConnection* conn) {
+    if (!ring->prepRecvMultishot(conn->fd, opData(conn, OP_RECV))) {
+        closeConnection(conn);
+        return;
+    }
+    conn->inflightOps++;
+}
+
+void RedisServer::submitWrite(RedisConnection* conn) {
+    if (conn->writeInterest || !conn->hasPendingOutput()) return;
+
+    conn->sendIov.clear();
+    size_t offset = conn->outputOffset;
+    for (const auto& chunk : conn->outputQueue) {
+        if (conn->sendIov.size() == WRITE_IOV_MAX) break;
+        conn->sendIov.push_back({const_cast<char*>(chunk->data()) + offset, chunk->size() - offset});
+        offset = 0;
+    }
+    conn->sendMsg = msghdr{};
+    conn->sendMsg.msg_iov = conn->sendIov.data();
+    conn->sendMsg.msg_iovlen = conn->sendIov.size();
+
+    if (!ring->prepSendmsg(conn->fd, &conn->sendMsg, opData(conn, OP_SEND))) {
+        // Submission queue full, retry after the next wait
+        conn->inPendingWrites = true;
+        pendingWriteConnections().push_back(conn);
+        return;
+    }
+    conn->inflightOps++;
+    conn->writeInterest = true;
+    // The kernel reads the queued chunks until the send completes, new
+    // replies must not grow (and reallocate) the last one
+    conn->lastChunkPrivate = false;
+}
+
+void RedisServer::handleCompletion(const UringCompletion& completion) {
+    UringOp op = static_cast<UringOp>(completion.userData & OP_MASK);
+    RedisConnection* conn = reinterpret_cast<RedisConnection*>(completion.userData & ~OP_MASK);
+
+    if (op == OP_ACCEPT) {
+        if (completion.res >= 0) {
+            if (admitClient(completion.res)) armRecv(addConnection(completion.res));
+        } else if (completion.res != -EINTR && completion.res != -ECONNABORTED && isRunning) {
+            std::cerr << "Error occured when accepting new client connection\n";
+        }
+        if (!completion.more() && isRunning) armAccept();
+        return;
+    }
+
+    // Without more set the operation is over, multishot or not
+    if (!completion.more()) conn->inflightOps--;
+    if (conn->closed) {
+        if (completion.hasBuffer()) ring->recycleBuffer(completion.bufferId());
+        if (conn->inflightOps == 0) retiredConnections.erase(conn);
+        return;
+    }
+
+    switch (op) {
+        case OP_RECV:
+            handleRecv(conn, completion);
+            break;
+        case OP_SEND:
+            handleSendDone(conn, completion.res);
+            break;
+        case OP_CONNECT: {
+            int fd = conn->fd;
+            if (!finishMasterConnect(conn)) break;
+            // Blocking like every socket the ring serves
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+            armRecv(conn);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void RedisServer::handleRecv(RedisConnection* conn, const UringCompletion& completion) {
+    if (completion.res > 0) {
+        int fd = conn->fd;
+        bool rearm = !completion.more();
+        uint16_t bufferId = completion.bufferId();
+        handleInput(conn, ring->buffer(bufferId), completion.res);
+        ring->recycleBuffer(bufferId);
+
+        // Input may have closed the connection
+        auto it = connections.find(fd);
+        if (rearm && it != connections.end() && it->second.get() == conn) armRecv(conn);
+        return;
+    }
+
+    // Out of provided buffers, the recv stopped until buffers are returned
+    if (completion.res == -ENOBUFS || completion.res == -EINTR || completion.res == -EAGAIN) {
+        if (!completion.more()) armRecv(conn);
+        return;
+    }
+    closeConnection(conn);
+}
+
+void RedisServer::handleSendDone(RedisConnection* conn, int result) {
+    conn->writeInterest = false;
+    if (result == -EAGAIN || result == -EINTR) {
+        submitWrite(conn);
+        return;
+    }
+    if (result < 0) {
+        closeConnection(conn);
+        return;
+    }
+
+    serverStats().netOutputBytes += result;
+    conn->consumeOutput(result);
+    if (conn->hasPendingOutput()) {
+        submitWrite(conn);
+    } else if (conn->closeAfterReply) {
+        closeConnection(conn);
+        return;
+    }
+    resumeIfDrained(conn);
+}
@@ -0,0 +1,158 @@
+#include "redis_set.h"
+#include "config.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+
+RedisSet::RedisSet() : intsetEncoded(true) {}
+
+void RedisSet::convertToHashtable() {
+    table.reserve(ints.size());
+    for (int64_t value : ints.values()) {
+        table.insert(std::to_string(value));
+    }
+    ints = IntSet();
+    intsetEncoded = false;
+}
+
+void RedisSet::checkIntsetSize() {
+    long long limit = serverConfig().setMaxIntsetEntries.load(std::memory_order_relaxed);
+    if (ints.size() > static_cast<size_t>(limit)) convertToHashtable();
+}
+
+bool RedisSet::add(const std::string& member) {
+    if (intsetEncoded) {
+        int64_t value;
+        if (IntSet::parseMember(member, value)) {
+            if (!ints.add(value)) return false;
+            checkIntsetSize();
+            return true;
+        }
+        convertToHashtable();
+    }
+    return table.insert(member).second;
+}
+
+size_t RedisSet::add(const std::vector<std::string>& members) {
+    if (intsetEncoded) {
+        std::vector<int64_t> values;
+        values.reserve(members.size());
+        for (const auto& member : members) {
+            int64_t value;
+            if (!IntSet::parseMember(member, value)) break;
+            values.push_back(value);
+        }
+        if (values.size() == members.size()) {
+            size_t added = ints.add(std::move(values));
+            checkIntsetSize();
+            return added;
+        }
+        convertToHashtable();
+    }
+    size_t added = 0;
+    for (const auto& member : members) {
+        if (table.insert(member).second) added++;
+    }
+    return added;
+}
+
+bool RedisSet::remove(const std::string& member) {
+    if (intsetEncoded) {
+        int64_t value;
+        return IntSet::parseMember(member, value) && ints.remove(value);
+    }
+    return table.erase(member) > 0;
+}
+
+bool RedisSet::contains(const std::string& member) const {
+    if (intsetEncoded) {
+        int64_t value;
+        return IntSet::parseMember(member, value) && ints.contains(value);
+    }
+    return table.find(member) != table.end();
+}
+
+size_t RedisSet::size() const {
+    return intsetEncoded ? ints.size() : table.size();
+}
+
+bool RedisSet::isIntset() const {
+    return intsetEncoded;
+}
+
+size_t RedisSet::memoryUsage(size_t samples) const {
+    if (intsetEncoded) return allocationSize(ints.values().capacity() * sizeof(int64_t));
+    return hashTableOverhead(table) +
+           sampledBytes(table.begin(), table.size(), samples, [](const std::string& m) { return stringHeapSize(m); });
+}
+
+std::vector<std::string> RedisSet::members() const {
+    std::vector<std::string> result;
+    result.reserve(size());
+    if (intsetEncoded) {
+        for (int64_t value : ints.values()) result.push_back(std::to_string(value));
+    } else {
+        result.assign(table.begin(), table.end());
+    }
+    return result;
+}
+
+std::vector<std::string> RedisSet::intersect(std::vector<const RedisSet*> sets) {
+    std::vector<std::string> result;
+    if (sets.empty()) return result;
+    for (const RedisSet* set : sets) {
+        if (!set || set->size() == 0) return result;
+    }
+
+    // Smallest first, so every step shrinks the candidate list the most
+    std::sort(sets.begin(), sets.end(), [](const RedisSet* a, const RedisSet* b) { return a->size() < b->size(); });
+
+    bool allIntsets = std::all_of(sets.begin(), sets.end(), [](const RedisSet* set) { return set->intsetEncoded; });
+    if (allIntsets) {
+        std::vector<int64_t> current = sets[0]->ints.values();
+        std::vector<int64_t> next(current.size());
+        for (size_t i = 1; i < sets.size() && !current.empty(); i++) {
+            const auto& other = sets[i]->ints.values();
+            size_t n = IntSet::intersect(current.data(), current.size(), other.data(), other.size(), next.data());
+            next.resize(n);
+            current.swap(next);
+            next.resize(current.size());
+        }
+        result.reserve(current.size());
+        for (int64_t value : current) result.push_back(std::to_string(value));
+        return result;
+    }
+
+    // Mixed encodings: probe every member of the smallest set in the others
+    for (const auto& member : sets[0]->members()) {
+        bool inAll = true;
+        for (size_t i = 1; i < sets.size() && inAll; i++) {
+            inAll = sets[i]->contains(member);
+        }
+        if (inAll) result.push_back(member);
+    }
+    return result;
+}
+
+std::vector<std::string> RedisSet::unite(const std::vector<const RedisSet*>& sets) {
+    RedisSet merged;
+    for (const RedisSet* set : sets) {
+        if (!set) continue;
+        merged.add(set->members());
+    }
+    return merged.members();
+}
+
+std::vector<std::string> RedisSet::difference(const std::vector<const RedisSet*>& sets) {
+    std::vector<std::string> result;
+    if (sets.empty() || !sets[0]) return result;
+
+    for (const auto& member : sets[0]->members()) {
+        bool found = false;
+        for (size_t i = 1; i < sets.size() && !found; i++) {
+            found = sets[i] && sets[i]->contains(member);
+        }
+        if (!found) result.push_back(member);
+    }
+    return result;
+}
@@ -0,0 +1,188 @@
+#include "replication.h"
+#include "redis_database.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+// Pieces a full resync snapshot is queued in
+static constexpr size_t SNAPSHOT_CHUNK_BYTES = 64 * 1024;
+
+ReplicationBacklog::ReplicationBacklog(size_t capacity)
+    : buffer(capacity), head(0), length(0), endOffset(0) {}
+
+void ReplicationBacklog::append(const std::string& bytes) {
+    endOffset += bytes.size();
+
+    // Only the last capacity bytes can survive
+    const char* data = bytes.data();
+    size_t len = bytes.size();
+    if (len > buffer.size()) {
+        data += len - buffer.size();
+        len = buffer.size();
+    }
+
+    while (len > 0) {
+        size_t chunk = std::min(len, buffer.size() - head);
+        std::copy(data, data + chunk, buffer.begin() + head);
+        head = (head + chunk) % buffer.size();
+        data += chunk;
+        len -= chunk;
+        length = std::min(buffer.size(), length + chunk);
+    }
+}
+
+void ReplicationBacklog::reset(uint64_t offset) {
+    head = 0;
+    length = 0;
+    endOffset = offset;
+}
+
+uint64_t ReplicationBacklog::offset() const {
+    return endOffset;
+}
+
+bool ReplicationBacklog::readFrom(uint64_t offset, std::string& out) const {
+    uint64_t firstOffset = endOffset - length + 1;
+    if (offset < firstOffset || offset > endOffset + 1) return false;
+
+    size_t count = endOffset + 1 - offset;
+    size_t start = (head + buffer.size() - count) % buffer.size();
+    out.clear();
+    out.reserve(count);
+    size_t first = std::min(count, buffer.size() - start);
+    out.append(buffer.data() + start, first);
+    out.append(buffer.data(), count - first);
+    return true;
+}
+
+static std::string newReplicationId() {
+    static const char hex[] = "0123456789abcdef";
+    std::random_device rd;
+    std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) ^ rd());
+    std::string id(40, '0');
+    for (char& c : id) {
+        c = hex[gen() & 0xf];
+    }
+    return id;
+}
+
+static std::string bulk(const std::string& value) {
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+Replication::Replication()
+    : replid(newReplicationId()), backlog(BACKLOG_BYTES), port(0), generation(0) {}
+
+bool Replication::isReplica() const {
+    return !host.empty();
+}
+
+const std::string& Replication::masterHost() const {
+    return host;
+}
+
+int Replication::masterPort() const {
+    return port;
+}
+
+uint64_t Replication::masterGeneration() const {
+    return generation;
+}
+
+void Replication::setMaster(const std::string& newHost, int newPort) {
+    host = newHost;
+    port = newPort;
+    generation++;
+}
+
+void Replication::clearMaster() {
+    if (!isReplica()) return;
+    host.clear();
+    port = 0;
+    generation++;
+
+    // Our history now diverges from the old primary's, start a new one but
+    // keep counting from the same offset
+    replid = newReplicationId();
+}
+
+void Replication::appendToStream(const std::string& bytes) {
+    backlog.append(bytes);
+    if (replicaConns.empty()) return;
+
+    // Serialized once, every replica queues a reference to the same buffer
+    auto frame = std::make_shared<const std::string>(bytes);
+    for (RedisConnection* conn : replicaConns) {
+        conn->addSharedReply(frame);
+    }
+}
+
+void Replication::propagate(const std::vector<std::string>& tokens) {
+    std::string frame = "*" + std::to_string(tokens.size()) + "\r\n";
+    for (const auto& token : tokens) {
+        frame += bulk(token);
+    }
+    appendToStream(frame);
+}
+
+void Replication::feed(const std::string& bytes) {
+    appendToStream(bytes);
+}
+
+std::string Replication::psync(RedisConnection& conn, const std::string& requestedId, const std::string& requestedOffset) {
+    replicaConns.insert(&conn);
+    conn.isReplica = true;
+
+    uint64_t wanted = 0;
+    try {
+        wanted = std::stoull(requestedOffset);
+    } catch (const std::exception&) {
+        wanted = 0;
+    }
+
+    std::string missing;
+    if (requestedId == replid && backlog.readFrom(wanted, missing)) {
+        return "+CONTINUE " + replid + "\r\n" + missing;
+    }
+
+    // The snapshot and the offset are taken on the event loop thread, so no
+    // write can fall between them. The chunks go to the output queue as
+    // they are, the snapshot is never joined into one string or copied
+    std::vector<std::shared_ptr<const std::string>> chunks;
+    size_t length = 0;
+    RedisDatabase::getInstance().snapshot(SNAPSHOT_CHUNK_BYTES, [&chunks, &length](std::string&& chunk) {
+        length += chunk.size();
+        chunks.push_back(std::make_shared<const std::string>(std::move(chunk)));
+    });
+    conn.addReply("+FULLRESYNC " + replid + " " + std::to_string(backlog.offset()) + "\r\n" +
+                  "$" + std::to_string(length) + "\r\n");
+    for (const auto& chunk : chunks) conn.addSharedReply(chunk);
+    return "";
+}
+
+void Replication::removeReplica(RedisConnection* conn) {
+    replicaConns.erase(conn);
+}
+
+void Replication::startFromMaster(const std::string& masterReplid, uint64_t offset) {
+    replid = masterReplid;
+    backlog.reset(offset);
+}
+
+void Replication::continueWithMaster(const std::string& masterReplid) {
+    // The primary may have been promoted since, its history still contains ours
+    if (!masterReplid.empty()) replid = masterReplid;
+}
+
+const std::string& Replication::replicationId() const {
+    return replid;
+}
+
+uint64_t Replication::offset() const {
+    return backlog.offset();
+}
+
+const std::unordered_set<RedisConnection*>& Replication::replicas() const {
+    return replicaConns;
+}
@@ -0,0 +1,209 @@
+#include "resp_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESP_HAVE_X86 1
+#endif
+
+static size_t findCrlfScalar(const char* data, size_t from, size_t len) {
+    for (size_t i = from; i + 1 < len; i++) {
+        if (data[i] == '\r' && data[i + 1] == '\n') return i;
+    }
+    return std::string::npos;
+}
+
+#ifdef RESP_HAVE_X86
+// Compare a block against '\r' at once, then check the byte after each hit.
+// The byte after the block is read with a bounds check, so a CR ending one
+// block still matches an LF starting the next
+static size_t findCrlfSSE2(const char* data, size_t from, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = from;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, cr)));
+        while (mask) {
+            size_t at = i + __builtin_ctz(mask);
+            if (at + 1 < len && data[at + 1] == '\n') return at;
+            mask &= mask - 1;
+        }
+    }
+    return findCrlfScalar(data, i, len);
+}
+
+__attribute__((target("avx2")))
+static size_t findCrlfAVX2(const char* data, size_t from, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = from;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr)));
+        while (mask) {
+            size_t at = i + __builtin_ctz(mask);
+            if (at + 1 < len && data[at + 1] == '\n') return at;
+            mask &= mask - 1;
+        }
+    }
+    return findCrlfSSE2(data, i, len);
+}
+#endif
+
+using CrlfFinder = size_t (*)(const char*, size_t, size_t);
+
+static RespScanner resolve(RespScanner scanner) {
+#ifdef RESP_HAVE_X86
+    __builtin_cpu_init();
+    bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (scanner == RespScanner::Auto) return hasAVX2 ? RespScanner::AVX2 : RespScanner::SSE2;
+    if (scanner == RespScanner::AVX2 && !hasAVX2) return RespScanner::SSE2;
+    return scanner;
+#else
+    (void)scanner;
+    return RespScanner::Scalar;
+#endif
+}
+
+static CrlfFinder finderFor(RespScanner scanner) {
+#ifdef RESP_HAVE_X86
+    if (scanner == RespScanner::AVX2) return findCrlfAVX2;
+    if (scanner == RespScanner::SSE2) return findCrlfSSE2;
+#endif
+    return findCrlfScalar;
+}
+
+struct ScannerChoice {
+    RespScanner scanner;
+    CrlfFinder finder;
+};
+
+// Picked on first use, setRespScanner must not race with parsing
+static ScannerChoice& scannerChoice() {
+    static ScannerChoice choice = {resolve(RespScanner::Auto), finderFor(resolve(RespScanner::Auto))};
+    return choice;
+}
+
+void setRespScanner(RespScanner scanner) {
+    scannerChoice().scanner = resolve(scanner);
+    scannerChoice().finder = finderFor(scannerChoice().scanner);
+}
+
+RespScanner activeRespScanner() {
+    return scannerChoice().scanner;
+}
+
+const char* respScannerName(RespScanner scanner) {
+    switch (scanner) {
+        case RespScanner::Scalar: return "scalar";
+        case RespScanner::SSE2: return "sse2";
+        case RespScanner::AVX2: return "avx2";
+        default: return "auto";
+    }
+}
+
+// Bytes checked one at a time before the vector scanner takes over. A RESP
+// header ("*<count>" or "$<len>", 11 digits at most) always ends inside
+// them, and setting up a vector compare costs more than these few bytes, so
+// only a longer line (or a malformed one) reaches the vector loop
+static constexpr size_t CRLF_SCALAR_PROBE = 16;
+
+size_t findCrlf(const char* data, size_t from, size_t len) {
+    size_t probeEnd = std::min(len, from + CRLF_SCALAR_PROBE);
+    for (size_t i = from; i < probeEnd && i + 1 < len; i++) {
+        if (data[i] == '\r' && data[i + 1] == '\n') return i;
+    }
+    if (probeEnd >= len) return std::string::npos;
+    return scannerChoice().finder(data, probeEnd, len);
+}
+
+// Decimal length of a *count or $len header, an optional '-' then digits.
+// Every digit is validated without branching, a single check at the end
+// rejects anything else
+static bool parseLength(const char* p, size_t n, long long& out) {
+    if (n == 0 || n > 11) return false;
+    bool negative = p[0] == '-';
+    size_t i = negative;
+    if (i == n) return false;
+
+    unsigned bad = 0;
+    long long value = 0;
+    for (; i < n; i++) {
+        unsigned digit = static_cast<unsigned char>(p[i]) - '0';
+        bad |= digit > 9;
+        value = value * 10 + digit;
+    }
+    if (bad || value > INT_MAX) return false;
+    out = negative ? -value : value;
+    return true;
+}
+
+ParseStatus parseRespCommand(std::string_view input, size_t& pos, std::vector<std::string_view>& tokens) {
+    tokens.clear();
+    const char* data = input.data();
+    size_t size = input.size();
+    if (pos >= size) return ParseStatus::Incomplete;
+
+    // Inline command, terminated by a newline and split on whitespace
+    if (data[pos] != '*') {
+        size_t newline = input.find('\n', pos);
+        if (newline == std::string_view::npos) return ParseStatus::Incomplete;
+
+        size_t cur = pos;
+        while (cur < newline) {
+            while (cur < newline && std::isspace(static_cast<unsigned char>(data[cur]))) cur++;
+            size_t start = cur;
+            while (cur < newline && !std::isspace(static_cast<unsigned char>(data[cur]))) cur++;
+            if (cur > start) tokens.emplace_back(data + start, cur - start);
+        }
+        pos = newline + 1;
+        return ParseStatus::Ok;
+    }
+
+    size_t cur = pos + 1;
+    size_t crlf = findCrlf(data, cur, size);
+    if (crlf == std::string::npos) return ParseStatus::Incomplete;
+
+    // A count of zero or less is an empty command
+    long long numElements;
+    if (!parseLength(data + cur, crlf - cur, numElements)) return ParseStatus::Error;
+    cur = crlf + 2;
+    if (numElements > 0) tokens.reserve(std::min<long long>(numElements, 1024));
+
+    for (long long i = 0; i < numElements; i++) {
+        if (cur >= size) return ParseStatus::Incomplete;
+        // Anything but a bulk string here is a protocol error
+        if (data[cur] != '$') return ParseStatus::Error;
+        cur++;
+
+        crlf = findCrlf(data, cur, size);
+        if (crlf == std::string::npos) return ParseStatus::Incomplete;
+
+        long long len;
+        if (!parseLength(data + cur, crlf - cur, len) || len < 0) return ParseStatus::Error;
+        cur = crlf + 2;
+
+        // Wait until the token and its trailing CRLF have arrived
+        if (cur + len + 2 > size) return ParseStatus::Incomplete;
+        tokens.emplace_back(data + cur, static_cast<size_t>(len));
+        cur += len + 2;
+    }
+
+    pos = cur;
+    return ParseStatus::Ok;
+}
+
+ParseStatus parseRespCommand(const std::string& input, size_t& pos, std::vector<std::string>& tokens) {
+    static thread_local std::vector<std::string_view> views;
+    ParseStatus status = parseRespCommand(std::string_view(input), pos, views);
+
+    // assign reuses the capacity of the strings left from the last command
+    tokens.resize(status == ParseStatus::Ok ? views.size() : 0);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        tokens[i].assign(views[i].data(), views[i].size());
+    }
+    return status;
+}
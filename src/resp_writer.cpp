@@ -0,0 +1,53 @@
+#include "resp_writer.h"
+#include "sorted_set.h"
+
+#include <cmath>
+
+static int currentProtocol = 2;
+
+int replyProtocol() {
+    return currentProtocol;
+}
+
+ReplyProtocolScope::ReplyProtocolScope(int protocol) : saved(currentProtocol) {
+    currentProtocol = protocol;
+}
+
+ReplyProtocolScope::~ReplyProtocolScope() {
+    currentProtocol = saved;
+}
+
+std::string bulkReply(const std::string& value) {
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+std::string nullBulkReply(int protocol) {
+    return protocol >= 3 ? "_\r\n" : "$-1\r\n";
+}
+
+std::string nullArrayReply(int protocol) {
+    return protocol >= 3 ? "_\r\n" : "*-1\r\n";
+}
+
+std::string mapHeader(size_t pairs, int protocol) {
+    return protocol >= 3 ? "%" + std::to_string(pairs) + "\r\n" : "*" + std::to_string(pairs * 2) + "\r\n";
+}
+
+std::string setHeader(size_t count, int protocol) {
+    return (protocol >= 3 ? "~" : "*") + std::to_string(count) + "\r\n";
+}
+
+std::string pushHeader(size_t count, int protocol) {
+    return (protocol >= 3 ? ">" : "*") + std::to_string(count) + "\r\n";
+}
+
+std::string doubleReply(double value, int protocol) {
+    if (protocol < 3) return bulkReply(formatScore(value));
+    if (std::isnan(value)) return ",nan\r\n";
+    return "," + formatScore(value) + "\r\n";
+}
+
+std::string boolReply(bool value, int protocol) {
+    if (protocol >= 3) return value ? "#t\r\n" : "#f\r\n";
+    return value ? ":1\r\n" : ":0\r\n";
+}
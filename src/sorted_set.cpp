@@ -0,0 +1,441 @@
+#include "sorted_set.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+std::string formatScore(double score) {
+    if (std::isinf(score)) return score > 0 ? "inf" : "-inf";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.15g", score);
+    if (std::strtod(buf, nullptr) != score) snprintf(buf, sizeof(buf), "%.17g", score);
+    return buf;
+}
+
+static bool scoreGteMin(double score, const ZRangeSpec& range) {
+    return range.minex ? score > range.min : score >= range.min;
+}
+
+static bool scoreLteMax(double score, const ZRangeSpec& range) {
+    return range.maxex ? score < range.max : score <= range.max;
+}
+
+static bool rangeIsEmpty(const ZRangeSpec& range) {
+    return range.min > range.max || (range.min == range.max && (range.minex || range.maxex));
+}
+
+SortedSet::SortedSet()
+    : compactEncoded(true), header(nullptr), tail(nullptr), length(0), level(1) {}
+
+SortedSet::~SortedSet() {
+    release();
+}
+
+SortedSet::SortedSet(SortedSet&& other) noexcept
+    : compactEncoded(other.compactEncoded), compact(std::move(other.compact)),
+      header(other.header), tail(other.tail), length(other.length), level(other.level),
+      dict(std::move(other.dict)) {
+    other.compactEncoded = true;
+    other.header = nullptr;
+    other.tail = nullptr;
+    other.length = 0;
+    other.level = 1;
+}
+
+SortedSet& SortedSet::operator=(SortedSet&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    compactEncoded = other.compactEncoded;
+    compact = std::move(other.compact);
+    header = other.header;
+    tail = other.tail;
+    length = other.length;
+    level = other.level;
+    dict = std::move(other.dict);
+
+    other.compactEncoded = true;
+    other.header = nullptr;
+    other.tail = nullptr;
+    other.length = 0;
+    other.level = 1;
+    return *this;
+}
+
+void SortedSet::release() {
+    if (!header) return;
+    Node* node = header->level[0].forward;
+    while (node) {
+        Node* next = node->level[0].forward;
+        freeNode(node);
+        node = next;
+    }
+    freeNode(header);
+    header = nullptr;
+    tail = nullptr;
+    length = 0;
+    level = 1;
+}
+
+size_t SortedSet::size() const {
+    return compactEncoded ? compact.size() : length;
+}
+
+bool SortedSet::isCompact() const {
+    return compactEncoded;
+}
+
+// Skiplist helpers
+size_t SortedSet::memoryUsage(size_t samples) const {
+    if (compactEncoded) {
+        return allocationSize(compact.capacity() * sizeof(compact[0])) +
+               sampledBytes(compact.begin(), compact.size(), samples,
+                            [](const std::pair<double, std::string>& e) { return stringHeapSize(e.second); });
+    }
+
+    // Each member is held twice: in its skiplist node and as a dict key
+    struct NodeIterator {
+        const Node* node;
+        const Node& operator*() const { return *node; }
+        NodeIterator& operator++() {
+            node = node->level[0].forward;
+            return *this;
+        }
+    };
+    size_t headerBytes = allocationSize(sizeof(Node) + (SKIPLIST_MAXLEVEL - 1) * sizeof(Level));
+    return headerBytes + hashTableOverhead(dict) +
+           sampledBytes(NodeIterator{header->level[0].forward}, length, samples, [](const Node& node) {
+               return allocationSize(sizeof(Node) + (node.height - 1) * sizeof(Level)) + 2 * stringHeapSize(node.member);
+           });
+}
+
+SortedSet::Node* SortedSet::createNode(int height, double score, const std::string& member) {
+    size_t bytes = sizeof(Node) + (height - 1) * sizeof(Level);
+    void* mem = ::operator new(bytes);
+    Node* node = new (mem) Node{score, nullptr, member, height, {}};
+    for (int i = 0; i < height; i++) {
+        node->level[i].forward = nullptr;
+        node->level[i].span = 0;
+    }
+    return node;
+}
+
+void SortedSet::freeNode(Node* node) {
+    node->~Node();
+    ::operator delete(node);
+}
+
+// Level i + 1 is reached with probability 1/4, as in Redis
+int SortedSet::randomLevel() {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    int height = 1;
+    while (height < SKIPLIST_MAXLEVEL && (gen() & 0xFFFF) < (0xFFFF / 4)) height++;
+    return height;
+}
+
+bool SortedSet::nodeBefore(const Node* node, double score, const std::string& member) {
+    return node->score < score || (node->score == score && node->member < member);
+}
+
+SortedSet::Node* SortedSet::slInsert(double score, const std::string& member) {
+    Node* update[SKIPLIST_MAXLEVEL];
+    size_t rank[SKIPLIST_MAXLEVEL];
+
+    // Find the insert position on every level and the rank crossed to get there
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        rank[i] = (i == level - 1) ? 0 : rank[i + 1];
+        while (x->level[i].forward && nodeBefore(x->level[i].forward, score, member)) {
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    int height = randomLevel();
+    if (height > level) {
+        for (int i = level; i < height; i++) {
+            rank[i] = 0;
+            update[i] = header;
+            update[i]->level[i].span = length;
+        }
+        level = height;
+    }
+
+    x = createNode(height, score, member);
+    for (int i = 0; i < height; i++) {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    // Untouched levels now jump over one more node
+    for (int i = height; i < level; i++) {
+        update[i]->level[i].span++;
+    }
+
+    x->backward = (update[0] == header) ? nullptr : update[0];
+    if (x->level[0].forward) x->level[0].forward->backward = x;
+    else tail = x;
+
+    length++;
+    return x;
+}
+
+void SortedSet::slDeleteNode(Node* x, Node** update) {
+    for (int i = 0; i < level; i++) {
+        if (update[i]->level[i].forward == x) {
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+        } else {
+            update[i]->level[i].span -= 1;
+        }
+    }
+
+    if (x->level[0].forward) x->level[0].forward->backward = x->backward;
+    else tail = x->backward;
+
+    while (level > 1 && header->level[level - 1].forward == nullptr) level--;
+    length--;
+}
+
+bool SortedSet::slDelete(double score, const std::string& member) {
+    Node* update[SKIPLIST_MAXLEVEL];
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && nodeBefore(x->level[i].forward, score, member)) {
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    if (x && x->score == score && x->member == member) {
+        slDeleteNode(x, update);
+        freeNode(x);
+        return true;
+    }
+    return false;
+}
+
+size_t SortedSet::slRank(double score, const std::string& member) const {
+    size_t rank = 0;
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               (x->level[i].forward->score < score ||
+                (x->level[i].forward->score == score && x->level[i].forward->member <= member))) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        if (x != header && x->member == member) return rank;
+    }
+    return 0;
+}
+
+SortedSet::Node* SortedSet::slNodeByRank(size_t rank) const {
+    size_t traversed = 0;
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && traversed + x->level[i].span <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        if (traversed == rank) return x;
+    }
+    return nullptr;
+}
+
+SortedSet::Node* SortedSet::slFirstInRange(const ZRangeSpec& range) const {
+    if (rangeIsEmpty(range)) return nullptr;
+
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && !scoreGteMin(x->level[i].forward->score, range)) {
+            x = x->level[i].forward;
+        }
+    }
+
+    x = x->level[0].forward;
+    if (!x || !scoreLteMax(x->score, range)) return nullptr;
+    return x;
+}
+
+SortedSet::Node* SortedSet::slLastInRange(const ZRangeSpec& range) const {
+    if (rangeIsEmpty(range)) return nullptr;
+
+    Node* x = header;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && scoreLteMax(x->level[i].forward->score, range)) {
+            x = x->level[i].forward;
+        }
+    }
+
+    if (x == header || !scoreGteMin(x->score, range)) return nullptr;
+    return x;
+}
+
+void SortedSet::convertToSkiplist() {
+    header = createNode(SKIPLIST_MAXLEVEL, 0, "");
+    tail = nullptr;
+    length = 0;
+    level = 1;
+    dict.reserve(compact.size());
+
+    for (const auto& entry : compact) {
+        slInsert(entry.first, entry.second);
+        dict.emplace(entry.second, entry.first);
+    }
+
+    compact.clear();
+    compact.shrink_to_fit();
+    compactEncoded = false;
+}
+
+// Public operations
+bool SortedSet::add(const std::string& member, double score) {
+    if (compactEncoded && member.size() > COMPACT_MAX_VALUE) convertToSkiplist();
+
+    if (compactEncoded) {
+        auto it = std::find_if(compact.begin(), compact.end(),
+                               [&member](const std::pair<double, std::string>& e) { return e.second == member; });
+        bool added = (it == compact.end());
+        if (!added) {
+            if (it->first == score) return false;
+            compact.erase(it);
+        }
+
+        auto entry = std::make_pair(score, member);
+        compact.insert(std::lower_bound(compact.begin(), compact.end(), entry), std::move(entry));
+
+        if (compact.size() > COMPACT_MAX_ENTRIES) convertToSkiplist();
+        return added;
+    }
+
+    auto it = dict.find(member);
+    if (it != dict.end()) {
+        if (it->second == score) return false;
+        slDelete(it->second, member);
+        slInsert(score, member);
+        it->second = score;
+        return false;
+    }
+
+    slInsert(score, member);
+    dict.emplace(member, score);
+    return true;
+}
+
+bool SortedSet::remove(const std::string& member) {
+    if (compactEncoded) {
+        auto it = std::find_if(compact.begin(), compact.end(),
+                               [&member](const std::pair<double, std::string>& e) { return e.second == member; });
+        if (it == compact.end()) return false;
+        compact.erase(it);
+        return true;
+    }
+
+    auto it = dict.find(member);
+    if (it == dict.end()) return false;
+    slDelete(it->second, member);
+    dict.erase(it);
+    return true;
+}
+
+bool SortedSet::score(const std::string& member, double& score) const {
+    if (compactEncoded) {
+        for (const auto& entry : compact) {
+            if (entry.second == member) {
+                score = entry.first;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto it = dict.find(member);
+    if (it == dict.end()) return false;
+    score = it->second;
+    return true;
+}
+
+long SortedSet::rank(const std::string& member, bool reverse) const {
+    size_t total = size();
+    if (compactEncoded) {
+        for (size_t i = 0; i < compact.size(); i++) {
+            if (compact[i].second == member) return reverse ? total - 1 - i : i;
+        }
+        return -1;
+    }
+
+    auto it = dict.find(member);
+    if (it == dict.end()) return -1;
+    size_t r = slRank(it->second, member);
+    if (r == 0) return -1;
+    return reverse ? total - r : r - 1;
+}
+
+std::vector<SortedSet::Entry> SortedSet::rangeByRank(size_t start, size_t stop, bool reverse) const {
+    std::vector<Entry> result;
+    size_t total = size();
+    if (start > stop || start >= total) return result;
+    if (stop >= total) stop = total - 1;
+    result.reserve(stop - start + 1);
+
+    if (compactEncoded) {
+        for (size_t i = start; i <= stop; i++) {
+            const auto& entry = reverse ? compact[total - 1 - i] : compact[i];
+            result.emplace_back(entry.second, entry.first);
+        }
+        return result;
+    }
+
+    Node* node = slNodeByRank(reverse ? total - start : start + 1);
+    for (size_t i = start; i <= stop && node; i++) {
+        result.emplace_back(node->member, node->score);
+        node = reverse ? node->backward : node->level[0].forward;
+    }
+    return result;
+}
+
+std::vector<SortedSet::Entry> SortedSet::rangeByScore(const ZRangeSpec& range, size_t offset, long count, bool reverse) const {
+    std::vector<Entry> result;
+    if (count == 0 || rangeIsEmpty(range)) return result;
+
+    if (compactEncoded) {
+        auto emit = [&](const std::pair<double, std::string>& entry) {
+            if (!scoreGteMin(entry.first, range) || !scoreLteMax(entry.first, range)) return true;
+            if (offset > 0) {
+                offset--;
+                return true;
+            }
+            result.emplace_back(entry.second, entry.first);
+            return count < 0 || static_cast<long>(result.size()) < count;
+        };
+        if (reverse) {
+            for (auto it = compact.rbegin(); it != compact.rend() && emit(*it); ++it) {}
+        } else {
+            for (auto it = compact.begin(); it != compact.end() && emit(*it); ++it) {}
+        }
+        return result;
+    }
+
+    Node* node = reverse ? slLastInRange(range) : slFirstInRange(range);
+    while (node && offset > 0) {
+        node = reverse ? node->backward : node->level[0].forward;
+        offset--;
+    }
+
+    while (node && (count < 0 || static_cast<long>(result.size()) < count)) {
+        if (reverse ? !scoreGteMin(node->score, range) : !scoreLteMax(node->score, range)) break;
+        result.emplace_back(node->member, node->score);
+        node = reverse ? node->backward : node->level[0].forward;
+    }
+    return result;
+}
@@ -0,0 +1,196 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+// Single writer: a load and a store instead of a locked read-modify-write
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::indexOf(uint64_t value) {
+    int bucket = (63 - __builtin_clzll(value | SUB_BUCKET_MASK)) - SUB_BUCKET_HALF_COUNT_MAGNITUDE;
+    uint64_t subBucket = value >> bucket;
+    return ((bucket + 1) << SUB_BUCKET_HALF_COUNT_MAGNITUDE) + (subBucket - SUB_BUCKET_HALF_COUNT);
+}
+
+uint64_t LatencyHistogram::highestEquivalent(size_t index) {
+    int bucket = static_cast<int>(index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+    uint64_t subBucket = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+    if (bucket < 0) {
+        subBucket -= SUB_BUCKET_HALF_COUNT;
+        bucket = 0;
+    }
+    return (subBucket << bucket) + (1ULL << bucket) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    bump(counts[indexOf(std::min(nanos, HIGHEST))], 1);
+}
+
+void LatencyHistogram::addTo(std::vector<uint64_t>& out) const {
+    out.resize(COUNTS);
+    for (size_t i = 0; i < COUNTS; i++) {
+        out[i] += counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::valueAtPercentile(const std::vector<uint64_t>& counts, double percentile) {
+    uint64_t total = 0;
+    for (uint64_t count : counts) total += count;
+    if (total == 0) return 0;
+
+    uint64_t wanted = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(percentile / 100.0 * total)), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= wanted) return highestEquivalent(i);
+    }
+    return HIGHEST;
+}
+
+// Every command the dispatcher knows, new commands must be added here to
+// show up in INFO commandstats
+static const char* const COMMAND_TABLE[] = {
+    "PING", "ECHO", "INFO", "SLOWLOG", "LATENCY", "CONFIG", "CLIENT", "HELLO", "FLUSHALL", "KEYS", "SCAN", "TYPE",
+    "MEMORY", "HOTKEYS", "OBJECT", "SET", "GET", "STRLEN", "DEL", "UNLINK", "EXPIRE", "RENAME",
+    "LGET", "LRANGE", "LLEN", "LPUSH", "RPUSH", "LPOP", "RPOP", "LREM", "LINDEX", "LSET", "LTRIM", "LINSERT", "LPOS",
+    "LMOVE", "RPOPLPUSH", "BLPOP", "BRPOP", "BLMOVE",
+    "HSET", "HGET", "HEXISTS", "HDEL", "HGETALL", "HKEYS", "HVALS", "HLEN", "HMSET",
+    "ZADD", "ZREM", "ZSCORE", "ZINCRBY", "ZRANK", "ZREVRANK", "ZRANGE", "ZRANGEBYSCORE", "ZCARD",
+    "SADD", "SREM", "SISMEMBER", "SCARD", "SMEMBERS", "SINTER", "SUNION", "SDIFF",
+    "PFADD", "PFCOUNT", "PFMERGE",
+    "SUBSCRIBE", "UNSUBSCRIBE", "PSUBSCRIBE", "PUNSUBSCRIBE", "PUBLISH",
+    "MULTI", "EXEC", "DISCARD", "WATCH", "UNWATCH",
+    "REPLICAOF", "SLAVEOF", "REPLCONF", "PSYNC", "ROLE",
+    "CLUSTER", "ASKING", "MIGRATE", "DUMP", "RESTORE"
+};
+static constexpr size_t COMMAND_COUNT = sizeof(COMMAND_TABLE) / sizeof(COMMAND_TABLE[0]);
+
+int CommandStats::commandId(const std::string& cmd) {
+    static const std::unordered_map<std::string, int> ids = []() {
+        std::unordered_map<std::string, int> table;
+        for (size_t i = 0; i < COMMAND_COUNT; i++) table[COMMAND_TABLE[i]] = static_cast<int>(i);
+        return table;
+    }();
+    auto it = ids.find(cmd);
+    return it == ids.end() ? -1 : it->second;
+}
+
+CommandStats& CommandStats::getInstance() {
+    static CommandStats instance;
+    return instance;
+}
+
+CommandStats::Counters& CommandStats::local(int id) {
+    thread_local ThreadStats* mine = nullptr;
+    if (!mine) {
+        auto stats = std::make_unique<ThreadStats>();
+        stats->commands.reset(new std::atomic<Counters*>[COMMAND_COUNT]);
+        for (size_t i = 0; i < COMMAND_COUNT; i++) stats->commands[i].store(nullptr, std::memory_order_relaxed);
+        mine = stats.get();
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.push_back(std::move(stats));
+    }
+
+    Counters* counters = mine->commands[id].load(std::memory_order_relaxed);
+    if (!counters) {
+        // Value initialized, every counter starts at zero
+        counters = new Counters();
+        mine->commands[id].store(counters, std::memory_order_release);
+    }
+    return *counters;
+}
+
+void CommandStats::record(int id, uint64_t nanos, bool failed) {
+    if (id < 0) return;
+    Counters& counters = local(id);
+    bump(counters.calls, 1);
+    bump(counters.nanos, nanos);
+    if (failed) bump(counters.failed, 1);
+    counters.latency.record(nanos);
+}
+
+void CommandStats::recordRejected(int id) {
+    if (id < 0) return;
+    bump(local(id).rejected, 1);
+}
+
+uint64_t CommandStats::totalCalls() {
+    uint64_t total = 0;
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (const auto& thread : threads) {
+        for (size_t i = 0; i < COMMAND_COUNT; i++) {
+            const Counters* counters = thread->commands[i].load(std::memory_order_acquire);
+            if (counters) total += counters->calls.load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+static std::string lowercase(const char* name) {
+    std::string out(name);
+    std::transform(out.begin(), out.end(), out.begin(), ::tolower);
+    return out;
+}
+
+std::string CommandStats::commandStatsInfo() {
+    std::string out;
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        uint64_t calls = 0, nanos = 0, failed = 0, rejected = 0;
+        for (const auto& thread : threads) {
+            const Counters* counters = thread->commands[i].load(std::memory_order_acquire);
+            if (!counters) continue;
+            calls += counters->calls.load(std::memory_order_relaxed);
+            nanos += counters->nanos.load(std::memory_order_relaxed);
+            failed += counters->failed.load(std::memory_order_relaxed);
+            rejected += counters->rejected.load(std::memory_order_relaxed);
+        }
+        if (calls == 0 && rejected == 0) continue;
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                      "cmdstat_%s:calls=%llu,usec=%llu,usec_per_call=%.2f,rejected_calls=%llu,failed_calls=%llu\r\n",
+                      lowercase(COMMAND_TABLE[i]).c_str(), static_cast<unsigned long long>(calls),
+                      static_cast<unsigned long long>(nanos / 1000), calls ? nanos / 1000.0 / calls : 0.0,
+                      static_cast<unsigned long long>(rejected), static_cast<unsigned long long>(failed));
+        out += line;
+    }
+    return out;
+}
+
+std::string CommandStats::latencyStatsInfo() {
+    std::string out;
+    std::vector<uint64_t> merged;
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        // Only commands that ran pay for the merge
+        merged.assign(LatencyHistogram::COUNTS, 0);
+        bool called = false;
+        for (const auto& thread : threads) {
+            const Counters* counters = thread->commands[i].load(std::memory_order_acquire);
+            if (!counters || counters->calls.load(std::memory_order_relaxed) == 0) continue;
+            counters->latency.addTo(merged);
+            called = true;
+        }
+        if (!called) continue;
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "latency_percentiles_usec_%s:p50=%.3f,p99=%.3f,p99.9=%.3f\r\n",
+                      lowercase(COMMAND_TABLE[i]).c_str(),
+                      LatencyHistogram::valueAtPercentile(merged, 50) / 1000.0,
+                      LatencyHistogram::valueAtPercentile(merged, 99) / 1000.0,
+                      LatencyHistogram::valueAtPercentile(merged, 99.9) / 1000.0);
+        out += line;
+    }
+    return out;
+}
+
+ServerStats& serverStats() {
+    static ServerStats stats;
+    return stats;
+}
@@ -0,0 +1,128 @@
+#include "tracking.h"
+#include "config.h"
+#include "resp_writer.h"
+
+void Tracking::enable(RedisConnection* conn) {
+    clients[conn->id] = conn;
+    if (!conn->tracking.bcast) return;
+    if (conn->tracking.prefixes.empty()) {
+        prefixes[""].insert(conn->id);
+    }
+    for (const auto& prefix : conn->tracking.prefixes) {
+        prefixes[prefix].insert(conn->id);
+    }
+}
+
+void Tracking::disable(RedisConnection* conn) {
+    for (auto it = prefixes.begin(); it != prefixes.end();) {
+        it->second.erase(conn->id);
+        it = it->second.empty() ? prefixes.erase(it) : std::next(it);
+    }
+    // Table entries naming the client are skipped when their key is
+    // invalidated, walking the table here would cost O(keys)
+    clients.erase(conn->id);
+    conn->tracking = TrackingState();
+}
+
+void Tracking::rememberKeys(RedisConnection* conn, const std::vector<std::string>& keys) {
+    for (const auto& key : keys) {
+        if (table[key].insert(conn->id).second) items++;
+    }
+    evictKeys();
+}
+
+void Tracking::evictKeys() {
+    long long maxKeys = serverConfig().trackingTableMaxKeys.load(std::memory_order_relaxed);
+    if (maxKeys <= 0) return;
+    while (table.size() > static_cast<size_t>(maxKeys)) {
+        auto it = table.begin();
+        std::vector<std::string> keys = {it->first};
+        for (uint64_t id : it->second) send(id, &keys);
+        items -= it->second.size();
+        table.erase(it);
+    }
+}
+
+void Tracking::invalidate(const std::vector<std::string>& keys, bool flushed, const RedisConnection* modifier) {
+    if (flushed) {
+        for (const auto& entry : clients) send(entry.first, nullptr);
+        table.clear();
+        items = 0;
+        return;
+    }
+
+    // One message per client for the whole batch of keys
+    std::map<uint64_t, std::vector<std::string>> pending;
+    auto notify = [&](uint64_t id, const std::string& key) {
+        if (modifier && modifier->id == id && modifier->tracking.noLoop) return;
+        std::vector<std::string>& list = pending[id];
+        if (list.empty() || list.back() != key) list.push_back(key);
+    };
+
+    for (const auto& key : keys) {
+        auto it = table.find(key);
+        if (it != table.end()) {
+            for (uint64_t id : it->second) notify(id, key);
+            items -= it->second.size();
+            table.erase(it);
+        }
+        for (const auto& entry : prefixes) {
+            if (key.compare(0, entry.first.size(), entry.first) != 0) continue;
+            for (uint64_t id : entry.second) notify(id, key);
+        }
+    }
+    for (const auto& entry : pending) send(entry.first, &entry.second);
+}
+
+void Tracking::send(uint64_t clientId, const std::vector<std::string>* keys) {
+    auto client = clients.find(clientId);
+    if (client == clients.end()) return;
+
+    // Without REDIRECT a RESP3 client gets the invalidations itself
+    uint64_t targetId = client->second->tracking.redirect ? client->second->tracking.redirect : clientId;
+    auto target = clientConnections().find(targetId);
+    if (target == clientConnections().end()) return;
+    RedisConnection* conn = target->second;
+
+    // A RESP3 target gets an "invalidate" push, a RESP2 one hears through
+    // its subscription to CHANNEL
+    std::string frame;
+    if (conn->protocol >= 3) {
+        frame = pushHeader(2, 3) + bulkReply("invalidate");
+    } else if (conn->channels.count(CHANNEL)) {
+        frame = pushHeader(3, 2) + bulkReply("message") + bulkReply(CHANNEL);
+    } else {
+        return;
+    }
+    if (!keys) {
+        frame += nullArrayReply(conn->protocol);
+    } else {
+        frame += "*" + std::to_string(keys->size()) + "\r\n";
+        for (const auto& key : *keys) frame += bulkReply(key);
+    }
+    conn->addReply(frame);
+}
+
+void Tracking::onConnectionClosed(RedisConnection* conn) {
+    if (conn->tracking.enabled) disable(conn);
+}
+
+bool Tracking::active() const {
+    return !clients.empty();
+}
+
+size_t Tracking::clientCount() const {
+    return clients.size();
+}
+
+size_t Tracking::keyCount() const {
+    return table.size();
+}
+
+size_t Tracking::itemCount() const {
+    return items;
+}
+
+size_t Tracking::prefixCount() const {
+    return prefixes.size();
+}
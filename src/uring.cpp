@@ -0,0 +1,351 @@
+#include "uring.h"
+
+#include <cerrno>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// Multishot recv is the newest piece the server needs (buffer rings are an
+// enum, not a macro, and came with multishot accept)
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define HAVE_IO_URING 1
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool UringCompletion::more() const {
+    return flags & IORING_CQE_F_MORE;
+}
+
+bool UringCompletion::hasBuffer() const {
+    return flags & IORING_CQE_F_BUFFER;
+}
+
+uint16_t UringCompletion::bufferId() const {
+    return static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+static constexpr uint16_t BUFFER_GROUP = 0;
+
+struct IoUring::Ring {
+    int fd = -1;
+
+    void* sqMap = nullptr;
+    size_t sqMapSize = 0;
+    void* cqMap = nullptr;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    // Entries handed out, published to the kernel on submit
+    unsigned sqeTail = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    io_uring_buf_ring* bufRing = nullptr;
+    size_t bufRingSize = 0;
+    unsigned bufMask = 0;
+    uint16_t bufTail = 0;
+    char* buffers = nullptr;
+    size_t buffersSize = 0;
+    size_t bufferSize = 0;
+};
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    return ret < 0 ? -errno : ret;
+}
+
+static int uringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    int ret = static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    return ret < 0 ? -errno : ret;
+}
+
+IoUring::~IoUring() {
+    if (!ring) return;
+    if (ring->fd >= 0) close(ring->fd);
+    if (ring->bufRing) munmap(ring->bufRing, ring->bufRingSize);
+    if (ring->buffers) munmap(ring->buffers, ring->buffersSize);
+    if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqMap && ring->cqMap != ring->sqMap) munmap(ring->cqMap, ring->cqMapSize);
+    if (ring->sqMap) munmap(ring->sqMap, ring->sqMapSize);
+    delete ring;
+}
+
+// Recv a byte through a multishot recv with a provided buffer: kernels that
+// know the opcodes but not the flags (before 6.0) fail here, not under load
+static bool probeMultishotRecv(IoUring& uring, std::string& error) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        error = "socketpair failed";
+        return false;
+    }
+
+    bool ok = false;
+    bool finished = false;
+    if (uring.prepRecvMultishot(pair[0], 1) && write(pair[1], "x", 1) == 1) {
+        // The recv stays armed until the peer goes away
+        for (int round = 0; round < 2 && !finished; round++) {
+            if (round == 1) shutdown(pair[1], SHUT_RDWR);
+            int ret = uring.submitAndWait(1000);
+            if (ret < 0 && ret != -ETIME && ret != -EINTR) break;
+            UringCompletion completions[8];
+            size_t n;
+            while ((n = uring.takeCompletions(completions, 8)) > 0) {
+                for (size_t i = 0; i < n; i++) {
+                    const UringCompletion& c = completions[i];
+                    if (c.res == 1 && c.hasBuffer()) ok = true;
+                    if (c.hasBuffer()) uring.recycleBuffer(c.bufferId());
+                    if (c.res < 0 && !ok) error = std::string("multishot recv: ") + std::strerror(-c.res);
+                    if (!c.more()) finished = true;
+                }
+            }
+        }
+    }
+    close(pair[0]);
+    close(pair[1]);
+    if (!ok && error.empty()) error = "multishot recv probe got no data";
+    return ok;
+}
+
+bool IoUring::init(unsigned entries, unsigned bufferCount, size_t bufferSize, std::string& error) {
+    ring = new Ring();
+
+    // Try the cheapest task running modes first, older kernels reject them
+    io_uring_params params{};
+    const unsigned modes[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN,
+        IORING_SETUP_CQSIZE,
+    };
+    for (unsigned flags : modes) {
+        std::memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        // Multishot operations post many completions per submission
+        params.cq_entries = entries * 8;
+        ring->fd = uringSetup(entries, &params);
+        if (ring->fd >= 0 || errno != EINVAL) break;
+    }
+    if (ring->fd < 0) {
+        error = std::string("io_uring_setup: ") + std::strerror(errno);
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        error = "kernel too old (no IORING_FEAT_EXT_ARG)";
+        return false;
+    }
+
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqMapSize = ring->cqMapSize = std::max(ring->sqMapSize, ring->cqMapSize);
+    ring->sqMap = mmap(nullptr, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED) {
+        ring->sqMap = nullptr;
+        error = "mmap of the rings failed";
+        return false;
+    }
+    ring->cqMap = ring->sqMap;
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        error = "mmap of the submission entries failed";
+        return false;
+    }
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(ring->sqMap);
+    ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->sqeTail = *ring->sqTail;
+    // Entries are always used in ring order, the index array is the identity
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) array[i] = i;
+
+    char* cq = static_cast<char*>(ring->cqMap);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Provided buffers: the kernel picks one per received chunk, so idle
+    // connections hold no read buffer at all
+    ring->bufRingSize = bufferCount * sizeof(io_uring_buf);
+    void* bufRing = mmap(nullptr, ring->bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buffersSize = bufferCount * bufferSize;
+    void* buffers = mmap(nullptr, ring->buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRing == MAP_FAILED || buffers == MAP_FAILED) {
+        if (bufRing != MAP_FAILED) munmap(bufRing, ring->bufRingSize);
+        if (buffers != MAP_FAILED) munmap(buffers, ring->buffersSize);
+        error = "allocating the receive buffers failed";
+        return false;
+    }
+    ring->bufRing = static_cast<io_uring_buf_ring*>(bufRing);
+    ring->buffers = static_cast<char*>(buffers);
+    ring->bufferSize = bufferSize;
+    ring->bufMask = bufferCount - 1;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring->bufRing);
+    reg.ring_entries = bufferCount;
+    reg.bgid = BUFFER_GROUP;
+    int ret = uringRegister(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (ret < 0) {
+        error = std::string("registering the buffer ring: ") + std::strerror(-ret);
+        return false;
+    }
+    for (unsigned i = 0; i < bufferCount; i++) recycleBuffer(static_cast<uint16_t>(i));
+
+    return probeMultishotRecv(*this, error);
+}
+
+void* IoUring::nextEntry() {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (ring->sqeTail - head >= ring->sqEntries) {
+        __atomic_store_n(ring->sqTail, ring->sqeTail, __ATOMIC_RELEASE);
+        uringEnter(ring->fd, ring->sqeTail - head, 0, 0, nullptr, 0);
+        head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (ring->sqeTail - head >= ring->sqEntries) return nullptr;
+    }
+    io_uring_sqe* sqe = &ring->sqes[ring->sqeTail & ring->sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ring->sqeTail++;
+    return sqe;
+}
+
+bool IoUring::prepAcceptMultishot(int fd, uint64_t userData) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::prepRecvMultishot(int fd, uint64_t userData) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::prepSendmsg(int fd, const msghdr* msg, uint64_t userData) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::prepPollOut(int fd, uint64_t userData) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = userData;
+    return true;
+}
+
+int IoUring::submitAndWait(int timeoutMs) {
+    __atomic_store_n(ring->sqTail, ring->sqeTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = ring->sqeTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    return uringEnter(ring->fd, toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+size_t IoUring::takeCompletions(UringCompletion* out, size_t max) {
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    for (; head != tail && n < max; head++, n++) {
+        const io_uring_cqe& cqe = ring->cqes[head & ring->cqMask];
+        out[n] = {cqe.user_data, cqe.res, cqe.flags};
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+const char* IoUring::buffer(uint16_t id) const {
+    return ring->buffers + static_cast<size_t>(id) * ring->bufferSize;
+}
+
+void IoUring::recycleBuffer(uint16_t id) {
+    // Entries start at the ring base. bufs is not used: the empty struct
+    // __DECLARE_FLEX_ARRAY wraps it in takes a byte in C++ and shifts it
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(ring->bufRing) + (ring->bufTail & ring->bufMask);
+    buf->addr = reinterpret_cast<uint64_t>(buffer(id));
+    buf->len = static_cast<uint32_t>(ring->bufferSize);
+    buf->bid = id;
+    ring->bufTail++;
+    __atomic_store_n(&ring->bufRing->tail, ring->bufTail, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool UringCompletion::more() const { return false; }
+bool UringCompletion::hasBuffer() const { return false; }
+uint16_t UringCompletion::bufferId() const { return 0; }
+
+struct IoUring::Ring {};
+
+IoUring::~IoUring() {
+    delete ring;
+}
+
+bool IoUring::init(unsigned, unsigned, size_t, std::string& error) {
+    error = "built without io_uring support";
+    return false;
+}
+
+bool IoUring::prepAcceptMultishot(int, uint64_t) { return false; }
+bool IoUring::prepRecvMultishot(int, uint64_t) { return false; }
+bool IoUring::prepSendmsg(int, const msghdr*, uint64_t) { return false; }
+bool IoUring::prepPollOut(int, uint64_t) { return false; }
+int IoUring::submitAndWait(int) { return -ENOSYS; }
+size_t IoUring::takeCompletions(UringCompletion*, size_t) { return 0; }
+const char* IoUring::buffer(uint16_t) const { return nullptr; }
+void IoUring::recycleBuffer(uint16_t) {}
+void* IoUring::nextEntry() { return nullptr; }
+
+#endif